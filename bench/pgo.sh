@@ -0,0 +1,29 @@
+#!/bin/sh
+# Profile-guided optimized build of the ports, see "Customized builds" in the README.
+#
+#     bench/pgo.sh [mix run arguments]
+#
+# 1. builds the instrumented ports (OPTIMIZED_BUILD=true OPEX62541_PGO=generate),
+# 2. trains them on bench/port_bench.exs, the profiles go to OPEX62541_PGO_DIR,
+# 3. rebuilds them with the profiles (OPEX62541_PGO=use).
+#
+# Keep the same OPTIMIZED_BUILD, OPEX62541_PGO_DIR and OPEN62541_* variables for the
+# following `mix compile`, otherwise the ports are rebuilt without the profiles.
+set -e
+
+export OPTIMIZED_BUILD=true
+export OPEX62541_PGO_DIR="${OPEX62541_PGO_DIR:-$PWD/_build/pgo}"
+export BENCH_TIME="${BENCH_TIME:-2}"
+
+rm -rf "$OPEX62541_PGO_DIR"
+mkdir -p "$OPEX62541_PGO_DIR"
+
+OPEX62541_PGO=generate mix compile --force
+OPEX62541_PGO=generate mix run bench/port_bench.exs "$@"
+
+# clang writes raw profiles that must be merged first
+if ls "$OPEX62541_PGO_DIR"/*.profraw >/dev/null 2>&1; then
+    llvm-profdata merge -output="$OPEX62541_PGO_DIR/default.profdata" "$OPEX62541_PGO_DIR"/*.profraw
+fi
+
+OPEX62541_PGO=use mix compile --force
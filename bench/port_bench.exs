@@ -0,0 +1,163 @@
+# Throughput and latency of the port hot paths with an in-process OpcUA.Server and OpcUA.Client.
+#
+#     mix run bench/port_bench.exs
+#
+# BENCH_TIME (seconds per scenario, default 5) and BENCH_NODES (address space sizes, default
+# "1000,10000,100000") tune the run. Results are printed in the Benchee style (ips, average,
+# median and 99th percentile), compare two runs on the same machine.
+
+defmodule PortBench do
+  alias OpcUA.{Client, NodeId, QualifiedName, Server}
+
+  @port 4060
+
+  def run() do
+    time = String.to_integer(System.get_env("BENCH_TIME", "5")) * 1000
+
+    sizes =
+      System.get_env("BENCH_NODES", "1000,10000,100000")
+      |> String.split(",", trim: true)
+      |> Enum.map(&String.to_integer/1)
+
+    {s_pid, c_pid, node_id} = setup()
+
+    header()
+    counter = :counters.new(1, [])
+
+    measure("server read_node_value", time, fn -> {:ok, _} = Server.read_node_value(s_pid, node_id) end)
+    measure("client read_node_value", time, fn -> {:ok, _} = Client.read_node_value(c_pid, node_id) end)
+
+    measure("client write_node_value", time, fn ->
+      :counters.add(counter, 1, 1)
+      :ok = Client.write_node_value(c_pid, node_id, 10, :counters.get(counter, 1) * 1.0)
+    end)
+
+    {:ok, subscription_id} = Client.add_subscription(c_pid, 10.0)
+
+    {:ok, _monitored_item_id} =
+      Client.add_monitored_item(c_pid,
+        monitored_item: node_id,
+        subscription_id: subscription_id,
+        sampling_time: 0.0
+      )
+
+    flush_notifications()
+
+    measure("notification latency", time, fn ->
+      :counters.add(counter, 1, 1)
+      :ok = Server.write_node_value(s_pid, node_id, 10, :counters.get(counter, 1) * 1.0)
+
+      receive do
+        {:data, ^subscription_id, _monitored_item_id, _value} -> :ok
+      after
+        1000 -> raise "no notification within 1s"
+      end
+    end)
+
+    Client.stop(c_pid)
+    Server.stop_server(s_pid)
+
+    for size <- sizes do
+      address_space = address_space(size)
+
+      measure("load_address_space #{size} nodes", time, fn ->
+        {:ok, pid} = Server.start_link()
+        :ok = Server.set_default_config(pid)
+        {:ok, %{failures: []}} = Server.load_address_space(pid, address_space)
+        Server.stop(pid)
+      end)
+    end
+  end
+
+  defp setup() do
+    {:ok, s_pid} = Server.start_link()
+    :ok = Server.set_default_config(s_pid)
+    :ok = Server.set_port(s_pid, @port)
+    {:ok, %{failures: []}} = Server.load_address_space(s_pid, address_space(1))
+    :ok = Server.start(s_pid)
+
+    {:ok, c_pid} = Client.start_link()
+    :ok = Client.set_config(c_pid)
+    :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:#{@port}/")
+
+    {s_pid, c_pid, NodeId.new(ns_index: 2, identifier_type: "integer", identifier: 1)}
+  end
+
+  # An object with `size` Double variables, ns=2;i=1..size.
+  defp address_space(size) do
+    object_node_id = NodeId.new(ns_index: 2, identifier_type: "string", identifier: "Bench")
+
+    object =
+      OpcUA.ObjectNode.new(
+        requested_new_node_id: object_node_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+        browse_name: QualifiedName.new(ns_index: 2, name: "Bench"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+      )
+
+    variables =
+      for identifier <- 1..size do
+        {:variable_node,
+         OpcUA.VariableNode.new(
+           [
+             requested_new_node_id: NodeId.new(ns_index: 2, identifier_type: "integer", identifier: identifier),
+             parent_node_id: object_node_id,
+             reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+             browse_name: QualifiedName.new(ns_index: 2, name: "Variable #{identifier}"),
+             type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+           ],
+           access_level: 3,
+           value: {10, 0.0}
+         )}
+      end
+
+    [namespace: "Bench", object_node: object] ++ variables
+  end
+
+  defp flush_notifications() do
+    receive do
+      {:data, _subscription_id, _monitored_item_id, _value} -> flush_notifications()
+    after
+      100 -> :ok
+    end
+  end
+
+  defp measure(name, time, fun) do
+    deadline = System.monotonic_time(:millisecond) + time
+    samples = sample(fun, deadline, [])
+    count = length(samples)
+    sorted = Enum.sort(samples)
+    average = Enum.sum(samples) / count
+
+    IO.puts(
+      String.pad_trailing(name, 36) <>
+        format(1_000_000 / average, "") <>
+        format(average, " us") <>
+        format(Enum.at(sorted, div(count, 2)), " us") <>
+        format(Enum.at(sorted, min(count - 1, div(count * 99, 100))), " us")
+    )
+  end
+
+  # Stops after the deadline, and always takes at least one sample.
+  defp sample(fun, deadline, samples) do
+    {elapsed, _result} = :timer.tc(fun)
+    samples = [elapsed | samples]
+
+    if System.monotonic_time(:millisecond) < deadline,
+      do: sample(fun, deadline, samples),
+      else: samples
+  end
+
+  defp header() do
+    IO.puts(
+      String.pad_trailing("Name", 36) <>
+        Enum.map_join(["ips", "average", "median", "99th %"], &String.pad_leading(&1, 14))
+    )
+  end
+
+  defp format(value, unit),
+    do: String.pad_leading(:erlang.float_to_binary(value / 1, decimals: 1) <> unit, 14)
+end
+
+PortBench.run()
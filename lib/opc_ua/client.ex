@@ -95,6 +95,17 @@ defmodule OpcUA.Client do
   """
   @callback handle_monitored_data({integer(), integer(), any()}, term()) :: term()
 
+  @doc """
+  Optional callback that handles a batch of node values updates, it is only used after
+  `set_notification_batch_size/2` enables batching.
+
+  It's first argument is a list of `{subscription_id, monitored_item_id, value}` tuples collected
+  during a single publish cycle, by default each one is passed to `handle_monitored_data/2`.
+
+  the second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_monitored_data_batch(list({integer(), integer(), any()}), term()) :: term()
+
   @doc """
   Optional callback that handles a deleted monitored items events.
 
@@ -124,6 +135,17 @@ defmodule OpcUA.Client do
   """
   @callback handle_deleted_subscription(integer(), term()) :: term()
 
+  @doc """
+  Optional callback that handles a restored connection, see `set_reconnect/2`.
+
+  It's first argument is a map with the connection `:attempts` it took and the number of
+  `:subscriptions` and `:monitored_items` recreated (they keep their ids), `:failed` ones
+  are also reported as deleted.
+
+  The second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_reconnected(map(), term()) :: term()
+
   defmacro __using__(opts) do
     quote location: :keep, bind_quoted: [opts: opts] do
       use GenServer, Keyword.drop(opts, [:configuration])
@@ -145,9 +167,11 @@ defmodule OpcUA.Client do
       @impl true
       def handle_info(:init, user_initial_params) do
         # Client Terraform
-        {:ok, c_pid} = OpcUA.Client.start_link()
-
         configuration = apply(__MODULE__, :configuration, [user_initial_params])
+
+        # configuration = [session_of: pid] shares the C port of another client.
+        {:ok, c_pid} = OpcUA.Client.start_link(Keyword.take(configuration, [:session_of]))
+
         monitored_items = apply(__MODULE__, :monitored_items, [user_initial_params])
 
         #OpcUA.Client.set_config(c_pid)
@@ -185,6 +209,11 @@ defmodule OpcUA.Client do
         {:noreply, state}
       end
 
+      def handle_info({:data_batch, changed_data_events}, state) do
+        state = apply(__MODULE__, :handle_monitored_data_batch, [changed_data_events, state])
+        {:noreply, state}
+      end
+
       def handle_info({:delete, subscription_id, monitored_id}, state) do
         state =
           apply(__MODULE__, :handle_deleted_monitored_item, [subscription_id, monitored_id, state])
@@ -192,6 +221,11 @@ defmodule OpcUA.Client do
         {:noreply, state}
       end
 
+      def handle_info({:reconnected, info}, state) do
+        state = apply(__MODULE__, :handle_reconnected, [info, state])
+        {:noreply, state}
+      end
+
       @impl true
       def handle_subscription_timeout(subscription_id, state) do
         require Logger
@@ -231,6 +265,13 @@ defmodule OpcUA.Client do
         state
       end
 
+      @impl true
+      def handle_monitored_data_batch(changed_data_events, state) do
+        Enum.reduce(changed_data_events, state, fn changed_data_event, state ->
+          apply(__MODULE__, :handle_monitored_data, [changed_data_event, state])
+        end)
+      end
+
       @impl true
       def handle_deleted_monitored_item(subscription_id, monitored_id, state) do
         require Logger
@@ -244,6 +285,15 @@ defmodule OpcUA.Client do
         state
       end
 
+      @impl true
+      def handle_reconnected(info, state) do
+        require Logger
+
+        Logger.warn("No handle_reconnected/2 clause in #{__MODULE__} provided for #{inspect(info)}")
+
+        state
+      end
+
       @impl true
       def configuration(_user_init_state), do: []
 
@@ -283,7 +333,9 @@ defmodule OpcUA.Client do
                      handle_subscription_timeout: 2,
                      handle_deleted_subscription: 2,
                      handle_monitored_data: 2,
-                     handle_deleted_monitored_item: 3
+                     handle_monitored_data_batch: 2,
+                     handle_deleted_monitored_item: 3,
+                     handle_reconnected: 2
     end
   end
 
@@ -291,6 +343,15 @@ defmodule OpcUA.Client do
 
   @doc """
     Starts up a OPC UA Client GenServer.
+
+    The following options can be used in `args`:
+    * `:packet` -> 2 or 4. Size of the port message length prefix. The default `2`
+      limits every request and response to 64 KiB; use `4` for large arrays or
+      batched operations.
+    * `:session_of` -> GenServer.server(). Runs this client as another session in the OS process
+      of an already started client instead of spawning its own C port, many clients can share a
+      single process this way. The session is closed when this client stops and it stops
+      whenever that client does.
   """
   @spec start_link(term(), list()) :: {:ok, pid} | {:error, term} | {:error, :einval}
   def start_link(args \\ [], opts \\ []) do
@@ -408,6 +469,25 @@ defmodule OpcUA.Client do
     GenServer.call(pid, {:conn, {:disconnect, nil}})
   end
 
+  @doc """
+    Reconnects the OPC UA Client (to the url and user of its last connect) when it loses the connection.
+    Its node handles (see `register_nodes/2`) are registered again with the new session, its
+    subscriptions and monitored items are recreated with the same ids, then `{:reconnected, info}`
+    is sent to the controlling process (see `handle_reconnected/2`).
+    The first attempt waits `:min_interval`, the interval doubles after each failed attempt up to
+    `:max_interval` and is shortened at random by up to `:jitter` of it. The port is busy during an
+    attempt, so each one may take at most 500 ms (or the config "timeout" when it is shorter).
+    The following are optional:
+    * `:min_interval` -> non_neg_integer() (ms, defaults to 500).
+    * `:max_interval` -> non_neg_integer() (ms, defaults to 30_000).
+    * `:jitter` -> float() (0.0 to 1.0, defaults to 0.5).
+    * `:enabled` -> boolean() (defaults to true, false deletes the subscriptions when the connection is lost).
+  """
+  @spec set_reconnect(GenServer.server(), list()) :: :ok | {:error, term} | {:error, :einval}
+  def set_reconnect(pid, args \\ []) when is_list(args) do
+    GenServer.call(pid, {:conn, {:reconnect, args}})
+  end
+
   # Discovery functions
 
   @doc """
@@ -461,11 +541,32 @@ defmodule OpcUA.Client do
     GenServer.call(pid, {:subscription, {:delete, subscription_id}})
   end
 
+  @doc """
+    Enables batched data change notifications.
+
+    Every notification received in one pass of the Client loop is sent to the controlling
+    process as a single `{:data_batch, [{subscription_id, monitored_item_id, value}, ...]}`
+    message instead of one `{:data, ...}` message each, a batch is split after `max_size` items.
+    `0` (default) disables batching.
+  """
+  @spec set_notification_batch_size(GenServer.server(), non_neg_integer()) ::
+          :ok | {:error, term} | {:error, :einval}
+  def set_notification_batch_size(pid, max_size) when is_integer(max_size) and max_size >= 0 do
+    GenServer.call(pid, {:subscription, {:batch_size, max_size}})
+  end
+
   @doc """
     Adds a monitored item used to request a server for notifications of each change of value in a specific node.
     The following option must be filled:
     * `:subscription_id` -> integer().
     * `:monitored_item` -> %NodeId{}.
+    The following are optional (the filtering happens in the server):
+    * `:sampling_time` -> double() (default: 250.0).
+    * `:deadband` -> `{:absolute, float()}` or `{:percent, float()}` (percent of the node EURange).
+    * `:trigger` -> `:status`, `:status_value` (default) or `:status_value_timestamp`.
+    * `:queue_size` -> integer().
+    * `:discard_oldest` -> boolean().
+    * `:cache` -> boolean(). Keeps the latest value of the node in the Client for `read_cached_value/3`.
   """
   @spec add_monitored_item(GenServer.server(), list()) ::
           {:ok, integer()} | {:error, term} | {:error, :einval}
@@ -485,6 +586,64 @@ defmodule OpcUA.Client do
     GenServer.call(pid, {:subscription, {:delete_monitored_item, args}})
   end
 
+  @doc """
+    Reads the 'value' attribute of a node monitored with the `cache: true` option, without a request to the server
+    when its latest notification arrived less than `max_age` ms ago (`:infinity` for any age). Otherwise (or when the
+    node isn't cached, or its subscription timed out) the value is read from the server.
+    Servers only notify changes, so the age of a value that doesn't change grows even if it is current.
+
+    The response is `{:ok, %{value: term(), source_timestamp: integer() | nil, server_timestamp: integer() | nil,
+    cached: boolean()}}`, the timestamps are OPC UA DateTimes.
+  """
+  @spec read_cached_value(GenServer.server(), %NodeId{}, non_neg_integer() | :infinity) ::
+          {:ok, map()} | {:error, binary()} | {:error, :einval}
+  def read_cached_value(pid, %NodeId{} = node_id, max_age \\ :infinity)
+      when max_age == :infinity or (is_integer(max_age) and max_age >= 0) do
+    GenServer.call(pid, {:read, {:cached_value, node_id, max_age}})
+  end
+
+  @doc """
+    Reads the raw history of a node from the server (HistoryRead), the continuation points are followed until
+    every value has been read.
+    The following are optional:
+      * `:start_time` -> integer(). OPC UA DateTime of the oldest value, `0` (default) for no bound.
+      * `:end_time` -> integer(). OPC UA DateTime of the newest value, `0` (default) for no bound.
+      * `:max_values` -> non_neg_integer(). At most `max_values` values, `0` (default) for every value.
+
+    The response is `{:ok, [%{value: term(), source_timestamp: integer() | nil, server_timestamp: integer() | nil,
+    status: nil | binary()}]}` in chronological order. Requires open62541 built with `UA_ENABLE_HISTORIZING`.
+  """
+  @spec history_read_raw(GenServer.server(), %NodeId{}, list()) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def history_read_raw(pid, %NodeId{} = node_id, opts \\ []) when is_list(opts) do
+    GenServer.call(pid, {:history, {:read_raw, node_id, opts}})
+  end
+
+  # Asynchronous (pipelined) service calls
+
+  @doc """
+    Same as `read_node_values/2`, but the Read request is sent without waiting for the previous ones to be answered,
+    so concurrent callers share the round trip latency instead of queuing behind each other.
+    Responses are delivered to its caller as soon as they arrive, which may not be in request order.
+  """
+  @spec read_node_values_async(GenServer.server(), list()) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def read_node_values_async(pid, nodes) when is_list(nodes) do
+    GenServer.call(pid, {:async, {:read_values, nodes}})
+  end
+
+  @doc """
+    Same as `write_node_values/2`, but pipelined as `read_node_values_async/2`.
+    `values` is a list of `{node_id, data_type, value}` tuples (array elements can't be written by index).
+  """
+  @spec write_node_values_async(GenServer.server(), list()) ::
+          {:ok, list()} | {:error, binary()} | {:error, :einval}
+  def write_node_values_async(pid, values) when is_list(values) do
+    if Enum.all?(values, &match?({_node_id, data_type, _value} when is_integer(data_type), &1)),
+      do: GenServer.call(pid, {:async, {:write_values, values}}),
+      else: {:error, :einval}
+  end
+
   # Read nodes Attributes
 
   @doc """
@@ -600,7 +759,32 @@ defmodule OpcUA.Client do
   end
 
   # Handlers
-  def init({_args, controlling_process}) do
+  def init({args, controlling_process}) do
+    case Keyword.fetch(args, :session_of) do
+      {:ok, owner} -> init_session(owner, controlling_process)
+      :error -> init_port(args, controlling_process)
+    end
+  end
+
+  defp init_session(owner, controlling_process) do
+    case GenServer.call(owner, {:session, :new}) do
+      {:ok, {owner_pid, handle, opcodes}} ->
+        Process.monitor(owner_pid)
+
+        state = %State{
+          controlling_process: controlling_process,
+          opcodes: opcodes,
+          session: {owner_pid, handle}
+        }
+
+        {:ok, state}
+
+      error ->
+        {:stop, error}
+    end
+  end
+
+  defp init_port(args, controlling_process) do
     lib_dir =
       :opex62541
       |> :code.priv_dir()
@@ -609,9 +793,12 @@ defmodule OpcUA.Client do
 
     executable = lib_dir <> "/opc_ua_client"
 
-    port = open_port(executable, use_valgrind?())
+    packet = Keyword.get(args, :packet, 2)
+
+    port = open_port(executable, use_valgrind?(), packet)
 
-    state = %State{port: port, controlling_process: controlling_process}
+    state = %State{port: port, controlling_process: controlling_process, packet: packet}
+    request_opcodes(state)
     {:ok, state}
   end
 
@@ -695,6 +882,24 @@ defmodule OpcUA.Client do
     {:noreply, state}
   end
 
+  def handle_call({:conn, {:reconnect, args}}, caller_info, state) do
+    # A min_interval of 0 disables it in the port.
+    min_interval =
+      if Keyword.get(args, :enabled, true), do: Keyword.get(args, :min_interval, 500), else: 0
+    max_interval = Keyword.get(args, :max_interval, 30_000)
+    jitter = Keyword.get(args, :jitter, 0.5)
+
+    with true <- is_integer(min_interval) and min_interval >= 0,
+         true <- is_integer(max_interval) and max_interval >= min_interval,
+         true <- is_number(jitter) and jitter >= 0 and jitter <= 1 do
+      call_port(state, :set_reconnect, caller_info, {min_interval, max_interval, jitter / 1})
+      {:noreply, state}
+    else
+      _ ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
   # Discovery Handlers.
 
   def handle_call({:discovery, {:find_servers_on_network, url}}, caller_info, state) do
@@ -724,13 +929,19 @@ defmodule OpcUA.Client do
     {:noreply, state}
   end
 
+  def handle_call({:subscription, {:batch_size, max_size}}, caller_info, state) do
+    call_port(state, :set_notification_batch_size, caller_info, max_size)
+    {:noreply, state}
+  end
+
   def handle_call({:subscription, {:monitored_item, args}}, caller_info, state) do
     with monitored_item <- Keyword.fetch!(args, :monitored_item) |> to_c(),
          subscription_id <- Keyword.fetch!(args, :subscription_id),
          sampling_time <- Keyword.get(args, :sampling_time, 250.0),
          true <- is_integer(subscription_id),
-         true <- is_float(sampling_time) do
-      c_args = {monitored_item, subscription_id, sampling_time}
+         true <- is_float(sampling_time),
+         {:ok, options} <- monitoring_options(args) do
+      c_args = {monitored_item, subscription_id, sampling_time, options}
       call_port(state, :add_monitored_item, caller_info, c_args)
       {:noreply, state}
     else
@@ -753,6 +964,68 @@ defmodule OpcUA.Client do
     end
   end
 
+  @deadband_types %{absolute: 1, percent: 2}
+  @triggers %{status: 0, status_value: 1, status_value_timestamp: 2}
+
+  defp monitoring_options(args) do
+    Enum.reduce_while(args, {:ok, %{}}, fn
+      {:deadband, {type, value}}, {:ok, options} when type in [:absolute, :percent] and is_float(value) ->
+        options = Map.merge(options, %{"deadband_type" => @deadband_types[type], "deadband_value" => value})
+        {:cont, {:ok, options}}
+
+      {:trigger, trigger}, {:ok, options} when trigger in [:status, :status_value, :status_value_timestamp] ->
+        {:cont, {:ok, Map.put(options, "trigger", @triggers[trigger])}}
+
+      {:queue_size, queue_size}, {:ok, options} when is_integer(queue_size) and queue_size >= 0 ->
+        {:cont, {:ok, Map.put(options, "queue_size", queue_size)}}
+
+      {:discard_oldest, discard_oldest}, {:ok, options} when is_boolean(discard_oldest) ->
+        {:cont, {:ok, Map.put(options, "discard_oldest", discard_oldest)}}
+
+      {:cache, cache}, {:ok, options} when is_boolean(cache) ->
+        {:cont, {:ok, Map.put(options, "cache", cache)}}
+
+      {key, _value}, acc when key in [:monitored_item, :subscription_id, :sampling_time] ->
+        {:cont, acc}
+
+      _invalid_option, _acc ->
+        {:halt, :error}
+    end)
+  end
+
+  def handle_call({:read, {:cached_value, node_id, max_age}}, caller_info, state) do
+    c_args = {to_c(node_id), if(max_age == :infinity, do: nil, else: max_age)}
+    call_port(state, :read_cached_value, caller_info, c_args)
+    {:noreply, state}
+  end
+
+  def handle_call({:history, {:read_raw, node_id, opts}}, caller_info, state) do
+    start_time = Keyword.get(opts, :start_time, 0)
+    end_time = Keyword.get(opts, :end_time, 0)
+    max_values = Keyword.get(opts, :max_values, 0)
+
+    if is_integer(start_time) and is_integer(end_time) and is_integer(max_values) and max_values >= 0 do
+      call_port(state, :history_read_raw, caller_info, {to_c(node_id), start_time, end_time, max_values})
+      {:noreply, state}
+    else
+      {:reply, {:error, :einval}, state}
+    end
+  end
+
+  # Asynchronous (pipelined) service calls
+
+  def handle_call({:async, {:read_values, nodes}}, caller_info, state) do
+    c_args = Enum.map(nodes, fn {node_id, attribute} -> {to_c(node_id), attribute_id(attribute)} end)
+    call_port(state, :read_node_values_async, caller_info, c_args)
+    {:noreply, state}
+  end
+
+  def handle_call({:async, {:write_values, values}}, caller_info, state) do
+    c_args = Enum.map(values, &write_value_to_c/1)
+    call_port(state, :write_node_values_async, caller_info, c_args)
+    {:noreply, state}
+  end
+
   # Write nodes Attributes
 
   def handle_call({:read, {:user_write_mask, node_id}}, caller_info, state) do
@@ -817,6 +1090,13 @@ defmodule OpcUA.Client do
     {:noreply, state}
   end
 
+  # Client Sessions
+
+  def handle_call({:session, :new}, caller_info, %State{session: nil} = state) do
+    call_port(state, :new_client_session, caller_info, nil)
+    {:noreply, state}
+  end
+
   # Catch all
 
   def handle_call(invalid_call, _caller_info, state) do
@@ -838,6 +1118,33 @@ defmodule OpcUA.Client do
     {:stop, :restart, state}
   end
 
+  # Client Sessions
+
+  def handle_info({:session_command, command}, state) do
+    send(state.port, {self(), {:command, command}})
+    {:noreply, state}
+  end
+
+  def handle_info({:session_response, c_response}, state) do
+    state = handle_c_response(c_response, state)
+    {:noreply, state}
+  end
+
+  def handle_info({:DOWN, _ref, :process, owner, reason}, %State{session: {owner, _handle}} = state) do
+    {:stop, reason, state}
+  end
+
+  def handle_info({:DOWN, _ref, :process, pid, _reason}, state) do
+    case Enum.find(state.sessions, fn {_handle, session_pid} -> session_pid == pid end) do
+      {handle, _session_pid} ->
+        call_port(state, :delete_client_session, nil, handle)
+        {:noreply, %{state | sessions: Map.delete(state.sessions, handle)}}
+
+      nil ->
+        {:noreply, state}
+    end
+  end
+
   def handle_info(msg, state) do
     Logger.warn("(#{__MODULE__}) Unhandled message: #{inspect(msg)}.")
     {:noreply, state}
@@ -854,6 +1161,19 @@ defmodule OpcUA.Client do
     state
   end
 
+  defp handle_c_response(
+         {:subscription, {:data_batch, c_items}},
+         %{controlling_process: c_pid} = state
+       ) do
+    items =
+      Enum.map(c_items, fn {subscription_id, monitored_id, c_value} ->
+        {subscription_id, monitored_id, parse_c_value(c_value)}
+      end)
+
+    send(c_pid, {:data_batch, items})
+    state
+  end
+
   defp handle_c_response(
          {:subscription, message},
          %{controlling_process: c_pid} = state
@@ -862,6 +1182,33 @@ defmodule OpcUA.Client do
     state
   end
 
+  defp handle_c_response({:reconnected, info}, %{controlling_process: c_pid} = state) do
+    send(c_pid, {:reconnected, info})
+    state
+  end
+
+  # Client Sessions C handlers
+
+  defp handle_c_response({:session, handle, c_response}, state) do
+    with {:ok, session_pid} <- Map.fetch(state.sessions, handle),
+         do: send(session_pid, {:session_response, c_response})
+
+    state
+  end
+
+  defp handle_c_response({:new_client_session, {session_pid, _tag} = caller_metadata, {:ok, handle}}, state) do
+    Process.monitor(session_pid)
+    GenServer.reply(caller_metadata, {:ok, {self(), handle, state.opcodes}})
+    %{state | sessions: Map.put(state.sessions, handle, session_pid)}
+  end
+
+  defp handle_c_response({:new_client_session, caller_metadata, error}, state) do
+    GenServer.reply(caller_metadata, error)
+    state
+  end
+
+  defp handle_c_response({:delete_client_session, nil, _c_response}, state), do: state
+
   # Lifecycle C Handlers
 
   defp handle_c_response({:get_client_state, caller_metadata, client_state}, state) do
@@ -914,6 +1261,11 @@ defmodule OpcUA.Client do
     state
   end
 
+  defp handle_c_response({:set_reconnect, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
   # Discovery functions C Handlers
 
   defp handle_c_response({:find_servers_on_network, caller_metadata, c_response}, state) do
@@ -943,6 +1295,11 @@ defmodule OpcUA.Client do
     state
   end
 
+  defp handle_c_response({:set_notification_batch_size, caller_metadata, c_response}, state) do
+    GenServer.reply(caller_metadata, c_response)
+    state
+  end
+
   defp handle_c_response({:add_monitored_item, caller_metadata, c_response}, state) do
     GenServer.reply(caller_metadata, c_response)
     state
@@ -953,6 +1310,59 @@ defmodule OpcUA.Client do
     state
   end
 
+  defp handle_c_response(
+         {:read_cached_value, caller_metadata, {:ok, {c_value, source_timestamp, server_timestamp, cached?}}},
+         state
+       ) do
+    value = %{
+      value: parse_c_value(c_value),
+      source_timestamp: source_timestamp,
+      server_timestamp: server_timestamp,
+      cached: cached?
+    }
+
+    GenServer.reply(caller_metadata, {:ok, value})
+    state
+  end
+
+  defp handle_c_response({:read_cached_value, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:history_read_raw, caller_metadata, {:ok, c_values}}, state) do
+    values =
+      Enum.map(c_values, fn {c_value, source_timestamp, server_timestamp, status} ->
+        %{
+          value: parse_c_value(c_value),
+          source_timestamp: source_timestamp,
+          server_timestamp: server_timestamp,
+          status: status
+        }
+      end)
+
+    GenServer.reply(caller_metadata, {:ok, values})
+    state
+  end
+
+  defp handle_c_response({:history_read_raw, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  # Asynchronous (pipelined) service calls
+
+  defp handle_c_response({:read_node_values_async, caller_metadata, values_response}, state) do
+    response = parse_values(values_response)
+    GenServer.reply(caller_metadata, response)
+    state
+  end
+
+  defp handle_c_response({:write_node_values_async, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
   # Read nodes Attributes
 
   defp handle_c_response({:read_node_user_write_mask, caller_metadata, data}, state) do
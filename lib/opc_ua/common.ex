@@ -16,14 +16,54 @@ defmodule OpcUA.Common do
 
       @mix_env Mix.env()
 
+      # OPC UA attribute ids (Part 6, A.1)
+      @attribute_ids %{
+        node_id: 1,
+        node_class: 2,
+        browse_name: 3,
+        display_name: 4,
+        description: 5,
+        write_mask: 6,
+        user_write_mask: 7,
+        is_abstract: 8,
+        symmetric: 9,
+        inverse_name: 10,
+        contains_no_loops: 11,
+        event_notifier: 12,
+        value: 13,
+        data_type: 14,
+        value_rank: 15,
+        array_dimensions: 16,
+        access_level: 17,
+        user_access_level: 18,
+        minimum_sampling_interval: 19,
+        historizing: 20,
+        executable: 21,
+        user_executable: 22
+      }
+
       defmodule State do
         @moduledoc false
 
         # port: C port process
         # controlling_process: parent process
+        # opcodes: command atom -> C handler index, filled by the :list_commands handshake
+        # packet: size of the port message length prefix
+        # address_space_loads: caller -> summary of a load_address_space waiting for its last chunk
+        # session: {owner, handle} when the C client lives in the port of another client (session_of:)
+        # sessions: session handle -> process of the client sessions multiplexed in this port
+        # shm_ring: OpcUA.ShmRing of the port, see enable_shm_ring/3
+        # browse_trees: caller -> {attributes, chunks received so far (last first)} of a browse_tree
 
         defstruct port: nil,
-                  controlling_process: nil
+                  controlling_process: nil,
+                  opcodes: %{},
+                  packet: 2,
+                  address_space_loads: %{},
+                  session: nil,
+                  sessions: %{},
+                  shm_ring: nil,
+                  browse_trees: %{}
       end
 
       # Write nodes Attributes functions
@@ -183,6 +223,35 @@ defmodule OpcUA.Common do
         GenServer.call(pid, {:write, {:value, node_id, {data_type, value, index}}})
       end
 
+      @doc """
+      Change 'Value' attribute of several nodes in a single round trip.
+      `values` is a list of `{node_id, data_type, value}` or `{node_id, data_type, value, index}` tuples,
+      only the entries with an `index` read the current array before writing its element.
+      The response keeps the request order with an `:ok` or `{:error, status}` per entry.
+      """
+      @spec write_node_values(GenServer.server(), list()) ::
+              {:ok, list()} | {:error, binary()} | {:error, :einval}
+      def write_node_values(pid, values) when is_list(values) do
+        if(@mix_env != :test) do
+          GenServer.call(pid, {:write, {:values, values}})
+        else
+          # Valgrind
+          GenServer.call(pid, {:write, {:values, values}}, :infinity)
+        end
+      end
+
+      @doc """
+      Change a slice of the 'Value' array attribute of a node, the rest of the array is kept (see
+      `read_node_value_range/4` for `index_range`). `array` is a list or a packed binary (as in `write_node_array/5`)
+      with as many elements as the range.
+      """
+      @spec write_node_value_range(GenServer.server(), %NodeId{}, binary(), integer(), list() | binary()) ::
+              :ok | {:error, binary()} | {:error, :einval}
+      def write_node_value_range(pid, %NodeId{} = node_id, index_range, data_type, array)
+          when is_binary(index_range) and is_integer(data_type) and (is_list(array) or is_binary(array)) do
+        GenServer.call(pid, {:write, {:value_range, node_id, {index_range, data_type, array}}})
+      end
+
       @doc """
       Creates a blank 'value array' attribute of a node in the server.
       Note: the array must match with 'value_rank' and 'array_dimensions' attribute.
@@ -194,6 +263,26 @@ defmodule OpcUA.Common do
         GenServer.call(pid, {:write, {:array, node_id, {data_type, array_dimensions}}})
       end
 
+      @doc """
+      Change the whole 'Value' array attribute of a node with a single write (the current value is not read).
+      `array` is a list of values of the `data_type` or, for numeric types, a binary of the packed elements in
+      the host byte order (as in `%OpcUA.PackedArray{}`, which can also be passed instead of the data type).
+      `array_dimensions` is optional; when given, it must match the number of elements.
+      """
+      @spec write_node_array(GenServer.server(), %NodeId{}, integer() | %OpcUA.PackedArray{}, list() | binary(), list()) ::
+              :ok | {:error, binary()} | {:error, :einval}
+      def write_node_array(pid, node_id, data_type_or_packed_array, array \\ [], array_dimensions \\ [])
+
+      def write_node_array(pid, %NodeId{} = node_id, %OpcUA.PackedArray{} = packed_array, [], []) do
+        array_dimensions = Tuple.to_list(packed_array.dimensions)
+        write_node_array(pid, node_id, packed_array.data_type, packed_array.data, array_dimensions)
+      end
+
+      def write_node_array(pid, %NodeId{} = node_id, data_type, array, array_dimensions)
+          when is_integer(data_type) and (is_list(array) or is_binary(array)) and is_list(array_dimensions) do
+        GenServer.call(pid, {:write, {:whole_array, node_id, {data_type, array, array_dimensions}}})
+      end
+
       # Read nodes Attributes function
 
       @doc """
@@ -389,6 +478,29 @@ defmodule OpcUA.Common do
         end
       end
 
+      @doc """
+      Reads 'value' attribute of a node in the server.
+      Numeric arrays (SByte ... Double and DateTime) are returned as an `%OpcUA.PackedArray{}`, a single
+      binary of the array memory, instead of a list. Any other value is returned as in `read_node_value/3`.
+      """
+      @spec read_node_value_packed(GenServer.server(), %NodeId{}) ::
+              {:ok, %OpcUA.PackedArray{} | term()} | {:error, binary()} | {:error, :einval}
+      def read_node_value_packed(pid, node_id) do
+        GenServer.call(pid, {:read, {:value_packed, node_id}})
+      end
+
+      @doc """
+      Reads a slice of the 'value' array attribute of a node, only the slice is transferred.
+      `index_range` is an OPC UA NumericRange, e.g. `"100:199"`, `"7"` or `"0:3,2"` for multi-dimensional arrays.
+      The following are optional:
+        * `:packed` -> boolean(). Numeric slices are returned as an `%OpcUA.PackedArray{}` (default: false).
+      """
+      @spec read_node_value_range(GenServer.server(), %NodeId{}, binary(), list()) ::
+              {:ok, list() | %OpcUA.PackedArray{}} | {:error, binary()} | {:error, :einval}
+      def read_node_value_range(pid, %NodeId{} = node_id, index_range, opts \\ []) when is_binary(index_range) do
+        GenServer.call(pid, {:read, {:value_range, {node_id, index_range, Keyword.get(opts, :packed, false)}}})
+      end
+
       @doc """
       Reads 'Value' attribute (matching data type) of a node in the server.
       """
@@ -398,6 +510,156 @@ defmodule OpcUA.Common do
         GenServer.call(pid, {:read, {:value_by_data_type, {node_id, data_type}}})
       end
 
+      @doc """
+      Reads several attributes in a single round trip.
+      `nodes` is a list of `{node_id, attribute}` tuples, where `attribute` is an attribute
+      name (`:value`, `:browse_name`, `:data_type`, ...) or its OPC UA attribute id.
+      The response keeps the request order with an `{:ok, value}` or `{:error, status}` per entry.
+      """
+      @spec read_node_values(GenServer.server(), list()) ::
+              {:ok, list()} | {:error, binary()} | {:error, :einval}
+      def read_node_values(pid, nodes) when is_list(nodes) do
+        if(@mix_env != :test) do
+          GenServer.call(pid, {:read, {:values, nodes}})
+        else
+          # Valgrind
+          GenServer.call(pid, {:read, {:values, nodes}}, :infinity)
+        end
+      end
+
+      # Registered nodes functions
+
+      @doc """
+      Registers nodes that are used often (hot tags).
+
+      Returns the same NodeIds with a `handle`: requests then send that small integer instead of the
+      whole identifier and the port uses the node id it resolved at registration. A Client also calls
+      the RegisterNodes service, so the server can hand back optimized aliases. Any function that takes
+      a `%NodeId{}` accepts a registered one, requests with a released handle return `{:error, :einval}`.
+      """
+      @spec register_nodes(GenServer.server(), list(%NodeId{})) ::
+              {:ok, list(%NodeId{})} | {:error, binary()} | {:error, :einval}
+      def register_nodes(pid, node_ids) when is_list(node_ids) do
+        with {:ok, handles} <- GenServer.call(pid, {:register_nodes, node_ids}) do
+          registered =
+            node_ids
+            |> Enum.zip(handles)
+            |> Enum.map(fn {node_id, handle} -> %{node_id | handle: handle} end)
+
+          {:ok, registered}
+        end
+      end
+
+      @doc """
+      Releases the handles of registered NodeIds (returned by `register_nodes/2`), the returned
+      NodeIds no longer have a handle. A Client also calls the UnregisterNodes service.
+      """
+      @spec unregister_nodes(GenServer.server(), list(%NodeId{})) ::
+              {:ok, list(%NodeId{})} | {:error, binary()} | {:error, :einval}
+      def unregister_nodes(pid, node_ids) when is_list(node_ids) do
+        with :ok <- GenServer.call(pid, {:unregister_nodes, node_ids}),
+             do: {:ok, Enum.map(node_ids, &%{&1 | handle: nil})}
+      end
+
+      # Browse functions
+
+      @doc """
+      Browses the subtree of `root` breadth-first in the C port and returns every node found, once,
+      parents first. The following are optional:
+        * `:max_depth` -> non_neg_integer(). Levels below `root` to browse, `0` (default) for all.
+        * `:reference_type` -> %NodeId{}. References to follow (and their subtypes), default
+          `HierarchicalReferences` (ns=0;i=33).
+        * `:node_class_mask` -> non_neg_integer(). Only follows nodes of these classes (OPC UA NodeClass
+          bits), `0` (default) for all.
+        * `:attributes` -> list(). Attributes (names or ids, see `read_node_values/2`) read for every node,
+          default `[]`.
+        * `:timeout` -> timeout(). Default `60_000` ms.
+
+      Every node is a map with `:node_id`, `:parent_node_id`, `:reference_type_id`, `:browse_name`,
+      `:display_name` (`{locale, text}`), `:node_class`, `:type_definition`, `:depth` and `:attributes`
+      (attribute => `{:ok, value}` or `{:error, status}`).
+      """
+      @spec browse_tree(GenServer.server(), %NodeId{}, list()) ::
+              {:ok, list()} | {:error, binary()} | {:error, :einval}
+      def browse_tree(pid, %NodeId{} = root, opts \\ []) when is_list(opts) do
+        {timeout, opts} = Keyword.pop(opts, :timeout, 60_000)
+        GenServer.call(pid, {:browse_tree, root, opts}, timeout)
+      end
+
+      # Port statistics functions
+
+      @doc """
+      Returns the instrumentation counters of the C port:
+
+        * `:handlers` - per command `%{calls, total_time, max_time, histogram}`, times in microseconds.
+          `histogram` has 24 buckets, bucket `i` counts the calls that took less than `2^i` us
+          (the last one also counts the slower ones). Only commands that were called are listed.
+        * `:port` - messages and bytes read/written by the port, the largest message of each
+          direction, the microseconds spent writing to Elixir, the notifications/write events sent,
+          the ones dropped by `set_notification_queue/2` and the bytes waiting to be written.
+        * `:gauges` - current depth of the notification and write event batches, of the
+          notification queue plus the
+          program specific ones (sessions and pending asynchronous requests in a Client,
+          the command queue in a Server).
+      """
+      @spec get_stats(GenServer.server()) :: {:ok, map()} | {:error, term}
+      def get_stats(pid) do
+        GenServer.call(pid, {:stats, :get})
+      end
+
+      @doc """
+      Returns the optional open62541 features the port was built with (see `OPEN62541_PROFILE`):
+      `:multithreading` and `:historizing`.
+      """
+      @spec get_build_features(GenServer.server()) :: {:ok, list(atom())} | {:error, term}
+      def get_build_features(pid) do
+        GenServer.call(pid, {:stats, :build_features})
+      end
+
+      @doc """
+      Pushes the `get_stats/1` counters every `interval` ms (`0` disables it, default).
+      Every push is emitted as a `[:opex62541, :port, :stats]` `:telemetry` event, measured with the
+      `:port` counters and the gauges, the `:handlers` counters go in the metadata.
+      The event is only emitted when the `:telemetry` application is available.
+      """
+      @spec set_stats_interval(GenServer.server(), non_neg_integer()) :: :ok | {:error, :einval}
+      def set_stats_interval(pid, interval) when is_integer(interval) and interval >= 0 do
+        GenServer.call(pid, {:stats, {:interval, interval}})
+      end
+
+      @doc """
+      Keeps the port running when this process falls behind: the port stops blocking on a full pipe and
+      lets up to `high_water_mark` bytes of output wait for this process. Above it, data change
+      notifications and write events are compacted to the latest value of each monitored item (or
+      written node) until the output drains, the replaced ones are counted as `:notifications_dropped`
+      in `get_stats/1`. Responses are never dropped. `0` (default) goes back to blocking writes.
+
+      Not available in Windows nor for Clients started with `session_of:`, they share the port of the
+      owner.
+      """
+      @spec set_notification_queue(GenServer.server(), non_neg_integer()) ::
+              :ok | {:error, binary()} | {:error, :einval}
+      def set_notification_queue(pid, high_water_mark)
+          when is_integer(high_water_mark) and high_water_mark >= 0 do
+        GenServer.call(pid, {:notification_queue, high_water_mark})
+      end
+
+      @doc """
+      Moves the port responses of at least `:threshold` bytes (default 4096) to a shared memory ring
+      of `size` bytes (64 KiB to 1 GiB), only a one byte doorbell goes through the port pipe, which
+      saves a copy of large reads, arrays and notification batches and lifts the port packet size limit.
+      A `size` of `0` goes back to the pipe.
+
+      Requires the `opex62541_shm_ring` NIF (not available in Windows) and isn't available for Clients
+      started with `session_of:`, they share the transport of the port owner.
+      """
+      @spec enable_shm_ring(GenServer.server(), non_neg_integer(), list()) ::
+              :ok | {:error, binary()} | {:error, :einval} | {:error, :nif_not_loaded}
+      def enable_shm_ring(pid, size, opts \\ []) when is_integer(size) and size >= 0 do
+        threshold = Keyword.get(opts, :threshold, 4096)
+        GenServer.call(pid, {:shm_ring, {size, threshold}})
+      end
+
       # Write nodes Attributes handlers
       def handle_call({:write, {:browse_name, node_id, browse_name}}, caller_info, state) do
         c_args = {to_c(node_id), to_c(browse_name)}
@@ -524,6 +786,12 @@ defmodule OpcUA.Common do
         {:noreply, state}
       end
 
+      def handle_call({:write, {:values, values}}, caller_info, state) do
+        c_args = Enum.map(values, &write_value_to_c/1)
+        call_port(state, :write_node_values, caller_info, c_args)
+        {:noreply, state}
+      end
+
       def handle_call({:write, {:array, node_id, {data_type, array_dimensions}}}, caller_info, state)
           when is_integer(data_type) and is_list(array_dimensions) do
         with  true <- all_must_be(:integer, array_dimensions),
@@ -538,6 +806,24 @@ defmodule OpcUA.Common do
         end
       end
 
+      def handle_call({:write, {:whole_array, node_id, {data_type, array, array_dimensions}}}, caller_info, state) do
+        if all_must_be(:integer, array_dimensions) do
+          c_array = if is_list(array), do: Enum.map(array, &value_to_c(data_type, &1)), else: array
+          c_args = {to_c(node_id), data_type, c_array, List.to_tuple(array_dimensions)}
+          call_port(state, :write_node_array, caller_info, c_args)
+          {:noreply, state}
+        else
+          {:reply, {:error, :einval}, state}
+        end
+      end
+
+      def handle_call({:write, {:value_range, node_id, {index_range, data_type, array}}}, caller_info, state) do
+        c_array = if is_list(array), do: Enum.map(array, &value_to_c(data_type, &1)), else: array
+        c_args = {to_c(node_id), index_range, data_type, c_array}
+        call_port(state, :write_node_value_range, caller_info, c_args)
+        {:noreply, state}
+      end
+
       # Read nodes Attributes handlers
 
       def handle_call({:read, {:node_id, node_id}}, caller_info, state) do
@@ -660,12 +946,116 @@ defmodule OpcUA.Common do
         {:noreply, state}
       end
 
+      def handle_call({:read, {:value_packed, node_id}}, caller_info, state) do
+        c_args = to_c(node_id)
+        call_port(state, :read_node_value_packed, caller_info, c_args)
+        {:noreply, state}
+      end
+
+      def handle_call({:read, {:value_range, {node_id, index_range, packed?}}}, caller_info, state) do
+        c_args = {to_c(node_id), index_range, packed?}
+        call_port(state, :read_node_value_range, caller_info, c_args)
+        {:noreply, state}
+      end
+
       def handle_call({:read, {:value_by_data_type, {node_id, data_type}}}, caller_info, state) do
         c_args = {to_c(node_id), data_type}
         call_port(state, :read_node_value_by_data_type, caller_info, c_args)
         {:noreply, state}
       end
 
+      def handle_call({:read, {:values, nodes}}, caller_info, state) do
+        c_args = Enum.map(nodes, fn {node_id, attribute} -> {to_c(node_id), attribute_id(attribute)} end)
+        call_port(state, :read_node_values, caller_info, c_args)
+        {:noreply, state}
+      end
+
+      # Registered nodes handlers
+      def handle_call({:register_nodes, node_ids}, caller_info, state) do
+        if Enum.all?(node_ids, &match?(%NodeId{}, &1)) do
+          c_args = Enum.map(node_ids, &to_c(%{&1 | handle: nil}))
+          call_port(state, :register_nodes, caller_info, c_args)
+          {:noreply, state}
+        else
+          {:reply, {:error, :einval}, state}
+        end
+      end
+
+      def handle_call({:unregister_nodes, node_ids}, caller_info, state) do
+        if Enum.all?(node_ids, &match?(%NodeId{handle: handle} when is_integer(handle), &1)) do
+          call_port(state, :unregister_nodes, caller_info, Enum.map(node_ids, & &1.handle))
+          {:noreply, state}
+        else
+          {:reply, {:error, :einval}, state}
+        end
+      end
+
+      # Browse handlers
+      def handle_call({:browse_tree, root, opts}, caller_info, state) do
+        max_depth = Keyword.get(opts, :max_depth, 0)
+        hierarchical_references = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 33)
+        reference_type = Keyword.get(opts, :reference_type, hierarchical_references)
+        node_class_mask = Keyword.get(opts, :node_class_mask, 0)
+        attributes = Keyword.get(opts, :attributes, [])
+
+        with true <- is_integer(max_depth) and max_depth >= 0,
+             true <- is_integer(node_class_mask) and node_class_mask >= 0,
+             %NodeId{} <- reference_type,
+             {:ok, attribute_ids} <- browse_attribute_ids(attributes) do
+          c_args = {to_c(root), max_depth, to_c(reference_type), node_class_mask, attribute_ids}
+          call_port(state, :browse_tree, caller_info, c_args)
+          browse_trees = Map.put(state.browse_trees, caller_info, {attributes, []})
+          {:noreply, %{state | browse_trees: browse_trees}}
+        else
+          _invalid -> {:reply, {:error, :einval}, state}
+        end
+      end
+
+      # Port statistics handlers
+      def handle_call({:stats, :get}, caller_info, state) do
+        call_port(state, :get_stats, caller_info, nil)
+        {:noreply, state}
+      end
+
+      def handle_call({:stats, :build_features}, caller_info, state) do
+        call_port(state, :get_build_features, caller_info, nil)
+        {:noreply, state}
+      end
+
+      def handle_call({:stats, {:interval, interval}}, caller_info, state) do
+        call_port(state, :set_stats_interval, caller_info, interval)
+        {:noreply, state}
+      end
+
+      def handle_call(
+            {:notification_queue, _high_water_mark},
+            _caller_info,
+            %{session: {_owner, _handle}} = state
+          ),
+          do: {:reply, {:error, :einval}, state}
+
+      def handle_call({:notification_queue, high_water_mark}, caller_info, state) do
+        call_port(state, :set_notification_queue, caller_info, high_water_mark)
+        {:noreply, state}
+      end
+
+      # Shared memory ring handlers
+      def handle_call({:shm_ring, _args}, _caller_info, %{session: {_owner, _handle}} = state),
+        do: {:reply, {:error, :einval}, state}
+
+      def handle_call({:shm_ring, {size, threshold}}, caller_info, state)
+          when is_integer(threshold) and threshold >= 0 do
+        if size == 0 or OpcUA.ShmRing.loaded?() do
+          call_port(state, :enable_shm_ring, caller_info, {size, threshold})
+          {:noreply, state}
+        else
+          {:reply, {:error, :nif_not_loaded}, state}
+        end
+      end
+
+      def handle_call({:shm_ring, _args}, _caller_info, state),
+        do: {:reply, {:error, :einval}, state}
+
       # Catch all handlers
 
       def handle_info({_port, {:data, <<?r, c_response::binary>>}}, state) do
@@ -677,6 +1067,24 @@ defmodule OpcUA.Common do
         {:noreply, state}
       end
 
+      # The response waits in the shared memory ring.
+      def handle_info({_port, {:data, <<?s>>}}, %{shm_ring: ring} = state) when ring != nil do
+        {:ok, c_response} = OpcUA.ShmRing.read(ring)
+        {:noreply, handle_c_response(c_response, state)}
+      end
+
+      def handle_info({_port, {:data, <<?s>>}}, state) do
+        Logger.warn("(#{__MODULE__}) Dropping a shared memory ring response, the ring isn't open")
+        {:noreply, state}
+      end
+
+      # Dispatch C handlers
+
+      defp handle_c_response({:list_commands, nil, {:ok, commands}}, state) do
+        opcodes = commands |> Enum.with_index() |> Map.new()
+        %{state | opcodes: opcodes}
+      end
+
       # Write nodes Attributes C handlers
 
       defp handle_c_response({:write_node_browse_name, caller_metadata, data}, state) do
@@ -757,11 +1165,26 @@ defmodule OpcUA.Common do
         state
       end
 
+      defp handle_c_response({:write_node_values, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
       defp handle_c_response({:write_node_blank_array, caller_metadata, data}, state) do
         GenServer.reply(caller_metadata, data)
         state
       end
 
+      defp handle_c_response({:write_node_array, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
+      defp handle_c_response({:write_node_value_range, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
       # Read nodes Attributes C handlers
 
       defp handle_c_response({:read_node_node_id, caller_metadata, node_id_response}, state) do
@@ -873,6 +1296,36 @@ defmodule OpcUA.Common do
         state
       end
 
+      defp handle_c_response(
+             {:read_node_value_packed, caller_metadata, {:ok, {:packed_array, data_type, dimensions, data}}},
+             state
+           ) do
+        packed_array = OpcUA.PackedArray.new(data_type: data_type, dimensions: dimensions, data: data)
+        GenServer.reply(caller_metadata, {:ok, packed_array})
+        state
+      end
+
+      defp handle_c_response({:read_node_value_packed, caller_metadata, value_response}, state) do
+        response = parse_value(value_response)
+        GenServer.reply(caller_metadata, response)
+        state
+      end
+
+      defp handle_c_response(
+             {:read_node_value_range, caller_metadata, {:ok, {:packed_array, data_type, dimensions, data}}},
+             state
+           ) do
+        packed_array = OpcUA.PackedArray.new(data_type: data_type, dimensions: dimensions, data: data)
+        GenServer.reply(caller_metadata, {:ok, packed_array})
+        state
+      end
+
+      defp handle_c_response({:read_node_value_range, caller_metadata, value_response}, state) do
+        response = parse_value(value_response)
+        GenServer.reply(caller_metadata, response)
+        state
+      end
+
       defp handle_c_response(
              {:read_node_value_by_data_type, caller_metadata, value_response},
              state
@@ -882,19 +1335,141 @@ defmodule OpcUA.Common do
         state
       end
 
+      defp handle_c_response({:read_node_values, caller_metadata, values_response}, state) do
+        response = parse_values(values_response)
+        GenServer.reply(caller_metadata, response)
+        state
+      end
+
+      # Browse C handlers
+
+      defp handle_c_response({:browse_tree, caller_metadata, {:ok, {:chunk, entries}}}, state) do
+        case Map.fetch(state.browse_trees, caller_metadata) do
+          {:ok, {attributes, chunks}} ->
+            browse_trees = Map.put(state.browse_trees, caller_metadata, {attributes, [entries | chunks]})
+            %{state | browse_trees: browse_trees}
+
+          :error ->
+            state
+        end
+      end
+
+      # The caller is answered once: after an error, the entry is gone and the rest of the request is ignored.
+      defp handle_c_response({:browse_tree, caller_metadata, response}, state) do
+        case Map.pop(state.browse_trees, caller_metadata) do
+          {nil, _browse_trees} ->
+            state
+
+          {{attributes, chunks}, browse_trees} ->
+            case response do
+              {:ok, _node_count} ->
+                nodes =
+                  chunks
+                  |> Enum.reverse()
+                  |> Enum.flat_map(fn entries ->
+                    Enum.map(entries, &parse_browse_tree_entry(&1, attributes))
+                  end)
+
+                GenServer.reply(caller_metadata, {:ok, nodes})
+
+              error ->
+                GenServer.reply(caller_metadata, error)
+            end
+
+            %{state | browse_trees: browse_trees}
+        end
+      end
+
+      # Registered nodes C handlers
+
+      defp handle_c_response({:register_nodes, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
+      defp handle_c_response({:unregister_nodes, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
+      # Shared memory ring C handlers
+
+      defp handle_c_response({:enable_shm_ring, caller_metadata, {:ok, name}}, state) do
+        case OpcUA.ShmRing.open(name) do
+          {:ok, ring} ->
+            GenServer.reply(caller_metadata, :ok)
+            %{state | shm_ring: ring}
+
+          error ->
+            # The port already writes to the ring, nothing else would read it.
+            Logger.error("(#{__MODULE__}) Can't open the shared memory ring: #{inspect(error)}")
+            call_port(state, :enable_shm_ring, nil, {0, 0})
+            GenServer.reply(caller_metadata, error)
+            state
+        end
+      end
+
+      defp handle_c_response({:enable_shm_ring, nil, _data}, state), do: state
+
+      defp handle_c_response({:enable_shm_ring, caller_metadata, :ok}, state) do
+        GenServer.reply(caller_metadata, :ok)
+        %{state | shm_ring: nil}
+      end
+
+      defp handle_c_response({:enable_shm_ring, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
+      # Port statistics C handlers
+
+      defp handle_c_response({:get_stats, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
+      defp handle_c_response({:get_build_features, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
+      defp handle_c_response({:set_stats_interval, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
+      defp handle_c_response({:set_notification_queue, caller_metadata, data}, state) do
+        GenServer.reply(caller_metadata, data)
+        state
+      end
+
+      defp handle_c_response({:stats, stats}, state) do
+        emit_stats(stats)
+        state
+      end
+
+      # :telemetry is optional, the periodic push is dropped without it.
+      defp emit_stats(%{handlers: handlers, port: port, gauges: gauges}) do
+        if Code.ensure_loaded?(:telemetry) do
+          measurements = Map.merge(port, gauges)
+          metadata = %{pid: self(), module: __MODULE__, handlers: handlers}
+          apply(:telemetry, :execute, [[:opex62541, :port, :stats], measurements, metadata])
+        end
+      end
+
       defp use_valgrind?(), do: System.get_env("USE_VALGRIND", "false")
 
-      defp open_port(executable, "false") do
+      defp open_port(executable, "false", packet) do
         Port.open({:spawn_executable, to_charlist(executable)}, [
-          {:args, []},
-          {:packet, 2},
+          {:args, packet_args(packet)},
+          {:packet, packet},
           :use_stdio,
           :binary,
           :exit_status
         ])
       end
 
-      defp open_port(executable, valgrind_env) do
+      defp open_port(executable, valgrind_env, packet) do
         Logger.warn("(#{__MODULE__}) Valgrind Activated: #{inspect valgrind_env}")
         Port.open({:spawn_executable, to_charlist("/usr/bin/valgrind.bin")}, [
           {:args,
@@ -906,22 +1481,37 @@ defmodule OpcUA.Common do
              #"--verbose",
              #"--track-origins=yes",
              executable
-           ]},
-          {:packet, 2},
+           ] ++ packet_args(packet)},
+          {:packet, packet},
           :use_stdio,
           :binary,
           :exit_status
         ])
       end
 
+      # The C side defaults to 2-byte framing, only tell it otherwise.
+      defp packet_args(2), do: []
+      defp packet_args(4), do: ["--packet", "4"]
+
+      # Commands are sent as atoms until the C handler table has been received, then as integer opcodes.
+      # Client sessions send their commands through the port owner.
+      defp call_port(%{session: {owner, handle}} = state, command, caller, arguments) do
+        msg = {{handle, Map.get(state.opcodes, command, command)}, caller, arguments}
+        send(owner, {:session_command, :erlang.term_to_binary(msg)})
+      end
+
       defp call_port(state, command, caller, arguments) do
-        msg = {command, caller, arguments}
+        msg = {Map.get(state.opcodes, command, command), caller, arguments}
         send(state.port, {self(), {:command, :erlang.term_to_binary(msg)}})
       end
 
+      defp request_opcodes(state), do: call_port(state, :list_commands, nil, nil)
+
       defp charlist_to_string({:ok, charlist}), do: {:ok, to_string(charlist)}
       defp charlist_to_string(error_response), do: error_response
 
+      defp to_c(%NodeId{handle: handle}) when is_integer(handle), do: handle
+
       defp to_c(%NodeId{ns_index: ns_index, identifier_type: id_type, identifier: identifier}),
         do: {id_type, ns_index, identifier}
 
@@ -930,12 +1520,47 @@ defmodule OpcUA.Common do
 
       defp to_c(_invalid_struct), do: raise("Invalid Data type")
 
+      defp attribute_id(attribute) when is_integer(attribute), do: attribute
+      defp attribute_id(attribute), do: Map.fetch!(@attribute_ids, attribute)
+
+      defp browse_attribute_ids(attributes) when is_list(attributes) do
+        if Enum.all?(attributes, &(is_integer(&1) or Map.has_key?(@attribute_ids, &1))),
+          do: {:ok, Enum.map(attributes, &attribute_id/1)},
+          else: :error
+      end
+
+      defp browse_attribute_ids(_attributes), do: :error
+
+      defp parse_browse_tree_entry(
+             {node_id, parent_node_id, reference_type_id, browse_name, display_name, node_class,
+              type_definition, depth, results},
+             attributes
+           ) do
+        %{
+          node_id: parse_c_value(node_id),
+          parent_node_id: parse_c_value(parent_node_id),
+          reference_type_id: parse_c_value(reference_type_id),
+          browse_name: parse_c_value(browse_name),
+          display_name: display_name,
+          node_class: node_class,
+          type_definition: parse_c_value(type_definition),
+          depth: depth,
+          attributes: attributes |> Enum.zip(Enum.map(results, &parse_result/1)) |> Map.new()
+        }
+      end
+
       # For NodeId, QualifiedName.
       defp value_to_c(data_type, value) when data_type in [16, 17, 19], do: to_c(value)
       # SEMANTICCHANGESTRUCTUREDATATYPE
       defp value_to_c(data_type, {arg1, arg2}) when data_type == 25, do: {to_c(arg1), to_c(arg2)}
       defp value_to_c(_data_type, value), do: value
 
+      defp write_value_to_c({node_id, data_type, value}),
+        do: {to_c(node_id), data_type, nil, value_to_c(data_type, value)}
+
+      defp write_value_to_c({node_id, data_type, value, index}) when is_integer(index),
+        do: {to_c(node_id), data_type, index, value_to_c(data_type, value)}
+
       defp parse_browse_name({:ok, {ns_index, name}}),
         do: {:ok, QualifiedName.new(ns_index: ns_index, name: name)}
 
@@ -980,6 +1605,14 @@ defmodule OpcUA.Common do
 
       defp parse_value(response), do: response
 
+      defp parse_values({:ok, results}) when is_list(results),
+        do: {:ok, Enum.map(results, &parse_result/1)}
+
+      defp parse_values(response), do: response
+
+      defp parse_result({:ok, value}), do: {:ok, parse_c_value(value)}
+      defp parse_result(error_response), do: error_response
+
       defp parse_c_value({ns_index, type, name, name_space_uri, server_index}),
         do:
           ExpandedNodeId.new(
@@ -9,6 +9,10 @@ defmodule OpcUA.NodeId do
   Every node has a unique NodeId. NodeIds refer to a `namespace` with an additional
   `identifier` value that can be an integer, a string, a guid or a bytestring depending on the selected
   `identifier_type`.
+
+  `register_nodes/2` (Client & Server) returns NodeIds with a `handle`, they are sent to the port
+  as that small integer instead of the whole identifier. A handle is only valid in the process
+  (and Client session) that registered it, until `unregister_nodes/2`.
   """
   alias OpcUA.NodeId
   @enforce_keys [:ns_index, :identifier_type, :identifier]
@@ -17,7 +21,8 @@ defmodule OpcUA.NodeId do
 
   defstruct ns_index: nil,
             identifier_type: nil,
-            identifier: nil
+            identifier: nil,
+            handle: nil
 
   @doc """
   Creates a structure for a node in the address space of an OPC UA Server.
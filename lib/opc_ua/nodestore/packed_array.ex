@@ -0,0 +1,72 @@
+defmodule OpcUA.PackedArray do
+  @moduledoc """
+  A numeric array value read as a single binary (see `read_node_value_packed/2`).
+
+  `data` holds the elements back to back in the host byte order, `data_type` is the OPC UA
+  type index (`1` SByte ... `10` Double, `12` DateTime) and `dimensions` a tuple with the size
+  of each dimension. Elements are only decoded when asked for.
+  """
+  alias OpcUA.PackedArray
+
+  @enforce_keys [:data_type, :dimensions, :data]
+
+  defstruct data_type: nil,
+            dimensions: nil,
+            data: <<>>
+
+  # {data_type, element size}
+  @element_sizes %{1 => 1, 2 => 1, 3 => 2, 4 => 2, 5 => 4, 6 => 4, 7 => 8, 8 => 8, 9 => 4, 10 => 8, 12 => 8}
+  @data_types Map.keys(@element_sizes)
+
+  @doc """
+  Creates a structure for a packed numeric array.
+  """
+  @spec new(list()) :: %PackedArray{}
+  def new(data_type: data_type, dimensions: dimensions, data: data)
+      when data_type in @data_types and is_tuple(dimensions) and is_binary(data) do
+    %PackedArray{data_type: data_type, dimensions: dimensions, data: data}
+  end
+
+  def new(_invalid_data), do: raise("Invalid data type, dimensions or data")
+
+  @doc """
+  Returns the number of elements.
+  """
+  @spec size(%PackedArray{}) :: non_neg_integer()
+  def size(%PackedArray{data_type: data_type, data: data}),
+    do: div(byte_size(data), Map.fetch!(@element_sizes, data_type))
+
+  @doc """
+  Decodes the element at `index` (zero based).
+  """
+  @spec at(%PackedArray{}, non_neg_integer()) :: number() | nil
+  def at(%PackedArray{data_type: data_type, data: data}, index) when is_integer(index) and index >= 0 do
+    element_size = Map.fetch!(@element_sizes, data_type)
+
+    case data do
+      <<_skip::binary-size(index * element_size), element::binary-size(element_size), _rest::binary>> ->
+        decode(data_type, element)
+
+      _out_of_range ->
+        nil
+    end
+  end
+
+  @doc """
+  Decodes every element into a flat list.
+  """
+  @spec to_list(%PackedArray{}) :: list(number())
+  def to_list(%PackedArray{data_type: 1, data: data}), do: for(<<v::signed-8 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 2, data: data}), do: :binary.bin_to_list(data)
+  def to_list(%PackedArray{data_type: 3, data: data}), do: for(<<v::signed-native-16 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 4, data: data}), do: for(<<v::unsigned-native-16 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 5, data: data}), do: for(<<v::signed-native-32 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 6, data: data}), do: for(<<v::unsigned-native-32 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 7, data: data}), do: for(<<v::signed-native-64 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 8, data: data}), do: for(<<v::unsigned-native-64 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 9, data: data}), do: for(<<v::float-native-32 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 10, data: data}), do: for(<<v::float-native-64 <- data>>, do: v)
+  def to_list(%PackedArray{data_type: 12, data: data}), do: for(<<v::signed-native-64 <- data>>, do: v)
+
+  defp decode(data_type, element), do: hd(to_list(%PackedArray{data_type: data_type, dimensions: {1}, data: element}))
+end
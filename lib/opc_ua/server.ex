@@ -47,6 +47,20 @@ defmodule OpcUA.Server do
   ```
   """
 
+  # Bytes of load_address_space entries per port message, the rest is left for the command and caller.
+  @address_space_chunk_size %{2 => 60_000, 4 => 1_048_576}
+
+  @address_space_node_types [
+    :variable_node,
+    :variable_type_node,
+    :method_node,
+    :object_node,
+    :object_type_node,
+    :reference_type_node,
+    :data_type_node,
+    :view_node
+  ]
+
   @doc """
   Optional callback that handles node values updates from a Client to a Server.
 
@@ -57,6 +71,28 @@ defmodule OpcUA.Server do
   """
   @callback handle_write(key :: {%NodeId{}, any}, term()) :: term()
 
+  @doc """
+  Optional callback that handles a batch of node values updates, it is only used after
+  `set_write_batch/2` enables batching. By default each update is passed to `handle_write/2`.
+  """
+  @callback handle_write_batch(list({%NodeId{}, any()}), term()) :: term()
+
+  @doc """
+  Optional callback that handles value changes of local monitored items (see `add_monitored_item/2`).
+
+  It's first argument is a tuple, in which its first element is the `monitored_item_id`
+  and the second element is the new value.
+
+  the second argument it's the GenServer state (Parent process).
+  """
+  @callback handle_monitored_data({integer(), any()}, term()) :: term()
+
+  @doc """
+  Optional callback that handles a batch of local monitored items changes, it is only used after
+  `set_notification_batch_size/2` enables batching. By default each change is passed to `handle_monitored_data/2`.
+  """
+  @callback handle_monitored_data_batch(list({integer(), any()}), term()) :: term()
+
   @type config_params ::
           {:hostname, binary()}
           | {:port, non_neg_integer()}
@@ -138,6 +174,21 @@ defmodule OpcUA.Server do
         {:noreply, state}
       end
 
+      def handle_info({:write_batch, write_events}, state) do
+        state = apply(__MODULE__, :handle_write_batch, [write_events, state])
+        {:noreply, state}
+      end
+
+      def handle_info({:data, monitored_item_id, value}, state) do
+        state = apply(__MODULE__, :handle_monitored_data, [{monitored_item_id, value}, state])
+        {:noreply, state}
+      end
+
+      def handle_info({:data_batch, changed_data_events}, state) do
+        state = apply(__MODULE__, :handle_monitored_data_batch, [changed_data_events, state])
+        {:noreply, state}
+      end
+
       @impl true
       def handle_write(write_event, state) do
         require Logger
@@ -145,6 +196,27 @@ defmodule OpcUA.Server do
         state
       end
 
+      @impl true
+      def handle_monitored_data(changed_data_event, state) do
+        require Logger
+        Logger.warn("No handle_monitored_data/2 clause in #{__MODULE__} provided for #{inspect(changed_data_event)}")
+        state
+      end
+
+      @impl true
+      def handle_write_batch(write_events, state) do
+        Enum.reduce(write_events, state, fn write_event, state ->
+          apply(__MODULE__, :handle_write, [write_event, state])
+        end)
+      end
+
+      @impl true
+      def handle_monitored_data_batch(changed_data_events, state) do
+        Enum.reduce(changed_data_events, state, fn changed_data_event, state ->
+          apply(__MODULE__, :handle_monitored_data, [changed_data_event, state])
+        end)
+      end
+
       @impl true
       def address_space(_user_init_state), do: []
 
@@ -157,68 +229,38 @@ defmodule OpcUA.Server do
       end
 
       defp set_server_address_space(s_pid, address_space) do
-        for {node_type, node_params} <- address_space, reduce: %{} do
-          acc -> add_node(s_pid, node_type, node_params, acc)
-        end
-      end
-
-      defp add_node(s_pid, :namespace, node_param, namespaces) do
-        ns_index = GenServer.call(s_pid, {:add, {:namespace, node_param}})
-        Map.put(namespaces, node_param, ns_index)
-      end
-
-      defp add_node(s_pid, node_type, node, namespaces) do
-        # separate the node params (creation arguments & node attributes)
-        {node_args, node_attrs} =
-          node
-          |> Map.from_struct()
-          |> Map.pop(:args)
-
-        # Create node
-        #node_args = replace_namespace(node_args, namespaces)
-        GenServer.call(s_pid, {:add, {node_type, node_args}})
+        {monitored_items, address_space} =
+          Enum.split_with(address_space, &match?({:monitored_item, _}, &1))
 
-        # add nodes attribures
-        node_id = Keyword.get(node_args, :requested_new_node_id, nil)
-        #node_attrs = replace_namespace(node_attrs, namespaces)
-        add_node_attrs(s_pid, node_id, node_attrs)
-
-        namespaces
-      end
-
-      defp add_node_attrs(s_pid, node_id, node_attrs) do
-        for {attr, attr_value} <- node_attrs do
-          set_node_attr(s_pid, node_id, attr, attr_value)
+        # Namespaces, nodes (with their attributes) and references are created in bulk.
+        with {:ok, %{failures: [_ | _] = failures}} <- OpcUA.Server.load_address_space(s_pid, address_space) do
+          require Logger
+          Logger.warn("#{__MODULE__} address space entries not loaded: #{inspect(failures)}")
         end
-      end
 
-      defp set_node_attr(_s_pid, _node_id, _attr, nil), do: nil
-      defp set_node_attr(s_pid, node_id, attr, attr_value) do
-        GenServer.call(s_pid, {:write, {attr, node_id, attr_value}})
+        for {:monitored_item, %OpcUA.MonitoredItem{args: args}} <- monitored_items do
+          GenServer.call(s_pid, {:add, {:monitored_item, args}})
+        end
       end
 
-      # TODO: complete the function.
-      # defp replace_namespace(params, namespaces) do
-      #   for {param, param_value} <- params, reduce: %{} do
-      #     acc ->
-      #       param_value =
-      #         if is_struct(params_value) do
-
-      #         end
-      #       Map.put
-      #   end
-      # end
-
       defoverridable  start_link: 0,
                       start_link: 1,
                       configuration: 1,
                       address_space: 1,
-                      handle_write: 2
+                      handle_write: 2,
+                      handle_write_batch: 2,
+                      handle_monitored_data: 2,
+                      handle_monitored_data_batch: 2
     end
   end
 
   @doc """
   Starts up a OPC UA Server GenServer.
+
+  The following options can be used in `args`:
+  * `:packet` -> 2 or 4. Size of the port message length prefix. The default `2`
+    limits every request and response to 64 KiB; use `4` for large arrays or
+    batched operations.
   """
   @spec start_link(term(), list()) :: {:ok, pid} | {:error, term} | {:error, :einval}
   def start_link(args \\ [], opts \\ []) do
@@ -303,6 +345,17 @@ defmodule OpcUA.Server do
     end
   end
 
+  @doc """
+  Sets the number of worker threads the Server uses to serve its clients, it must be called before `start/1`.
+  Worker threads are only available when open62541 is built with the `multithreading` profile
+  (`OPEN62541_PROFILE=multithreading`), otherwise it returns `{:error, "BadNotSupported"}`.
+  """
+  @spec set_worker_threads(GenServer.server(), non_neg_integer()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_worker_threads(pid, n_threads) when is_integer(n_threads) and n_threads >= 0 do
+    GenServer.call(pid, {:config, {:worker_threads, n_threads}})
+  end
+
   @doc """
   Adds users (and passwords) the Server.
   Users must be a tuple list ([{user, password}]).
@@ -637,13 +690,65 @@ defmodule OpcUA.Server do
     GenServer.call(pid, {:delete_node, args})
   end
 
+  @doc """
+  Adds namespaces, nodes and references in bulk.
+
+  `address_space` has the format of the `address_space/1` callback: `{:namespace, binary()}`,
+  `{node_type, %OpcUA.*Node{}}` and `{:reference_node, %OpcUA.ReferenceNode{}}` entries. Every
+  node is created with its attributes already set. The entries are sent in as few port messages
+  as the packet size allows; it can also be called several times to stream an address space.
+
+  A failed entry does not stop the load, the reply lists the failures by entry position:
+
+      {:ok, %{namespaces: %{"Sensor" => 2}, failures: [{3, "BadNodeIdExists"}]}}
+  """
+  @spec load_address_space(GenServer.server(), list()) ::
+          {:ok, %{namespaces: map(), failures: list({non_neg_integer(), binary()})}}
+          | {:error, binary()}
+          | {:error, :einval}
+  def load_address_space(pid, address_space) when is_list(address_space) do
+    GenServer.call(pid, {:load_address_space, address_space}, :infinity)
+  end
+
+  @doc """
+  Saves the user namespaces (namespaces, nodes with their attributes and values, references) to a
+  snapshot file and returns the number of saved entries. Method nodes are not saved.
+
+  Values are stored in the host memory layout, a snapshot is meant to be restored with
+  `load_nodeset/2` on the same host (e.g. to speed up restarts of a large address space).
+  """
+  @spec save_nodeset(GenServer.server(), binary()) ::
+          {:ok, non_neg_integer()} | {:error, binary()} | {:error, atom()}
+  def save_nodeset(pid, path) when is_binary(path) do
+    GenServer.call(pid, {:save_nodeset, path}, :infinity)
+  end
+
+  @doc """
+  Restores a snapshot written by `save_nodeset/2`, the reply has the format of `load_address_space/2`.
+
+  A truncated or corrupt file returns `{:error, :einval}` and a snapshot of another format version
+  or host layout (byte order, word size, open62541 types) `{:error, "BadDataEncodingUnsupported"}`,
+  nothing is loaded then.
+  """
+  @spec load_nodeset(GenServer.server(), binary()) ::
+          {:ok, %{namespaces: map(), failures: list({non_neg_integer(), binary()})}}
+          | {:error, binary()}
+          | {:error, atom()}
+  def load_nodeset(pid, path) when is_binary(path) do
+    GenServer.call(pid, {:load_nodeset, path}, :infinity)
+  end
+
   # Add Monitored Items function
 
   @doc """
   Create a local MonitoredItem with a sampling interval that detects data changes.
+  Changes are sent to the controlling process as `{:data, monitored_item_id, value}`.
   The following must be filled:
     * `:monitored_item` -> %NodeID{}.
     * `:sampling_time` -> double().
+  The following are optional:
+    * `:coalesce` -> boolean(). Only the latest value of a burst of changes is sent, at most
+      once per server iteration (default: false).
   """
   @spec add_monitored_item(GenServer.server(), list()) ::
           {:ok, integer()} | {:error, binary()} | {:error, :einval}
@@ -660,13 +765,111 @@ defmodule OpcUA.Server do
     GenServer.call(pid, {:delete_monitored_item, monitored_item_id})
   end
 
+  @doc """
+  Enables batched local MonitoredItems notifications.
+
+  Changes detected in one server iteration are sent to the controlling process as a single
+  `{:data_batch, [{monitored_item_id, value}, ...]}` message, a batch is split after `max_size` items.
+  `0` (default) disables batching.
+  """
+  @spec set_notification_batch_size(GenServer.server(), non_neg_integer()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_notification_batch_size(pid, max_size) when is_integer(max_size) and max_size >= 0 do
+    GenServer.call(pid, {:batch_size, max_size})
+  end
+
+  @doc """
+  Enables batched write events.
+
+  Writes from OPC UA clients are sent to the controlling process as a single
+  `{:write_batch, [{node_id, value}, ...]}` message instead of one `{node_id, value}` message each.
+  The following are optional:
+    * `:enabled` -> boolean() (default: true).
+    * `:interval` -> non_neg_integer(). A batch is sent every `interval` ms, `0` (default) sends it
+      at the end of every server iteration.
+  """
+  @spec set_write_batch(GenServer.server(), list()) :: :ok | {:error, binary()} | {:error, :einval}
+  def set_write_batch(pid, args \\ []) when is_list(args) do
+    GenServer.call(pid, {:write_batch, args})
+  end
+
+  @doc """
+  Enables or disables the forwarding of writes from OPC UA clients to a variable node (enabled by default).
+  Nodes whose value comes from a data source can't forward writes (`{:error, "BadNodeClassInvalid"}`).
+  """
+  @spec set_write_forwarding(GenServer.server(), %NodeId{}, boolean()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_write_forwarding(pid, %NodeId{} = node_id, enabled?) when is_boolean(enabled?) do
+    GenServer.call(pid, {:write_forwarding, node_id, enabled?})
+  end
+
+  @doc """
+  Keeps the last `capacity` values of a variable node in memory and serves them to OPC UA clients
+  through HistoryRead (raw, by time range). It also sets the `historizing` attribute of the node and
+  the history read bit of its access level.
+  The following are optional:
+    * `:sampling` -> float(). A value is only recorded `sampling` ms (source timestamp) after the
+      previous one, `0.0` (default) records every change.
+
+  The memory of the whole history is allocated here; configuring a node again starts an empty
+  history and a `capacity` of `0` drops it. Requires open62541 built with `UA_ENABLE_HISTORIZING`
+  (`OPEN62541_PROFILE=historizing`), otherwise `{:error, "BadNotSupported"}` is returned.
+  """
+  @spec configure_history(GenServer.server(), %NodeId{}, non_neg_integer(), list()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def configure_history(pid, %NodeId{} = node_id, capacity, opts \\ [])
+      when is_integer(capacity) and capacity >= 0 and is_list(opts) do
+    GenServer.call(pid, {:history, {node_id, capacity, Keyword.get(opts, :sampling, 0.0)}})
+  end
+
+  # Shadow values functions
+
+  @doc """
+  Allocates a table of `size` shadow values, the slots of the shadow variables (see
+  `set_shadow_variable/4`). Existing slots keep their values, it can't be resized while the server
+  runs (`{:error, "BadInvalidState"}`).
+  """
+  @spec set_shadow_table(GenServer.server(), non_neg_integer()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_shadow_table(pid, size) when is_integer(size) and size >= 0 do
+    GenServer.call(pid, {:shadow, {:table, size}})
+  end
+
+  @doc """
+  Serves the value of a variable node from the slot `handle` of the shadow table, that is
+  updated with `update_shadow_values/2` instead of `write_node_value/4` (the node can't be written
+  anymore). Monitored items sample the slot, so publishing many values doesn't trigger a write
+  for each one.
+
+  `data_type` (as in `write_node_value/4`) must be a number, a boolean or a DateTime and should be
+  the data type of the node. Floats only fit Float and Double variables, a variable reads
+  `BadWaitingForInitialData` until its slot is updated.
+  """
+  @spec set_shadow_variable(GenServer.server(), %NodeId{}, non_neg_integer(), integer()) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def set_shadow_variable(pid, %NodeId{} = node_id, handle, data_type)
+      when is_integer(handle) and handle >= 0 and is_integer(data_type) do
+    GenServer.call(pid, {:shadow, {:variable, node_id, handle, data_type}})
+  end
+
+  @doc """
+  Updates many shadow values (integers, floats or booleans) with a single message, `values` is a
+  list of `{handle, value}` tuples. Handles out of the table are skipped and `{:error, :einval}`
+  is returned, the other values are still updated.
+  """
+  @spec update_shadow_values(GenServer.server(), list({non_neg_integer(), number() | boolean()})) ::
+          :ok | {:error, binary()} | {:error, :einval}
+  def update_shadow_values(pid, values) when is_list(values) do
+    GenServer.call(pid, {:shadow, {:update, values}})
+  end
+
   @doc false
   def test(pid) do
     GenServer.call(pid, {:test, nil}, :infinity)
   end
 
   # Handlers
-  def init({_args, controlling_process}) do
+  def init({args, controlling_process}) do
 
     lib_dir =
       :opex62541
@@ -676,9 +879,12 @@ defmodule OpcUA.Server do
 
     executable = lib_dir <> "/opc_ua_server"
 
-    port = open_port(executable, use_valgrind?())
+    packet = Keyword.get(args, :packet, 2)
+
+    port = open_port(executable, use_valgrind?(), packet)
 
-    state = %State{port: port, controlling_process: controlling_process}
+    state = %State{port: port, controlling_process: controlling_process, packet: packet}
+    request_opcodes(state)
     {:ok, state}
   end
 
@@ -714,6 +920,11 @@ defmodule OpcUA.Server do
     {:noreply, state}
   end
 
+  def handle_call({:config, {:worker_threads, n_threads}}, caller_info, state) do
+    call_port(state, :set_worker_threads, caller_info, n_threads)
+    {:noreply, state}
+  end
+
   def handle_call({:config, {:users, users}}, caller_info, state) do
     call_port(state, :set_users, caller_info, users)
     {:noreply, state}
@@ -982,13 +1193,50 @@ defmodule OpcUA.Server do
     {:noreply, state}
   end
 
+  def handle_call({:load_address_space, []}, _caller_info, state),
+    do: {:reply, {:ok, %{namespaces: %{}, failures: []}}, state}
+
+  def handle_call({:load_address_space, address_space}, caller_info, state) do
+    c_entries = Enum.map(address_space, &address_space_entry_to_c/1)
+
+    if Enum.member?(c_entries, :error) do
+      {:reply, {:error, :einval}, state}
+    else
+      chunks = chunk_by_size(c_entries, Map.fetch!(@address_space_chunk_size, state.packet))
+      last_chunk = length(chunks) - 1
+
+      chunks
+      |> Enum.with_index()
+      |> Enum.reduce(0, fn {chunk, chunk_index}, offset ->
+        chunk_caller = {caller_info, offset, chunk_index == last_chunk}
+        call_port(state, :load_address_space, chunk_caller, chunk)
+        offset + length(chunk)
+      end)
+
+      loads = Map.put(state.address_space_loads, caller_info, %{namespaces: %{}, failures: []})
+      {:noreply, %{state | address_space_loads: loads}}
+    end
+  end
+
+  def handle_call({:save_nodeset, path}, caller_info, state) do
+    call_port(state, :save_nodeset, caller_info, path)
+    {:noreply, state}
+  end
+
+  def handle_call({:load_nodeset, path}, caller_info, state) do
+    call_port(state, :load_nodeset, caller_info, path)
+    {:noreply, state}
+  end
+
   # Add/delete Monitored Items function
 
   def handle_call({:add, {:monitored_item, args}}, caller_info, state) do
     with  monitored_item <- Keyword.fetch!(args, :monitored_item) |> to_c(),
           sampling_time <- Keyword.fetch!(args, :sampling_time),
-          true <- is_float(sampling_time) do
-      c_args = {monitored_item, sampling_time}
+          coalesce <- Keyword.get(args, :coalesce, false),
+          true <- is_float(sampling_time),
+          true <- is_boolean(coalesce) do
+      c_args = {monitored_item, sampling_time, coalesce}
       call_port(state, :add_monitored_item, caller_info, c_args)
       {:noreply, state}
     else
@@ -1002,6 +1250,58 @@ defmodule OpcUA.Server do
     {:noreply, state}
   end
 
+  def handle_call({:batch_size, max_size}, caller_info, state) do
+    call_port(state, :set_notification_batch_size, caller_info, max_size)
+    {:noreply, state}
+  end
+
+  def handle_call({:write_batch, args}, caller_info, state) do
+    enabled? = Keyword.get(args, :enabled, true)
+    interval = Keyword.get(args, :interval, 0)
+
+    if is_boolean(enabled?) and is_integer(interval) and interval >= 0 do
+      call_port(state, :set_write_batch, caller_info, {enabled?, interval})
+      {:noreply, state}
+    else
+      {:reply, {:error, :einval}, state}
+    end
+  end
+
+  def handle_call({:write_forwarding, node_id, enabled?}, caller_info, state) do
+    call_port(state, :set_write_forwarding, caller_info, {to_c(node_id), enabled?})
+    {:noreply, state}
+  end
+
+  def handle_call({:history, {node_id, capacity, sampling}}, caller_info, state)
+      when is_number(sampling) and sampling >= 0 do
+    call_port(state, :configure_history, caller_info, {to_c(node_id), capacity, sampling / 1})
+    {:noreply, state}
+  end
+
+  def handle_call({:history, _args}, _caller_info, state),
+    do: {:reply, {:error, :einval}, state}
+
+  def handle_call({:shadow, {:table, size}}, caller_info, state) do
+    call_port(state, :set_shadow_table, caller_info, size)
+    {:noreply, state}
+  end
+
+  def handle_call({:shadow, {:variable, node_id, handle, data_type}}, caller_info, state) do
+    call_port(state, :set_shadow_variable, caller_info, {to_c(node_id), handle, data_type})
+    {:noreply, state}
+  end
+
+  def handle_call({:shadow, {:update, values}}, caller_info, state) do
+    case shadow_values_to_c(values, <<>>) do
+      {:ok, c_values} ->
+        call_port(state, :update_shadow_values, caller_info, c_values)
+        {:noreply, state}
+
+      :error ->
+        {:reply, {:error, :einval}, state}
+    end
+  end
+
   # Catch all
 
   def handle_call({:test, nil}, caller_info, state) do
@@ -1043,6 +1343,41 @@ defmodule OpcUA.Server do
     state
   end
 
+  defp handle_c_response(
+         {:write_batch, c_write_events},
+         %{controlling_process: c_pid} = state
+       ) do
+    write_events =
+      Enum.map(c_write_events, fn {{ns_index, type, name}, c_value} ->
+        {NodeId.new(ns_index: ns_index, identifier_type: type, identifier: name), parse_c_value(c_value)}
+      end)
+
+    send(c_pid, {:write_batch, write_events})
+    state
+  end
+
+  # Local MonitoredItems belong to subscription 0.
+  defp handle_c_response(
+         {:subscription, {:data, 0, monitored_item_id, c_value}},
+         %{controlling_process: c_pid} = state
+       ) do
+    send(c_pid, {:data, monitored_item_id, parse_c_value(c_value)})
+    state
+  end
+
+  defp handle_c_response(
+         {:subscription, {:data_batch, c_items}},
+         %{controlling_process: c_pid} = state
+       ) do
+    items =
+      Enum.map(c_items, fn {0, monitored_item_id, c_value} ->
+        {monitored_item_id, parse_c_value(c_value)}
+      end)
+
+    send(c_pid, {:data_batch, items})
+    state
+  end
+
   defp handle_c_response({:test, caller_metadata, data}, state) do
     GenServer.reply(caller_metadata, data)
     state
@@ -1080,6 +1415,11 @@ defmodule OpcUA.Server do
     state
   end
 
+  defp handle_c_response({:set_worker_threads, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
   defp handle_c_response({:set_users, caller_metadata, data}, state) do
     GenServer.reply(caller_metadata, data)
     state
@@ -1189,6 +1529,51 @@ defmodule OpcUA.Server do
     state
   end
 
+  defp handle_c_response(
+         {:load_address_space, {caller_info, offset, last_chunk?}, data},
+         %{address_space_loads: loads} = state
+       ) do
+    case {Map.fetch(loads, caller_info), data} do
+      # A previous chunk already failed.
+      {:error, _data} ->
+        state
+
+      {{:ok, summary}, {:ok, {namespaces, failures}}} ->
+        failures = Enum.map(failures, fn {index, reason} -> {index + offset, reason} end)
+
+        summary = %{
+          namespaces: Enum.into(namespaces, summary.namespaces),
+          failures: summary.failures ++ failures
+        }
+
+        if last_chunk? do
+          GenServer.reply(caller_info, {:ok, summary})
+          %{state | address_space_loads: Map.delete(loads, caller_info)}
+        else
+          %{state | address_space_loads: Map.put(loads, caller_info, summary)}
+        end
+
+      {{:ok, _summary}, error} ->
+        GenServer.reply(caller_info, error)
+        %{state | address_space_loads: Map.delete(loads, caller_info)}
+    end
+  end
+
+  defp handle_c_response({:save_nodeset, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:load_nodeset, caller_metadata, {:ok, {namespaces, failures}}}, state) do
+    GenServer.reply(caller_metadata, {:ok, %{namespaces: Map.new(namespaces), failures: failures}})
+    state
+  end
+
+  defp handle_c_response({:load_nodeset, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
   # C Handlers "Discovery".
 
   defp handle_c_response({:set_lds_config, caller_metadata, data}, state) do
@@ -1217,4 +1602,150 @@ defmodule OpcUA.Server do
     GenServer.reply(caller_metadata, data)
     state
   end
+
+  defp handle_c_response({:set_notification_batch_size, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_write_batch, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_write_forwarding, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:configure_history, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_shadow_table, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:set_shadow_variable, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  defp handle_c_response({:update_shadow_values, caller_metadata, data}, state) do
+    GenServer.reply(caller_metadata, data)
+    state
+  end
+
+  # update_shadow_values records, <<handle::32, kind::32, value::64>> in the host byte order
+  # (kind 1 integer, 2 float).
+
+  @shadow_max_handle 0xFFFFFFFF
+  @shadow_min_integer -0x8000000000000000
+  @shadow_max_integer 0xFFFFFFFFFFFFFFFF
+
+  defp shadow_values_to_c([], c_values), do: {:ok, c_values}
+
+  defp shadow_values_to_c([{handle, value} | values], c_values)
+       when is_integer(handle) and handle >= 0 and handle <= @shadow_max_handle do
+    case shadow_value_to_c(value) do
+      {kind, bits} ->
+        record = <<handle::native-32, kind::native-32, bits::binary>>
+        shadow_values_to_c(values, <<c_values::binary, record::binary>>)
+
+      :error ->
+        :error
+    end
+  end
+
+  defp shadow_values_to_c(_values, _c_values), do: :error
+
+  defp shadow_value_to_c(true), do: {1, <<1::native-64>>}
+  defp shadow_value_to_c(false), do: {1, <<0::native-64>>}
+
+  defp shadow_value_to_c(value)
+       when is_integer(value) and value >= @shadow_min_integer and value <= @shadow_max_integer,
+       do: {1, <<value::native-64>>}
+
+  defp shadow_value_to_c(value) when is_float(value), do: {2, <<value::float-native-64>>}
+  defp shadow_value_to_c(_value), do: :error
+
+  # load_address_space entries
+
+  defp address_space_entry_to_c({:namespace, namespace}) when is_binary(namespace),
+    do: {:namespace, namespace}
+
+  defp address_space_entry_to_c({:reference_node, %OpcUA.ReferenceNode{args: args}}) do
+    source_id = Keyword.fetch!(args, :source_id) |> to_c()
+    reference_type_id = Keyword.fetch!(args, :reference_type_id) |> to_c()
+    target_id = Keyword.fetch!(args, :target_id) |> to_c()
+    is_forward = Keyword.fetch!(args, :is_forward)
+
+    {:reference, {source_id, reference_type_id, target_id, is_forward}}
+  end
+
+  defp address_space_entry_to_c({node_type, %_{args: args} = node})
+       when node_type in @address_space_node_types do
+    # The browse name attribute replaces the creation one instead of renaming the node.
+    {browse_name, node_attrs} =
+      node
+      |> Map.from_struct()
+      |> Map.delete(:args)
+      |> Map.pop(:browse_name)
+
+    args = if browse_name, do: Keyword.put(args, :browse_name, browse_name), else: args
+
+    {node_type, node_args_to_c(args), node_attrs_to_c(node_attrs)}
+  end
+
+  defp address_space_entry_to_c(_invalid_entry), do: :error
+
+  defp node_args_to_c(args) do
+    requested_new_node_id = Keyword.fetch!(args, :requested_new_node_id) |> to_c()
+    parent_node_id = Keyword.fetch!(args, :parent_node_id) |> to_c()
+    reference_type_node_id = Keyword.fetch!(args, :reference_type_node_id) |> to_c()
+    browse_name = Keyword.fetch!(args, :browse_name) |> to_c()
+
+    c_args = {requested_new_node_id, parent_node_id, reference_type_node_id, browse_name}
+
+    case Keyword.fetch(args, :type_definition) do
+      {:ok, type_definition} -> Tuple.append(c_args, to_c(type_definition))
+      :error -> c_args
+    end
+  end
+
+  defp node_attrs_to_c(node_attrs) do
+    for {attr, attr_value} <- node_attrs, attr_value != nil, do: node_attr_to_c(attr, attr_value)
+  end
+
+  defp node_attr_to_c(:value, {data_type, raw_value}),
+    do: {attribute_id(:value), {data_type, value_to_c(data_type, raw_value)}}
+
+  defp node_attr_to_c(:array, {data_type, array_dimensions}),
+    do:
+      {attribute_id(:value),
+       {data_type, get_array_raw_size(array_dimensions), List.to_tuple(array_dimensions)}}
+
+  defp node_attr_to_c(:data_type, data_type), do: {attribute_id(:data_type), to_c(data_type)}
+
+  defp node_attr_to_c(:array_dimensions, array_dimensions),
+    do: {attribute_id(:array_dimensions), List.to_tuple(array_dimensions)}
+
+  defp node_attr_to_c(attr, attr_value), do: {attribute_id(attr), attr_value}
+
+  defp chunk_by_size(c_entries, max_size) do
+    Enum.chunk_while(
+      c_entries,
+      {[], 0},
+      fn c_entry, {chunk, size} ->
+        entry_size = :erlang.external_size(c_entry)
+
+        if chunk != [] and size + entry_size > max_size,
+          do: {:cont, Enum.reverse(chunk), {[c_entry], entry_size}},
+          else: {:cont, {[c_entry | chunk], size + entry_size}}
+      end,
+      fn {chunk, _size} -> {:cont, Enum.reverse(chunk), {[], 0}} end
+    )
+  end
 end
@@ -0,0 +1,29 @@
+defmodule OpcUA.ShmRing do
+  @moduledoc false
+
+  # Consumer of the shared memory ring of a port (`enable_shm_ring/3`), see src/shm_ring_nif.c.
+  # The NIF is optional, without it `loaded?/0` is false and the ports keep the pipe.
+
+  @on_load :load_nif
+
+  def load_nif() do
+    path =
+      :opex62541
+      |> :code.priv_dir()
+      |> Path.join("opex62541_shm_ring")
+      |> to_charlist()
+
+    # A missing NIF isn't an error, the module just reports it.
+    _ = :erlang.load_nif(path, 0)
+    :ok
+  end
+
+  @spec loaded?() :: boolean()
+  def loaded?(), do: false
+
+  @spec open(charlist()) :: {:ok, reference()} | {:error, atom()}
+  def open(_name), do: :erlang.nif_error(:nif_not_loaded)
+
+  @spec read(reference()) :: {:ok, term()} | :empty | {:error, :einval}
+  def read(_ring), do: :erlang.nif_error(:nif_not_loaded)
+end
@@ -0,0 +1,266 @@
+/*
+ *  Microbenchmarks of the port hot paths: request decoding, response encoding, erlcmd framing and the
+ *  request dispatch table. Built by the `bench` target (not part of the default build):
+ *
+ *      cmake --build <build dir> --target bench && <priv dir>/bench [iterations]
+ *
+ *  Every benchmark prints the mean time per operation, compare the numbers of two builds on the same machine.
+ */
+#include "common.h"
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define BENCH_DEFAULT_ITERATIONS 1000000
+#define BENCH_LARGE_ARRAY_SIZE 100000
+#define BENCH_HANDLERS 200 // About the size of the server handler table
+
+static unsigned long iterations = BENCH_DEFAULT_ITERATIONS;
+
+static void report(const char *name, uint64_t started, unsigned long operations, size_t bytes)
+{
+    uint64_t elapsed = current_time_us() - started;
+    double ns_per_op = elapsed * 1000.0 / operations;
+
+    if(bytes)
+        printf("%-40s %12.1f ns/op %10.1f MB/s\n", name, ns_per_op, bytes / (elapsed ? (double) elapsed : 1.0));
+    else
+        printf("%-40s %12.1f ns/op\n", name, ns_per_op);
+}
+
+/***************************/
+/* Request decoding        */
+/***************************/
+
+static void bench_assemble_node_id(const char *name, ei_x_buff *req)
+{
+    uint64_t started = current_time_us();
+
+    for(unsigned long i = 0; i < iterations; i++) {
+        int req_index = 0;
+        UA_NodeId node_id = assemble_node_id(req->buff, &req_index);
+        UA_NodeId_clear(&node_id);
+    }
+
+    report(name, started, iterations, 0);
+}
+
+static void bench_node_ids()
+{
+    ei_x_buff req;
+
+    // {node_type, ns_index, identifier}, see OpcUA.Common.to_c/1
+    ei_x_new(&req);
+    ei_x_encode_tuple_header(&req, 3);
+    ei_x_encode_ulong(&req, 0);
+    ei_x_encode_ulong(&req, 2);
+    ei_x_encode_ulong(&req, 1000);
+    bench_assemble_node_id("assemble_node_id numeric", &req);
+    ei_x_free(&req);
+
+    ei_x_new(&req);
+    ei_x_encode_tuple_header(&req, 3);
+    ei_x_encode_ulong(&req, 1);
+    ei_x_encode_ulong(&req, 2);
+    ei_x_encode_binary(&req, "R1_TS1_Temperature", strlen("R1_TS1_Temperature"));
+    bench_assemble_node_id("assemble_node_id string", &req);
+    ei_x_free(&req);
+}
+
+/***************************/
+/* Response encoding       */
+/***************************/
+
+static void bench_encode_variant(const char *name, UA_Variant *value, unsigned long operations)
+{
+    ei_x_buff resp;
+    ei_x_new(&resp);
+
+    uint64_t started = current_time_us();
+    size_t bytes = 0;
+
+    for(unsigned long i = 0; i < operations; i++) {
+        resp.index = 0;
+        encode_variant_struct(&resp, value);
+        bytes += resp.index;
+    }
+
+    report(name, started, operations, bytes);
+    ei_x_free(&resp);
+}
+
+static void bench_variants()
+{
+    UA_Variant value;
+    UA_Double scalar = 21.5;
+
+    UA_Variant_setScalar(&value, &scalar, &UA_TYPES[UA_TYPES_DOUBLE]);
+    bench_encode_variant("encode_variant_struct double", &value, iterations);
+
+    UA_String string = UA_STRING("Temperature sensor");
+    UA_Variant_setScalar(&value, &string, &UA_TYPES[UA_TYPES_STRING]);
+    bench_encode_variant("encode_variant_struct string", &value, iterations);
+
+    UA_Double *array = malloc(BENCH_LARGE_ARRAY_SIZE * sizeof(UA_Double));
+    if(!array)
+        errx(EXIT_FAILURE, "Can't allocate the benchmark array");
+
+    for(size_t i = 0; i < BENCH_LARGE_ARRAY_SIZE; i++)
+        array[i] = i * 0.5;
+
+    UA_Variant_setArray(&value, array, BENCH_LARGE_ARRAY_SIZE, &UA_TYPES[UA_TYPES_DOUBLE]);
+    bench_encode_variant("encode_variant_struct double[100000]", &value, iterations / 10000 + 1);
+    free(array);
+}
+
+/***************************/
+/* erlcmd framing          */
+/***************************/
+
+struct pipe_feed {
+    int fd;
+    const char *data;
+    size_t size;
+};
+
+static unsigned long dispatched = 0;
+
+static void count_request(const char *req, void *cookie)
+{
+    (void) req;
+    (void) cookie;
+    dispatched++;
+}
+
+static void *feed_pipe(void *arg)
+{
+    struct pipe_feed *feed = arg;
+
+    for(size_t wrote = 0; wrote < feed->size;) {
+        ssize_t amount_written = write(feed->fd, feed->data + wrote, feed->size - wrote);
+        if(amount_written < 0)
+            err(EXIT_FAILURE, "write");
+        wrote += amount_written;
+    }
+
+    close(feed->fd);
+    return NULL;
+}
+
+/* Messages of `payload_size`, written to a pipe that replaces stdin, are read and framed by erlcmd_process(). */
+static void bench_erlcmd_framing(const char *name, size_t payload_size)
+{
+    size_t message_size = erlcmd_packet_size() + payload_size;
+    unsigned long messages = iterations / 10;
+    if(messages * message_size > 256 * 1024 * 1024)
+        messages = 256 * 1024 * 1024 / message_size;
+
+    char *data = calloc(messages, message_size);
+    if(!data)
+        errx(EXIT_FAILURE, "Can't allocate the benchmark messages");
+
+    for(unsigned long i = 0; i < messages; i++) {
+        uint16_t be_len = htons((uint16_t) payload_size);
+        memcpy(data + i * message_size, &be_len, sizeof(be_len));
+    }
+
+    int fds[2];
+    if(pipe(fds) < 0)
+        err(EXIT_FAILURE, "pipe");
+
+    int saved_stdin = dup(STDIN_FILENO);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+
+    struct erlcmd handler;
+    erlcmd_init(&handler, count_request, NULL);
+    dispatched = 0;
+
+    struct pipe_feed feed = {fds[1], data, messages * message_size};
+    pthread_t feeder;
+    uint64_t started = current_time_us();
+    pthread_create(&feeder, NULL, feed_pipe, &feed);
+
+    while(!erlcmd_process(&handler))
+        ;
+
+    report(name, started, messages, feed.size);
+    pthread_join(feeder, NULL);
+
+    if(dispatched != messages)
+        errx(EXIT_FAILURE, "%s dispatched %lu of %lu messages", name, dispatched, messages);
+
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdin);
+    free(handler.buffer);
+    free(data);
+}
+
+static void bench_framing()
+{
+    bench_erlcmd_framing("erlcmd framing 64 B", 64);
+    bench_erlcmd_framing("erlcmd framing 1 KiB", 1024);
+    bench_erlcmd_framing("erlcmd framing 32 KiB", 32 * 1024);
+}
+
+/***************************/
+/* Request dispatch        */
+/***************************/
+
+static void handle_nothing(void *entity, bool entity_type, const char *req, int *req_index)
+{
+}
+
+static void bench_dispatch(const char *name, ei_x_buff *req)
+{
+    uint64_t started = current_time_us();
+
+    for(unsigned long i = 0; i < iterations; i++) {
+        int req_index = 0;
+        decode_request_handler(req->buff, &req_index);
+    }
+
+    report(name, started, iterations, 0);
+}
+
+static void bench_dispatch_table()
+{
+    static struct request_handler handlers[BENCH_HANDLERS + 1];
+    static char names[BENCH_HANDLERS][32];
+
+    for(int i = 0; i < BENCH_HANDLERS; i++) {
+        snprintf(names[i], sizeof(names[i]), "read_node_attribute_%d", i);
+        handlers[i].name = names[i];
+        handlers[i].handler = handle_nothing;
+    }
+    init_request_handlers(handlers);
+
+    ei_x_buff req;
+
+    ei_x_new(&req);
+    ei_x_encode_atom(&req, names[BENCH_HANDLERS - 1]);
+    bench_dispatch("decode_request_handler atom", &req);
+    ei_x_free(&req);
+
+    ei_x_new(&req);
+    ei_x_encode_ulong(&req, BENCH_HANDLERS - 1);
+    bench_dispatch("decode_request_handler opcode", &req);
+    ei_x_free(&req);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc > 1)
+        iterations = strtoul(argv[1], NULL, 10);
+
+    if(iterations == 0)
+        errx(EXIT_FAILURE, "usage: %s [iterations]", argv[0]);
+
+    bench_node_ids();
+    bench_variants();
+    bench_framing();
+    bench_dispatch_table();
+
+    return 0;
+}
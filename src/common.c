@@ -1,5 +1,15 @@
 #include "common.h"
 #include <string.h>
+#include <setjmp.h>
+#if UA_MULTITHREADING >= 200
+#include <pthread.h>
+#endif
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "shm_ring.h"
+#endif
 #ifdef __APPLE__
 #include <mach/clock.h>
 #include <mach/mach.h>
@@ -12,12 +22,11 @@ FILE *log_location;
 #endif
 
 const char response_id = 'r';
-bool server_is_writing = false;
 
 /**
- * @return a monotonic timestamp in milliseconds
+ * @return a monotonic timestamp in microseconds
  */
-uint64_t current_time()
+uint64_t current_time_us()
 {
 #ifdef __APPLE__
     clock_serv_t cclock;
@@ -27,7 +36,7 @@ uint64_t current_time()
     clock_get_time(cclock, &mts);
     mach_port_deallocate(mach_task_self(), cclock);
 
-    return ((uint64_t) mts.tv_sec) * 1000 + mts.tv_nsec / 1000000;
+    return ((uint64_t) mts.tv_sec) * 1000000 + mts.tv_nsec / 1000;
 #else
     // Linux and Windows support clock_gettime()
     struct timespec tp;
@@ -35,10 +44,17 @@ uint64_t current_time()
     if (rc < 0)
         errx(EXIT_FAILURE, "clock_gettime failed?");
 
-    return ((uint64_t) tp.tv_sec) * 1000 + tp.tv_nsec / 1000000;
+    return ((uint64_t) tp.tv_sec) * 1000000 + tp.tv_nsec / 1000;
 #endif
 }
 
+/**
+ * @return a monotonic timestamp in milliseconds
+ */
+uint64_t current_time()
+{
+    return current_time_us() / 1000;
+}
 
 /*************/
 /* Toolchain */
@@ -72,6 +88,287 @@ void itoa(int n, char s[])
     reverse(s);
 }
 
+/*  Node id sets
+ *
+ *  Open addressing hash set of node ids (copies), used to visit every node once while walking the address space.
+ */
+static size_t node_id_set_slot(const struct node_id_set *set, const UA_NodeId *node_id)
+{
+    size_t slot = UA_NodeId_hash(node_id) & (set->capacity - 1);
+
+    while(!UA_NodeId_isNull(&set->node_ids[slot]) && !UA_NodeId_equal(&set->node_ids[slot], node_id))
+        slot = (slot + 1) & (set->capacity - 1);
+
+    return slot;
+}
+
+// Returns false if the node id is already in the set.
+bool node_id_set_insert(struct node_id_set *set, const UA_NodeId *node_id)
+{
+    if(2 * (set->size + 1) > set->capacity) {
+        struct node_id_set grown = {.size = set->size, .capacity = set->capacity ? 2 * set->capacity : 1024};
+
+        grown.node_ids = calloc(grown.capacity, sizeof(UA_NodeId));
+        if(!grown.node_ids)
+            errx(EXIT_FAILURE, "Could not allocate a node id set");
+
+        for(size_t i = 0; i < set->capacity; i++)
+            if(!UA_NodeId_isNull(&set->node_ids[i]))
+                grown.node_ids[node_id_set_slot(&grown, &set->node_ids[i])] = set->node_ids[i];
+
+        free(set->node_ids);
+        *set = grown;
+    }
+
+    size_t slot = node_id_set_slot(set, node_id);
+    if(!UA_NodeId_isNull(&set->node_ids[slot]))
+        return false;
+
+    UA_NodeId_copy(node_id, &set->node_ids[slot]);
+    set->size++;
+    return true;
+}
+
+void node_id_set_clear(struct node_id_set *set)
+{
+    for(size_t i = 0; i < set->capacity; i++)
+        UA_NodeId_clear(&set->node_ids[i]);
+
+    free(set->node_ids);
+    set->node_ids = NULL;
+    set->size = 0;
+    set->capacity = 0;
+}
+
+/*  Registered nodes
+ *
+ *  register_nodes resolves node ids once and hands back small integer handles, requests may then send the handle
+ *  in place of the {type, ns_index, identifier} tuple. The client keeps the alias returned by the RegisterNodes
+ *  service, along with the registered node id: aliases only hold for the server session that returned them, see
+ *  reregister_session_nodes. Handles belong to the client session that registered them.
+ *
+ *  A handle is the table index + 1 with the generation of its slot in the upper bits, it stays below 2^31 so
+ *  Elixir sends it as an integer. Released slots are reused oldest first and their generation is bumped, so a
+ *  handle Elixir kept after unregister_nodes is rejected instead of naming the node registered after it.
+ */
+#define NODE_HANDLE_INDEX_BITS 22
+#define NODE_HANDLE_INDEX_MASK ((1u << NODE_HANDLE_INDEX_BITS) - 1)
+#define NODE_HANDLE_GENERATIONS (1u << (31 - NODE_HANDLE_INDEX_BITS))
+#define NODE_HANDLE_NO_SLOT UINT32_MAX
+
+struct registered_node {
+    UA_NodeId node_id; // Alias for the client
+    UA_NodeId registered_id; // Client, null for the server
+    uint32_t session;
+    uint32_t generation;
+    uint32_t next_free; // Index of the next released slot, NODE_HANDLE_NO_SLOT at the end of the list
+    bool used;
+};
+
+static struct registered_node *registered_nodes = NULL;
+static size_t registered_nodes_size = 0;
+static size_t registered_nodes_capacity = 0;
+static uint32_t free_nodes_head = NODE_HANDLE_NO_SLOT; // Released slots, oldest first
+static uint32_t free_nodes_tail = NODE_HANDLE_NO_SLOT;
+static uint32_t response_session = 0; // Client session the responses belong to, 0 sends them unwrapped (also owns
+                                       // the registered nodes)
+
+static void release_registered_node(size_t index)
+{
+    struct registered_node *entry = &registered_nodes[index];
+
+    UA_NodeId_clear(&entry->node_id);
+    UA_NodeId_clear(&entry->registered_id);
+    entry->used = false;
+    entry->generation = (entry->generation + 1) % NODE_HANDLE_GENERATIONS;
+    entry->next_free = NODE_HANDLE_NO_SLOT;
+
+    if(free_nodes_tail == NODE_HANDLE_NO_SLOT)
+        free_nodes_head = (uint32_t) index;
+    else
+        registered_nodes[free_nodes_tail].next_free = (uint32_t) index;
+    free_nodes_tail = (uint32_t) index;
+}
+
+/**
+ * @brief Registers node_id (alias NULL) or, for the client, the alias the server returned for it
+ */
+uint32_t register_node(const UA_NodeId *node_id, const UA_NodeId *alias)
+{
+    size_t index;
+
+    if(free_nodes_head != NODE_HANDLE_NO_SLOT) {
+        index = free_nodes_head;
+        free_nodes_head = registered_nodes[index].next_free;
+        if(free_nodes_head == NODE_HANDLE_NO_SLOT)
+            free_nodes_tail = NODE_HANDLE_NO_SLOT;
+    }
+    else {
+        if(registered_nodes_size == NODE_HANDLE_INDEX_MASK)
+            errx(EXIT_FAILURE, "Too many registered nodes");
+
+        if(registered_nodes_size == registered_nodes_capacity) {
+            registered_nodes_capacity = registered_nodes_capacity ? registered_nodes_capacity * 2 : 64;
+            registered_nodes = realloc(registered_nodes, registered_nodes_capacity * sizeof(struct registered_node));
+            if(!registered_nodes)
+                errx(EXIT_FAILURE, "Could not allocate the registered nodes table");
+        }
+
+        index = registered_nodes_size++;
+        registered_nodes[index].generation = 0;
+    }
+
+    struct registered_node *entry = &registered_nodes[index];
+    UA_NodeId_copy(alias ? alias : node_id, &entry->node_id);
+    UA_NodeId_init(&entry->registered_id);
+    if(alias)
+        UA_NodeId_copy(node_id, &entry->registered_id);
+    entry->session = response_session;
+    entry->used = true;
+    return (entry->generation << NODE_HANDLE_INDEX_BITS) | (uint32_t) (index + 1);
+}
+
+/**
+ * @return the node id of a handle registered by the current session, NULL if there is none (or it was released)
+ */
+const UA_NodeId *registered_node(uint32_t handle)
+{
+    size_t index = handle & NODE_HANDLE_INDEX_MASK;
+    if(index == 0 || index > registered_nodes_size)
+        return NULL;
+
+    struct registered_node *entry = &registered_nodes[index - 1];
+    if(!entry->used || entry->generation != handle >> NODE_HANDLE_INDEX_BITS || entry->session != response_session)
+        return NULL;
+
+    return &entry->node_id;
+}
+
+/**
+ * @brief Releases a valid handle (see registered_node), its node id is moved to node_id (cleared by the caller)
+ */
+void unregister_node(uint32_t handle, UA_NodeId *node_id)
+{
+    size_t index = (handle & NODE_HANDLE_INDEX_MASK) - 1;
+    struct registered_node *entry = &registered_nodes[index];
+
+    *node_id = entry->node_id;
+    UA_NodeId_init(&entry->node_id);
+    release_registered_node(index);
+}
+
+/**
+ * @brief Releases every handle of a client session
+ */
+void unregister_session_nodes(uint32_t session)
+{
+    for(size_t i = 0; i < registered_nodes_size; i++) {
+        if(registered_nodes[i].used && registered_nodes[i].session == session)
+            release_registered_node(i);
+    }
+}
+
+/**
+ * @brief Registers the handles of the current client session with its new server session (after a reconnect) in a
+ *        single RegisterNodes request. renamed() is called for every alias that changed, before it is replaced.
+ *        The handles keep their old aliases if the request fails.
+ */
+UA_StatusCode reregister_session_nodes(UA_Client *client, void (*renamed)(const UA_NodeId *alias,
+                                                                         const UA_NodeId *new_alias))
+{
+    size_t count = 0;
+    for(size_t i = 0; i < registered_nodes_size; i++)
+        if(registered_nodes[i].used && registered_nodes[i].session == response_session)
+            count++;
+
+    if(count == 0)
+        return UA_STATUSCODE_GOOD;
+
+    UA_NodeId *node_ids = malloc(count * sizeof(UA_NodeId));
+    size_t *indexes = malloc(count * sizeof(size_t));
+    if(!node_ids || !indexes)
+        errx(EXIT_FAILURE, "Could not allocate %d nodes to register", (int) count);
+
+    count = 0;
+    for(size_t i = 0; i < registered_nodes_size; i++) {
+        if(registered_nodes[i].used && registered_nodes[i].session == response_session) {
+            node_ids[count] = registered_nodes[i].registered_id; // Shallow, the table keeps them
+            indexes[count++] = i;
+        }
+    }
+
+    UA_RegisterNodesRequest request;
+    UA_RegisterNodesRequest_init(&request);
+    request.nodesToRegister = node_ids;
+    request.nodesToRegisterSize = count;
+
+    UA_RegisterNodesResponse response = UA_Client_Service_registerNodes(client, request);
+
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.registeredNodeIdsSize != count)
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+    for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < count; i++) {
+        struct registered_node *entry = &registered_nodes[indexes[i]];
+        if(UA_NodeId_equal(&entry->node_id, &response.registeredNodeIds[i]))
+            continue;
+
+        renamed(&entry->node_id, &response.registeredNodeIds[i]);
+        UA_NodeId_clear(&entry->node_id);
+        UA_NodeId_copy(&response.registeredNodeIds[i], &entry->node_id);
+    }
+
+    UA_RegisterNodesResponse_clear(&response);
+    free(node_ids);
+    free(indexes);
+    return retval;
+}
+
+/*  Unknown node handles
+ *
+ *  A handle that isn't registered (released, or of another session) must not reach open62541 as the null node id,
+ *  add_*_node would create the node under a random id. The node ids are assembled while a handler decodes its
+ *  arguments, before it acts, so decode_node_handle jumps back to call_request_handler that answers
+ *  {:error, :einval}. The array a handler fills while decoding (set_request_abort_array) is deleted then.
+ */
+static __thread jmp_buf *request_abort = NULL; // Set while a handler runs (the server peeks at requests on stdin)
+static void *request_abort_array = NULL;
+static size_t request_abort_array_size = 0;
+static const UA_DataType *request_abort_array_type = NULL;
+
+/**
+ * @brief Deletes array (filled while decoding, released by the handler afterwards) if the current request is aborted
+ */
+void set_request_abort_array(void *array, size_t size, const UA_DataType *type)
+{
+    request_abort_array = array;
+    request_abort_array_size = size;
+    request_abort_array_type = type;
+}
+
+/* Node ids may be sent as a registered handle, unknown handles abort the request (the null node id outside one). */
+static bool decode_node_handle(const char *req, int *req_index, const UA_NodeId **node_id)
+{
+    int term_size;
+    int term_type;
+    if(ei_get_type(req, req_index, &term_type, &term_size) < 0 ||
+        (term_type != ERL_SMALL_INTEGER_EXT && term_type != ERL_INTEGER_EXT))
+        return false;
+
+    unsigned long handle;
+    if(ei_decode_ulong(req, req_index, &handle) < 0)
+        errx(EXIT_FAILURE, "Invalid node handle");
+
+    static const UA_NodeId null_node_id = {0};
+    *node_id = handle <= UINT32_MAX ? registered_node((uint32_t) handle) : NULL;
+    if(*node_id == NULL && request_abort != NULL)
+        longjmp(*request_abort, 1);
+    if(*node_id == NULL)
+        *node_id = &null_node_id;
+
+    return true;
+}
+
 /*******************************/
 /* Common Open62541 assemblers */
 /*******************************/
@@ -84,6 +381,12 @@ UA_NodeId assemble_node_id(const char *req, int *req_index)
     int term_type;
     UA_NodeId node_id = UA_NODEID_NULL;
 
+    const UA_NodeId *registered;
+    if(decode_node_handle(req, req_index, &registered)) {
+        UA_NodeId_copy(registered, &node_id);
+        return node_id;
+    }
+
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
         term_size != 3)
         errx(EXIT_FAILURE, "assemble_node_id requires a 3-tuple, term_size = %d", term_size);
@@ -187,6 +490,57 @@ UA_NodeId assemble_node_id(const char *req, int *req_index)
     return node_id;
 }
 
+/* 
+ *  Same as assemble_node_id, but string and bytestring identifiers point into the request (or the registered nodes
+ *  table) instead of being copied. The node id is only valid during the request and must not be cleared.
+ */
+UA_NodeId assemble_node_id_ref(const char *req, int *req_index)
+{
+    enum node_type{Numeric, String, GUID, ByteString}; 
+
+    int term_size;
+    int term_type;
+    int start_index = *req_index;
+    UA_NodeId node_id = UA_NODEID_NULL;
+
+    // Registered nodes are also borrowed from their table.
+    const UA_NodeId *registered;
+    if(decode_node_handle(req, req_index, &registered))
+        return *registered;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, "assemble_node_id_ref requires a 3-tuple, term_size = %d", term_size);
+
+    unsigned long node_type;
+    if (ei_decode_ulong(req, req_index, &node_type) < 0)
+        errx(EXIT_FAILURE, "Invalid node_type");
+
+    unsigned long ns_index;
+    if (ei_decode_ulong(req, req_index, &ns_index) < 0)
+        errx(EXIT_FAILURE, "Invalid ns_index");
+
+    // Numeric and GUID identifiers are not allocated.
+    if(node_type != String && node_type != ByteString) {
+        *req_index = start_index;
+        return assemble_node_id(req, req_index);
+    }
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid bytestring (size)");
+
+    node_id.namespaceIndex = (UA_UInt16) ns_index;
+    node_id.identifierType = node_type == String ? UA_NODEIDTYPE_STRING : UA_NODEIDTYPE_BYTESTRING;
+    node_id.identifier.string.length = term_size;
+    // BINARY_EXT: tag (1 byte) and length (4 bytes) followed by the data.
+    node_id.identifier.string.data = (UA_Byte *) (req + *req_index + 5);
+
+    if (ei_skip_term(req, req_index) < 0)
+        errx(EXIT_FAILURE, "Invalid bytestring");
+
+    return node_id;
+}
+
 UA_ExpandedNodeId assemble_expanded_node_id(const char *req, int *req_index)
 {
     enum node_type{Numeric, String, GUID, ByteString}; 
@@ -195,6 +549,13 @@ UA_ExpandedNodeId assemble_expanded_node_id(const char *req, int *req_index)
     int term_type;
     UA_ExpandedNodeId node_id = UA_EXPANDEDNODEID_NULL;
 
+    // A registered node is local, without namespace uri nor server index.
+    const UA_NodeId *registered;
+    if(decode_node_handle(req, req_index, &registered)) {
+        UA_NodeId_copy(registered, &node_id.nodeId);
+        return node_id;
+    }
+
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
         term_size != 3)
         errx(EXIT_FAILURE, "assemble_node_id requires a 3-tuple, term_size = %d", term_size);
@@ -326,415 +687,765 @@ UA_QualifiedName assemble_qualified_name(const char *req, int *req_index)
     return UA_QUALIFIEDNAME(ns_index, node_qualified_name_str);
 }
 
-/***************************/
-/* Elixir Message encoders */
-/***************************/
-void encode_caller_metadata(char *req, int *req_index)
-{   
-    ei_encode_atom(req, req_index, caller_function);
-    
-    //Add untouched caller_metadata.
-    int caller_metadata_start_index = *req_index;
+UA_StatusCode assemble_string(const char *req, int *req_index, UA_String *string)
+{
+    int term_size;
+    int term_type;
 
-    for(int index = 0; index < caller_metadata_size; index ++)
-    {
-        req[*req_index] = caller_metadata_ptr[index];
-        *req_index = *req_index + 1;
-    }
-}
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        return UA_STATUSCODE_BADDECODINGERROR;
 
+    string->data = (UA_Byte *)malloc(term_size + 1);
+    long binary_len;
+    if (ei_decode_binary(req, req_index, string->data, &binary_len) < 0) {
+        free(string->data);
+        string->data = NULL;
+        return UA_STATUSCODE_BADDECODINGERROR;
+    }
 
-void encode_client_config(char *resp, int *resp_index, void *data)
-{
-    ei_encode_map_header(resp, resp_index, 3);
-    ei_encode_binary(resp, resp_index, "timeout", 7);
-    ei_encode_long(resp, resp_index,((UA_ClientConfig *)data)->timeout);
-    
-    ei_encode_binary(resp, resp_index, "secureChannelLifeTime", 21);
-    ei_encode_long(resp, resp_index,((UA_ClientConfig *)data)->secureChannelLifeTime);
-    
-    ei_encode_binary(resp, resp_index, "requestedSessionTimeout", 23);
-    ei_encode_long(resp, resp_index,((UA_ClientConfig *)data)->requestedSessionTimeout);
+    string->length = binary_len;
+    return UA_STATUSCODE_GOOD;
 }
 
-void encode_server_on_the_network_struct(char *resp, int *resp_index, void *data, int data_len)
+/*
+ *  Decodes an Elixir value of the `data_type` (UA_TYPES index) into a scalar variant that
+ *  owns its data, so it can be released with UA_Variant_clear.
+ */
+UA_StatusCode assemble_variant_scalar(const char *req, int *req_index, unsigned long data_type, UA_Variant *value)
 {
-    UA_ServerOnNetwork *serverOnNetwork = ((UA_ServerOnNetwork *)data);
-
-    ei_encode_list_header(resp, resp_index, data_len);
+    int term_size;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
 
-    for(size_t i = 0; i < data_len; i++) {
-        UA_ServerOnNetwork *server = &serverOnNetwork[i];
-        ei_encode_map_header(resp, resp_index, 4);
-        
-        ei_encode_binary(resp, resp_index, "server_name", 11);
-        ei_encode_binary(resp, resp_index, server->serverName.data, (int)server->serverName.length);
+    UA_Variant_init(value);
 
-        ei_encode_binary(resp, resp_index, "record_id", 9);
-        ei_encode_long(resp, resp_index, (int)server->recordId);
+    if(data_type >= UA_TYPES_COUNT)
+        return UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
 
-        ei_encode_binary(resp, resp_index, "discovery_url", 13);
-        ei_encode_binary(resp, resp_index, server->discoveryUrl.data, (int)server->discoveryUrl.length);
+    const UA_DataType *type = &UA_TYPES[data_type];
+    void *data = UA_new(type);
 
-        ei_encode_binary(resp, resp_index, "capabilities", 12);
+    switch (data_type)
+    {
+        case UA_TYPES_BOOLEAN:
+        {
+            int boolean_data;
+            if (ei_decode_boolean(req, req_index, &boolean_data) < 0)
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+            else
+                *(UA_Boolean *)data = boolean_data;
+        }
+        break;
 
-        ei_encode_list_header(resp, resp_index, server->serverCapabilitiesSize);
-        for(size_t j = 0; j < server->serverCapabilitiesSize; j++) {
-            ei_encode_binary(resp, resp_index, server->serverCapabilities[j].data, (int) server->serverCapabilities[j].length);
+        case UA_TYPES_SBYTE:
+        case UA_TYPES_INT16:
+        case UA_TYPES_INT32:
+        {
+            long long_data;
+            if (ei_decode_long(req, req_index, &long_data) < 0)
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+            else if (data_type == UA_TYPES_SBYTE)
+                *(UA_SByte *)data = long_data;
+            else if (data_type == UA_TYPES_INT16)
+                *(UA_Int16 *)data = long_data;
+            else
+                *(UA_Int32 *)data = long_data;
         }
-        if(server->serverCapabilitiesSize)
-            ei_encode_empty_list(resp, resp_index);
-    }
-    if(data_len)
-        ei_encode_empty_list(resp, resp_index);
-}
+        break;
 
-void encode_application_description_struct(char *resp, int *resp_index, void *data, int data_len)
-{
-    UA_ApplicationDescription *applicationDescriptionArray = ((UA_ApplicationDescription *)data);
+        case UA_TYPES_BYTE:
+        case UA_TYPES_UINT16:
+        case UA_TYPES_UINT32:
+        case UA_TYPES_STATUSCODE:
+        case UA_TYPES_UADPNETWORKMESSAGECONTENTMASK:
+        {
+            unsigned long ulong_data;
+            if (ei_decode_ulong(req, req_index, &ulong_data) < 0)
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+            else if (data_type == UA_TYPES_BYTE)
+                *(UA_Byte *)data = ulong_data;
+            else if (data_type == UA_TYPES_UINT16)
+                *(UA_UInt16 *)data = ulong_data;
+            else
+                *(UA_UInt32 *)data = ulong_data;
+        }
+        break;
 
-    ei_encode_list_header(resp, resp_index, data_len);
+        case UA_TYPES_INT64:
+        case UA_TYPES_DATETIME:
+        {
+            long long int64_data;
+            if (ei_decode_longlong(req, req_index, &int64_data) < 0)
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+            else
+                *(UA_Int64 *)data = int64_data;
+        }
+        break;
 
-    for(size_t i = 0; i < data_len; i++) {
-        UA_ApplicationDescription *description = &applicationDescriptionArray[i];
-        ei_encode_map_header(resp, resp_index, 6);
-        
-        ei_encode_binary(resp, resp_index, "server", 6);
-        ei_encode_binary(resp, resp_index, description->applicationUri.data, (int) description->applicationUri.length);
+        case UA_TYPES_UINT64:
+        {
+            unsigned long long uint64_data;
+            if (ei_decode_ulonglong(req, req_index, &uint64_data) < 0)
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+            else
+                *(UA_UInt64 *)data = uint64_data;
+        }
+        break;
 
-        ei_encode_binary(resp, resp_index, "name", 4);
-        ei_encode_binary(resp, resp_index, description->applicationName.text.data, (int) description->applicationName.text.length);
+        case UA_TYPES_FLOAT:
+        case UA_TYPES_DOUBLE:
+        {
+            double double_data;
+            if (ei_decode_double(req, req_index, &double_data) < 0)
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+            else if (data_type == UA_TYPES_FLOAT)
+                *(UA_Float *)data = (float) double_data;
+            else
+                *(UA_Double *)data = double_data;
+        }
+        break;
 
-        ei_encode_binary(resp, resp_index, "application_uri", 15);
-        ei_encode_binary(resp, resp_index, description->applicationUri.data, (int) description->applicationUri.length);
+        case UA_TYPES_STRING:
+        case UA_TYPES_BYTESTRING:
+        case UA_TYPES_XMLELEMENT:
+        case UA_TYPES_TIMESTRING:
+            retval = assemble_string(req, req_index, (UA_String *)data);
+        break;
 
-        ei_encode_binary(resp, resp_index, "product_uri", 11);
-        ei_encode_binary(resp, resp_index, description->productUri.data, (int) description->productUri.length);
+        case UA_TYPES_GUID:
+        {
+            int term_type;
+            UA_Guid *guid = (UA_Guid *)data;
+            unsigned long guid_data1, guid_data2, guid_data3;
+            long binary_len;
 
-        ei_encode_binary(resp, resp_index, "type", 4);
-        switch(description->applicationType) {
-            case UA_APPLICATIONTYPE_SERVER:
-                ei_encode_binary(resp, resp_index, "server", 6);
-                break;
-            case UA_APPLICATIONTYPE_CLIENT:
-                ei_encode_binary(resp, resp_index, "client", 6);
-                break;
-            case UA_APPLICATIONTYPE_CLIENTANDSERVER:
-                ei_encode_binary(resp, resp_index, "client_and_server", 17);
-                break;
-            case UA_APPLICATIONTYPE_DISCOVERYSERVER:
-                ei_encode_binary(resp, resp_index, "discovery_server", 16);
+            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 4 ||
+                ei_decode_ulong(req, req_index, &guid_data1) < 0 ||
+                ei_decode_ulong(req, req_index, &guid_data2) < 0 ||
+                ei_decode_ulong(req, req_index, &guid_data3) < 0 ||
+                ei_get_type(req, req_index, &term_type, &term_size) < 0 ||
+                term_type != ERL_BINARY_EXT ||
+                term_size > (int) sizeof(guid->data4) ||
+                ei_decode_binary(req, req_index, guid->data4, &binary_len) < 0)
+            {
+                retval = UA_STATUSCODE_BADDECODINGERROR;
                 break;
-            default:
-                ei_encode_binary(resp, resp_index, "unknown", 7);
-        }
+            }
 
-        ei_encode_binary(resp, resp_index, "discovery_url", 13);
-        ei_encode_list_header(resp, resp_index, description->discoveryUrlsSize);
-        for(size_t j = 0; j < description->discoveryUrlsSize; j++) {
-            ei_encode_binary(resp, resp_index, description->discoveryUrls[j].data, (int) description->discoveryUrls[j].length);
+            guid->data1 = guid_data1;
+            guid->data2 = guid_data2;
+            guid->data3 = guid_data3;
         }
-        if(description->discoveryUrlsSize)
-            ei_encode_empty_list(resp, resp_index);
-    }
-    if(data_len)
-        ei_encode_empty_list(resp, resp_index);
-}
-
-void encode_endpoint_description_struct(char *resp, int *resp_index, void *data, int data_len)
-{
-    UA_EndpointDescription *endpointArray = ((UA_EndpointDescription *)data);
+        break;
 
-    ei_encode_list_header(resp, resp_index, data_len);
+        case UA_TYPES_NODEID:
+            *(UA_NodeId *)data = assemble_node_id(req, req_index);
+        break;
 
-    for(size_t i = 0; i < data_len; i++) {
-        UA_EndpointDescription *endpoint = &endpointArray[i];
-        ei_encode_map_header(resp, resp_index, 5);
+        case UA_TYPES_EXPANDEDNODEID:
+            *(UA_ExpandedNodeId *)data = assemble_expanded_node_id(req, req_index);
+        break;
 
-        ei_encode_binary(resp, resp_index, "endpoint_url", 12);
-        ei_encode_binary(resp, resp_index, endpoint->endpointUrl.data, (int) endpoint->endpointUrl.length);
+        case UA_TYPES_QUALIFIEDNAME:
+            *(UA_QualifiedName *)data = assemble_qualified_name(req, req_index);
+        break;
 
-        ei_encode_binary(resp, resp_index, "transport_profile_uri", 21);
-        ei_encode_binary(resp, resp_index, endpoint->transportProfileUri.data, (int) endpoint->transportProfileUri.length);
+        case UA_TYPES_LOCALIZEDTEXT:
+        {
+            UA_LocalizedText *localized_text = (UA_LocalizedText *)data;
+            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 2 ||
+                assemble_string(req, req_index, &localized_text->locale) != UA_STATUSCODE_GOOD ||
+                assemble_string(req, req_index, &localized_text->text) != UA_STATUSCODE_GOOD)
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+        }
+        break;
 
-        ei_encode_binary(resp, resp_index, "security_mode", 13);
-        switch(endpoint->securityMode) {
-            case UA_APPLICATIONTYPE_SERVER:
-                ei_encode_binary(resp, resp_index, "invalid", 7);
+        case UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE:
+        {
+            UA_SemanticChangeStructureDataType *semantic_change = (UA_SemanticChangeStructureDataType *)data;
+            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 2) {
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+                break;
+            }
+            semantic_change->affected = assemble_node_id(req, req_index);
+            semantic_change->affectedType = assemble_node_id(req, req_index);
+        }
+        break;
+
+        case UA_TYPES_XVTYPE:
+        {
+            double float_data;
+            double double_data;
+            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 2 ||
+                ei_decode_double(req, req_index, &float_data) < 0 ||
+                ei_decode_double(req, req_index, &double_data) < 0)
+            {
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+                break;
+            }
+            ((UA_XVType *)data)->value = (float) float_data;
+            ((UA_XVType *)data)->x = double_data;
+        }
+        break;
+
+        case UA_TYPES_ELEMENTOPERAND:
+        {
+            unsigned long element_operand_data;
+            if (ei_decode_ulong(req, req_index, &element_operand_data) < 0)
+                retval = UA_STATUSCODE_BADDECODINGERROR;
+            else
+                ((UA_ElementOperand *)data)->index = element_operand_data;
+        }
+        break;
+
+        default:
+            retval = UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
+        break;
+    }
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_delete(data, type);
+        return retval;
+    }
+
+    UA_Variant_setScalar(value, data, type);
+    return retval;
+}
+
+/**
+ * @brief Numeric types (SByte ... Double and DateTime) have a contiguous memory layout that can be sent as a binary.
+ */
+bool data_type_is_packable(unsigned long data_type)
+{
+    switch(data_type)
+    {
+        case UA_TYPES_SBYTE:
+        case UA_TYPES_BYTE:
+        case UA_TYPES_INT16:
+        case UA_TYPES_UINT16:
+        case UA_TYPES_INT32:
+        case UA_TYPES_UINT32:
+        case UA_TYPES_INT64:
+        case UA_TYPES_UINT64:
+        case UA_TYPES_FLOAT:
+        case UA_TYPES_DOUBLE:
+        case UA_TYPES_DATETIME:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Lists of small integers are encoded as a string by term_to_binary.
+static UA_StatusCode assemble_small_integer_array(const char *req, int *req_index, const UA_DataType *type,
+                                                  void *data, int array_size)
+{
+    unsigned char *bytes = (unsigned char *) request_arena_alloc(array_size + 1);
+
+    if(type->typeIndex == UA_TYPES_FLOAT || type->typeIndex == UA_TYPES_DOUBLE ||
+        ei_decode_string(req, req_index, (char *) bytes) < 0)
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    for(int i = 0; i < array_size; i++)
+    {
+        void *element = (void *)((uintptr_t)data + i * type->memSize);
+
+        switch(type->typeIndex)
+        {
+            case UA_TYPES_SBYTE: *(UA_SByte *) element = bytes[i]; break;
+            case UA_TYPES_BYTE: *(UA_Byte *) element = bytes[i]; break;
+            case UA_TYPES_INT16: *(UA_Int16 *) element = bytes[i]; break;
+            case UA_TYPES_UINT16: *(UA_UInt16 *) element = bytes[i]; break;
+            case UA_TYPES_INT32: *(UA_Int32 *) element = bytes[i]; break;
+            case UA_TYPES_UINT32: *(UA_UInt32 *) element = bytes[i]; break;
+            default: *(UA_Int64 *) element = bytes[i]; break; // Int64, UInt64 and DateTime
+        }
+    }
+
+    return UA_STATUSCODE_GOOD;
+}
+
+/*
+ *  Decodes a whole array of the `data_type` (UA_TYPES index) into an array variant that owns its data. The array is
+ *  a list of Elixir values (as in assemble_variant_scalar) or, for numeric types, a binary of the packed elements
+ *  in the host byte order (see encode_packed_array).
+ */
+UA_StatusCode assemble_variant_array(const char *req, int *req_index, unsigned long data_type, UA_Variant *value)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    UA_Variant_init(value);
+
+    if(data_type >= UA_TYPES_COUNT)
+        return UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
+
+    const UA_DataType *type = &UA_TYPES[data_type];
+
+    if(ei_get_type(req, req_index, &term_type, &term_size) < 0)
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    if(term_type == ERL_BINARY_EXT)
+    {
+        long binary_len;
+
+        if(!data_type_is_packable(data_type) || term_size % type->memSize != 0)
+            return UA_STATUSCODE_BADTYPEMISMATCH;
+
+        size_t array_size = term_size / type->memSize;
+        void *data = UA_Array_new(array_size, type);
+        if(!data)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+
+        if(ei_decode_binary(req, req_index, array_size ? data : NULL, &binary_len) < 0) {
+            UA_Array_delete(data, array_size, type);
+            return UA_STATUSCODE_BADDECODINGERROR;
+        }
+
+        UA_Variant_setArray(value, data, array_size, type);
+        return UA_STATUSCODE_GOOD;
+    }
+
+    if(term_type != ERL_LIST_EXT && term_type != ERL_NIL_EXT && term_type != ERL_STRING_EXT)
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    void *data = UA_Array_new(term_size, type);
+    if(!data)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    if(term_type == ERL_STRING_EXT)
+        retval = data_type_is_packable(data_type) ?
+            assemble_small_integer_array(req, req_index, type, data, term_size) : UA_STATUSCODE_BADTYPEMISMATCH;
+    else if(ei_decode_list_header(req, req_index, &term_size) < 0)
+        retval = UA_STATUSCODE_BADDECODINGERROR;
+
+    for(int i = 0; term_type != ERL_STRING_EXT && retval == UA_STATUSCODE_GOOD && i < term_size; i++)
+    {
+        UA_Variant element;
+        retval = assemble_variant_scalar(req, req_index, data_type, &element);
+        if(retval != UA_STATUSCODE_GOOD)
+            break;
+
+        // Move the element members into the array, only the scalar container is released.
+        memcpy((void *)((uintptr_t)data + i * type->memSize), element.data, type->memSize);
+        UA_free(element.data);
+    }
+
+    if(retval == UA_STATUSCODE_GOOD && term_type == ERL_LIST_EXT && ei_skip_term(req, req_index) < 0)
+        retval = UA_STATUSCODE_BADDECODINGERROR;
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_Array_delete(data, term_size, type);
+        return retval;
+    }
+
+    UA_Variant_setArray(value, data, term_size, type);
+    return retval;
+}
+
+/***************************/
+/* Elixir Message encoders */
+/***************************/
+void encode_caller_metadata(ei_x_buff *resp)
+{   
+    ei_x_encode_atom(resp, caller_function);
+    
+    //Add untouched caller_metadata.
+    ei_x_append_buf(resp, caller_metadata_ptr, caller_metadata_size);
+}
+
+void encode_client_config(ei_x_buff *resp, void *data)
+{
+    ei_x_encode_map_header(resp, 3);
+    ei_x_encode_binary(resp, "timeout", 7);
+    ei_x_encode_long(resp,((UA_ClientConfig *)data)->timeout);
+    
+    ei_x_encode_binary(resp, "secureChannelLifeTime", 21);
+    ei_x_encode_long(resp,((UA_ClientConfig *)data)->secureChannelLifeTime);
+    
+    ei_x_encode_binary(resp, "requestedSessionTimeout", 23);
+    ei_x_encode_long(resp,((UA_ClientConfig *)data)->requestedSessionTimeout);
+}
+
+void encode_server_on_the_network_struct(ei_x_buff *resp, void *data, int data_len)
+{
+    UA_ServerOnNetwork *serverOnNetwork = ((UA_ServerOnNetwork *)data);
+
+    ei_x_encode_list_header(resp, data_len);
+
+    for(size_t i = 0; i < data_len; i++) {
+        UA_ServerOnNetwork *server = &serverOnNetwork[i];
+        ei_x_encode_map_header(resp, 4);
+        
+        ei_x_encode_binary(resp, "server_name", 11);
+        ei_x_encode_binary(resp, server->serverName.data, (int)server->serverName.length);
+
+        ei_x_encode_binary(resp, "record_id", 9);
+        ei_x_encode_long(resp, (int)server->recordId);
+
+        ei_x_encode_binary(resp, "discovery_url", 13);
+        ei_x_encode_binary(resp, server->discoveryUrl.data, (int)server->discoveryUrl.length);
+
+        ei_x_encode_binary(resp, "capabilities", 12);
+
+        ei_x_encode_list_header(resp, server->serverCapabilitiesSize);
+        for(size_t j = 0; j < server->serverCapabilitiesSize; j++) {
+            ei_x_encode_binary(resp, server->serverCapabilities[j].data, (int) server->serverCapabilities[j].length);
+        }
+        if(server->serverCapabilitiesSize)
+            ei_x_encode_empty_list(resp);
+    }
+    if(data_len)
+        ei_x_encode_empty_list(resp);
+}
+
+void encode_application_description_struct(ei_x_buff *resp, void *data, int data_len)
+{
+    UA_ApplicationDescription *applicationDescriptionArray = ((UA_ApplicationDescription *)data);
+
+    ei_x_encode_list_header(resp, data_len);
+
+    for(size_t i = 0; i < data_len; i++) {
+        UA_ApplicationDescription *description = &applicationDescriptionArray[i];
+        ei_x_encode_map_header(resp, 6);
+        
+        ei_x_encode_binary(resp, "server", 6);
+        ei_x_encode_binary(resp, description->applicationUri.data, (int) description->applicationUri.length);
+
+        ei_x_encode_binary(resp, "name", 4);
+        ei_x_encode_binary(resp, description->applicationName.text.data, (int) description->applicationName.text.length);
+
+        ei_x_encode_binary(resp, "application_uri", 15);
+        ei_x_encode_binary(resp, description->applicationUri.data, (int) description->applicationUri.length);
+
+        ei_x_encode_binary(resp, "product_uri", 11);
+        ei_x_encode_binary(resp, description->productUri.data, (int) description->productUri.length);
+
+        ei_x_encode_binary(resp, "type", 4);
+        switch(description->applicationType) {
+            case UA_APPLICATIONTYPE_SERVER:
+                ei_x_encode_binary(resp, "server", 6);
+                break;
+            case UA_APPLICATIONTYPE_CLIENT:
+                ei_x_encode_binary(resp, "client", 6);
+                break;
+            case UA_APPLICATIONTYPE_CLIENTANDSERVER:
+                ei_x_encode_binary(resp, "client_and_server", 17);
+                break;
+            case UA_APPLICATIONTYPE_DISCOVERYSERVER:
+                ei_x_encode_binary(resp, "discovery_server", 16);
+                break;
+            default:
+                ei_x_encode_binary(resp, "unknown", 7);
+        }
+
+        ei_x_encode_binary(resp, "discovery_url", 13);
+        ei_x_encode_list_header(resp, description->discoveryUrlsSize);
+        for(size_t j = 0; j < description->discoveryUrlsSize; j++) {
+            ei_x_encode_binary(resp, description->discoveryUrls[j].data, (int) description->discoveryUrls[j].length);
+        }
+        if(description->discoveryUrlsSize)
+            ei_x_encode_empty_list(resp);
+    }
+    if(data_len)
+        ei_x_encode_empty_list(resp);
+}
+
+void encode_endpoint_description_struct(ei_x_buff *resp, void *data, int data_len)
+{
+    UA_EndpointDescription *endpointArray = ((UA_EndpointDescription *)data);
+
+    ei_x_encode_list_header(resp, data_len);
+
+    for(size_t i = 0; i < data_len; i++) {
+        UA_EndpointDescription *endpoint = &endpointArray[i];
+        ei_x_encode_map_header(resp, 5);
+
+        ei_x_encode_binary(resp, "endpoint_url", 12);
+        ei_x_encode_binary(resp, endpoint->endpointUrl.data, (int) endpoint->endpointUrl.length);
+
+        ei_x_encode_binary(resp, "transport_profile_uri", 21);
+        ei_x_encode_binary(resp, endpoint->transportProfileUri.data, (int) endpoint->transportProfileUri.length);
+
+        ei_x_encode_binary(resp, "security_mode", 13);
+        switch(endpoint->securityMode) {
+            case UA_APPLICATIONTYPE_SERVER:
+                ei_x_encode_binary(resp, "invalid", 7);
                 break;
             case UA_APPLICATIONTYPE_CLIENT:
-                ei_encode_binary(resp, resp_index, "none", 4);
+                ei_x_encode_binary(resp, "none", 4);
                 break;
             case UA_APPLICATIONTYPE_CLIENTANDSERVER:
-                ei_encode_binary(resp, resp_index, "sign", 4);
+                ei_x_encode_binary(resp, "sign", 4);
                 break;
             case UA_APPLICATIONTYPE_DISCOVERYSERVER:
-                ei_encode_binary(resp, resp_index, "sign_and_encrypt", 16);
+                ei_x_encode_binary(resp, "sign_and_encrypt", 16);
                 break;
             default:
-                ei_encode_binary(resp, resp_index, "unknown", 7);
+                ei_x_encode_binary(resp, "unknown", 7);
         }
 
-        ei_encode_binary(resp, resp_index, "security_profile_uri", 20);
-        ei_encode_binary(resp, resp_index, endpoint->securityPolicyUri.data, (int) endpoint->securityPolicyUri.length);
+        ei_x_encode_binary(resp, "security_profile_uri", 20);
+        ei_x_encode_binary(resp, endpoint->securityPolicyUri.data, (int) endpoint->securityPolicyUri.length);
 
-        ei_encode_binary(resp, resp_index, "security_level", 14);
-        ei_encode_long(resp, resp_index, endpoint->securityLevel);
+        ei_x_encode_binary(resp, "security_level", 14);
+        ei_x_encode_long(resp, endpoint->securityLevel);
     }
     if(data_len)
-        ei_encode_empty_list(resp, resp_index);
+        ei_x_encode_empty_list(resp);
 }
 
-void encode_server_config(char *resp, int *resp_index, void *data)
+void encode_server_config(ei_x_buff *resp, void *data)
 {   
-    ei_encode_map_header(resp, resp_index, 4);
-    ei_encode_binary(resp, resp_index, "n_threads", 9);
-    ei_encode_long(resp, resp_index,((UA_ServerConfig *)data)->nThreads);
-    ei_encode_binary(resp, resp_index, "hostname", 8);
+    ei_x_encode_map_header(resp, 4);
+    ei_x_encode_binary(resp, "n_threads", 9);
+    ei_x_encode_long(resp,((UA_ServerConfig *)data)->nThreads);
+    ei_x_encode_binary(resp, "hostname", 8);
     if (((UA_ServerConfig *)data)->customHostname.length)
-        ei_encode_binary(resp, resp_index,((UA_ServerConfig *)data)->customHostname.data, ((UA_ServerConfig *)data)->customHostname.length);
+        ei_x_encode_binary(resp,((UA_ServerConfig *)data)->customHostname.data, ((UA_ServerConfig *)data)->customHostname.length);
     else
-        ei_encode_binary(resp, resp_index, "localhost", 9);
+        ei_x_encode_binary(resp, "localhost", 9);
     
-    ei_encode_binary(resp, resp_index, "endpoint_description", 20);
-    encode_endpoint_description_struct(resp, resp_index, ((UA_ServerConfig *)data)->endpoints, ((UA_ServerConfig *)data)->endpointsSize);
+    ei_x_encode_binary(resp, "endpoint_description", 20);
+    encode_endpoint_description_struct(resp, ((UA_ServerConfig *)data)->endpoints, ((UA_ServerConfig *)data)->endpointsSize);
 
-    ei_encode_binary(resp, resp_index, "application_description", 23);
-    encode_application_description_struct(resp, resp_index, &((UA_ServerConfig *)data)->applicationDescription, 1);
+    ei_x_encode_binary(resp, "application_description", 23);
+    encode_application_description_struct(resp, &((UA_ServerConfig *)data)->applicationDescription, 1);
 }
 
 //{ns_index, node_id_type, identifier}
-void encode_node_id(char *resp, int *resp_index, void *data)
+void encode_node_id(ei_x_buff *resp, void *data)
 {   
     enum node_type{Numeric, String = 3, GUID, ByteString};
-    ei_encode_tuple_header(resp, resp_index, 3);
+    ei_x_encode_tuple_header(resp, 3);
     //Namespace Index
-    ei_encode_ulong(resp, resp_index,((UA_NodeId *)data)->namespaceIndex);
+    ei_x_encode_ulong(resp,((UA_NodeId *)data)->namespaceIndex);
     //encode NodeID type (Opex)
     switch(((UA_NodeId *)data)->identifierType)
     {
         case Numeric:
         case 1:
         case 2: 
-            ei_encode_binary(resp, resp_index, "integer", 7);
-            ei_encode_ulong(resp, resp_index,((UA_NodeId *)data)->identifier.numeric);
+            ei_x_encode_binary(resp, "integer", 7);
+            ei_x_encode_ulong(resp,((UA_NodeId *)data)->identifier.numeric);
         break;
 
         case String: 
-            ei_encode_binary(resp, resp_index, "string", 6);
-            ei_encode_binary(resp, resp_index,((UA_NodeId *)data)->identifier.string.data, ((UA_NodeId *)data)->identifier.string.length);
+            ei_x_encode_binary(resp, "string", 6);
+            ei_x_encode_binary(resp,((UA_NodeId *)data)->identifier.string.data, ((UA_NodeId *)data)->identifier.string.length);
         break;
 
         case GUID:
-            ei_encode_binary(resp, resp_index, "guid", 4);
-            ei_encode_tuple_header(resp, resp_index, 4);
-            ei_encode_ulong(resp, resp_index,((UA_NodeId *)data)->identifier.guid.data1); 
-            ei_encode_ulong(resp, resp_index,((UA_NodeId *)data)->identifier.guid.data2); 
-            ei_encode_ulong(resp, resp_index,((UA_NodeId *)data)->identifier.guid.data3);
-            ei_encode_binary(resp, resp_index, ((UA_NodeId *)data)->identifier.guid.data4, 8);
+            ei_x_encode_binary(resp, "guid", 4);
+            ei_x_encode_tuple_header(resp, 4);
+            ei_x_encode_ulong(resp,((UA_NodeId *)data)->identifier.guid.data1); 
+            ei_x_encode_ulong(resp,((UA_NodeId *)data)->identifier.guid.data2); 
+            ei_x_encode_ulong(resp,((UA_NodeId *)data)->identifier.guid.data3);
+            ei_x_encode_binary(resp, ((UA_NodeId *)data)->identifier.guid.data4, 8);
         break;
 
         case ByteString:
-            ei_encode_binary(resp, resp_index, "bytestring", 10);
-            ei_encode_binary(resp, resp_index,((UA_NodeId *)data)->identifier.byteString.data, ((UA_NodeId *)data)->identifier.byteString.length);
+            ei_x_encode_binary(resp, "bytestring", 10);
+            ei_x_encode_binary(resp,((UA_NodeId *)data)->identifier.byteString.data, ((UA_NodeId *)data)->identifier.byteString.length);
         break;
     }
 }
 
 //{ns_index, identifier}
-void encode_qualified_name(char *resp, int *resp_index, void *data)
+void encode_qualified_name(ei_x_buff *resp, void *data)
 {   
-    ei_encode_tuple_header(resp, resp_index, 2);
-    ei_encode_ulong(resp, resp_index,((UA_QualifiedName *)data)->namespaceIndex);
-    ei_encode_binary(resp, resp_index,((UA_QualifiedName *)data)->name.data, ((UA_QualifiedName *)data)->name.length); 
+    ei_x_encode_tuple_header(resp, 2);
+    ei_x_encode_ulong(resp,((UA_QualifiedName *)data)->namespaceIndex);
+    ei_x_encode_binary(resp,((UA_QualifiedName *)data)->name.data, ((UA_QualifiedName *)data)->name.length); 
 }
 
 //{locale, text}
-void encode_localized_text(char *resp, int *resp_index, void *data)
+void encode_localized_text(ei_x_buff *resp, void *data)
 {   
-    ei_encode_tuple_header(resp, resp_index, 2);
-    ei_encode_binary(resp, resp_index,((UA_LocalizedText *)data)->locale.data, ((UA_LocalizedText *)data)->locale.length);
-    ei_encode_binary(resp, resp_index,((UA_LocalizedText *)data)->text.data, ((UA_LocalizedText *)data)->text.length); 
+    ei_x_encode_tuple_header(resp, 2);
+    ei_x_encode_binary(resp,((UA_LocalizedText *)data)->locale.data, ((UA_LocalizedText *)data)->locale.length);
+    ei_x_encode_binary(resp,((UA_LocalizedText *)data)->text.data, ((UA_LocalizedText *)data)->text.length); 
 }
 
-void encode_ua_float(char *resp, int *resp_index, void *data)
+void encode_ua_float(ei_x_buff *resp, void *data)
 {   
     float value = *(float *) data;
-    ei_encode_double(resp, resp_index, (double) value);
+    ei_x_encode_double(resp, (double) value);
 }
 
-void encode_ua_guid(char *resp, int *resp_index, void *data)
+void encode_ua_guid(ei_x_buff *resp, void *data)
 {   
-    ei_encode_tuple_header(resp, resp_index, 4);
-    ei_encode_ulong(resp, resp_index,((UA_Guid *)data)->data1); 
-    ei_encode_ulong(resp, resp_index,((UA_Guid *)data)->data2); 
-    ei_encode_ulong(resp, resp_index,((UA_Guid *)data)->data3);
-    ei_encode_binary(resp, resp_index, ((UA_Guid *)data)->data4, 8);
+    ei_x_encode_tuple_header(resp, 4);
+    ei_x_encode_ulong(resp,((UA_Guid *)data)->data1); 
+    ei_x_encode_ulong(resp,((UA_Guid *)data)->data2); 
+    ei_x_encode_ulong(resp,((UA_Guid *)data)->data3);
+    ei_x_encode_binary(resp, ((UA_Guid *)data)->data4, 8);
 }
 
 //{ns_index, node_id_type, identifier, namespaceuri, serverIndex}
-void encode_expanded_node_id(char *resp, int *resp_index, void *data)
+void encode_expanded_node_id(ei_x_buff *resp, void *data)
 {   
     enum node_type{Numeric, String = 3, GUID, ByteString};
-    ei_encode_tuple_header(resp, resp_index, 5);
+    ei_x_encode_tuple_header(resp, 5);
     //Namespace Index
-    ei_encode_ulong(resp, resp_index,((UA_ExpandedNodeId *)data)->nodeId.namespaceIndex);
+    ei_x_encode_ulong(resp,((UA_ExpandedNodeId *)data)->nodeId.namespaceIndex);
     //encode NodeID type (Opex)
     switch(((UA_ExpandedNodeId *)data)->nodeId.identifierType)
     {
         case Numeric:
         case 1:
         case 2: 
-            ei_encode_binary(resp, resp_index, "integer", 7);
-            ei_encode_ulong(resp, resp_index,((UA_ExpandedNodeId *)data)->nodeId.identifier.numeric);
+            ei_x_encode_binary(resp, "integer", 7);
+            ei_x_encode_ulong(resp,((UA_ExpandedNodeId *)data)->nodeId.identifier.numeric);
         break;
 
         case String: 
-            ei_encode_binary(resp, resp_index, "string", 6);
-            ei_encode_binary(resp, resp_index,((UA_ExpandedNodeId *)data)->nodeId.identifier.string.data, ((UA_ExpandedNodeId *)data)->nodeId.identifier.string.length);
+            ei_x_encode_binary(resp, "string", 6);
+            ei_x_encode_binary(resp,((UA_ExpandedNodeId *)data)->nodeId.identifier.string.data, ((UA_ExpandedNodeId *)data)->nodeId.identifier.string.length);
         break;
 
         case GUID:
-            ei_encode_binary(resp, resp_index, "guid", 4);
-            ei_encode_tuple_header(resp, resp_index, 4);
-            ei_encode_ulong(resp, resp_index,((UA_ExpandedNodeId *)data)->nodeId.identifier.guid.data1); 
-            ei_encode_ulong(resp, resp_index,((UA_ExpandedNodeId *)data)->nodeId.identifier.guid.data2); 
-            ei_encode_ulong(resp, resp_index,((UA_ExpandedNodeId *)data)->nodeId.identifier.guid.data3);
-            ei_encode_binary(resp, resp_index, ((UA_ExpandedNodeId *)data)->nodeId.identifier.guid.data4, 8);
+            ei_x_encode_binary(resp, "guid", 4);
+            ei_x_encode_tuple_header(resp, 4);
+            ei_x_encode_ulong(resp,((UA_ExpandedNodeId *)data)->nodeId.identifier.guid.data1); 
+            ei_x_encode_ulong(resp,((UA_ExpandedNodeId *)data)->nodeId.identifier.guid.data2); 
+            ei_x_encode_ulong(resp,((UA_ExpandedNodeId *)data)->nodeId.identifier.guid.data3);
+            ei_x_encode_binary(resp, ((UA_ExpandedNodeId *)data)->nodeId.identifier.guid.data4, 8);
         break;
 
         case ByteString:
-            ei_encode_binary(resp, resp_index, "bytestring", 10);
-            ei_encode_binary(resp, resp_index,((UA_ExpandedNodeId *)data)->nodeId.identifier.byteString.data, ((UA_ExpandedNodeId *)data)->nodeId.identifier.byteString.length);
+            ei_x_encode_binary(resp, "bytestring", 10);
+            ei_x_encode_binary(resp,((UA_ExpandedNodeId *)data)->nodeId.identifier.byteString.data, ((UA_ExpandedNodeId *)data)->nodeId.identifier.byteString.length);
         break;
     }
 
-    ei_encode_binary(resp, resp_index,((UA_ExpandedNodeId *)data)->namespaceUri.data, ((UA_ExpandedNodeId *)data)->namespaceUri.length);
-    ei_encode_ulong(resp, resp_index,((UA_ExpandedNodeId *)data)->serverIndex);
+    ei_x_encode_binary(resp,((UA_ExpandedNodeId *)data)->namespaceUri.data, ((UA_ExpandedNodeId *)data)->namespaceUri.length);
+    ei_x_encode_ulong(resp,((UA_ExpandedNodeId *)data)->serverIndex);
 }
 
-void encode_status_code(char *resp, int *resp_index, void *data)
+void encode_status_code(ei_x_buff *resp, void *data)
 {   
     const char *status_code = UA_StatusCode_name(*(UA_StatusCode *)data);
-    ei_encode_binary(resp, resp_index, status_code, strlen(status_code));
+    ei_x_encode_binary(resp, status_code, strlen(status_code));
 }
 
 //{affected, affectedType}
 //{{ns_index, node_id_type, identifier}, {ns_index, node_id_type, identifier}}
-void encode_semantic_change_structure_data_type(char *resp, int *resp_index, void *data)
+void encode_semantic_change_structure_data_type(ei_x_buff *resp, void *data)
 {   
-    ei_encode_tuple_header(resp, resp_index, 2);
-    encode_node_id(resp, resp_index, &(((UA_SemanticChangeStructureDataType *)data)->affected));
-    encode_node_id(resp, resp_index, &(((UA_SemanticChangeStructureDataType *)data)->affectedType));
+    ei_x_encode_tuple_header(resp, 2);
+    encode_node_id(resp, &(((UA_SemanticChangeStructureDataType *)data)->affected));
+    encode_node_id(resp, &(((UA_SemanticChangeStructureDataType *)data)->affectedType));
 }
 
 //{value, x}
-void encode_xv_type(char *resp, int *resp_index, void *data)
+void encode_xv_type(ei_x_buff *resp, void *data)
 {   
     float value = ((UA_XVType *)data)->value;
-    ei_encode_tuple_header(resp, resp_index, 2);
-    ei_encode_double(resp, resp_index, (double) value);    
-    ei_encode_double(resp, resp_index, ((UA_XVType *)data)->x);
+    ei_x_encode_tuple_header(resp, 2);
+    ei_x_encode_double(resp, (double) value);    
+    ei_x_encode_double(resp, ((UA_XVType *)data)->x);
 }
 
-void encode_array_dimensions_struct(char *resp, int *resp_index, void *data, int data_len)
+void encode_array_dimensions_struct(ei_x_buff *resp, void *data, int data_len)
 {
-    ei_encode_list_header(resp, resp_index, data_len);
+    ei_x_encode_list_header(resp, data_len);
 
     for(size_t i = 0; i < data_len; i++) {
-        ei_encode_ulong(resp, resp_index, *((UA_UInt32 *) data + i));
+        ei_x_encode_ulong(resp, *((UA_UInt32 *) data + i));
     }
     if(data_len)
-        ei_encode_empty_list(resp, resp_index);
+        ei_x_encode_empty_list(resp);
 }
 
-void encode_variant_scalar_struct(char *resp, int *resp_index, void *data, size_t index)
+void encode_variant_scalar_struct(ei_x_buff *resp, void *data, size_t index)
 {
     UA_Variant value = *(UA_Variant *) data;
     switch (value.type->typeIndex)
     {
         case UA_TYPES_BOOLEAN:
-            ei_encode_boolean(resp, resp_index, *((UA_Boolean *)value.data + index));
+            ei_x_encode_boolean(resp, *((UA_Boolean *)value.data + index));
         break;
 
         case UA_TYPES_SBYTE:
-            ei_encode_long(resp, resp_index, *((UA_SByte *)value.data + index));
+            ei_x_encode_long(resp, *((UA_SByte *)value.data + index));
         break;
 
         case UA_TYPES_BYTE:
-            ei_encode_ulong(resp, resp_index, *((UA_Byte *)value.data + index));
+            ei_x_encode_ulong(resp, *((UA_Byte *)value.data + index));
         break;
 
         case UA_TYPES_INT16:
-            ei_encode_long(resp, resp_index, *((UA_Int16 *)value.data + index));
+            ei_x_encode_long(resp, *((UA_Int16 *)value.data + index));
         break;
         
         case UA_TYPES_UINT16:
-            ei_encode_ulong(resp, resp_index, *((UA_UInt16 *)value.data + index));
+            ei_x_encode_ulong(resp, *((UA_UInt16 *)value.data + index));
         break;
 
         case UA_TYPES_INT32:
-            ei_encode_long(resp, resp_index, *((UA_Int32 *)value.data + index));
+            ei_x_encode_long(resp, *((UA_Int32 *)value.data + index));
         break;
 
         case UA_TYPES_UINT32:
-            ei_encode_ulong(resp, resp_index, *((UA_UInt32 *)value.data + index));
+            ei_x_encode_ulong(resp, *((UA_UInt32 *)value.data + index));
         break;
 
         case UA_TYPES_INT64:
-            ei_encode_longlong(resp, resp_index, *((UA_Int64 *)value.data + index));
+            ei_x_encode_longlong(resp, *((UA_Int64 *)value.data + index));
         break;
 
         case UA_TYPES_UINT64:
-            ei_encode_ulonglong(resp, resp_index, *((UA_UInt64 *)value.data + index));
+            ei_x_encode_ulonglong(resp, *((UA_UInt64 *)value.data + index));
         break;
 
         case UA_TYPES_FLOAT:
-            encode_ua_float(resp, resp_index, ((UA_Float *)value.data + index));
+            encode_ua_float(resp, ((UA_Float *)value.data + index));
         break;
 
         case UA_TYPES_DOUBLE:
-            ei_encode_double(resp, resp_index, *((UA_Double *)value.data + index));
+            ei_x_encode_double(resp, *((UA_Double *)value.data + index));
         break;
 
         case UA_TYPES_STRING:
-            ei_encode_binary(resp, resp_index, (*((UA_String *)value.data + index)).data, (*((UA_String *)value.data + index)).length);
+            ei_x_encode_binary(resp, (*((UA_String *)value.data + index)).data, (*((UA_String *)value.data + index)).length);
         break;
 
         case UA_TYPES_DATETIME:
-            ei_encode_ulonglong(resp, resp_index, *((UA_DateTime *)value.data + index));
+            ei_x_encode_ulonglong(resp, *((UA_DateTime *)value.data + index));
         break;
 
         case UA_TYPES_GUID:
-            encode_ua_guid(resp, resp_index, ((UA_Guid *)value.data + index));
+            encode_ua_guid(resp, ((UA_Guid *)value.data + index));
         break;
 
         case UA_TYPES_BYTESTRING:
-            ei_encode_binary(resp, resp_index, (*((UA_ByteString *)value.data + index)).data, (*((UA_ByteString *)value.data + index)).length);
+            ei_x_encode_binary(resp, (*((UA_ByteString *)value.data + index)).data, (*((UA_ByteString *)value.data + index)).length);
         break;
 
         case UA_TYPES_XMLELEMENT:
-            ei_encode_binary(resp, resp_index, (*((UA_XmlElement *)value.data + index)).data, (*((UA_XmlElement *)value.data + index)).length);
+            ei_x_encode_binary(resp, (*((UA_XmlElement *)value.data + index)).data, (*((UA_XmlElement *)value.data + index)).length);
         break;
 
         case UA_TYPES_NODEID:
-            encode_node_id(resp, resp_index, ((UA_NodeId *)value.data + index));
+            encode_node_id(resp, ((UA_NodeId *)value.data + index));
         break;
 
         case UA_TYPES_EXPANDEDNODEID:
-            encode_expanded_node_id(resp, resp_index, ((UA_ExpandedNodeId *)value.data + index));
+            encode_expanded_node_id(resp, ((UA_ExpandedNodeId *)value.data + index));
         break;
 
         case UA_TYPES_STATUSCODE:
-            encode_status_code(resp, resp_index, ((UA_StatusCode *)value.data + index));
+            encode_status_code(resp, ((UA_StatusCode *)value.data + index));
         break;
 
         case UA_TYPES_QUALIFIEDNAME:
-            encode_qualified_name(resp, resp_index, ((UA_QualifiedName *)value.data + index));
+            encode_qualified_name(resp, ((UA_QualifiedName *)value.data + index));
         break;
 
         case UA_TYPES_LOCALIZEDTEXT:
-            encode_localized_text(resp, resp_index, ((UA_LocalizedText *)value.data + index));
+            encode_localized_text(resp, ((UA_LocalizedText *)value.data + index));
         break;
 
         // // TODO: UA_TYPES_EXTENSIONOBJECT
@@ -746,1114 +1457,1915 @@ void encode_variant_scalar_struct(char *resp, int *resp_index, void *data, size_
         // // TODO: UA_TYPES_DIAGNOSTICINFO
 
         case UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE:
-            encode_semantic_change_structure_data_type(resp, resp_index, ((UA_SemanticChangeStructureDataType *)value.data + index));
+            encode_semantic_change_structure_data_type(resp, ((UA_SemanticChangeStructureDataType *)value.data + index));
         break;
 
         case UA_TYPES_TIMESTRING:
-            ei_encode_binary(resp, resp_index, (*((UA_TimeString *)value.data + index)).data, (*((UA_TimeString *)value.data + index)).length);
+            ei_x_encode_binary(resp, (*((UA_TimeString *)value.data + index)).data, (*((UA_TimeString *)value.data + index)).length);
         break;
 
         // // TODO: UA_TYPES_VIEWATTRIBUTES
 
         case UA_TYPES_UADPNETWORKMESSAGECONTENTMASK:
-            ei_encode_ulong(resp, resp_index, *((UA_UadpDataSetMessageContentMask *)value.data + index));
+            ei_x_encode_ulong(resp, *((UA_UadpDataSetMessageContentMask *)value.data + index));
         break;
 
         case UA_TYPES_XVTYPE:
-            encode_xv_type(resp, resp_index, ((UA_XVType *)value.data + index));
+            encode_xv_type(resp, ((UA_XVType *)value.data + index));
         break;
 
         case UA_TYPES_ELEMENTOPERAND:
-            ei_encode_long(resp, resp_index, (*((UA_ElementOperand *)value.data + index)).index);
+            ei_x_encode_long(resp, (*((UA_ElementOperand *)value.data + index)).index);
         break;
     
         default:
-            ei_encode_atom(resp, resp_index, "error");
+            ei_x_encode_atom(resp, "error");
         break;
     }
 }
 
-void encode_variant_array_struct(char *resp, int *resp_index, void *data)
+void encode_variant_array_struct(ei_x_buff *resp, void *data)
 {
     UA_Variant value = *(UA_Variant *) data;
 
-    ei_encode_list_header(resp, resp_index, value.arrayLength);
+    ei_x_encode_list_header(resp, value.arrayLength);
 
     for(size_t i = 0; i < value.arrayLength; i++)
     {
-        encode_variant_scalar_struct(resp, resp_index, data, i);
+        encode_variant_scalar_struct(resp, data, i);
     }
 
     if(value.arrayLength)
-        ei_encode_empty_list(resp, resp_index);
+        ei_x_encode_empty_list(resp);
 }
 
 
-void encode_variant_struct(char *resp, int *resp_index, void *data)
+void encode_variant_struct(ei_x_buff *resp, void *data)
 {
     if(UA_Variant_isEmpty((UA_Variant *)data))
     {
-        ei_encode_atom(resp, resp_index, "nil");
+        ei_x_encode_atom(resp, "nil");
         return;
     }
 
     if(UA_Variant_isScalar((UA_Variant *)data))
     {
-        encode_variant_scalar_struct(resp, resp_index, data, 0);
+        encode_variant_scalar_struct(resp, data, 0);
         return;
     }
 
-    encode_variant_array_struct(resp, resp_index, data);
+    encode_variant_array_struct(resp, data);
+}
+
+/**
+ * @brief Numeric arrays can be sent as a single binary of their contiguous memory.
+ */
+bool variant_is_packable(const UA_Variant *value)
+{
+    return value->type && !UA_Variant_isScalar(value) && value->type == &UA_TYPES[value->type->typeIndex] &&
+        data_type_is_packable(value->type->typeIndex);
+}
+
+//{:packed_array, data_type, {dimensions}, binary}, the binary keeps the host byte order.
+static void encode_packed_array(ei_x_buff *resp, void *data)
+{
+    UA_Variant *value = (UA_Variant *) data;
+
+    ei_x_encode_tuple_header(resp, 4);
+    ei_x_encode_atom(resp, "packed_array");
+    ei_x_encode_ulong(resp, value->type->typeIndex);
+
+    if(value->arrayDimensionsSize == 0) {
+        ei_x_encode_tuple_header(resp, 1);
+        ei_x_encode_ulong(resp, value->arrayLength);
+    }
+    else {
+        ei_x_encode_tuple_header(resp, value->arrayDimensionsSize);
+        for(size_t i = 0; i < value->arrayDimensionsSize; i++)
+            ei_x_encode_ulong(resp, value->arrayDimensions[i]);
+    }
+
+    ei_x_encode_binary(resp, value->arrayLength ? value->data : "", value->arrayLength * value->type->memSize);
+}
+
+//{value, source_timestamp | nil, server_timestamp | nil, cached?}, data_len is 1 when it comes from the client cache.
+static void encode_timestamped_value(ei_x_buff *resp, void *data, int data_len)
+{
+    UA_DataValue *value = (UA_DataValue *) data;
+
+    ei_x_encode_tuple_header(resp, 4);
+    encode_variant_struct(resp, &value->value);
+
+    if(value->hasSourceTimestamp)
+        ei_x_encode_longlong(resp, value->sourceTimestamp);
+    else
+        ei_x_encode_atom(resp, "nil");
+
+    if(value->hasServerTimestamp)
+        ei_x_encode_longlong(resp, value->serverTimestamp);
+    else
+        ei_x_encode_atom(resp, "nil");
+
+    ei_x_encode_boolean(resp, data_len == 1);
+}
+
+//[{:ok, value} | {:error, status_code}]
+void encode_data_value_results(ei_x_buff *resp, void *data, int data_len)
+{
+    ei_x_encode_list_header(resp, data_len);
+
+    for(size_t i = 0; i < data_len; i++) {
+        UA_DataValue *result = (UA_DataValue *) data + i;
+
+        ei_x_encode_tuple_header(resp, 2);
+        if(result->hasStatus && result->status != UA_STATUSCODE_GOOD) {
+            ei_x_encode_atom(resp, "error");
+            encode_status_code(resp, &result->status);
+        }
+        else {
+            ei_x_encode_atom(resp, "ok");
+            encode_variant_struct(resp, &result->value);
+        }
+    }
+
+    if(data_len)
+        ei_x_encode_empty_list(resp);
+}
+
+//[:ok | {:error, status_code}]
+void encode_status_code_results(ei_x_buff *resp, void *data, int data_len)
+{
+    ei_x_encode_list_header(resp, data_len);
+
+    for(size_t i = 0; i < data_len; i++) {
+        UA_StatusCode *result = (UA_StatusCode *) data + i;
+
+        if(*result == UA_STATUSCODE_GOOD) {
+            ei_x_encode_atom(resp, "ok");
+            continue;
+        }
+
+        ei_x_encode_tuple_header(resp, 2);
+        ei_x_encode_atom(resp, "error");
+        encode_status_code(resp, result);
+    }
+
+    if(data_len)
+        ei_x_encode_empty_list(resp);
+}
+
+//[{value | nil, source_timestamp | nil, server_timestamp | nil, nil | status_code}]
+static void encode_history_values(ei_x_buff *resp, void *data, int data_len)
+{
+    if(data_len)
+        ei_x_encode_list_header(resp, data_len);
+
+    for(int i = 0; i < data_len; i++) {
+        UA_DataValue *value = (UA_DataValue *) data + i;
+
+        ei_x_encode_tuple_header(resp, 4);
+        if(value->hasValue)
+            encode_variant_struct(resp, &value->value);
+        else
+            ei_x_encode_atom(resp, "nil");
+
+        if(value->hasSourceTimestamp)
+            ei_x_encode_longlong(resp, value->sourceTimestamp);
+        else
+            ei_x_encode_atom(resp, "nil");
+
+        if(value->hasServerTimestamp)
+            ei_x_encode_longlong(resp, value->serverTimestamp);
+        else
+            ei_x_encode_atom(resp, "nil");
+
+        if(value->hasStatus && value->status != UA_STATUSCODE_GOOD)
+            encode_status_code(resp, &value->status);
+        else
+            ei_x_encode_atom(resp, "nil");
+    }
+
+    ei_x_encode_empty_list(resp);
+}
+
+//{:chunk, [entry]}, the entries are already encoded
+static void encode_browse_tree_chunk(ei_x_buff *resp, void *data, int data_len)
+{
+    ei_x_encode_tuple_header(resp, 2);
+    ei_x_encode_atom(resp, "chunk");
+    ei_x_encode_list_header(resp, data_len);
+    ei_x_append(resp, (ei_x_buff *) data);
+    ei_x_encode_empty_list(resp);
+}
+
+static void encode_uint32_array(ei_x_buff *resp, void *data, int data_len)
+{
+    if(data_len)
+        ei_x_encode_list_header(resp, data_len);
+
+    for(int i = 0; i < data_len; i++)
+        ei_x_encode_ulong(resp, ((UA_UInt32 *) data)[i]);
+
+    ei_x_encode_empty_list(resp);
+}
+
+//{[{namespace, ns_index}], [{index, status_code}]}
+static void encode_address_space_summary(ei_x_buff *resp, void *data)
+{
+    struct address_space_summary *summary = data;
+
+    ei_x_encode_tuple_header(resp, 2);
+
+    if(summary->namespaces_size)
+        ei_x_encode_list_header(resp, summary->namespaces_size);
+
+    for(size_t i = 0; i < summary->namespaces_size; i++) {
+        ei_x_encode_tuple_header(resp, 2);
+        ei_x_encode_binary(resp, summary->namespace_names[i], strlen(summary->namespace_names[i]));
+        ei_x_encode_ulong(resp, summary->namespace_indexes[i]);
+    }
+
+    ei_x_encode_empty_list(resp);
+
+    if(summary->failures_size)
+        ei_x_encode_list_header(resp, summary->failures_size);
+
+    for(size_t i = 0; i < summary->failures_size; i++) {
+        ei_x_encode_tuple_header(resp, 2);
+        ei_x_encode_ulong(resp, summary->failure_indexes[i]);
+        encode_status_code(resp, &summary->failure_codes[i]);
+    }
+
+    ei_x_encode_empty_list(resp);
+}
+
+/**
+ * @brief Encodes the command names of a request handler table, their position is their opcode
+ */
+static void encode_request_handler_names(ei_x_buff *resp, void *data, int data_len)
+{
+    const struct request_handler *handlers = data;
+
+    if(data_len)
+        ei_x_encode_list_header(resp, data_len);
+
+    for(int i = 0; i < data_len; i++)
+        ei_x_encode_atom(resp, handlers[i].name);
+
+    ei_x_encode_empty_list(resp);
 }
 
-void encode_data_response(char *resp, int *resp_index, void *data, int data_type, int data_len)
+static void encode_port_stats(ei_x_buff *resp, void *data, int data_len);
+
+void encode_data_response(ei_x_buff *resp, void *data, int data_type, int data_len)
 {
     switch(data_type)
     {
         case 0: //UA_Boolean
-            ei_encode_boolean(resp, resp_index, *(UA_Boolean *)data);
+            ei_x_encode_boolean(resp, *(UA_Boolean *)data);
         break;
 
         case 1: //signed (long)
-            ei_encode_long(resp, resp_index, *(int32_t *)data);
+            ei_x_encode_long(resp, *(int32_t *)data);
         break;
 
         case 2: //unsigned (long)
-            ei_encode_ulong(resp, resp_index, *(uint32_t *)data);
+            ei_x_encode_ulong(resp, *(uint32_t *)data);
         break;
 
         case 3: //strings
-            ei_encode_string(resp, resp_index, data);
+            ei_x_encode_string(resp, data);
         break;
 
         case 4: //doubles
-            ei_encode_double(resp, resp_index, *(double *)data);
+            ei_x_encode_double(resp, *(double *)data);
         break;
 
         case 5: //arrays (byte type)
-            ei_encode_binary(resp, resp_index, data, data_len);
+            ei_x_encode_binary(resp, data, data_len);
         break;
 
         case 6: //atom
-            ei_encode_atom(resp, resp_index, data);
+            ei_x_encode_atom(resp, data);
         break;
 
         case 7: //UA_ClientConfig
-            encode_client_config(resp, resp_index, data);
+            encode_client_config(resp, data);
         break;
 
         case 8: //UA_ServerOnNetwork
-            encode_server_on_the_network_struct(resp, resp_index, data, data_len);
+            encode_server_on_the_network_struct(resp, data, data_len);
         break;
 
         case 9: //UA_ApplicationDescription
-            encode_application_description_struct(resp, resp_index, data, data_len);
+            encode_application_description_struct(resp, data, data_len);
         break;
 
         case 10: //UA_EndpointDescription
-            encode_endpoint_description_struct(resp, resp_index, data, data_len);
+            encode_endpoint_description_struct(resp, data, data_len);
         break;
 
         case 11: //UA_ServerConfig
-            encode_server_config(resp, resp_index, data);
+            encode_server_config(resp, data);
         break;
 
         case 12: //UA_NodeId
-            encode_node_id(resp, resp_index, data);
+            encode_node_id(resp, data);
         break;
 
         case 13: //UA_QualifiedName
-            encode_qualified_name(resp, resp_index, data);
+            encode_qualified_name(resp, data);
         break;
 
         case 14: //UA_LocalizedText
-            encode_localized_text(resp, resp_index, data);
+            encode_localized_text(resp, data);
         break;
 
         case 15: //UA_INT64
-            ei_encode_longlong(resp, resp_index,*(int64_t *)data);
+            ei_x_encode_longlong(resp,*(int64_t *)data);
         break;
 
         case 16: //UA_UINT64
-            ei_encode_ulonglong(resp, resp_index,*(uint64_t *)data);
+            ei_x_encode_ulonglong(resp,*(uint64_t *)data);
         break;
 
         case 17: //UA_Float
-            encode_ua_float(resp, resp_index, data);
+            encode_ua_float(resp, data);
         break;
 
         case 18: //UA_guid
-            encode_ua_guid(resp, resp_index, data);
+            encode_ua_guid(resp, data);
         break;
 
         case 19: //UA_ExpandedNodeId
-            encode_expanded_node_id(resp, resp_index, data);
+            encode_expanded_node_id(resp, data);
         break;
 
         case 20: //UA_StatusCode
-            encode_status_code(resp, resp_index, data);
+            encode_status_code(resp, data);
         break;
 
         case 21: //UA_StatusCode
-            encode_semantic_change_structure_data_type(resp, resp_index, data);
+            encode_semantic_change_structure_data_type(resp, data);
         break;
 
         case 22: //UA_XVType
-            encode_xv_type(resp, resp_index, data);
+            encode_xv_type(resp, data);
         break;
 
         case 23: //UA_SByte
-            ei_encode_long(resp, resp_index, *(UA_SByte *)data);
+            ei_x_encode_long(resp, *(UA_SByte *)data);
         break;
 
         case 24: //UA_Byte
-            ei_encode_ulong(resp, resp_index, *(UA_Byte *)data);
+            ei_x_encode_ulong(resp, *(UA_Byte *)data);
         break;
 
         case 25: //UA_Int16
-            ei_encode_long(resp, resp_index, *(UA_Int16 *)data);
+            ei_x_encode_long(resp, *(UA_Int16 *)data);
         break;
 
         case 26: //UA_UInt16
-            ei_encode_ulong(resp, resp_index, *(UA_UInt16 *)data);
+            ei_x_encode_ulong(resp, *(UA_UInt16 *)data);
         break;
 
         case 27: //UA_UInt32
-            ei_encode_ulong(resp, resp_index, *(UA_UInt32 *)data);
+            ei_x_encode_ulong(resp, *(UA_UInt32 *)data);
         break;
 
         case 28: //array_dimensions
-            encode_array_dimensions_struct(resp, resp_index, data, data_len);
+            encode_array_dimensions_struct(resp, data, data_len);
         break;
 
         case 29: //UA_Variant
-            encode_variant_struct(resp, resp_index, data);
+            encode_variant_struct(resp, data);
         break;
 
-        default:
-            errx(EXIT_FAILURE, "data_type error");
+        case 30: //UA_DataValue array (batched reads)
+            encode_data_value_results(resp, data, data_len);
         break;
-    }
-}
 
-/***************************/
-/* Elixir Message decoders */
-/***************************/
+        case 31: //UA_StatusCode array (batched writes)
+            encode_status_code_results(resp, data, data_len);
+        break;
+
+        case 32: //request_handler array (opcode handshake)
+            encode_request_handler_names(resp, data, data_len);
+        break;
+
+        case 33: //address_space_summary (load_address_space)
+            encode_address_space_summary(resp, data);
+        break;
+
+        case 34: //UA_Variant numeric array (packed reads)
+            encode_packed_array(resp, data);
+        break;
+
+        case 35: //UA_DataValue with timestamps (cached reads)
+            encode_timestamped_value(resp, data, data_len);
+        break;
+
+        case 36: //stats_gauge array (port statistics)
+            encode_port_stats(resp, data, data_len);
+        break;
+
+        case 37: //UA_UInt32 array (registered node handles)
+            encode_uint32_array(resp, data, data_len);
+        break;
+
+        case 38: //UA_DataValue array with timestamps (history reads)
+            encode_history_values(resp, data, data_len);
+        break;
+
+        case 39: //ei_x_buff of encoded entries (browse_tree chunks)
+            encode_browse_tree_chunk(resp, data, data_len);
+        break;
+
+        default:
+            errx(EXIT_FAILURE, "data_type error");
+        break;
+    }
+}
+
+/***************************/
+/* Elixir Message decoders */
+/***************************/
+
+/*  Request context
+ *
+ *  The caller metadata is a slice of the request and the command name points to the handler table, both outlive
+ *  the handler. Scratch memory of a request comes from a bump arena, everything is released at once by
+ *  reset_request_context() after the dispatch.
+ */
+#define REQUEST_ARENA_SIZE 16384
+#define REQUEST_ARENA_ALIGNMENT sizeof(uint64_t)
+
+struct request_arena_chunk {
+    struct request_arena_chunk *next;
+};
+
+static uint64_t request_arena[REQUEST_ARENA_SIZE / sizeof(uint64_t)];
+static size_t request_arena_used = 0;
+static struct request_arena_chunk *request_arena_overflow = NULL; // Allocations that did not fit in the arena
 
 void handle_caller_metadata(const char *req, int *req_index, const char* cmd)
 {   
-    caller_function = malloc(strlen(cmd) + 1);
-    strcpy(caller_function, cmd);
+    caller_function = cmd;
 
-    caller_metadata_ptr = (char *)req;
     int caller_metadata_start_index = *req_index;
 
     if (ei_skip_term(req, req_index) < 0)
         errx(EXIT_FAILURE, "Expecting caller metadata");
 
+    caller_metadata_ptr = req + caller_metadata_start_index;
     caller_metadata_size = *req_index - caller_metadata_start_index;
+}
 
-    caller_metadata_ptr = (char *) malloc(caller_metadata_size);
+/**
+ * @brief Scratch memory valid until the end of the current request, it must not be freed
+ */
+void *request_arena_alloc(size_t size)
+{
+    size = (size + REQUEST_ARENA_ALIGNMENT - 1) & ~((size_t) REQUEST_ARENA_ALIGNMENT - 1);
 
-    for(int index = 0; index < caller_metadata_size; index ++)
-        caller_metadata_ptr[index] = req[caller_metadata_start_index + index];
-}
+    if(size <= REQUEST_ARENA_SIZE - request_arena_used) {
+        void *ptr = (char *) request_arena + request_arena_used;
+        request_arena_used += size;
+        return ptr;
+    }
+
+    struct request_arena_chunk *chunk = malloc(sizeof(struct request_arena_chunk) + size);
+    if(!chunk)
+        errx(EXIT_FAILURE, "Could not allocate %d bytes of request memory", (int) size);
 
-void free_caller_metadata()
-{  
-    free(caller_function);
-    free(caller_metadata_ptr);
+    chunk->next = request_arena_overflow;
+    request_arena_overflow = chunk;
+    return chunk + 1;
 }
 
-/***************************/
-/* Elixir Message senders */
-/***************************/
+void reset_request_context()
+{
+    caller_function = NULL;
+    caller_metadata_ptr = NULL;
+    caller_metadata_size = 0;
+
+    request_arena_used = 0;
+    while(request_arena_overflow) {
+        struct request_arena_chunk *next = request_arena_overflow->next;
+        free(request_arena_overflow);
+        request_arena_overflow = next;
+    }
+}
 
 /**
- * @brief Sends subscription timeout/inactivity back to Elixir in form of {:subscription, {:timeout, subId}}
+ * @brief Copies the caller of the current request, so it can be answered after reset_request_context()
  */
-void send_subscription_timeout_response(void *data, int data_type, int data_len)
+void save_caller_context(struct caller_context *context)
 {
-    char resp[1024];
-    long i_struct;
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "subscription");
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "timeout");
-    encode_data_response(resp, &resp_index, data, data_type, data_len);
-    erlcmd_send(resp, resp_index);
+    char *metadata = malloc(caller_metadata_size);
+    if(!metadata)
+        errx(EXIT_FAILURE, "Could not allocate %d bytes of caller metadata", (int) caller_metadata_size);
+    memcpy(metadata, caller_metadata_ptr, caller_metadata_size);
+
+    context->function = caller_function;
+    context->metadata = metadata;
+    context->metadata_size = caller_metadata_size;
 }
 
 /**
- * @brief Sends subscription delete event back to Elixir in form of {:subscription, {:delete, subId}}
+ * @brief Makes `context` the current caller and stores the previous one in it, calling it again restores it.
+ *
+ * Responses may arrive while another request is being handled (e.g. inside a synchronous service call).
  */
-void send_subscription_deleted_response(void *data, int data_type, int data_len)
+void swap_caller_context(struct caller_context *context)
 {
-    char resp[1024];
-    long i_struct;
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "subscription");
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "delete");
-    encode_data_response(resp, &resp_index, data, data_type, data_len);
-    erlcmd_send(resp, resp_index);
+    struct caller_context previous = {caller_function, caller_metadata_ptr, caller_metadata_size};
+
+    caller_function = context->function;
+    caller_metadata_ptr = context->metadata;
+    caller_metadata_size = context->metadata_size;
+
+    *context = previous;
 }
 
-/**
- * @brief Send changed data back to Elixir in form of {:subscription, {:data, subId, monId, data}}
+void clear_caller_context(struct caller_context *context)
+{
+    free((void *) context->metadata);
+    context->function = NULL;
+    context->metadata = NULL;
+    context->metadata_size = 0;
+}
+
+/*  Request dispatch
+ *
+ *  A request names its handler either with the command atom or with an integer opcode, the position of the
+ *  handler in the table (see handle_list_commands). Atoms are looked up in an open addressing hash index built
+ *  once at startup, opcodes index the table directly.
  */
-void send_monitored_item_response(void *subscription_id, void *monitored_id, void *data, int data_type)
+#define REQUEST_HANDLERS_HASH_SIZE 512 // Must be a power of 2 and at least twice the number of handlers
+
+static const struct request_handler *request_handlers_table = NULL;
+static size_t request_handlers_count = 0;
+static uint16_t request_handlers_hash[REQUEST_HANDLERS_HASH_SIZE]; // Handler index + 1, 0 is an empty slot
+
+static uint32_t hash_command(const char *name)
 {
-    char resp[ERLCMD_BUF_SIZE];
-    long i_struct;
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "subscription");
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(; *name; name++) {
+        hash ^= (uint8_t) *name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    ei_encode_tuple_header(resp, &resp_index, 4);
-    ei_encode_atom(resp, &resp_index, "data");
-    encode_data_response(resp, &resp_index, subscription_id, 27, 0);
-    encode_data_response(resp, &resp_index, monitored_id, 27, 0);
-    
-    encode_data_response(resp, &resp_index, data, data_type, 0);
+static void init_handler_stats();
+
+void init_request_handlers(const struct request_handler *handlers)
+{
+    request_handlers_table = handlers;
+    memset(request_handlers_hash, 0, sizeof(request_handlers_hash));
+
+    for(request_handlers_count = 0; handlers[request_handlers_count].name != NULL; request_handlers_count++) {
+        if(2 * (request_handlers_count + 1) > REQUEST_HANDLERS_HASH_SIZE)
+            errx(EXIT_FAILURE, "REQUEST_HANDLERS_HASH_SIZE is too small");
+
+        uint32_t slot = hash_command(handlers[request_handlers_count].name) & (REQUEST_HANDLERS_HASH_SIZE - 1);
+        while(request_handlers_hash[slot])
+            slot = (slot + 1) & (REQUEST_HANDLERS_HASH_SIZE - 1);
+
+        request_handlers_hash[slot] = request_handlers_count + 1;
+    }
 
-    erlcmd_send(resp, resp_index);
+    init_handler_stats();
 }
 
 /**
- * @brief Send deleted items back to Elixir in form of {:subscription, {:delete, subId, monId}}
+ * @brief Decodes the command (atom or opcode) of a request and returns its handler
  */
-void send_monitored_item_delete_response(void *subscription_id, void *monitored_id)
+const struct request_handler *decode_request_handler(const char *req, int *req_index)
 {
-    char resp[1024];
-    long i_struct;
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "subscription");
+    int term_type;
+    int term_size;
+    if(ei_get_type(req, req_index, &term_type, &term_size) < 0)
+        errx(EXIT_FAILURE, "expecting command atom or opcode");
+
+    if(term_type == ERL_SMALL_INTEGER_EXT || term_type == ERL_INTEGER_EXT) {
+        unsigned long opcode;
+        if(ei_decode_ulong(req, req_index, &opcode) < 0 || opcode >= request_handlers_count)
+            errx(EXIT_FAILURE, "unknown opcode");
+
+        return &request_handlers_table[opcode];
+    }
 
-    ei_encode_tuple_header(resp, &resp_index, 3);
-    ei_encode_atom(resp, &resp_index, "delete");
-    encode_data_response(resp, &resp_index, subscription_id, 27, 0);
-    encode_data_response(resp, &resp_index, monitored_id, 27, 0);
+    char cmd[MAXATOMLEN];
+    if (ei_decode_atom(req, req_index, cmd) < 0)
+        errx(EXIT_FAILURE, "expecting command atom");
 
-    erlcmd_send(resp, resp_index);
+    uint32_t slot = hash_command(cmd) & (REQUEST_HANDLERS_HASH_SIZE - 1);
+    while(request_handlers_hash[slot]) {
+        const struct request_handler *rh = &request_handlers_table[request_handlers_hash[slot] - 1];
+        if(strcmp(cmd, rh->name) == 0)
+            return rh;
+
+        slot = (slot + 1) & (REQUEST_HANDLERS_HASH_SIZE - 1);
+    }
+
+    // no listed function
+    errx(EXIT_FAILURE, "unknown command: %s", cmd);
 }
 
+/***************************/
+/* Elixir Message senders */
+/***************************/
+
 /**
- * @brief Send write data back to Elixir in form of {:write, node_id, value}
+ * @brief Starts a response with room for the packet header, the response id and the version
  */
-void send_write_data_response(const UA_NodeId *nodeId, void *data, int data_type)
-{
-    char resp[ERLCMD_BUF_SIZE];
-    long i_struct;
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 3);
-    ei_encode_atom(resp, &resp_index, "write");
+#define RESPONSE_BUFFER_KEEP_SIZE (1024 * 1024) // Larger buffers are released after sending
 
-    encode_node_id(resp, &resp_index, (UA_NodeId *) nodeId);
-    encode_data_response(resp, &resp_index, data, data_type, 0);
+static uint64_t notifications_sent = 0; // Port statistics, see encode_port_stats
+static uint64_t write_events_sent = 0;
+static uint64_t notifications_dropped = 0;
 
-    erlcmd_send(resp, resp_index);
-}
+/* Responses are built one at a time, the same buffer is reused to avoid allocations on every response. */
+static ei_x_buff response_buffer = {.buff = NULL};
+static ei_x_buff *response_buffer_user = NULL; // Response currently using it, nested responses allocate their own
 
 /**
- * @brief Send data back to Elixir in form of {:ok, data}
+ * @brief Wraps the following responses as {:session, session, response}
  */
-void send_data_response(void *data, int data_type, int data_len)
+void set_response_session(uint32_t session)
+{
+    response_session = session;
+}
+
+static void response_init(ei_x_buff *resp)
 {
-    char resp[ERLCMD_BUF_SIZE];
-    long i_struct;
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 3);
-    encode_caller_metadata(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "ok");
-    encode_data_response(resp, &resp_index, data, data_type, data_len);
+    char header[sizeof(uint32_t) + 1] = {0};
+    size_t header_size = erlcmd_packet_size();
+
+    header[header_size] = response_id;
+
+    if(response_buffer_user == NULL) {
+        if(response_buffer.buff == NULL)
+            ei_x_new(&response_buffer);
+
+        response_buffer.index = 0;
+        response_buffer_user = resp;
+        *resp = response_buffer;
+    }
+    else
+        ei_x_new(resp);
+
+    ei_x_append_buf(resp, header, header_size + 1);
+    ei_x_encode_version(resp);
 
-    erlcmd_send(resp, resp_index);
+    if(response_session != 0) {
+        ei_x_encode_tuple_header(resp, 3);
+        ei_x_encode_atom(resp, "session");
+        ei_x_encode_ulong(resp, response_session);
+    }
 }
 
-/**
- * @brief Send a response of the form {:error, reason}
+/*  Shared memory ring
  *
- * @param reason is an error reason (sended back as an atom)
+ *  Once enabled (enable_shm_ring), responses of at least shm_ring_threshold bytes are copied once into a ring
+ *  shared with the port owner and only a one byte doorbell goes through the pipe, see shm_ring.h. Responses that
+ *  don't fit in the free space of the ring still use the pipe.
  */
-void send_error_response(const char *reason)
+#ifndef __WIN32__
+static struct shm_ring_header *shm_ring = NULL;
+static size_t shm_ring_size = 0; // Mapped bytes (header included)
+static size_t shm_ring_threshold = 0;
+static char shm_ring_name[64];
+
+static bool shm_ring_write(const char *payload, size_t len)
 {
-    char resp[256];
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 3);
-    encode_caller_metadata(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "error");
-    ei_encode_atom(resp, &resp_index, reason);
-    erlcmd_send(resp, resp_index);
+    uint64_t capacity = shm_ring->capacity;
+    uint64_t head = shm_ring->head;
+    uint64_t tail = __atomic_load_n(&shm_ring->tail, __ATOMIC_ACQUIRE);
+    uint64_t record = SHM_RING_RECORD_SIZE(len);
+    uint64_t offset = head % capacity;
+    uint64_t contiguous = capacity - offset;
+    uint64_t needed = record <= contiguous ? record : contiguous + record;
+
+    if(len > UINT32_MAX - 1 || needed > capacity - (head - tail))
+        return false;
+
+    char *data = SHM_RING_DATA(shm_ring);
+    if(record > contiguous) {
+        uint32_t wrap = SHM_RING_WRAP;
+        memcpy(data + offset, &wrap, sizeof(wrap));
+        head += contiguous;
+        offset = 0;
+    }
+
+    uint32_t record_len = (uint32_t) len;
+    memcpy(data + offset, &record_len, sizeof(record_len));
+    memcpy(data + offset + sizeof(record_len), payload, len);
+
+    __atomic_store_n(&shm_ring->head, head + record, __ATOMIC_RELEASE);
+    return true;
 }
 
 /**
- * @brief Send :ok back to Elixir
+ * @return true if the response went through the ring
  */
-void send_ok_response()
+static bool shm_ring_send(const char *buff, size_t size)
 {
-    char resp[256];
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 3);
-    encode_caller_metadata(resp, &resp_index);
-    ei_encode_atom(resp, &resp_index, "ok");
-    erlcmd_send(resp, resp_index);
+    size_t header_size = erlcmd_packet_size() + 1; // Length and response id
+    size_t len = size - header_size;
+
+    if(shm_ring == NULL || len < shm_ring_threshold || !shm_ring_write(buff + header_size, len))
+        return false;
+
+    char doorbell[sizeof(uint32_t) + 1] = {0};
+    doorbell[erlcmd_packet_size()] = SHM_RING_DOORBELL;
+    erlcmd_send(doorbell, erlcmd_packet_size() + 1);
+    return true;
 }
 
-// https://open62541.org/doc/current/statuscodes.html?highlight=error
-void send_opex_response(uint32_t reason)
+static void shm_ring_close()
 {
-    const char *status_code = UA_StatusCode_name(reason);
-    char resp[256];
-    int resp_index = sizeof(uint16_t); // Space for payload size
-    resp[resp_index++] = response_id;
-    ei_encode_version(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 3);
-    encode_caller_metadata(resp, &resp_index);
-    ei_encode_tuple_header(resp, &resp_index, 2);
-    ei_encode_atom(resp, &resp_index, "error");
-    ei_encode_binary(resp, &resp_index, status_code, strlen(status_code));
-    erlcmd_send(resp, resp_index);
-}
+    if(shm_ring == NULL)
+        return;
 
-/*****************************/
-/* Common Open62541 handlers */
-/*****************************/
+    munmap(shm_ring, shm_ring_size);
+    shm_unlink(shm_ring_name); // The owner unlinks it once mapped, this covers an owner that never did
+    shm_ring = NULL;
+}
 
-void handle_test(void *entity, bool entity_type, const char *req, int *req_index)
+static UA_StatusCode shm_ring_open(size_t capacity)
 {
-    send_ok_response();     
+    static unsigned int rings = 0;
+    snprintf(shm_ring_name, sizeof(shm_ring_name), "/opex62541-%d-%u", (int) getpid(), rings++);
+
+    int fd = shm_open(shm_ring_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd < 0)
+        return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+
+    size_t size = sizeof(struct shm_ring_header) + capacity;
+    void *mapping = MAP_FAILED;
+    if(ftruncate(fd, size) == 0)
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(mapping == MAP_FAILED) {
+        shm_unlink(shm_ring_name);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    shm_ring = mapping;
+    shm_ring_size = size;
+    shm_ring->magic = SHM_RING_MAGIC;
+    shm_ring->capacity = capacity;
+    shm_ring->head = 0;
+    shm_ring->tail = 0;
+    return UA_STATUSCODE_GOOD;
 }
+#endif
 
 /**
- * @brief Send data back to Elixir in form of {:ok, data}
+ * @brief Frames and sends a response started by response_init
+ *
+ * @return false if the payload doesn't fit in the port packet size (nothing is sent)
  */
-void send_write_response(UA_Server *server,
-               const UA_NodeId *sessionId, void *sessionContext,
-               const UA_NodeId *nodeId, void *nodeContext,
-               const UA_NumericRange *range, const UA_DataValue *data) {
+static bool response_write(char *buff, size_t size)
+{
+    bool fits = size - erlcmd_packet_size() <= erlcmd_max_payload_size();
 
-    if(server_is_writing) 
-    {
-        server_is_writing = false;
-        return;
-    }
+#ifndef __WIN32__
+    if(shm_ring_send(buff, size))
+        fits = true;
+    else
+#endif
+    if(fits)
+        erlcmd_send(buff, size);
+    else
+        warnx("Dropping a %d bytes response, use {:packet, 4} for larger messages", (int) size);
 
-    UA_Variant variant = data->value;
-    send_write_data_response(nodeId, &variant, 29);
+    return fits;
 }
 
-/******************************/
-/* Node Addition and Deletion */
-/******************************/
+static void response_release(ei_x_buff *resp)
+{
+    if(resp == response_buffer_user) {
+        // ei_x_* may have reallocated it.
+        response_buffer = *resp;
+        response_buffer_user = NULL;
+
+        if(response_buffer.buffsz > RESPONSE_BUFFER_KEEP_SIZE) {
+            ei_x_free(&response_buffer);
+            response_buffer.buff = NULL;
+        }
+    }
+    else
+        ei_x_free(resp);
+}
 
-/* 
- *  Add a new variable node to the server. 
+/**
+ * @brief Frames and sends a response, the buffer is released in any case
+ *
+ * @return false if the payload doesn't fit in the port packet size (nothing is sent)
  */
-void handle_add_variable_node(void *entity, bool entity_type, const char *req, int *req_index)
+static bool response_send(ei_x_buff *resp)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    bool fits = response_write(resp->buff, resp->index);
+    response_release(resp);
+    return fits;
+}
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 5)
-        errx(EXIT_FAILURE, ":handle_add_variable_node requires a 5-tuple, term_size = %d", term_size);
-    
-    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
-    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
-    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
-    UA_NodeId type_definition = assemble_node_id(req, req_index);
+/*  Notification queue
+ *
+ *  With a high-water mark (set_notification_queue > 0) stdout is non-blocking, see erlcmd_send, so a port owner
+ *  that falls behind costs data freshness instead of stalling the client or server loop. While more than
+ *  high_water bytes wait for the pipe, data change notifications and write events are kept here instead, only the
+ *  latest one per {session, subId, monId} (or {session, node id} for writes), and the replaced ones are counted as
+ *  dropped. flush_notification_queue() sends them, in arrival order of their keys, once the pipe drains.
+ *  Responses and the other events are never dropped, they wait in erlcmd. While entries are queued the
+ *  notification and write batches are empty, so a queued value can't be overtaken by an older batched one.
+ */
+struct queued_notification {
+    uint32_t session;
+    uint32_t subscription_id; // 0 for write events
+    uint32_t monitored_id;
+    UA_NodeId node_id; // Write events
+    char *message; // Framed response, NULL once sent or dropped
+    size_t message_size;
+};
+
+static struct queued_notification *notification_queue = NULL; // Since the queue was last empty, in arrival order
+static size_t notification_queue_head = 0; // Entries before it are sent
+static size_t notification_queue_size = 0;
+static size_t notification_queue_capacity = 0;
+static size_t notification_queue_pending = 0; // Entries with a message
+static uint32_t *notification_queue_slots = NULL; // Open addressing, index + 1 of the latest entry of a key
+static size_t notification_queue_slots_capacity = 0;
+static size_t notification_queue_keys = 0;
+static size_t notification_queue_high_water = 0; // Bytes, 0 disables it
+
+static uint32_t notification_key_hash(uint32_t session, uint32_t subscription_id, uint32_t monitored_id,
+                                      const UA_NodeId *node_id)
+{
+    uint32_t hash = node_id ? UA_NodeId_hash(node_id) : (subscription_id * 2654435761u) ^ monitored_id;
+    return (hash ^ (session * 40503u)) * 2654435761u;
+}
 
-    UA_VariableAttributes vAttr = UA_VariableAttributes_default;
-    
-    if(entity_type)
-        retval = UA_Client_addVariableNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, vAttr, NULL);
-    else
-    {
-        UA_ValueCallback callback;
-        callback.onRead = NULL;
-        callback.onWrite = send_write_response;
-        retval = UA_Server_addVariableNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, vAttr, NULL, NULL);
-        UA_Server_setVariableNode_valueCallback((UA_Server *)entity, requested_new_node_id, callback);
+static size_t notification_queue_slot(uint32_t session, uint32_t subscription_id, uint32_t monitored_id,
+                                      const UA_NodeId *node_id)
+{
+    size_t mask = notification_queue_slots_capacity - 1;
+    size_t slot = notification_key_hash(session, subscription_id, monitored_id, node_id) & mask;
+
+    for(;; slot = (slot + 1) & mask) {
+        if(notification_queue_slots[slot] == 0)
+            return slot;
+
+        const struct queued_notification *entry = &notification_queue[notification_queue_slots[slot] - 1];
+        if(entry->session == session && entry->subscription_id == subscription_id &&
+            entry->monitored_id == monitored_id &&
+            (node_id ? UA_NodeId_equal(&entry->node_id, node_id) : UA_NodeId_isNull(&entry->node_id)))
+            return slot;
     }
+}
 
-    UA_NodeId_clear(&requested_new_node_id);
-    UA_NodeId_clear(&parent_node_id);
-    UA_NodeId_clear(&reference_type_node_id);
-    UA_QualifiedName_clear(&browse_name);
-    UA_NodeId_clear(&type_definition);
+static void notification_queue_grow_slots()
+{
+    uint32_t *slots = notification_queue_slots;
+    size_t capacity = notification_queue_slots_capacity;
+
+    notification_queue_slots_capacity = capacity ? 2 * capacity : 1024;
+    notification_queue_slots = calloc(notification_queue_slots_capacity, sizeof(uint32_t));
+    if(!notification_queue_slots)
+        errx(EXIT_FAILURE, "Could not allocate the notification queue");
+
+    for(size_t i = 0; i < capacity; i++) {
+        if(slots[i] == 0)
+            continue;
+
+        const struct queued_notification *entry = &notification_queue[slots[i] - 1];
+        notification_queue_slots[notification_queue_slot(entry->session, entry->subscription_id,
+                                                          entry->monitored_id,
+                                                          UA_NodeId_isNull(&entry->node_id) ? NULL : &entry->node_id)]
+            = slots[i];
+    }
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+    free(slots);
+}
+
+static void notification_queue_reset()
+{
+    for(size_t i = 0; i < notification_queue_size; i++) {
+        UA_NodeId_clear(&notification_queue[i].node_id);
+        free(notification_queue[i].message);
     }
 
-    send_ok_response();
+    notification_queue_head = 0;
+    notification_queue_size = 0;
+    notification_queue_pending = 0;
+    notification_queue_keys = 0;
+    if(notification_queue_slots)
+        memset(notification_queue_slots, 0, notification_queue_slots_capacity * sizeof(uint32_t));
 }
 
-/* 
- *  Add a new variable type node to the server.(client must send {0,0,0} for type_definition),
+/**
+ * @brief Keeps the response as the latest one of its key, the buffer is released
  */
-void handle_add_variable_type_node(void *entity, bool entity_type, const char *req, int *req_index)
+static void notification_queue_add(ei_x_buff *resp, uint32_t subscription_id, uint32_t monitored_id,
+                                   const UA_NodeId *node_id)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    char *message = malloc(resp->index);
+    if(!message)
+        errx(EXIT_FAILURE, "Could not allocate a queued notification of %d bytes", resp->index);
+    memcpy(message, resp->buff, resp->index);
+    size_t message_size = resp->index;
+    response_release(resp);
+
+    if(2 * (notification_queue_keys + 1) > notification_queue_slots_capacity)
+        notification_queue_grow_slots();
+
+    size_t slot = notification_queue_slot(response_session, subscription_id, monitored_id, node_id);
+    if(notification_queue_slots[slot] != 0) {
+        struct queued_notification *entry = &notification_queue[notification_queue_slots[slot] - 1];
+
+        if(entry->message != NULL) {
+            free(entry->message);
+            entry->message = message;
+            entry->message_size = message_size;
+            __atomic_add_fetch(&notifications_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    else
+        notification_queue_keys++;
+
+    if(notification_queue_size == notification_queue_capacity) {
+        notification_queue_capacity = notification_queue_capacity ? 2 * notification_queue_capacity : 1024;
+        size_t size = notification_queue_capacity * sizeof(struct queued_notification);
+        notification_queue = realloc(notification_queue, size);
+        if(!notification_queue)
+            errx(EXIT_FAILURE, "Could not allocate the notification queue");
+    }
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 5)
-        errx(EXIT_FAILURE, ":handle_add_variable_type_node requires a 5-tuple, term_size = %d", term_size);
-    
-    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
-    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
-    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
-    UA_NodeId type_definition = assemble_node_id(req, req_index);
+    struct queued_notification *entry = &notification_queue[notification_queue_size++];
+    entry->session = response_session;
+    entry->subscription_id = subscription_id;
+    entry->monitored_id = monitored_id;
+    UA_NodeId_init(&entry->node_id);
+    if(node_id)
+        UA_NodeId_copy(node_id, &entry->node_id);
+    entry->message = message;
+    entry->message_size = message_size;
+
+    notification_queue_slots[slot] = (uint32_t) notification_queue_size;
+    notification_queue_pending++;
+}
 
-    UA_VariableTypeAttributes vtAttr = UA_VariableTypeAttributes_default;
-    
-    if(entity_type)
-        retval = UA_Client_addVariableTypeNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, vtAttr, NULL);
-    else
-        retval = UA_Server_addVariableTypeNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, vtAttr, NULL, NULL);
+/**
+ * @brief Drops the queued notifications of a deleted monitored item (monitored_id 0: of the whole subscription)
+ */
+static void notification_queue_remove(uint32_t subscription_id, uint32_t monitored_id)
+{
+    for(size_t i = notification_queue_head; i < notification_queue_size && notification_queue_pending > 0; i++) {
+        struct queued_notification *entry = &notification_queue[i];
 
-    UA_NodeId_clear(&requested_new_node_id);
-    UA_NodeId_clear(&parent_node_id);
-    UA_NodeId_clear(&reference_type_node_id);
-    UA_QualifiedName_clear(&browse_name);
-    UA_NodeId_clear(&type_definition);
+        if(entry->message == NULL || entry->session != response_session || entry->subscription_id != subscription_id ||
+            (monitored_id != 0 && entry->monitored_id != monitored_id) || !UA_NodeId_isNull(&entry->node_id))
+            continue;
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+        free(entry->message);
+        entry->message = NULL;
+        notification_queue_pending--;
+        __atomic_add_fetch(&notifications_dropped, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Sends the queued notifications while the output stays under the high-water mark (all of them when the
+ *        queue is disabled)
+ */
+void flush_notification_queue()
+{
+    if(erlcmd_flush() > notification_queue_high_water && notification_queue_high_water > 0)
         return;
+
+    if(notification_queue_size == 0)
+        return;
+
+    while(notification_queue_head < notification_queue_size) {
+        if(notification_queue_high_water > 0 && erlcmd_pending_size() > notification_queue_high_water)
+            return;
+
+        struct queued_notification *entry = &notification_queue[notification_queue_head++];
+        if(entry->message == NULL)
+            continue;
+
+        response_write(entry->message, entry->message_size);
+        free(entry->message);
+        entry->message = NULL;
+        notification_queue_pending--;
     }
 
-    send_ok_response();
+    notification_queue_reset();
 }
 
-/* 
- *  Add a new object node to the server. 
+/**
+ * @return true if the next notification or write event has to be queued
  */
-void handle_add_object_node(void *entity, bool entity_type, const char *req, int *req_index)
+static bool notification_queue_full()
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    if(notification_queue_high_water == 0)
+        return false;
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 5)
-        errx(EXIT_FAILURE, ":handle_add_object_node requires a 5-tuple, term_size = %d", term_size);
-    
-    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
-    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
-    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
-    UA_NodeId type_definition = assemble_node_id(req, req_index);
+    flush_notification_queue();
+    return erlcmd_pending_size() > notification_queue_high_water;
+}
 
-    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
-    
-    if(entity_type)
-        retval = UA_Client_addObjectNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, oAttr, NULL);
-    else
-        retval = UA_Server_addObjectNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, oAttr, NULL, NULL);
+/**
+ * @brief Enables (high_water > 0) or disables the notification queue, false if not supported
+ */
+bool set_notification_queue(size_t high_water)
+{
+    if(!erlcmd_set_nonblocking(high_water > 0))
+        return false;
+
+    notification_queue_high_water = high_water;
+    if(high_water == 0) {
+        // Blocking again, everything queued goes out now
+        flush_notification_queue();
+        free(notification_queue);
+        free(notification_queue_slots);
+        notification_queue = NULL;
+        notification_queue_slots = NULL;
+        notification_queue_capacity = 0;
+        notification_queue_slots_capacity = 0;
+    }
 
-    UA_NodeId_clear(&requested_new_node_id);
-    UA_NodeId_clear(&parent_node_id);
-    UA_NodeId_clear(&reference_type_node_id);
-    UA_QualifiedName_clear(&browse_name);
-    UA_NodeId_clear(&type_definition);
+    return true;
+}
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
+/**
+ * @brief Sends subscription timeout/inactivity back to Elixir in form of {:subscription, {:timeout, subId}}
+ */
+void send_subscription_timeout_response(void *data, int data_type, int data_len)
+{
+    ei_x_buff resp;
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "subscription");
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "timeout");
+    encode_data_response(&resp, data, data_type, data_len);
+    response_send(&resp);
+}
 
-    send_ok_response();
+/**
+ * @brief Sends subscription delete event back to Elixir in form of {:subscription, {:delete, subId}}
+ */
+void send_subscription_deleted_response(void *data, int data_type, int data_len)
+{
+    ei_x_buff resp;
+
+    if(notification_queue_pending > 0 && data_type == 27)
+        notification_queue_remove(*(uint32_t *) data, 0);
+
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "subscription");
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "delete");
+    encode_data_response(&resp, data, data_type, data_len);
+    response_send(&resp);
 }
 
-/* 
- *  Add a new object type node to the server. 
+/**
+ * @brief Send changed data back to Elixir in form of {:subscription, {:data, subId, monId, data}}
  */
-void handle_add_object_type_node(void *entity, bool entity_type, const char *req, int *req_index)
+void send_monitored_item_response(void *subscription_id, void *monitored_id, void *data, int data_type)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    ei_x_buff resp;
+    bool queued = notification_queue_full();
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 4)
-        errx(EXIT_FAILURE, ":handle_add_object_type_node requires a 4-tuple, term_size = %d", term_size);
-    
-    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
-    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
-    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+    if(queued)
+        flush_notification_batch();
 
-    UA_ObjectTypeAttributes otAttr = UA_ObjectTypeAttributes_default;
-    
-    if(entity_type)
-        retval = UA_Client_addObjectTypeNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, otAttr, NULL);
-    else
-        retval = UA_Server_addObjectTypeNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, otAttr, NULL, NULL);
-    
-    UA_NodeId_clear(&requested_new_node_id);
-    UA_NodeId_clear(&parent_node_id);
-    UA_NodeId_clear(&reference_type_node_id);
-    UA_QualifiedName_clear(&browse_name);
+    __atomic_add_fetch(&notifications_sent, 1, __ATOMIC_RELAXED);
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "subscription");
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
+    ei_x_encode_tuple_header(&resp, 4);
+    ei_x_encode_atom(&resp, "data");
+    encode_data_response(&resp, subscription_id, 27, 0);
+    encode_data_response(&resp, monitored_id, 27, 0);
+    
+    encode_data_response(&resp, data, data_type, 0);
 
-    send_ok_response();
+    if(queued)
+        notification_queue_add(&resp, *(uint32_t *) subscription_id, *(uint32_t *) monitored_id, NULL);
+    else
+        response_send(&resp);
 }
 
-/* 
- *  Add a new view node to the server. 
+/**
+ * @brief Send deleted items back to Elixir in form of {:subscription, {:delete, subId, monId}}
  */
-void handle_add_view_node(void *entity, bool entity_type, const char *req, int *req_index)
+void send_monitored_item_delete_response(void *subscription_id, void *monitored_id)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 4)
-        errx(EXIT_FAILURE, ":handle_add_view_node requires a 4-tuple, term_size = %d", term_size);
-    
-    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
-    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
-    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+    ei_x_buff resp;
 
-    UA_ViewAttributes vwAttr = UA_ViewAttributes_default;
-    
-    if(entity_type)
-        retval = UA_Client_addViewNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, vwAttr, NULL);
-    else
-        retval = UA_Server_addViewNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, vwAttr, NULL, NULL);
+    if(notification_queue_pending > 0)
+        notification_queue_remove(*(uint32_t *) subscription_id, *(uint32_t *) monitored_id);
 
-    UA_NodeId_clear(&requested_new_node_id);
-    UA_NodeId_clear(&parent_node_id);
-    UA_NodeId_clear(&reference_type_node_id);
-    UA_QualifiedName_clear(&browse_name);
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "subscription");
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
+    ei_x_encode_tuple_header(&resp, 3);
+    ei_x_encode_atom(&resp, "delete");
+    encode_data_response(&resp, subscription_id, 27, 0);
+    encode_data_response(&resp, monitored_id, 27, 0);
 
-    send_ok_response();
+    response_send(&resp);
 }
 
-/* 
- *  Add a new reference type node to the server. 
+/**
+ * @brief Sends a restored connection back to Elixir in form of
+ * {:reconnected, %{attempts: n, subscriptions: n, monitored_items: n, failed: n}}
  */
-void handle_add_reference_type_node(void *entity, bool entity_type, const char *req, int *req_index)
+void send_reconnected_response(uint32_t attempts, uint32_t subscriptions, uint32_t monitored_items, uint32_t failed)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    ei_x_buff resp;
+
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "reconnected");
+
+    ei_x_encode_map_header(&resp, 4);
+    ei_x_encode_atom(&resp, "attempts");
+    ei_x_encode_ulong(&resp, attempts);
+    ei_x_encode_atom(&resp, "subscriptions");
+    ei_x_encode_ulong(&resp, subscriptions);
+    ei_x_encode_atom(&resp, "monitored_items");
+    ei_x_encode_ulong(&resp, monitored_items);
+    ei_x_encode_atom(&resp, "failed");
+    ei_x_encode_ulong(&resp, failed);
+
+    response_send(&resp);
+}
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 4)
-        errx(EXIT_FAILURE, ":handle_add_reference_type_node requires a 4-tuple, term_size = %d", term_size);
-    
-    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
-    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
-    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+/*  Notification batches
+ *
+ *  When enabled (max_size > 0), data change notifications are encoded into a pending list instead of being sent
+ *  one by one. The owner flushes it once per iteration, or earlier when max_size items are pending, as
+ *  {:subscription, {:data_batch, [{subId, monId, data}, ...]}}.
+ */
+static ei_x_buff notification_batch;
+static int notification_batch_count = 0;
+static int notification_batch_max_size = 0;
+static uint32_t notification_batch_session = 0; // A batch only holds notifications of one client session
 
-    UA_ReferenceTypeAttributes rtAttr = UA_ReferenceTypeAttributes_default;
-    
-    if(entity_type)
-        retval = UA_Client_addReferenceTypeNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, rtAttr, NULL);
-    else
-        retval = UA_Server_addReferenceTypeNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, rtAttr, NULL, NULL);
+#define NOTIFICATION_BATCH_OVERHEAD 64 // Header, tuples and atoms around the list
 
-    UA_NodeId_clear(&requested_new_node_id);
-    UA_NodeId_clear(&parent_node_id);
-    UA_NodeId_clear(&reference_type_node_id);
-    UA_QualifiedName_clear(&browse_name);
+void set_notification_batch_size(int max_size)
+{
+    flush_notification_batch();
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
+    if(max_size > 0 && notification_batch_max_size == 0)
+        ei_x_new(&notification_batch);
+    else if(max_size == 0 && notification_batch_max_size > 0)
+        ei_x_free(&notification_batch);
 
-    send_ok_response();
+    notification_batch_max_size = max_size;
 }
 
-/* 
- *  Add a new data type node to the server. 
+bool notification_batch_enabled()
+{
+    return notification_batch_max_size > 0;
+}
+
+static void send_notification_batch(const char *items, size_t items_size, int count)
+{
+    uint32_t session = response_session;
+    ei_x_buff resp;
+
+    response_session = notification_batch_session;
+    response_init(&resp);
+    response_session = session;
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "subscription");
+
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "data_batch");
+    ei_x_encode_list_header(&resp, count);
+    ei_x_append_buf(&resp, items, items_size);
+    ei_x_encode_empty_list(&resp);
+
+    response_send(&resp);
+}
+
+/**
+ * @brief Appends {subId, monId, data} to the pending batch, it is sent when full or by flush_notification_batch()
  */
-void handle_add_data_type_node(void *entity, bool entity_type, const char *req, int *req_index)
+void add_notification_to_batch(void *subscription_id, void *monitored_id, void *data, int data_type)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    if(notification_queue_full()) {
+        send_monitored_item_response(subscription_id, monitored_id, data, data_type);
+        return;
+    }
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 4)
-        errx(EXIT_FAILURE, ":handle_add_data_type_node requires a 4-tuple, term_size = %d", term_size);
-    
-    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
-    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
-    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+    if(notification_batch_session != response_session) {
+        flush_notification_batch();
+        notification_batch_session = response_session;
+    }
 
-    UA_DataTypeAttributes dtAttr = UA_DataTypeAttributes_default;
-    
-    if(entity_type)
-        retval = UA_Client_addDataTypeNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, dtAttr, NULL);
-    else
-        retval = UA_Server_addDataTypeNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, dtAttr, NULL, NULL);
+    __atomic_add_fetch(&notifications_sent, 1, __ATOMIC_RELAXED);
 
-    UA_NodeId_clear(&requested_new_node_id);
-    UA_NodeId_clear(&parent_node_id);
-    UA_NodeId_clear(&reference_type_node_id);
-    UA_QualifiedName_clear(&browse_name);
+    int item_index = notification_batch.index;
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+    ei_x_encode_tuple_header(&notification_batch, 3);
+    encode_data_response(&notification_batch, subscription_id, 27, 0);
+    encode_data_response(&notification_batch, monitored_id, 27, 0);
+    encode_data_response(&notification_batch, data, data_type, 0);
+
+    // Keep every batch within a single port message.
+    if(notification_batch_count > 0 &&
+        notification_batch.index + NOTIFICATION_BATCH_OVERHEAD > erlcmd_max_payload_size()) {
+        send_notification_batch(notification_batch.buff, item_index, notification_batch_count);
+        memmove(notification_batch.buff, notification_batch.buff + item_index, notification_batch.index - item_index);
+        notification_batch.index -= item_index;
+        notification_batch_count = 0;
     }
 
-    send_ok_response();
+    if(++notification_batch_count >= notification_batch_max_size)
+        flush_notification_batch();
 }
 
-/* 
- *  Delete a reference in the server. 
+void flush_notification_batch()
+{
+    if(notification_batch_count == 0)
+        return;
+
+    send_notification_batch(notification_batch.buff, notification_batch.index, notification_batch_count);
+    notification_batch.index = 0;
+    notification_batch_count = 0;
+}
+
+/*  Write events
+ *
+ *  External writes to server variables are forwarded as {:write, node_id, value}. When batching is enabled they are
+ *  encoded into a pending list instead and sent as {:write_batch, [{node_id, value}, ...]} at the end of the server
+ *  iteration, or once every interval ms when an interval is set.
+ *
+ *  Writes done by Elixir itself run synchronously on the server thread, local_write_node_id is the node written at
+ *  that moment (by this thread) and its onWrite callback is not forwarded.
+ *
+ *  With worker threads (UA_MULTITHREADING >= 200) onWrite runs on the thread serving the client, so it only queues
+ *  a copy of the event under pending_writes_lock and the server thread forwards it in flush_write_batch().
  */
-void handle_delete_reference(void *entity, bool entity_type, const char *req, int *req_index)
+static ei_x_buff write_batch;
+static int write_batch_count = 0;
+static bool write_batch_enabled = false;
+static uint64_t write_batch_interval = 0; // ms, 0 = every server iteration
+static uint64_t write_batch_started = 0;
+static __thread const UA_NodeId *local_write_node_id = NULL;
+
+#if UA_MULTITHREADING >= 200
+struct pending_write {
+    UA_NodeId node_id;
+    UA_Variant value;
+    struct pending_write *next;
+};
+
+static pthread_mutex_t pending_writes_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pending_write *pending_writes = NULL;
+static struct pending_write **pending_writes_tail = &pending_writes;
+
+static void forward_write_event(const UA_NodeId *nodeId, UA_Variant *value);
+
+static void queue_pending_write(const UA_NodeId *nodeId, const UA_Variant *value)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    struct pending_write *write = malloc(sizeof(struct pending_write));
+    if(!write)
+        errx(EXIT_FAILURE, "Could not allocate a write event");
+
+    UA_NodeId_copy(nodeId, &write->node_id);
+    UA_Variant_copy(value, &write->value);
+    write->next = NULL;
+
+    pthread_mutex_lock(&pending_writes_lock);
+    *pending_writes_tail = write;
+    pending_writes_tail = &write->next;
+    pthread_mutex_unlock(&pending_writes_lock);
+}
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 5)
-        errx(EXIT_FAILURE, ":handle_delete_reference requires a 5-tuple, term_size = %d", term_size);
-    
-    UA_NodeId source_id = assemble_node_id(req, req_index);
-    UA_NodeId reference_type_id = assemble_node_id(req, req_index);
-    UA_ExpandedNodeId target_id = assemble_expanded_node_id(req, req_index);
-    
-    int is_forward;
-    ei_decode_boolean(req, req_index, &is_forward);
+static void forward_pending_writes()
+{
+    pthread_mutex_lock(&pending_writes_lock);
+    struct pending_write *write = pending_writes;
+    pending_writes = NULL;
+    pending_writes_tail = &pending_writes;
+    pthread_mutex_unlock(&pending_writes_lock);
 
-    int delete_bidirectional;
-    ei_decode_boolean(req, req_index, &delete_bidirectional);
-    
-    if(entity_type)
-        retval = UA_Client_deleteReference((UA_Client *)entity, source_id, reference_type_id, (UA_Boolean)is_forward, target_id, (UA_Boolean)delete_bidirectional);
-    else
-        retval = UA_Server_deleteReference((UA_Server *)entity, source_id, reference_type_id, (UA_Boolean)is_forward, target_id, (UA_Boolean)delete_bidirectional);
+    while(write) {
+        struct pending_write *next = write->next;
 
-    UA_NodeId_clear(&source_id);
-    UA_NodeId_clear(&reference_type_id);
-    UA_ExpandedNodeId_clear(&target_id);
+        forward_write_event(&write->node_id, &write->value);
+        UA_NodeId_clear(&write->node_id);
+        UA_Variant_clear(&write->value);
+        free(write);
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+        write = next;
     }
-
-    send_ok_response();
 }
+#endif
 
-/* 
- *  Delete a node in the server. 
- */
-void handle_delete_node(void *entity, bool entity_type, const char *req, int *req_index)
+void set_write_batch(bool enabled, uint64_t interval)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    flush_write_batch(true);
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_delete_node requires a 2-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    if(enabled && !write_batch_enabled)
+        ei_x_new(&write_batch);
+    else if(!enabled && write_batch_enabled)
+        ei_x_free(&write_batch);
 
-    int delete_references;
-    ei_decode_boolean(req, req_index, &delete_references);
-    
-    if(entity_type)
-        retval = UA_Client_deleteNode((UA_Client *)entity, node_id, (UA_Boolean)delete_references);
-    else
-        retval = UA_Server_deleteNode((UA_Server *)entity, node_id, (UA_Boolean)delete_references);
+    write_batch_enabled = enabled;
+    write_batch_interval = interval;
+}
 
-    UA_NodeId_clear(&node_id);
+static void send_write_batch(const char *events, size_t events_size, int count)
+{
+    ei_x_buff resp;
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "write_batch");
+    ei_x_encode_list_header(&resp, count);
+    ei_x_append_buf(&resp, events, events_size);
+    ei_x_encode_empty_list(&resp);
+
+    response_send(&resp);
+}
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+static void add_write_to_batch(const UA_NodeId *node_id, UA_Variant *value)
+{
+    int event_index = write_batch.index;
+
+    if(write_batch_count == 0)
+        write_batch_started = current_time();
+
+    ei_x_encode_tuple_header(&write_batch, 2);
+    encode_node_id(&write_batch, (UA_NodeId *) node_id);
+    encode_data_response(&write_batch, value, 29, 0);
+
+    // Keep every batch within a single port message.
+    if(write_batch_count > 0 &&
+        write_batch.index + NOTIFICATION_BATCH_OVERHEAD > erlcmd_max_payload_size()) {
+        send_write_batch(write_batch.buff, event_index, write_batch_count);
+        memmove(write_batch.buff, write_batch.buff + event_index, write_batch.index - event_index);
+        write_batch.index -= event_index;
+        write_batch_count = 0;
+        write_batch_started = current_time();
     }
 
-    send_ok_response();
+    write_batch_count++;
 }
 
-/***************************************/
-/* Reading and Writing Node Attributes */
-/***************************************/
+static void send_pending_write_batch()
+{
+    if(write_batch_count == 0)
+        return;
 
-/* 
- *  Change the browse name of a node in the server. 
+    send_write_batch(write_batch.buff, write_batch.index, write_batch_count);
+    write_batch.index = 0;
+    write_batch_count = 0;
+}
+
+/**
+ * @brief Sends the pending write events, unless the batch interval has not elapsed yet (force = false)
  */
-void handle_write_node_browse_name(void *entity, bool entity_type, const char *req, int *req_index)
+void flush_write_batch(bool force)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_browse_name requires a 2-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
-    
-    if(entity_type)
-        retval = UA_Client_writeBrowseNameAttribute((UA_Client *)entity, node_id, &browse_name);
-    else
-        retval = UA_Server_writeBrowseName((UA_Server *)entity, node_id, browse_name);
+#if UA_MULTITHREADING >= 200
+    forward_pending_writes();
+#endif
 
-    UA_NodeId_clear(&node_id);
-    UA_QualifiedName_clear(&browse_name);
+    if(write_batch_count == 0)
+        return;
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+    if(!force && write_batch_interval > 0 && current_time() - write_batch_started < write_batch_interval)
         return;
-    }
 
-    send_ok_response();
+    send_pending_write_batch();
 }
 
-/* 
- *  Change the display name of a node in the server. 
+/**
+ * @brief UA_Server_write without forwarding the write back to Elixir
  */
-void handle_write_node_display_name(void *entity, bool entity_type, const char *req, int *req_index)
+UA_StatusCode server_local_write(UA_Server *server, const UA_WriteValue *value)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    local_write_node_id = &value->nodeId;
+    UA_StatusCode retval = UA_Server_write(server, value);
+    local_write_node_id = NULL;
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 3)
-        errx(EXIT_FAILURE, ":handle_write_node_display_name requires a 3-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    return retval;
+}
 
-    // locale
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid locale (size)");
-    
-    char locale[term_size + 1];
-    long binary_len;
-    if (ei_decode_binary(req, req_index, locale, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid locale");
+UA_StatusCode server_local_write_value(UA_Server *server, const UA_NodeId node_id, const UA_Variant value)
+{
+    local_write_node_id = &node_id;
+    UA_StatusCode retval = UA_Server_writeValue(server, node_id, value);
+    local_write_node_id = NULL;
 
-    locale[binary_len] = '\0';
+    return retval;
+}
 
-    // name_str
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid name_str (size)");
-    
-    char name_str[term_size + 1];
-    if (ei_decode_binary(req, req_index, name_str, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid name_str");
+/**
+ * @brief Send write data back to Elixir in form of {:write, node_id, value}
+ */
+void send_write_data_response(const UA_NodeId *nodeId, void *data, int data_type)
+{
+    ei_x_buff resp;
+    bool queued = notification_queue_full();
 
-    name_str[binary_len] = '\0';
+    if(queued && write_batch_enabled)
+        send_pending_write_batch();
 
-    UA_LocalizedText display_name =  UA_LOCALIZEDTEXT(locale, name_str);
-    
-    if(entity_type)
-        retval = UA_Client_writeDisplayNameAttribute((UA_Client *)entity, node_id, &display_name);
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 3);
+    ei_x_encode_atom(&resp, "write");
+
+    encode_node_id(&resp, (UA_NodeId *) nodeId);
+    encode_data_response(&resp, data, data_type, 0);
+
+    if(queued)
+        notification_queue_add(&resp, 0, 0, nodeId);
     else
-        retval = UA_Server_writeDisplayName((UA_Server *)entity, node_id, display_name);
+        response_send(&resp);
+}
 
-    UA_NodeId_clear(&node_id);
+/**
+ * @brief Send data back to Elixir in form of {:ok, data}
+ */
+void send_data_response(void *data, int data_type, int data_len)
+{
+    ei_x_buff resp;
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 3);
+    encode_caller_metadata(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "ok");
+    encode_data_response(&resp, data, data_type, data_len);
+
+    if(!response_send(&resp))
+        send_opex_response(UA_STATUSCODE_BADRESPONSETOOLARGE);
+}
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
+/**
+ * @brief Send a response of the form {:error, reason}
+ *
+ * @param reason is an error reason (sended back as an atom)
+ */
+void send_error_response(const char *reason)
+{
+    ei_x_buff resp;
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 3);
+    encode_caller_metadata(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "error");
+    ei_x_encode_atom(&resp, reason);
+    response_send(&resp);
+}
 
-    send_ok_response();
+/**
+ * @brief Send :ok back to Elixir
+ */
+void send_ok_response()
+{
+    ei_x_buff resp;
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 3);
+    encode_caller_metadata(&resp);
+    ei_x_encode_atom(&resp, "ok");
+    response_send(&resp);
 }
 
-/* 
- *  Change description of a node in the server. 
+// https://open62541.org/doc/current/statuscodes.html?highlight=error
+void send_opex_response(uint32_t reason)
+{
+    const char *status_code = UA_StatusCode_name(reason);
+    ei_x_buff resp;
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 3);
+    encode_caller_metadata(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "error");
+    ei_x_encode_binary(&resp, status_code, strlen(status_code));
+    response_send(&resp);
+}
+
+/*  Port statistics
+ *
+ *  Every dispatched request is timed and counted per handler, its latency goes to a log2 histogram in microseconds.
+ *  get_stats reports them with the erlcmd traffic counters, the notification counters and the gauges of each
+ *  program. Once an interval is set they are also pushed as {:stats, stats}.
  */
-void handle_write_node_description(void *entity, bool entity_type, const char *req, int *req_index)
+#define STATS_LATENCY_BUCKETS 24 // Bucket i counts latencies below 2^i us, the last one also the slower ones
+
+struct handler_stats {
+    uint64_t calls;
+    uint64_t total_time;
+    uint64_t max_time;
+    uint64_t histogram[STATS_LATENCY_BUCKETS];
+};
+
+static struct handler_stats *handler_stats = NULL;
+static uint64_t stats_interval = 0; // ms, 0 = no push
+static uint64_t stats_next_push = 0;
+
+static void init_handler_stats()
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    free(handler_stats);
+    handler_stats = calloc(request_handlers_count, sizeof(struct handler_stats));
+    if(!handler_stats)
+        errx(EXIT_FAILURE, "Can't allocate the handler statistics");
+}
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 3)
-        errx(EXIT_FAILURE, ":handle_write_node_description requires a 3-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+/**
+ * @brief Runs a request handler and records its latency
+ */
+void call_request_handler(const struct request_handler *rh, void *entity, bool entity_type, const char *req, int *req_index)
+{
+    uint64_t started = current_time_us();
+    jmp_buf abort_point;
 
-    // locale
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid locale (size)");
-    
-    char locale[term_size + 1];
-    long binary_len;
-    if (ei_decode_binary(req, req_index, locale, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid locale");
+    if(setjmp(abort_point) == 0) {
+        request_abort = &abort_point;
+        rh->handler(entity, entity_type, req, req_index);
+    }
+    else {
+        // Unknown node handle, see decode_node_handle
+        if(request_abort_array)
+            UA_Array_delete(request_abort_array, request_abort_array_size, request_abort_array_type);
+        response_buffer_user = NULL;
+        send_error_response("einval");
+    }
 
-    locale[binary_len] = '\0';
+    request_abort = NULL;
+    set_request_abort_array(NULL, 0, NULL);
+    uint64_t elapsed = current_time_us() - started;
 
-    // description_str
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid description_str (size)");
-    
-    char description_str[term_size + 1];
-    if (ei_decode_binary(req, req_index, description_str, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid description_str");
+    struct handler_stats *hs = &handler_stats[rh - request_handlers_table];
+    int bucket = 0;
+    while(bucket < STATS_LATENCY_BUCKETS - 1 && elapsed >= (1ULL << bucket))
+        bucket++;
 
-    description_str[binary_len] = '\0';
+    hs->calls++;
+    hs->total_time += elapsed;
+    if(elapsed > hs->max_time)
+        hs->max_time = elapsed;
+    hs->histogram[bucket]++;
+}
 
-    UA_LocalizedText description =  UA_LOCALIZEDTEXT(locale, description_str);
-    
-    if(entity_type)
-        retval = UA_Client_writeDescriptionAttribute((UA_Client *)entity, node_id, &description);
-    else
-        retval = UA_Server_writeDescription((UA_Server *)entity, node_id, description);
+static void set_stats_interval(uint64_t interval)
+{
+    stats_interval = interval;
+    stats_next_push = current_time() + interval;
+}
 
-    UA_NodeId_clear(&node_id);
+/**
+ * @return true once per stats interval, the caller then sends the statistics with send_stats()
+ */
+bool stats_push_due()
+{
+    if(stats_interval == 0)
+        return false;
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
+    uint64_t now = current_time();
+    if(now < stats_next_push)
+        return false;
+
+    stats_next_push = now + stats_interval;
+    return true;
+}
+
+/**
+ * @return the ms until the next push, -1 if there is none (poll() timeout)
+ */
+int stats_push_timeout()
+{
+    if(stats_interval == 0)
+        return -1;
+
+    uint64_t now = current_time();
+    return now >= stats_next_push ? 0 : (int) (stats_next_push - now);
+}
+
+static void encode_stats_counter(ei_x_buff *resp, const char *name, uint64_t value)
+{
+    ei_x_encode_atom(resp, name);
+    ei_x_encode_ulonglong(resp, value);
+}
+
+//%{handlers: %{cmd => %{calls, total_time, max_time, histogram}}, port: %{...}, gauges: %{...}}
+static void encode_port_stats(ei_x_buff *resp, void *data, int data_len)
+{
+    const struct stats_gauge *gauges = data;
+    struct erlcmd_stats port;
+    erlcmd_get_stats(&port);
+
+    ei_x_encode_map_header(resp, 3);
+
+    ei_x_encode_atom(resp, "handlers");
+    size_t called = 0;
+    for(size_t i = 0; i < request_handlers_count; i++)
+        if(handler_stats[i].calls)
+            called++;
+
+    ei_x_encode_map_header(resp, called);
+    for(size_t i = 0; i < request_handlers_count; i++) {
+        const struct handler_stats *hs = &handler_stats[i];
+        if(!hs->calls)
+            continue;
+
+        ei_x_encode_atom(resp, request_handlers_table[i].name);
+        ei_x_encode_map_header(resp, 4);
+        encode_stats_counter(resp, "calls", hs->calls);
+        encode_stats_counter(resp, "total_time", hs->total_time);
+        encode_stats_counter(resp, "max_time", hs->max_time);
+        ei_x_encode_atom(resp, "histogram");
+        ei_x_encode_list_header(resp, STATS_LATENCY_BUCKETS);
+        for(int bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++)
+            ei_x_encode_ulonglong(resp, hs->histogram[bucket]);
+        ei_x_encode_empty_list(resp);
     }
 
-    send_ok_response();
+    ei_x_encode_atom(resp, "port");
+    ei_x_encode_map_header(resp, 11);
+    encode_stats_counter(resp, "messages_read", port.messages_read);
+    encode_stats_counter(resp, "bytes_read", port.bytes_read);
+    encode_stats_counter(resp, "max_read_size", port.max_read_size);
+    encode_stats_counter(resp, "messages_written", port.messages_written);
+    encode_stats_counter(resp, "bytes_written", port.bytes_written);
+    encode_stats_counter(resp, "max_written_size", port.max_written_size);
+    encode_stats_counter(resp, "write_time", port.write_time);
+    encode_stats_counter(resp, "notifications", __atomic_load_n(&notifications_sent, __ATOMIC_RELAXED));
+    encode_stats_counter(resp, "write_events", __atomic_load_n(&write_events_sent, __ATOMIC_RELAXED));
+    encode_stats_counter(resp, "notifications_dropped", __atomic_load_n(&notifications_dropped, __ATOMIC_RELAXED));
+    encode_stats_counter(resp, "output_pending", erlcmd_pending_size());
+
+    ei_x_encode_atom(resp, "gauges");
+    ei_x_encode_map_header(resp, data_len + 3);
+    encode_stats_counter(resp, "notification_batch", notification_batch_count);
+    encode_stats_counter(resp, "write_batch", write_batch_count);
+    encode_stats_counter(resp, "notification_queue", notification_queue_pending);
+    for(int i = 0; i < data_len; i++)
+        encode_stats_counter(resp, gauges[i].name, gauges[i].value);
+}
+
+/**
+ * @brief Send the statistics back to Elixir in form of {:ok, stats}
+ */
+void send_stats_response(const struct stats_gauge *gauges, size_t gauges_size)
+{
+    send_data_response((void *) gauges, 36, gauges_size);
+}
+
+/**
+ * @brief Push the statistics to Elixir in form of {:stats, stats}
+ */
+void send_stats(const struct stats_gauge *gauges, size_t gauges_size)
+{
+    uint32_t session = response_session;
+    ei_x_buff resp;
+
+    response_session = 0;
+    response_init(&resp);
+    response_session = session;
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "stats");
+    encode_port_stats(&resp, (void *) gauges, gauges_size);
+    response_send(&resp);
+}
+
+/*****************************/
+/* Common Open62541 handlers */
+/*****************************/
+
+void handle_test(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    send_ok_response();     
 }
 
 /* 
- *  Change 'Write Mask' of a node in the server. 
+ *   Returns the optional open62541 features the port was built with (OPEN62541_PROFILE), a list of atoms.
  */
-void handle_write_node_write_mask(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_get_build_features(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    const char *features[2];
+    int features_size = 0;
+#if UA_MULTITHREADING >= 200
+    features[features_size++] = "multithreading";
+#endif
+#ifdef UA_ENABLE_HISTORIZING
+    features[features_size++] = "historizing";
+#endif
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_write_mask requires a 2-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    ei_x_buff resp;
+    response_init(&resp);
+    ei_x_encode_tuple_header(&resp, 3);
+    encode_caller_metadata(&resp);
+    ei_x_encode_tuple_header(&resp, 2);
+    ei_x_encode_atom(&resp, "ok");
+    if(features_size > 0)
+        ei_x_encode_list_header(&resp, features_size);
+    for(int i = 0; i < features_size; i++)
+        ei_x_encode_atom(&resp, features[i]);
+    ei_x_encode_empty_list(&resp);
+    response_send(&resp);
+}
 
-    // write_mask
-    unsigned long write_mask;
-    if (ei_decode_ulong(req, req_index, &write_mask) < 0) {
+/* 
+ *   Enables (max_size > 0) or disables batched data change notifications, see add_notification_to_batch.
+ */
+void handle_set_notification_batch_size(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long max_size;
+    if (ei_decode_ulong(req, req_index, &max_size) < 0) {
         send_error_response("einval");
         return;
     }
 
-    UA_UInt32 ua_write_mask = write_mask;
-    
-    if(entity_type)
-        retval = UA_Client_writeWriteMaskAttribute((UA_Client *)entity, node_id, &ua_write_mask);
-    else
-        retval = UA_Server_writeWriteMask((UA_Server *)entity, node_id, ua_write_mask);
-    
-    UA_NodeId_clear(&node_id);
-
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
-        return;
-    }
+    set_notification_batch_size((int) max_size);
 
     send_ok_response();
 }
 
 /* 
- *  Change 'Is Abstract' of a node in the server. 
+ *   {capacity, threshold}: moves responses of at least threshold bytes to a shared memory ring of capacity bytes
+ *   and returns its name, the port owner maps it before the next message. A 0 capacity disables it.
  */
-void handle_write_node_is_abstract(void *entity, bool entity_type, const char *req, int *req_index)
+#define SHM_RING_MIN_CAPACITY (64 * 1024)
+#define SHM_RING_MAX_CAPACITY (1024 * 1024 * 1024)
+
+void handle_enable_shm_ring(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
-    int term_type;
-    UA_StatusCode retval;
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_is_abstract requires a 2-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    unsigned long capacity;
+    unsigned long threshold;
 
-    // write_mask
-    int is_abstract;
-    if (ei_decode_boolean(req, req_index, &is_abstract) < 0) {
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 2 ||
+        ei_decode_ulong(req, req_index, &capacity) < 0 ||
+        ei_decode_ulong(req, req_index, &threshold) < 0 ||
+        (capacity != 0 && (capacity < SHM_RING_MIN_CAPACITY || capacity > SHM_RING_MAX_CAPACITY))) {
         send_error_response("einval");
         return;
     }
 
-    UA_Boolean is_abstract_bool = is_abstract;
-    
-    if(entity_type)
-        retval = UA_Client_writeIsAbstractAttribute((UA_Client *)entity, node_id, &is_abstract_bool);
-    else
-        retval = UA_Server_writeIsAbstract((UA_Server *)entity, node_id, is_abstract_bool);
+#ifdef __WIN32__
+    send_opex_response(UA_STATUSCODE_BADNOTSUPPORTED);
+#else
+    if(capacity == 0) {
+        shm_ring_close();
+        send_ok_response();
+        return;
+    }
 
-    UA_NodeId_clear(&node_id);
+    if(shm_ring != NULL) {
+        send_opex_response(UA_STATUSCODE_BADINVALIDSTATE);
+        return;
+    }
 
+    UA_StatusCode retval = shm_ring_open((capacity + SHM_RING_ALIGN - 1) & ~((size_t) SHM_RING_ALIGN - 1));
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
         return;
     }
 
-    send_ok_response();
+    // The name goes through the pipe, the ring is only used by the following responses.
+    struct shm_ring_header *ring = shm_ring;
+    shm_ring = NULL;
+    send_data_response(shm_ring_name, 3, 0);
+    shm_ring = ring;
+    shm_ring_threshold = threshold;
+#endif
 }
 
 /* 
- *  Change 'Inverse name' of a node in the server. 
+ *   Lets the port keep at most high_water bytes (0 disables it) of output waiting for Elixir before notifications
+ *   and write events are compacted, see set_notification_queue.
  */
-void handle_write_node_inverse_name(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_set_notification_queue(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 3)
-        errx(EXIT_FAILURE, ":handle_write_node_inverse_name requires a 3-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    // locale
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid locale (size)");
-    
-    char locale[term_size + 1];
-    long binary_len;
-    if (ei_decode_binary(req, req_index, locale, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid locale");
-
-    locale[binary_len] = '\0';
-
-    // inverse_name_str
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-        errx(EXIT_FAILURE, "Invalid inverse_name_str (size)");
-    
-    char inverse_name_str[term_size + 1];
-    if (ei_decode_binary(req, req_index, inverse_name_str, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid inverse_name_str");
-
-    inverse_name_str[binary_len] = '\0';
+    unsigned long high_water;
+    if (ei_decode_ulong(req, req_index, &high_water) < 0) {
+        send_error_response("einval");
+        return;
+    }
 
-    UA_LocalizedText inverse_name =  UA_LOCALIZEDTEXT(locale, inverse_name_str);
-    
-    if(entity_type)
-        retval = UA_Client_writeInverseNameAttribute((UA_Client *)entity, node_id, &inverse_name);
-    else
-        retval = UA_Server_writeInverseName((UA_Server *)entity, node_id, inverse_name);
+    if(!set_notification_queue(high_water)) {
+        send_opex_response(UA_STATUSCODE_BADNOTSUPPORTED);
+        return;
+    }
 
-    UA_NodeId_clear(&node_id);
+    send_ok_response();
+}
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+/* 
+ *   Pushes the port statistics every interval ms (0 disables it), see encode_port_stats.
+ */
+void handle_set_stats_interval(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long interval;
+    if (ei_decode_ulong(req, req_index, &interval) < 0) {
+        send_error_response("einval");
         return;
     }
 
+    set_stats_interval(interval);
+
     send_ok_response();
 }
 
 /* 
- *  Change 'data type' of a node in the server. 
+ *   Returns the command names in opcode order, Elixir uses it to send opcodes instead of atoms.
  */
-void handle_write_node_data_type(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_list_commands(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    int term_size;
-    int term_type;
-    UA_StatusCode retval;
+    send_data_response((void *) request_handlers_table, 32, request_handlers_count);
+}
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_data_type requires a 3-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-    UA_NodeId data_type_node_id = assemble_node_id(req, req_index);
+static void forward_write_event(const UA_NodeId *nodeId, UA_Variant *value)
+{
+    __atomic_add_fetch(&write_events_sent, 1, __ATOMIC_RELAXED);
 
-    if(entity_type)
-        retval = UA_Client_writeDataTypeAttribute((UA_Client *)entity, node_id, &data_type_node_id);
+    if(write_batch_enabled && !notification_queue_full())
+        add_write_to_batch(nodeId, value);
     else
-        retval = UA_Server_writeDataType((UA_Server *)entity, node_id, data_type_node_id);
+        send_write_data_response(nodeId, value, 29);
+}
 
-    UA_NodeId_clear(&node_id);
-    UA_NodeId_clear(&data_type_node_id);
+/**
+ * @brief onWrite callback of server variables, forwards external writes to Elixir
+ */
+void send_write_response(UA_Server *server,
+               const UA_NodeId *sessionId, void *sessionContext,
+               const UA_NodeId *nodeId, void *nodeContext,
+               const UA_NumericRange *range, const UA_DataValue *data) {
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+    if(local_write_node_id && UA_NodeId_equal(nodeId, local_write_node_id))
         return;
-    }
 
-    send_ok_response();
+#if UA_MULTITHREADING >= 200
+    queue_pending_write(nodeId, &data->value);
+#else
+    UA_Variant variant = data->value;
+    forward_write_event(nodeId, &variant);
+#endif
 }
 
+/******************************/
+/* Node Addition and Deletion */
+/******************************/
+
 /* 
- *  Change 'Value Rank' of a node in the server. 
+ *  Add a new variable node to the server. 
  */
-void handle_write_node_value_rank(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_add_variable_node(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
     UA_StatusCode retval;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_value_rank requires a 2-tuple, term_size = %d", term_size);
+        term_size != 5)
+        errx(EXIT_FAILURE, ":handle_add_variable_node requires a 5-tuple, term_size = %d", term_size);
     
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    // value_range
-    unsigned long value_rank;
-    if (ei_decode_ulong(req, req_index, &value_rank) < 0) {
-        send_error_response("einval");
-        return;
-    }
+    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+    UA_NodeId type_definition = assemble_node_id(req, req_index);
 
-    UA_UInt32 ua_value_rank = value_rank;
+    UA_VariableAttributes vAttr = UA_VariableAttributes_default;
     
     if(entity_type)
-        retval = UA_Client_writeValueRankAttribute((UA_Client *)entity, node_id, &ua_value_rank);
+        retval = UA_Client_addVariableNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, vAttr, NULL);
     else
-        retval = UA_Server_writeValueRank((UA_Server *)entity, node_id, ua_value_rank);
+    {
+        UA_ValueCallback callback;
+        callback.onRead = NULL;
+        callback.onWrite = send_write_response;
+        retval = UA_Server_addVariableNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, vAttr, NULL, NULL);
+        UA_Server_setVariableNode_valueCallback((UA_Server *)entity, requested_new_node_id, callback);
+    }
 
-    UA_NodeId_clear(&node_id);
+    UA_NodeId_clear(&requested_new_node_id);
+    UA_NodeId_clear(&parent_node_id);
+    UA_NodeId_clear(&reference_type_node_id);
+    UA_QualifiedName_clear(&browse_name);
+    UA_NodeId_clear(&type_definition);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -1864,55 +3376,36 @@ void handle_write_node_value_rank(void *entity, bool entity_type, const char *re
 }
 
 /* 
- *  Change 'Array_dimensions' of a node in the server. 
+ *  Add a new variable type node to the server.(client must send {0,0,0} for type_definition),
  */
-void handle_write_node_array_dimensions(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_add_variable_type_node(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
-    int list_size;
     int term_type;
     UA_StatusCode retval;
-    UA_Variant var_array_dimension;
-    UA_Variant_init(&var_array_dimension);
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 3)
-        errx(EXIT_FAILURE, ":handle_write_node_array_dimension requires a 3-tuple, term_size = %d", term_size);
-    
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    unsigned long array_dimension_size;
-    if (ei_decode_ulong(req, req_index, &array_dimension_size) < 0) {
-        send_error_response("einval");
-        return;
-    }
-
-    UA_UInt32 array_dimension[array_dimension_size];
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != array_dimension_size)
-        errx(EXIT_FAILURE, ":handle_write_node_array_dimension arity mismatch, list_size = %d, array_d = %ld", term_size, array_dimension_size);
-
-    for (unsigned long i = 0; i < array_dimension_size; i++)
-    {
-        unsigned long dimension;
-        if (ei_decode_ulong(req, req_index, &dimension) < 0) {
-            send_error_response("einval");
-            return;
-        }
+        term_size != 5)
+        errx(EXIT_FAILURE, ":handle_add_variable_type_node requires a 5-tuple, term_size = %d", term_size);
     
-        array_dimension[i] = (UA_UInt32) dimension;
-    }
-
-    UA_Variant_setArrayCopy(&var_array_dimension, array_dimension, array_dimension_size, &UA_TYPES[UA_TYPES_UINT32]);
+    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+    UA_NodeId type_definition = assemble_node_id(req, req_index);
 
+    UA_VariableTypeAttributes vtAttr = UA_VariableTypeAttributes_default;
     
     if(entity_type)
-        retval = UA_Client_writeArrayDimensionsAttribute((UA_Client *)entity, node_id, array_dimension_size, array_dimension);
+        retval = UA_Client_addVariableTypeNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, vtAttr, NULL);
     else
-        retval = UA_Server_writeArrayDimensions((UA_Server *)entity, node_id, var_array_dimension);
+        retval = UA_Server_addVariableTypeNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, vtAttr, NULL, NULL);
 
-    UA_NodeId_clear(&node_id);
-    UA_Variant_clear(&var_array_dimension);
+    UA_NodeId_clear(&requested_new_node_id);
+    UA_NodeId_clear(&parent_node_id);
+    UA_NodeId_clear(&reference_type_node_id);
+    UA_QualifiedName_clear(&browse_name);
+    UA_NodeId_clear(&type_definition);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -1923,35 +3416,36 @@ void handle_write_node_array_dimensions(void *entity, bool entity_type, const ch
 }
 
 /* 
- *  Change 'Access Level' of a node in the server. 
+ *  Add a new object node to the server. 
  */
-void handle_write_node_access_level(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_add_object_node(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
     UA_StatusCode retval;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_access_level requires a 2-tuple, term_size = %d", term_size);
+        term_size != 5)
+        errx(EXIT_FAILURE, ":handle_add_object_node requires a 5-tuple, term_size = %d", term_size);
     
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    // value_range
-    unsigned long access_level;
-    if (ei_decode_ulong(req, req_index, &access_level) < 0) {
-        send_error_response("einval");
-        return;
-    }
+    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+    UA_NodeId type_definition = assemble_node_id(req, req_index);
 
-    UA_Byte ua_access_level = access_level;
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
     
     if(entity_type)
-        retval = UA_Client_writeAccessLevelAttribute((UA_Client *)entity, node_id, &ua_access_level);
+        retval = UA_Client_addObjectNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, oAttr, NULL);
     else
-        retval = UA_Server_writeAccessLevel((UA_Server *)entity, node_id, ua_access_level);
+        retval = UA_Server_addObjectNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, oAttr, NULL, NULL);
 
-    UA_NodeId_clear(&node_id);
+    UA_NodeId_clear(&requested_new_node_id);
+    UA_NodeId_clear(&parent_node_id);
+    UA_NodeId_clear(&reference_type_node_id);
+    UA_QualifiedName_clear(&browse_name);
+    UA_NodeId_clear(&type_definition);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -1962,35 +3456,34 @@ void handle_write_node_access_level(void *entity, bool entity_type, const char *
 }
 
 /* 
- *  Change 'Minimum Sampling Interval' of a node in the server. 
+ *  Add a new object type node to the server. 
  */
-void handle_write_node_minimum_sampling_interval(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_add_object_type_node(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
     UA_StatusCode retval;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_minimum_sampling_interval requires a 2-tuple, term_size = %d", term_size);
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_add_object_type_node requires a 4-tuple, term_size = %d", term_size);
     
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    // value_range
-    double sampling_interval;
-    if (ei_decode_double(req, req_index, &sampling_interval) < 0) {
-        send_error_response("einval");
-        return;
-    }
+    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
 
-    UA_Double ua_sampling_interval = sampling_interval;
+    UA_ObjectTypeAttributes otAttr = UA_ObjectTypeAttributes_default;
     
     if(entity_type)
-        retval = UA_Client_writeMinimumSamplingIntervalAttribute((UA_Client *)entity, node_id, &ua_sampling_interval);
+        retval = UA_Client_addObjectTypeNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, otAttr, NULL);
     else
-        retval = UA_Server_writeMinimumSamplingInterval((UA_Server *)entity, node_id, ua_sampling_interval);
-
-    UA_NodeId_clear(&node_id);
+        retval = UA_Server_addObjectTypeNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, otAttr, NULL, NULL);
+    
+    UA_NodeId_clear(&requested_new_node_id);
+    UA_NodeId_clear(&parent_node_id);
+    UA_NodeId_clear(&reference_type_node_id);
+    UA_QualifiedName_clear(&browse_name);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -2001,35 +3494,72 @@ void handle_write_node_minimum_sampling_interval(void *entity, bool entity_type,
 }
 
 /* 
- *  Change 'Historizing' of a node in the server. 
+ *  Add a new view node to the server. 
  */
-void handle_write_node_historizing(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_add_view_node(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
     UA_StatusCode retval;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_historizing requires a 2-tuple, term_size = %d", term_size);
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_add_view_node requires a 4-tuple, term_size = %d", term_size);
     
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
 
-    // write_mask
-    int historizing;
-    if (ei_decode_boolean(req, req_index, &historizing) < 0) {
-        send_error_response("einval");
+    UA_ViewAttributes vwAttr = UA_ViewAttributes_default;
+    
+    if(entity_type)
+        retval = UA_Client_addViewNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, vwAttr, NULL);
+    else
+        retval = UA_Server_addViewNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, vwAttr, NULL, NULL);
+
+    UA_NodeId_clear(&requested_new_node_id);
+    UA_NodeId_clear(&parent_node_id);
+    UA_NodeId_clear(&reference_type_node_id);
+    UA_QualifiedName_clear(&browse_name);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
         return;
     }
+
+    send_ok_response();
+}
+
+/* 
+ *  Add a new reference type node to the server. 
+ */
+void handle_add_reference_type_node(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_add_reference_type_node requires a 4-tuple, term_size = %d", term_size);
     
-    UA_Boolean ua_historizing = historizing;
+    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
 
+    UA_ReferenceTypeAttributes rtAttr = UA_ReferenceTypeAttributes_default;
+    
     if(entity_type)
-        retval = UA_Client_writeHistorizingAttribute((UA_Client *)entity, node_id, &ua_historizing);
+        retval = UA_Client_addReferenceTypeNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, rtAttr, NULL);
     else
-        retval = UA_Server_writeHistorizing((UA_Server *)entity, node_id, ua_historizing);
+        retval = UA_Server_addReferenceTypeNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, rtAttr, NULL, NULL);
 
-    UA_NodeId_clear(&node_id);
+    UA_NodeId_clear(&requested_new_node_id);
+    UA_NodeId_clear(&parent_node_id);
+    UA_NodeId_clear(&reference_type_node_id);
+    UA_QualifiedName_clear(&browse_name);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -2040,35 +3570,74 @@ void handle_write_node_historizing(void *entity, bool entity_type, const char *r
 }
 
 /* 
- *  Change 'Excutable' of a node in the server. 
+ *  Add a new data type node to the server. 
  */
-void handle_write_node_executable(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_add_data_type_node(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
     UA_StatusCode retval;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_executable requires a 2-tuple, term_size = %d", term_size);
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_add_data_type_node requires a 4-tuple, term_size = %d", term_size);
     
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    UA_NodeId requested_new_node_id = assemble_node_id(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
 
-    // write_mask
-    int executable;
-    if (ei_decode_boolean(req, req_index, &executable) < 0) {
-        send_error_response("einval");
+    UA_DataTypeAttributes dtAttr = UA_DataTypeAttributes_default;
+    
+    if(entity_type)
+        retval = UA_Client_addDataTypeNode((UA_Client *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, dtAttr, NULL);
+    else
+        retval = UA_Server_addDataTypeNode((UA_Server *)entity, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, dtAttr, NULL, NULL);
+
+    UA_NodeId_clear(&requested_new_node_id);
+    UA_NodeId_clear(&parent_node_id);
+    UA_NodeId_clear(&reference_type_node_id);
+    UA_QualifiedName_clear(&browse_name);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
         return;
     }
+
+    send_ok_response();
+}
+
+/* 
+ *  Delete a reference in the server. 
+ */
+void handle_delete_reference(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 5)
+        errx(EXIT_FAILURE, ":handle_delete_reference requires a 5-tuple, term_size = %d", term_size);
     
-    UA_Boolean ua_executable = executable;
+    UA_NodeId source_id = assemble_node_id(req, req_index);
+    UA_NodeId reference_type_id = assemble_node_id(req, req_index);
+    UA_ExpandedNodeId target_id = assemble_expanded_node_id(req, req_index);
+    
+    int is_forward;
+    ei_decode_boolean(req, req_index, &is_forward);
 
+    int delete_bidirectional;
+    ei_decode_boolean(req, req_index, &delete_bidirectional);
+    
     if(entity_type)
-        retval = UA_Client_writeHistorizingAttribute((UA_Client *)entity, node_id, &ua_executable);
+        retval = UA_Client_deleteReference((UA_Client *)entity, source_id, reference_type_id, (UA_Boolean)is_forward, target_id, (UA_Boolean)delete_bidirectional);
     else
-        retval = UA_Server_writeHistorizing((UA_Server *)entity, node_id, ua_executable);
+        retval = UA_Server_deleteReference((UA_Server *)entity, source_id, reference_type_id, (UA_Boolean)is_forward, target_id, (UA_Boolean)delete_bidirectional);
 
-    UA_NodeId_clear(&node_id);
+    UA_NodeId_clear(&source_id);
+    UA_NodeId_clear(&reference_type_id);
+    UA_ExpandedNodeId_clear(&target_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -2079,9 +3648,9 @@ void handle_write_node_executable(void *entity, bool entity_type, const char *re
 }
 
 /* 
- *  Change 'event_notifier' of a node in the server. 
+ *  Delete a node in the server. 
  */
-void handle_write_node_event_notifier(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_delete_node(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
@@ -2089,22 +3658,17 @@ void handle_write_node_event_notifier(void *entity, bool entity_type, const char
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
         term_size != 2)
-        errx(EXIT_FAILURE, ":handle_write_node_event_notifier requires a 2-tuple, term_size = %d", term_size);
+        errx(EXIT_FAILURE, ":handle_delete_node requires a 2-tuple, term_size = %d", term_size);
     
     UA_NodeId node_id = assemble_node_id(req, req_index);
 
-    unsigned long event_notifier;
-    if (ei_decode_ulong(req, req_index, &event_notifier) < 0) {
-        send_error_response("einval");
-        return;
-    }
+    int delete_references;
+    ei_decode_boolean(req, req_index, &delete_references);
     
-    UA_Byte ua_event_notifier = (UA_Byte) event_notifier;
-
     if(entity_type)
-        retval = UA_Client_writeEventNotifierAttribute((UA_Client *)entity, node_id, &ua_event_notifier);
+        retval = UA_Client_deleteNode((UA_Client *)entity, node_id, (UA_Boolean)delete_references);
     else
-        retval = UA_Server_writeEventNotifier((UA_Server *)entity, node_id, ua_event_notifier);
+        retval = UA_Server_deleteNode((UA_Server *)entity, node_id, (UA_Boolean)delete_references);
 
     UA_NodeId_clear(&node_id);
 
@@ -2116,80 +3680,683 @@ void handle_write_node_event_notifier(void *entity, bool entity_type, const char
     send_ok_response();
 }
 
+/***************************************/
+/* Reading and Writing Node Attributes */
+/***************************************/
+
 /* 
- *  Change 'value' of a node in the server.
- *  BUG String is allocated in memory 
+ *  Change the browse name of a node in the server. 
  */
-void handle_write_node_value(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_write_node_browse_name(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
-    bool is_null = false;
-    bool is_scalar = false;
-    UA_NodeId node_id_arg_1;
-    UA_NodeId node_id_arg_2;
-    UA_ExpandedNodeId expanded_node_id_arg_1;
-    UA_QualifiedName qualified_name;
-    UA_StatusCode retval = 0;
+    UA_StatusCode retval;
 
-    UA_Variant value;
-    UA_Variant_init(&value);
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_browse_name requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+    
+    if(entity_type)
+        retval = UA_Client_writeBrowseNameAttribute((UA_Client *)entity, node_id, &browse_name);
+    else
+        retval = UA_Server_writeBrowseName((UA_Server *)entity, node_id, browse_name);
 
-    char *arg1 = NULL;
-    char *arg2 = NULL;
+    UA_NodeId_clear(&node_id);
+    UA_QualifiedName_clear(&browse_name);
 
-    UA_NodeId_init(&node_id_arg_1);
-    UA_NodeId_init(&node_id_arg_2);
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
 
-    UA_ExpandedNodeId_init(&expanded_node_id_arg_1);
+    send_ok_response();
+}
+
+/* 
+ *  Change the display name of a node in the server. 
+ */
+void handle_write_node_display_name(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 4)
-        errx(EXIT_FAILURE, ":handle_write_node_value requires a 4-tuple, term_size = %d", term_size);
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_write_node_display_name requires a 3-tuple, term_size = %d", term_size);
     
     UA_NodeId node_id = assemble_node_id(req, req_index);
 
-    unsigned long data_type;
-    if (ei_decode_ulong(req, req_index, &data_type) < 0) {
-        send_error_response("einval");
-        return;
-    }
+    // locale
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid locale (size)");
+    
+    char locale[term_size + 1];
+    long binary_len;
+    if (ei_decode_binary(req, req_index, locale, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid locale");
 
-    size_t data_index;
-    if (ei_decode_ulong(req, req_index, &data_index) < 0) {
-        send_error_response("einval");
-        return;
-    }
+    locale[binary_len] = '\0';
+
+    // name_str
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid name_str (size)");
+    
+    char name_str[term_size + 1];
+    if (ei_decode_binary(req, req_index, name_str, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid name_str");
+
+    name_str[binary_len] = '\0';
 
+    UA_LocalizedText display_name =  UA_LOCALIZEDTEXT(locale, name_str);
+    
     if(entity_type)
-        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, &value);
+        retval = UA_Client_writeDisplayNameAttribute((UA_Client *)entity, node_id, &display_name);
     else
-        retval = UA_Server_readValue((UA_Server *)entity, node_id, &value); 
+        retval = UA_Server_writeDisplayName((UA_Server *)entity, node_id, display_name);
+
+    UA_NodeId_clear(&node_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_NodeId_clear(&node_id);
-        UA_NodeId_clear(&node_id_arg_1);
-        UA_NodeId_clear(&node_id_arg_2);
-        UA_Variant_clear(&value);
         send_opex_response(retval);
         return;
     }
 
-    if(UA_Variant_isEmpty(&value))
-    {
-        UA_Variant_clear(&value);
-        is_null = true;
-    }
+    send_ok_response();
+}
 
-    if(UA_Variant_isScalar(&value))
-    {
-        UA_Variant_clear(&value);
-        is_scalar = true;
-    }
+/* 
+ *  Change description of a node in the server. 
+ */
+void handle_write_node_description(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
 
-    if (!is_scalar && !is_null && (value.arrayLength <= data_index))
-    {
-        UA_NodeId_clear(&node_id);
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_write_node_description requires a 3-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // locale
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid locale (size)");
+    
+    char locale[term_size + 1];
+    long binary_len;
+    if (ei_decode_binary(req, req_index, locale, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid locale");
+
+    locale[binary_len] = '\0';
+
+    // description_str
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid description_str (size)");
+    
+    char description_str[term_size + 1];
+    if (ei_decode_binary(req, req_index, description_str, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid description_str");
+
+    description_str[binary_len] = '\0';
+
+    UA_LocalizedText description =  UA_LOCALIZEDTEXT(locale, description_str);
+    
+    if(entity_type)
+        retval = UA_Client_writeDescriptionAttribute((UA_Client *)entity, node_id, &description);
+    else
+        retval = UA_Server_writeDescription((UA_Server *)entity, node_id, description);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Write Mask' of a node in the server. 
+ */
+void handle_write_node_write_mask(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_write_mask requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // write_mask
+    unsigned long write_mask;
+    if (ei_decode_ulong(req, req_index, &write_mask) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_UInt32 ua_write_mask = write_mask;
+    
+    if(entity_type)
+        retval = UA_Client_writeWriteMaskAttribute((UA_Client *)entity, node_id, &ua_write_mask);
+    else
+        retval = UA_Server_writeWriteMask((UA_Server *)entity, node_id, ua_write_mask);
+    
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Is Abstract' of a node in the server. 
+ */
+void handle_write_node_is_abstract(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_is_abstract requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // write_mask
+    int is_abstract;
+    if (ei_decode_boolean(req, req_index, &is_abstract) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_Boolean is_abstract_bool = is_abstract;
+    
+    if(entity_type)
+        retval = UA_Client_writeIsAbstractAttribute((UA_Client *)entity, node_id, &is_abstract_bool);
+    else
+        retval = UA_Server_writeIsAbstract((UA_Server *)entity, node_id, is_abstract_bool);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Inverse name' of a node in the server. 
+ */
+void handle_write_node_inverse_name(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_write_node_inverse_name requires a 3-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // locale
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid locale (size)");
+    
+    char locale[term_size + 1];
+    long binary_len;
+    if (ei_decode_binary(req, req_index, locale, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid locale");
+
+    locale[binary_len] = '\0';
+
+    // inverse_name_str
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid inverse_name_str (size)");
+    
+    char inverse_name_str[term_size + 1];
+    if (ei_decode_binary(req, req_index, inverse_name_str, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid inverse_name_str");
+
+    inverse_name_str[binary_len] = '\0';
+
+    UA_LocalizedText inverse_name =  UA_LOCALIZEDTEXT(locale, inverse_name_str);
+    
+    if(entity_type)
+        retval = UA_Client_writeInverseNameAttribute((UA_Client *)entity, node_id, &inverse_name);
+    else
+        retval = UA_Server_writeInverseName((UA_Server *)entity, node_id, inverse_name);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'data type' of a node in the server. 
+ */
+void handle_write_node_data_type(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_data_type requires a 3-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+    UA_NodeId data_type_node_id = assemble_node_id(req, req_index);
+
+    if(entity_type)
+        retval = UA_Client_writeDataTypeAttribute((UA_Client *)entity, node_id, &data_type_node_id);
+    else
+        retval = UA_Server_writeDataType((UA_Server *)entity, node_id, data_type_node_id);
+
+    UA_NodeId_clear(&node_id);
+    UA_NodeId_clear(&data_type_node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Value Rank' of a node in the server. 
+ */
+void handle_write_node_value_rank(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_value_rank requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // value_range
+    unsigned long value_rank;
+    if (ei_decode_ulong(req, req_index, &value_rank) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_UInt32 ua_value_rank = value_rank;
+    
+    if(entity_type)
+        retval = UA_Client_writeValueRankAttribute((UA_Client *)entity, node_id, &ua_value_rank);
+    else
+        retval = UA_Server_writeValueRank((UA_Server *)entity, node_id, ua_value_rank);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Array_dimensions' of a node in the server. 
+ */
+void handle_write_node_array_dimensions(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int list_size;
+    int term_type;
+    UA_StatusCode retval;
+    UA_Variant var_array_dimension;
+    UA_Variant_init(&var_array_dimension);
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_write_node_array_dimension requires a 3-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    unsigned long array_dimension_size;
+    if (ei_decode_ulong(req, req_index, &array_dimension_size) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_UInt32 array_dimension[array_dimension_size];
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != array_dimension_size)
+        errx(EXIT_FAILURE, ":handle_write_node_array_dimension arity mismatch, list_size = %d, array_d = %ld", term_size, array_dimension_size);
+
+    for (unsigned long i = 0; i < array_dimension_size; i++)
+    {
+        unsigned long dimension;
+        if (ei_decode_ulong(req, req_index, &dimension) < 0) {
+            send_error_response("einval");
+            return;
+        }
+    
+        array_dimension[i] = (UA_UInt32) dimension;
+    }
+
+    UA_Variant_setArrayCopy(&var_array_dimension, array_dimension, array_dimension_size, &UA_TYPES[UA_TYPES_UINT32]);
+
+    
+    if(entity_type)
+        retval = UA_Client_writeArrayDimensionsAttribute((UA_Client *)entity, node_id, array_dimension_size, array_dimension);
+    else
+        retval = UA_Server_writeArrayDimensions((UA_Server *)entity, node_id, var_array_dimension);
+
+    UA_NodeId_clear(&node_id);
+    UA_Variant_clear(&var_array_dimension);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Access Level' of a node in the server. 
+ */
+void handle_write_node_access_level(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_access_level requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // value_range
+    unsigned long access_level;
+    if (ei_decode_ulong(req, req_index, &access_level) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_Byte ua_access_level = access_level;
+    
+    if(entity_type)
+        retval = UA_Client_writeAccessLevelAttribute((UA_Client *)entity, node_id, &ua_access_level);
+    else
+        retval = UA_Server_writeAccessLevel((UA_Server *)entity, node_id, ua_access_level);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Minimum Sampling Interval' of a node in the server. 
+ */
+void handle_write_node_minimum_sampling_interval(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_minimum_sampling_interval requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // value_range
+    double sampling_interval;
+    if (ei_decode_double(req, req_index, &sampling_interval) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_Double ua_sampling_interval = sampling_interval;
+    
+    if(entity_type)
+        retval = UA_Client_writeMinimumSamplingIntervalAttribute((UA_Client *)entity, node_id, &ua_sampling_interval);
+    else
+        retval = UA_Server_writeMinimumSamplingInterval((UA_Server *)entity, node_id, ua_sampling_interval);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Historizing' of a node in the server. 
+ */
+void handle_write_node_historizing(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_historizing requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // write_mask
+    int historizing;
+    if (ei_decode_boolean(req, req_index, &historizing) < 0) {
+        send_error_response("einval");
+        return;
+    }
+    
+    UA_Boolean ua_historizing = historizing;
+
+    if(entity_type)
+        retval = UA_Client_writeHistorizingAttribute((UA_Client *)entity, node_id, &ua_historizing);
+    else
+        retval = UA_Server_writeHistorizing((UA_Server *)entity, node_id, ua_historizing);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'Excutable' of a node in the server. 
+ */
+void handle_write_node_executable(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_executable requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    // write_mask
+    int executable;
+    if (ei_decode_boolean(req, req_index, &executable) < 0) {
+        send_error_response("einval");
+        return;
+    }
+    
+    UA_Boolean ua_executable = executable;
+
+    if(entity_type)
+        retval = UA_Client_writeHistorizingAttribute((UA_Client *)entity, node_id, &ua_executable);
+    else
+        retval = UA_Server_writeHistorizing((UA_Server *)entity, node_id, ua_executable);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Change 'event_notifier' of a node in the server. 
+ */
+void handle_write_node_event_notifier(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_write_node_event_notifier requires a 2-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    unsigned long event_notifier;
+    if (ei_decode_ulong(req, req_index, &event_notifier) < 0) {
+        send_error_response("einval");
+        return;
+    }
+    
+    UA_Byte ua_event_notifier = (UA_Byte) event_notifier;
+
+    if(entity_type)
+        retval = UA_Client_writeEventNotifierAttribute((UA_Client *)entity, node_id, &ua_event_notifier);
+    else
+        retval = UA_Server_writeEventNotifier((UA_Server *)entity, node_id, ua_event_notifier);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Strings written as a scalar are copied by open62541, so they only need to live during the request.
+ *  Strings stored in an array element are owned (and freed) by the array.
+ */
+static char *decode_buffer(bool request_scoped, size_t size)
+{
+    return request_scoped ? request_arena_alloc(size) : malloc(size);
+}
+
+/* 
+ *  Change 'value' of a node in the server.
+ */
+void handle_write_node_value(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    bool is_null = false;
+    bool is_scalar = false;
+    UA_NodeId node_id_arg_1;
+    UA_NodeId node_id_arg_2;
+    UA_ExpandedNodeId expanded_node_id_arg_1;
+    UA_QualifiedName qualified_name;
+    UA_StatusCode retval = 0;
+
+    UA_Variant value;
+    UA_Variant_init(&value);
+
+    char *arg1 = NULL;
+    char *arg2 = NULL;
+
+    UA_NodeId_init(&node_id_arg_1);
+    UA_NodeId_init(&node_id_arg_2);
+
+    UA_ExpandedNodeId_init(&expanded_node_id_arg_1);
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_write_node_value requires a 4-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id_ref(req, req_index);
+
+    unsigned long data_type;
+    if (ei_decode_ulong(req, req_index, &data_type) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    size_t data_index;
+    if (ei_decode_ulong(req, req_index, &data_index) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    if(entity_type)
+        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, &value);
+    else
+        retval = UA_Server_readValue((UA_Server *)entity, node_id, &value); 
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_NodeId_clear(&node_id_arg_1);
+        UA_NodeId_clear(&node_id_arg_2);
+        UA_Variant_clear(&value);
+        send_opex_response(retval);
+        return;
+    }
+
+    if(UA_Variant_isEmpty(&value))
+    {
+        UA_Variant_clear(&value);
+        is_null = true;
+    }
+
+    if(UA_Variant_isScalar(&value))
+    {
+        UA_Variant_clear(&value);
+        is_scalar = true;
+    }
+
+    if (!is_scalar && !is_null && (value.arrayLength <= data_index))
+    {
         UA_NodeId_clear(&node_id_arg_1);
         UA_NodeId_clear(&node_id_arg_2);
         UA_Variant_clear(&value);
@@ -2197,1853 +4364,2559 @@ void handle_write_node_value(void *entity, bool entity_type, const char *req, in
         return;
     }    
 
-    switch (data_type)
-    {
-        case UA_TYPES_BOOLEAN:
+    switch (data_type)
+    {
+        case UA_TYPES_BOOLEAN:
+        {
+            int boolean_data;
+            if (ei_decode_boolean(req, req_index, &boolean_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_Boolean data = boolean_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_BOOLEAN]);
+            else
+                *((UA_Boolean *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_SBYTE:
+        {
+            long sbyte_data;
+            if (ei_decode_long(req, req_index, &sbyte_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_SByte data = sbyte_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_SBYTE]);
+            else
+                *((UA_SByte *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_BYTE:
+        {
+            unsigned long byte_data;
+            if (ei_decode_ulong(req, req_index, &byte_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_Byte data = byte_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_BYTE]);
+            else
+                *((UA_Byte *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_INT16:
+        {
+            long int16_data;
+            if (ei_decode_long(req, req_index, &int16_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_Int16 data = int16_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_INT16]);
+            else
+                *((UA_Int16 *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_UINT16:
+        {
+            unsigned long uint16_data;
+            if (ei_decode_ulong(req, req_index, &uint16_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_UInt16 data = uint16_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_UINT16]);
+            else
+                *((UA_UInt16 *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_INT32:
+        {
+            long int32_data;
+            if (ei_decode_long(req, req_index, &int32_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_Int32 data = int32_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_INT32]);
+            else
+                *((UA_Int32 *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_UINT32:
+        {
+            unsigned long uint32_data;
+            if (ei_decode_ulong(req, req_index, &uint32_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_UInt32 data = uint32_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_UINT32]);
+            else
+                *((UA_UInt32 *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_INT64:
+        {
+            long long int64_data;
+            if (ei_decode_longlong(req, req_index, &int64_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_Int64 data = int64_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_INT64]);
+            else
+                *((UA_Int64 *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_UINT64:
+        {
+            unsigned long long uint64_data;
+            if (ei_decode_ulonglong(req, req_index, &uint64_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_UInt64 data = uint64_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_UINT64]);
+            else
+                *((UA_UInt64 *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_FLOAT:
+        {
+            double float_data;
+            if (ei_decode_double(req, req_index, &float_data) < 0) {
+                send_error_response("einval");
+                return;
+            }
+            UA_Float data = (float) float_data;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_FLOAT]);
+            else
+                *((UA_Float *)value.data + data_index) = data;
+        }
+        break;
+
+        case UA_TYPES_DOUBLE:
         {
-            int boolean_data;
-            if (ei_decode_boolean(req, req_index, &boolean_data) < 0) {
+            double double_data;
+            if (ei_decode_double(req, req_index, &double_data) < 0) {
                 send_error_response("einval");
                 return;
             }
-            UA_Boolean data = boolean_data;
+            UA_Double data = double_data;
+
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_BOOLEAN]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_DOUBLE]);
             else
-                *((UA_Boolean *)value.data + data_index) = data;
+                *((UA_Double *)value.data + data_index) = data;
+
         }
         break;
 
-        case UA_TYPES_SBYTE:
+        case UA_TYPES_STRING:
         {
-            long sbyte_data;
-            if (ei_decode_long(req, req_index, &sbyte_data) < 0) {
+            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+                errx(EXIT_FAILURE, "Invalid string (size)");
+
+            arg1 = decode_buffer(is_scalar || is_null, term_size + 1);
+    
+            long binary_len;
+            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
+                errx(EXIT_FAILURE, "Invalid string");
+
+            arg1[binary_len] = '\0';
+
+            UA_String data = UA_STRING(arg1);
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_STRING]);
+            else
+            {
+                UA_String_clear(((UA_String *)value.data + data_index));
+                *((UA_String *)value.data + data_index) = data;
+            }
+        }
+        break;
+
+        case UA_TYPES_DATETIME:
+        {
+            long long date_time_data;
+            if (ei_decode_longlong(req, req_index, &date_time_data) < 0) {
                 send_error_response("einval");
                 return;
             }
-            UA_SByte data = sbyte_data;
+            
+            UA_DateTime data = date_time_data;
+            
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_SBYTE]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_DATETIME]);
             else
-                *((UA_SByte *)value.data + data_index) = data;
+                *((UA_DateTime *)value.data + data_index) = data;
         }
         break;
 
-        case UA_TYPES_BYTE:
+        case UA_TYPES_GUID:
         {
-            unsigned long byte_data;
-            if (ei_decode_ulong(req, req_index, &byte_data) < 0) {
-                send_error_response("einval");
-                return;
+            UA_Guid guid;
+
+            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 4)
+                errx(EXIT_FAILURE, "Invalid string, term_size = %d", term_size);
+
+            unsigned long guid_data1;
+            if (ei_decode_ulong(req, req_index, &guid_data1) < 0)
+                errx(EXIT_FAILURE, "Invalid GUID data1");
+            
+            unsigned long guid_data2;
+            if (ei_decode_ulong(req, req_index, &guid_data2) < 0)
+                errx(EXIT_FAILURE, "Invalid GUID data2");
+            
+            unsigned long guid_data3;
+            if (ei_decode_ulong(req, req_index, &guid_data3) < 0)
+                errx(EXIT_FAILURE, "Invalid GUID data3");
+
+            // UA_Byte guid_data4[9];
+            long binary_len;
+            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 ||
+                    term_type != ERL_BINARY_EXT ||
+                    term_size > (int) sizeof(guid.data4) ||
+                    ei_decode_binary(req, req_index, guid.data4, &binary_len) < 0) 
+                errx(EXIT_FAILURE, "Invalid GUID data4 %d >= %d, %d", term_size,(int) sizeof(guid.data4), term_size >= (int) sizeof(guid.data4));
+            
+            guid.data1 = guid_data1;
+            guid.data2 = guid_data2;
+            guid.data3 = guid_data3;
+
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &guid, &UA_TYPES[UA_TYPES_GUID]);
+            else
+                *((UA_Guid *)value.data + data_index) = guid;
+        }
+        break;
+
+        case UA_TYPES_BYTESTRING:
+        {
+            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+                errx(EXIT_FAILURE, "Invalid byte_string (size)");
+
+            arg1 = decode_buffer(is_scalar || is_null, term_size + 1);
+    
+            long binary_len;
+            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
+                errx(EXIT_FAILURE, "Invalid byte_string");
+
+            arg1[binary_len] = '\0';
+
+            UA_ByteString data = UA_BYTESTRING(arg1);
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_BYTESTRING]);
+            else
+            {
+                UA_ByteString_clear(((UA_ByteString *)value.data + data_index));
+                *((UA_ByteString *)value.data + data_index) = data;
             }
-            UA_Byte data = byte_data;
+        }
+        break;
+
+        case UA_TYPES_XMLELEMENT:
+        {
+            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+                errx(EXIT_FAILURE, "Invalid xml (size)");
+
+            arg1 = decode_buffer(is_scalar || is_null, term_size + 1);
+    
+            long binary_len;
+            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
+                errx(EXIT_FAILURE, "Invalid xml");
+
+            arg1[binary_len] = '\0';
+
+            UA_XmlElement data = UA_STRING(arg1);
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_BYTE]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_XMLELEMENT]);
             else
-                *((UA_Byte *)value.data + data_index) = data;
+            {
+                UA_XmlElement_clear(((UA_XmlElement *)value.data + data_index));
+                *((UA_XmlElement *)value.data + data_index) = data;
+            }
         }
         break;
 
-        case UA_TYPES_INT16:
+        case UA_TYPES_NODEID:
         {
-            long int16_data;
-            if (ei_decode_long(req, req_index, &int16_data) < 0) {
-                send_error_response("einval");
-                return;
+            node_id_arg_1 = assemble_node_id(req, req_index);
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &node_id_arg_1, &UA_TYPES[UA_TYPES_NODEID]);
+            else
+            {
+                UA_NodeId_clear(((UA_NodeId *)value.data + data_index));
+                *((UA_NodeId *)value.data + data_index) = node_id_arg_1;
             }
-            UA_Int16 data = int16_data;
+        }
+        break;
+
+        case UA_TYPES_EXPANDEDNODEID:
+        {
+            expanded_node_id_arg_1 = assemble_expanded_node_id(req, req_index);
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_INT16]);
+                UA_Variant_setScalar(&value, &expanded_node_id_arg_1, &UA_TYPES[UA_TYPES_EXPANDEDNODEID]);
             else
-                *((UA_Int16 *)value.data + data_index) = data;
+            {
+                UA_ExpandedNodeId_clear(((UA_ExpandedNodeId *)value.data + data_index));
+                *((UA_ExpandedNodeId *)value.data + data_index) = expanded_node_id_arg_1;
+            }
         }
         break;
 
-        case UA_TYPES_UINT16:
+        case UA_TYPES_STATUSCODE:
         {
-            unsigned long uint16_data;
-            if (ei_decode_ulong(req, req_index, &uint16_data) < 0) {
+            unsigned long status_code_data;
+            if (ei_decode_ulong(req, req_index, &status_code_data) < 0) {
                 send_error_response("einval");
                 return;
             }
-            UA_UInt16 data = uint16_data;
+            UA_StatusCode data = status_code_data;
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_UINT16]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_STATUSCODE]);
             else
-                *((UA_UInt16 *)value.data + data_index) = data;
+                *((UA_StatusCode *)value.data + data_index) = data;
         }
         break;
 
-        case UA_TYPES_INT32:
+        case UA_TYPES_QUALIFIEDNAME:
         {
-            long int32_data;
-            if (ei_decode_long(req, req_index, &int32_data) < 0) {
-                send_error_response("einval");
-                return;
+            qualified_name = assemble_qualified_name(req, req_index);
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &qualified_name, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]);
+            else
+            {
+                UA_QualifiedName_clear(((UA_QualifiedName *)value.data + data_index));
+                *((UA_QualifiedName *)value.data + data_index) = qualified_name;
             }
-            UA_Int32 data = int32_data;
+        }
+        break;
+
+        case UA_TYPES_LOCALIZEDTEXT:
+        {
+            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+                term_size != 2)
+                errx(EXIT_FAILURE, ":handle_write_node_value requires a 2-tuple, term_size = %d", term_size);
+
+            // locale
+            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+                errx(EXIT_FAILURE, "Invalid locale (size)");
+
+            arg1 = decode_buffer(is_scalar || is_null, term_size + 1);
+    
+            long binary_len;
+            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
+                errx(EXIT_FAILURE, "Invalid locale");
+
+            arg1[binary_len] = '\0';
+
+            // text
+            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+                errx(EXIT_FAILURE, "Invalid text (size)");
+
+            arg2 = decode_buffer(is_scalar || is_null, term_size + 1);
+    
+            if (ei_decode_binary(req, req_index, arg2, &binary_len) < 0) 
+                errx(EXIT_FAILURE, "Invalid text");
+
+            arg2[binary_len] = '\0';
+
+            UA_LocalizedText data = UA_LOCALIZEDTEXT(arg1, arg2);
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_INT32]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+            else
+            {
+                UA_LocalizedText_clear(((UA_LocalizedText *)value.data + data_index));
+                *((UA_LocalizedText *)value.data + data_index) = data;
+            }
+        }
+        break;
+
+        //UA_TYPES_EXTENSIONOBJECT:
+
+        //UA_TYPES_DATAVALUE
+
+        //UA_TYPES_VARIANT
+
+        //UA_TYPES_DIAGNOSTICINFO:
+
+        case UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE:
+        {
+            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+                term_size != 2)
+                errx(EXIT_FAILURE, ":handle_write_node_value requires a 2-tuple, term_size = %d", term_size);
+
+            node_id_arg_1 = assemble_node_id(req, req_index);
+            node_id_arg_2 = assemble_node_id(req, req_index);
+            UA_SemanticChangeStructureDataType data;
+            data.affected = node_id_arg_1;
+            data.affectedType = node_id_arg_2;
+            if (is_scalar || is_null)
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE]);
             else
-                *((UA_Int32 *)value.data + data_index) = data;
+            {
+                UA_SemanticChangeStructureDataType_clear(((UA_SemanticChangeStructureDataType *)value.data + data_index));
+                *((UA_SemanticChangeStructureDataType *)value.data + data_index) = data;
+            }
         }
         break;
 
-        case UA_TYPES_UINT32:
+        case UA_TYPES_TIMESTRING:
         {
-            unsigned long uint32_data;
-            if (ei_decode_ulong(req, req_index, &uint32_data) < 0) {
-                send_error_response("einval");
-                return;
-            }
-            UA_UInt32 data = uint32_data;
+            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+                errx(EXIT_FAILURE, "Invalid time_string (size)");
+
+            arg1 = decode_buffer(is_scalar || is_null, term_size + 1);
+    
+            long binary_len;
+            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
+                errx(EXIT_FAILURE, "Invalid time_string");
+
+            arg1[binary_len] = '\0';
+
+            UA_TimeString data = UA_STRING(arg1);
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_UINT32]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_TIMESTRING]);
             else
-                *((UA_UInt32 *)value.data + data_index) = data;
+            {
+                UA_TimeString_clear(((UA_TimeString *)value.data + data_index));
+                *((UA_TimeString *)value.data + data_index) = data;
+            }
         }
         break;
 
-        case UA_TYPES_INT64:
+        //UA_TYPES_VIEWATTRIBUTES
+
+        case UA_TYPES_UADPNETWORKMESSAGECONTENTMASK:
         {
-            long long int64_data;
-            if (ei_decode_longlong(req, req_index, &int64_data) < 0) {
+            unsigned long content_mask_data;
+            if (ei_decode_ulong(req, req_index, &content_mask_data) < 0) {
                 send_error_response("einval");
                 return;
             }
-            UA_Int64 data = int64_data;
+            UA_UadpNetworkMessageContentMask data = content_mask_data;
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_INT64]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_UADPNETWORKMESSAGECONTENTMASK]);
             else
-                *((UA_Int64 *)value.data + data_index) = data;
+                *((UA_UadpNetworkMessageContentMask *)value.data + data_index) = data;
         }
         break;
 
-        case UA_TYPES_UINT64:
+        case UA_TYPES_XVTYPE:
         {
-            unsigned long long uint64_data;
-            if (ei_decode_ulonglong(req, req_index, &uint64_data) < 0) {
+            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+                term_size != 2)
+                errx(EXIT_FAILURE, ":handle_write_node_value (UA_TYPES_XVTYPE) requires a 2-tuple, term_size = %d", term_size);
+
+            double float_data;
+            if (ei_decode_double(req, req_index, &float_data) < 0) {
                 send_error_response("einval");
                 return;
             }
-            UA_UInt64 data = uint64_data;
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_UINT64]);
-            else
-                *((UA_UInt64 *)value.data + data_index) = data;
-        }
-        break;
 
-        case UA_TYPES_FLOAT:
-        {
-            double float_data;
-            if (ei_decode_double(req, req_index, &float_data) < 0) {
+            double double_data;
+            if (ei_decode_double(req, req_index, &double_data) < 0) {
                 send_error_response("einval");
                 return;
             }
-            UA_Float data = (float) float_data;
+
+            UA_XVType data;
+
+            data.value = (float) float_data;
+            data.x = double_data;
+            
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_FLOAT]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_XVTYPE]);
             else
-                *((UA_Float *)value.data + data_index) = data;
+                *((UA_XVType *)value.data + data_index) = data;
         }
         break;
 
-        case UA_TYPES_DOUBLE:
+        case UA_TYPES_ELEMENTOPERAND:
         {
-            double double_data;
-            if (ei_decode_double(req, req_index, &double_data) < 0) {
+            unsigned long element_operand_data;
+            if (ei_decode_ulong(req, req_index, &element_operand_data) < 0) {
                 send_error_response("einval");
                 return;
             }
-            UA_Double data = double_data;
-
+            UA_ElementOperand data ;
+            data.index = element_operand_data;
+            
             if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_DOUBLE]);
+                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_ELEMENTOPERAND]);
             else
-                *((UA_Double *)value.data + data_index) = data;
-
+                *((UA_ElementOperand *)value.data + data_index) = data;
         }
         break;
 
-        case UA_TYPES_STRING:
-        {
-            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-                errx(EXIT_FAILURE, "Invalid string (size)");
+        default:
+            errx(EXIT_FAILURE, ":handle_write_node_value invalid data_type = %ld", data_type);
+        break;
+    }
+    
+    if(entity_type)
+    {
+        retval = UA_Client_writeValueAttribute((UA_Client *)entity, node_id, &value);
+    }
+    else
+    {
+        retval = server_local_write_value((UA_Server *)entity, node_id, value);
+    }
 
-            arg1 = (char *)malloc(term_size + 1);
     
-            long binary_len;
-            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
-                errx(EXIT_FAILURE, "Invalid string");
+    
 
-            arg1[binary_len] = '\0';
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
 
-            UA_String data = UA_STRING(arg1);
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_STRING]);
-            else
-            {
-                UA_String_clear(((UA_String *)value.data + data_index));
-                *((UA_String *)value.data + data_index) = data;
-            }
-        }
-        break;
+    if (!is_scalar && !is_null)
+    {
+        UA_Variant_clear(&value);
+    }
+    else
+    {
+        UA_NodeId_clear(&node_id_arg_1);
+        UA_NodeId_clear(&node_id_arg_2);
+        
+        if(data_type == UA_TYPES_EXPANDEDNODEID)
+            UA_ExpandedNodeId_clear(&expanded_node_id_arg_1);
+        if(data_type == UA_TYPES_QUALIFIEDNAME)
+            UA_QualifiedName_clear(&qualified_name);
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Creates a blank 'value array' of a node in the server.
+ */
+void handle_write_node_blank_array(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval = 0;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 5)
+        errx(EXIT_FAILURE, ":handle_write_node_blank_array requires a 5-tuple, term_size = %d", term_size);
+    
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    unsigned long data_type;
+    if (ei_decode_ulong(req, req_index, &data_type) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    unsigned long array_dimension_size;
+    if (ei_decode_ulong(req, req_index, &array_dimension_size) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    unsigned long array_raw_size;
+    if (ei_decode_ulong(req, req_index, &array_raw_size) < 0) {
+        send_error_response("einval");
+        return;
+    }
 
+    UA_Variant value;
+    UA_Variant_init(&value);
+    switch (data_type)
+    {
+        case UA_TYPES_BOOLEAN:
+        case UA_TYPES_SBYTE:
+        case UA_TYPES_BYTE:
+        case UA_TYPES_INT16:
+        case UA_TYPES_UINT16:
+        case UA_TYPES_INT32:
+        case UA_TYPES_UINT32:
+        case UA_TYPES_INT64:
+        case UA_TYPES_UINT64:
+        case UA_TYPES_FLOAT:
+        case UA_TYPES_DOUBLE:
+        case UA_TYPES_STRING:
         case UA_TYPES_DATETIME:
+        case UA_TYPES_GUID:
+        case UA_TYPES_BYTESTRING:
+        case UA_TYPES_XMLELEMENT:
+        case UA_TYPES_NODEID:
+        case UA_TYPES_EXPANDEDNODEID:
+        case UA_TYPES_STATUSCODE:
+        case UA_TYPES_QUALIFIEDNAME:
+        case UA_TYPES_LOCALIZEDTEXT:
+        case UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE:
+        case UA_TYPES_TIMESTRING:
+        case UA_TYPES_UADPNETWORKMESSAGECONTENTMASK:
+        case UA_TYPES_XVTYPE:
+        case UA_TYPES_ELEMENTOPERAND:
         {
-            long long date_time_data;
-            if (ei_decode_longlong(req, req_index, &date_time_data) < 0) {
-                send_error_response("einval");
-                return;
-            }
-            
-            UA_DateTime data = date_time_data;
-            
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_DATETIME]);
-            else
-                *((UA_DateTime *)value.data + data_index) = data;
+            // Zero initialized elements, allocated on the heap as large arrays do not fit on the stack.
+            void *data = UA_Array_new(array_raw_size, &UA_TYPES[data_type]);
+            if(!data)
+                errx(EXIT_FAILURE, ":handle_write_node_blank_array can't allocate %ld elements", array_raw_size);
+            UA_Variant_setArray(&value, data, array_raw_size, &UA_TYPES[data_type]);
         }
         break;
 
-        case UA_TYPES_GUID:
-        {
-            UA_Guid guid;
+        default:
+            errx(EXIT_FAILURE, ":handle_write_node_value invalid data_type = %ld", data_type);
+        break;
+    }
+
+    value.arrayDimensions = (UA_UInt32 *)UA_Array_new(array_dimension_size, &UA_TYPES[UA_TYPES_UINT32]);
+    value.arrayDimensionsSize = array_dimension_size;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != array_dimension_size)
+        errx(EXIT_FAILURE, ":handle_write_node_array_dimension arity mismatch, list_size = %d, array_d = %ld", term_size, array_dimension_size);
+
+    for (unsigned long i = 0; i < array_dimension_size; i++)
+    {
+        unsigned long dimension;
+        if (ei_decode_ulong(req, req_index, &dimension) < 0) {
+            send_error_response("einval");
+            return;
+        }
+    
+         value.arrayDimensions[i] = (UA_UInt32) dimension;
+    }
+
+    
+    if(entity_type)
+    {
+        retval = UA_Client_writeValueAttribute((UA_Client *)entity, node_id, &value);
+    }
+    else
+    {
+        retval = server_local_write_value((UA_Server *)entity, node_id, value);
+    }
+    
+    UA_Variant_clear(&value);
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
 
-            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-            term_size != 4)
-                errx(EXIT_FAILURE, "Invalid string, term_size = %d", term_size);
 
-            unsigned long guid_data1;
-            if (ei_decode_ulong(req, req_index, &guid_data1) < 0)
-                errx(EXIT_FAILURE, "Invalid GUID data1");
-            
-            unsigned long guid_data2;
-            if (ei_decode_ulong(req, req_index, &guid_data2) < 0)
-                errx(EXIT_FAILURE, "Invalid GUID data2");
-            
-            unsigned long guid_data3;
-            if (ei_decode_ulong(req, req_index, &guid_data3) < 0)
-                errx(EXIT_FAILURE, "Invalid GUID data3");
+/* 
+ *  Writes a whole array value ({node_id, data_type, array, array_dimensions}) with a single write call and without
+ *  reading the current value, see assemble_variant_array. An empty array_dimensions tuple keeps them unset.
+ */
+void handle_write_node_array(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    UA_StatusCode retval;
+    UA_Variant value;
 
-            // UA_Byte guid_data4[9];
-            long binary_len;
-            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 ||
-                    term_type != ERL_BINARY_EXT ||
-                    term_size > (int) sizeof(guid.data4) ||
-                    ei_decode_binary(req, req_index, guid.data4, &binary_len) < 0) 
-                errx(EXIT_FAILURE, "Invalid GUID data4 %d >= %d, %d", term_size,(int) sizeof(guid.data4), term_size >= (int) sizeof(guid.data4));
-            
-            guid.data1 = guid_data1;
-            guid.data2 = guid_data2;
-            guid.data3 = guid_data3;
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_write_node_array requires a 4-tuple, term_size = %d", term_size);
 
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &guid, &UA_TYPES[UA_TYPES_GUID]);
-            else
-                *((UA_Guid *)value.data + data_index) = guid;
-        }
-        break;
+    UA_NodeId node_id = assemble_node_id_ref(req, req_index);
 
-        case UA_TYPES_BYTESTRING:
-        {
-            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-                errx(EXIT_FAILURE, "Invalid byte_string (size)");
+    unsigned long data_type;
+    if (ei_decode_ulong(req, req_index, &data_type) < 0) {
+        send_error_response("einval");
+        return;
+    }
 
-            arg1 = (char *)malloc(term_size + 1);
-    
-            long binary_len;
-            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
-                errx(EXIT_FAILURE, "Invalid byte_string");
+    retval = assemble_variant_array(req, req_index, data_type, &value);
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
 
-            arg1[binary_len] = '\0';
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0) {
+        UA_Variant_clear(&value);
+        send_error_response("einval");
+        return;
+    }
 
-            UA_ByteString data = UA_BYTESTRING(arg1);
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_BYTESTRING]);
-            else
-            {
-                UA_ByteString_clear(((UA_ByteString *)value.data + data_index));
-                *((UA_ByteString *)value.data + data_index) = data;
-            }
+    size_t elements_size = 1;
+    if(term_size > 0) {
+        value.arrayDimensions = (UA_UInt32 *)UA_Array_new(term_size, &UA_TYPES[UA_TYPES_UINT32]);
+        value.arrayDimensionsSize = term_size;
+    }
+
+    for(int i = 0; i < term_size; i++) {
+        unsigned long dimension;
+        if (ei_decode_ulong(req, req_index, &dimension) < 0) {
+            UA_Variant_clear(&value);
+            send_error_response("einval");
+            return;
         }
-        break;
 
-        case UA_TYPES_XMLELEMENT:
-        {
-            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-                errx(EXIT_FAILURE, "Invalid xml (size)");
+        value.arrayDimensions[i] = (UA_UInt32) dimension;
+        elements_size *= dimension;
+    }
 
-            arg1 = (char *)malloc(term_size + 1);
-    
-            long binary_len;
-            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
-                errx(EXIT_FAILURE, "Invalid xml");
+    if(term_size > 0 && elements_size != value.arrayLength) {
+        UA_Variant_clear(&value);
+        send_opex_response(UA_STATUSCODE_BADTYPEMISMATCH);
+        return;
+    }
 
-            arg1[binary_len] = '\0';
+    if(entity_type)
+        retval = UA_Client_writeValueAttribute((UA_Client *)entity, node_id, &value);
+    else
+        retval = server_local_write_value((UA_Server *)entity, node_id, value);
 
-            UA_XmlElement data = UA_STRING(arg1);
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_XMLELEMENT]);
-            else
-            {
-                UA_XmlElement_clear(((UA_XmlElement *)value.data + data_index));
-                *((UA_XmlElement *)value.data + data_index) = data;
-            }
-        }
-        break;
+    UA_Variant_clear(&value);
 
-        case UA_TYPES_NODEID:
-        {
-            node_id_arg_1 = assemble_node_id(req, req_index);
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &node_id_arg_1, &UA_TYPES[UA_TYPES_NODEID]);
-            else
-            {
-                UA_NodeId_clear(((UA_NodeId *)value.data + data_index));
-                *((UA_NodeId *)value.data + data_index) = node_id_arg_1;
-            }
-        }
-        break;
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
 
-        case UA_TYPES_EXPANDEDNODEID:
-        {
-            expanded_node_id_arg_1 = assemble_expanded_node_id(req, req_index);
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &expanded_node_id_arg_1, &UA_TYPES[UA_TYPES_EXPANDEDNODEID]);
-            else
-            {
-                UA_ExpandedNodeId_clear(((UA_ExpandedNodeId *)value.data + data_index));
-                *((UA_ExpandedNodeId *)value.data + data_index) = expanded_node_id_arg_1;
-            }
-        }
-        break;
+    send_ok_response();
+}
 
-        case UA_TYPES_STATUSCODE:
-        {
-            unsigned long status_code_data;
-            if (ei_decode_ulong(req, req_index, &status_code_data) < 0) {
-                send_error_response("einval");
-                return;
-            }
-            UA_StatusCode data = status_code_data;
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_STATUSCODE]);
-            else
-                *((UA_StatusCode *)value.data + data_index) = data;
-        }
-        break;
+/* 
+ *  Writes a slice of the 'value' of a node ({node_id, index_range, data_type, array}), see
+ *  handle_read_node_value_range. The array (list or packed binary, see assemble_variant_array) must have the
+ *  number of elements of the range; the server patches the slice, no read is needed.
+ */
+void handle_write_node_value_range(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    UA_StatusCode retval;
+    UA_WriteValue item;
 
-        case UA_TYPES_QUALIFIEDNAME:
-        {
-            qualified_name = assemble_qualified_name(req, req_index);
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &qualified_name, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]);
-            else
-            {
-                UA_QualifiedName_clear(((UA_QualifiedName *)value.data + data_index));
-                *((UA_QualifiedName *)value.data + data_index) = qualified_name;
-            }
-        }
-        break;
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_write_node_value_range requires a 4-tuple, term_size = %d", term_size);
 
-        case UA_TYPES_LOCALIZEDTEXT:
-        {
-            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-                term_size != 2)
-                errx(EXIT_FAILURE, ":handle_write_node_value requires a 2-tuple, term_size = %d", term_size);
+    UA_WriteValue_init(&item);
+    item.nodeId = assemble_node_id(req, req_index);
+    item.attributeId = UA_ATTRIBUTEID_VALUE;
 
-            // locale
-            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-                errx(EXIT_FAILURE, "Invalid locale (size)");
+    unsigned long data_type;
+    if(assemble_string(req, req_index, &item.indexRange) != UA_STATUSCODE_GOOD ||
+        ei_decode_ulong(req, req_index, &data_type) < 0) {
+        UA_WriteValue_clear(&item);
+        send_error_response("einval");
+        return;
+    }
 
-            arg1 = (char *)malloc(term_size + 1);
-    
-            long binary_len;
-            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
-                errx(EXIT_FAILURE, "Invalid locale");
+    retval = assemble_variant_array(req, req_index, data_type, &item.value.value);
+    item.value.hasValue = true;
 
-            arg1[binary_len] = '\0';
+    if(retval == UA_STATUSCODE_GOOD && entity_type) {
+        UA_WriteRequest request;
+        UA_WriteRequest_init(&request);
+        request.nodesToWrite = &item;
+        request.nodesToWriteSize = 1;
 
-            // text
-            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-                errx(EXIT_FAILURE, "Invalid text (size)");
+        UA_WriteResponse response = UA_Client_Service_write((UA_Client *)entity, request);
 
-            arg2 = (char *)malloc(term_size + 1);
-    
-            if (ei_decode_binary(req, req_index, arg2, &binary_len) < 0) 
-                errx(EXIT_FAILURE, "Invalid text");
+        retval = response.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = response.resultsSize == 1 ? response.results[0] : UA_STATUSCODE_BADUNEXPECTEDERROR;
 
-            arg2[binary_len] = '\0';
+        UA_WriteResponse_clear(&response);
+    }
+    else if(retval == UA_STATUSCODE_GOOD)
+        retval = server_local_write((UA_Server *)entity, &item);
 
-            UA_LocalizedText data = UA_LOCALIZEDTEXT(arg1, arg2);
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
-            else
-            {
-                UA_LocalizedText_clear(((UA_LocalizedText *)value.data + data_index));
-                *((UA_LocalizedText *)value.data + data_index) = data;
-            }
-        }
-        break;
+    UA_WriteValue_clear(&item);
 
-        //UA_TYPES_EXTENSIONOBJECT:
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
 
-        //UA_TYPES_DATAVALUE
+    send_ok_response();
+}
 
-        //UA_TYPES_VARIANT
+/* 
+ *  Reads 'Node ID' Attribute from a node. 
+ */
+void handle_read_node_node_id(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_NodeId *node_id_out;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-        //UA_TYPES_DIAGNOSTICINFO:
+    if(entity_type)
+        retval = UA_Client_readNodeIdAttribute((UA_Client *)entity, node_id, node_id_out);
+    else
+        retval = UA_Server_readNodeId((UA_Server *)entity, node_id, node_id_out);
 
-        case UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE:
-        {
-            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-                term_size != 2)
-                errx(EXIT_FAILURE, ":handle_write_node_value requires a 2-tuple, term_size = %d", term_size);
+    UA_NodeId_clear(&node_id);
 
-            node_id_arg_1 = assemble_node_id(req, req_index);
-            node_id_arg_2 = assemble_node_id(req, req_index);
-            UA_SemanticChangeStructureDataType data;
-            data.affected = node_id_arg_1;
-            data.affectedType = node_id_arg_2;
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE]);
-            else
-            {
-                UA_SemanticChangeStructureDataType_clear(((UA_SemanticChangeStructureDataType *)value.data + data_index));
-                *((UA_SemanticChangeStructureDataType *)value.data + data_index) = data;
-            }
-        }
-        break;
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_NodeId_clear(node_id_out);
+        send_opex_response(retval);
+        return;
+    }
 
-        case UA_TYPES_TIMESTRING:
-        {
-            if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-                errx(EXIT_FAILURE, "Invalid time_string (size)");
+    send_data_response(node_id_out, 12, 0);
 
-            arg1 = (char *)malloc(term_size + 1);
-    
-            long binary_len;
-            if (ei_decode_binary(req, req_index, arg1, &binary_len) < 0) 
-                errx(EXIT_FAILURE, "Invalid time_string");
+    UA_NodeId_clear(node_id_out);
+}
 
-            arg1[binary_len] = '\0';
+/* 
+ *  Reads 'Node Class' Attribute from a node. 
+ */
+void handle_read_node_node_class(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_NodeClass *node_class;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-            UA_TimeString data = UA_STRING(arg1);
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_TIMESTRING]);
-            else
-            {
-                UA_TimeString_clear(((UA_TimeString *)value.data + data_index));
-                *((UA_TimeString *)value.data + data_index) = data;
-            }
-        }
-        break;
+    if(entity_type)
+        retval = UA_Client_readNodeClassAttribute((UA_Client *)entity, node_id, node_class);
+    else
+        retval = UA_Server_readNodeClass((UA_Server *)entity, node_id, node_class);
 
-        //UA_TYPES_VIEWATTRIBUTES
+    UA_NodeId_clear(&node_id);
 
-        case UA_TYPES_UADPNETWORKMESSAGECONTENTMASK:
-        {
-            unsigned long content_mask_data;
-            if (ei_decode_ulong(req, req_index, &content_mask_data) < 0) {
-                send_error_response("einval");
-                return;
-            }
-            UA_UadpNetworkMessageContentMask data = content_mask_data;
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_UADPNETWORKMESSAGECONTENTMASK]);
-            else
-                *((UA_UadpNetworkMessageContentMask *)value.data + data_index) = data;
-        }
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_NodeClass_clear(node_class);
+        send_opex_response(retval);
+        return;
+    }
+
+    switch(*node_class)
+    {
+        case UA_NODECLASS_UNSPECIFIED:
+            send_data_response("Unspecified", 3, 0);
         break;
 
-        case UA_TYPES_XVTYPE:
-        {
-            if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-                term_size != 2)
-                errx(EXIT_FAILURE, ":handle_write_node_value (UA_TYPES_XVTYPE) requires a 2-tuple, term_size = %d", term_size);
+        case UA_NODECLASS_OBJECT:
+            send_data_response("Object", 3, 0);
+        break;
 
-            double float_data;
-            if (ei_decode_double(req, req_index, &float_data) < 0) {
-                send_error_response("einval");
-                return;
-            }
+        case UA_NODECLASS_VARIABLE:
+            send_data_response("Variable", 3, 0);
+        break;
 
-            double double_data;
-            if (ei_decode_double(req, req_index, &double_data) < 0) {
-                send_error_response("einval");
-                return;
-            }
+        case UA_NODECLASS_METHOD:
+            send_data_response("Method", 3, 0);
+        break;
 
-            UA_XVType data;
+        case UA_NODECLASS_OBJECTTYPE:
+            send_data_response("ObjectType", 3, 0);
+        break;
 
-            data.value = (float) float_data;
-            data.x = double_data;
-            
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_XVTYPE]);
-            else
-                *((UA_XVType *)value.data + data_index) = data;
-        }
+        case UA_NODECLASS_VARIABLETYPE:
+            send_data_response("VariableType", 3, 0);
         break;
 
-        case UA_TYPES_ELEMENTOPERAND:
-        {
-            unsigned long element_operand_data;
-            if (ei_decode_ulong(req, req_index, &element_operand_data) < 0) {
-                send_error_response("einval");
-                return;
-            }
-            UA_ElementOperand data ;
-            data.index = element_operand_data;
-            
-            if (is_scalar || is_null)
-                UA_Variant_setScalar(&value, &data, &UA_TYPES[UA_TYPES_ELEMENTOPERAND]);
-            else
-                *((UA_ElementOperand *)value.data + data_index) = data;
-        }
+        case UA_NODECLASS_REFERENCETYPE:
+            send_data_response("ReferenceType", 3, 0);
         break;
 
-        default:
-            errx(EXIT_FAILURE, ":handle_write_node_value invalid data_type = %ld", data_type);
+        case UA_NODECLASS_DATATYPE:
+            send_data_response("DataType", 3, 0);
+        break;
+
+        case UA_NODECLASS_VIEW:
+            send_data_response("View", 3, 0);
         break;
     }
-    
+
+    UA_NodeClass_clear(node_class);
+}
+
+/* 
+ *  Reads 'Browse Name' Attribute from a node. 
+ */
+void handle_read_node_browse_name(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_QualifiedName *node_browse_name;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
     if(entity_type)
-    {
-        retval = UA_Client_writeValueAttribute((UA_Client *)entity, node_id, &value);
-    }
+        retval = UA_Client_readBrowseNameAttribute((UA_Client *)entity, node_id, node_browse_name);
     else
-    {
-        server_is_writing = true;
-        retval = UA_Server_writeValue((UA_Server *)entity, node_id, value);
-    }
+        retval = UA_Server_readBrowseName((UA_Server *)entity, node_id, node_browse_name);
 
     UA_NodeId_clear(&node_id);
-    
-    
 
     if(retval != UA_STATUSCODE_GOOD) {
+        UA_QualifiedName_clear(node_browse_name);
         send_opex_response(retval);
         return;
     }
 
-    if (!is_scalar && !is_null)
-    {
-        UA_Variant_clear(&value);
-    }
-    else
-    {
-        if(arg1 != NULL)
-            free(arg1);
-        if(arg1 != NULL)
-            free(arg2);
-
-        UA_NodeId_clear(&node_id_arg_1);
-        UA_NodeId_clear(&node_id_arg_2);
-        
-        if(data_type == UA_TYPES_EXPANDEDNODEID)
-            UA_ExpandedNodeId_clear(&expanded_node_id_arg_1);
-        if(data_type == UA_TYPES_QUALIFIEDNAME)
-            UA_QualifiedName_clear(&qualified_name);
-    }
+    send_data_response(node_browse_name, 13, 0);
 
-    send_ok_response();
+    UA_QualifiedName_clear(node_browse_name);
 }
 
 /* 
- *  Creates a blank 'value array' of a node in the server.
+ *  Reads 'Display Name' Attribute from a node. 
  */
-void handle_write_node_blank_array(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_display_name(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
-    UA_StatusCode retval = 0;
-
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 5)
-        errx(EXIT_FAILURE, ":handle_write_node_blank_array requires a 5-tuple, term_size = %d", term_size);
-    
+    UA_StatusCode retval;
+    UA_LocalizedText *node_display_name;
     UA_NodeId node_id = assemble_node_id(req, req_index);
 
-    unsigned long data_type;
-    if (ei_decode_ulong(req, req_index, &data_type) < 0) {
-        send_error_response("einval");
+    if(entity_type)
+        retval = UA_Client_readDisplayNameAttribute((UA_Client *)entity, node_id, node_display_name);
+    else
+        retval = UA_Server_readDisplayName((UA_Server *)entity, node_id, node_display_name);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LocalizedText_clear(node_display_name);
+        send_opex_response(retval);
         return;
     }
 
-    unsigned long array_dimension_size;
-    if (ei_decode_ulong(req, req_index, &array_dimension_size) < 0) {
-        send_error_response("einval");
+    send_data_response(node_display_name, 14, 0);
+
+    UA_LocalizedText_clear(node_display_name);
+}
+
+/* 
+ *  Reads 'Description' Attribute from a node. 
+ */
+void handle_read_node_description(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_LocalizedText *node_description;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    if(entity_type)
+        retval = UA_Client_readDescriptionAttribute((UA_Client *)entity, node_id, node_description);
+    else
+        retval = UA_Server_readDescription((UA_Server *)entity, node_id, node_description);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LocalizedText_clear(node_description);
+        send_opex_response(retval);
         return;
     }
 
-    unsigned long array_raw_size;
-    if (ei_decode_ulong(req, req_index, &array_raw_size) < 0) {
-        send_error_response("einval");
+    send_data_response(node_description, 14, 0);
+
+    UA_LocalizedText_clear(node_description);
+}
+
+/* 
+ *  Reads 'Write Mask' Attribute from a node. 
+ */
+void handle_read_node_write_mask(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_UInt32 *node_write_mask;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    if(entity_type)
+        retval = UA_Client_readWriteMaskAttribute((UA_Client *)entity, node_id, node_write_mask);
+    else
+        retval = UA_Server_readWriteMask((UA_Server *)entity, node_id, node_write_mask);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_UInt32_clear(node_write_mask);
+        send_opex_response(retval);
         return;
     }
 
-    UA_Variant value;
-    UA_Variant_init(&value);
-    switch (data_type)
-    {
-        case UA_TYPES_BOOLEAN:
-        {
-            UA_Boolean data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_Boolean_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_BOOLEAN]);
-        }
-        break;
+    send_data_response(node_write_mask, 2, 0);
 
-        case UA_TYPES_SBYTE:
-        {
-            UA_SByte data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_SByte_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_SBYTE]);
-        }
-        break;
+    UA_UInt32_clear(node_write_mask);
+}
 
-        case UA_TYPES_BYTE:
-        {
-            UA_Byte data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_Byte_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_BYTE]);
-        }
-        break;
+/* 
+ *  Reads 'is_abstract' Attribute from a node. 
+ */
+void handle_read_node_is_abstract(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_Boolean *node_is_abstract;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-        case UA_TYPES_INT16:
-        {
-            UA_Int16 data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_Int16_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_INT16]);
-        }
-        break;
+    if(entity_type)
+        retval = UA_Client_readIsAbstractAttribute((UA_Client *)entity, node_id, node_is_abstract);
+    else
+        retval = UA_Server_readIsAbstract((UA_Server *)entity, node_id, node_is_abstract);
 
-        case UA_TYPES_UINT16:
-        {
-            UA_UInt16 data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_UInt16_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_UINT16]);
-        }
-        break;
+    UA_NodeId_clear(&node_id);
 
-        case UA_TYPES_INT32:
-        {
-            UA_Int32 data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_Int32_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_INT32]);
-        }
-        break;
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_Boolean_clear(node_is_abstract);
+        send_opex_response(retval);
+        return;
+    }
 
-        case UA_TYPES_UINT32:
-        {
-            UA_UInt32 data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_UInt32_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_UINT32]);
-        }
-        break;
+    send_data_response(node_is_abstract, 0, 0);
 
-        case UA_TYPES_INT64:
-        {
-            UA_Int64 data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_Int64_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_INT64]);
-        }
-        break;
+    UA_Boolean_clear(node_is_abstract);
+}
 
-        case UA_TYPES_UINT64:
-        {
-            UA_UInt64 data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_UInt64_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_UINT64]);
-        }
-        break;
+/* 
+ *  Reads 'symmetric' Attribute from a node. 
+ */
+void handle_read_node_symmetric(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_Boolean symmetric;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-        case UA_TYPES_FLOAT:
-        {
-            UA_Float data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_Float_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_FLOAT]);
-        }
-        break;
+    if(entity_type)
+        retval = UA_Client_readSymmetricAttribute((UA_Client *)entity, node_id, &symmetric);
+    else
+        retval = UA_Server_readSymmetric((UA_Server *)entity, node_id, &symmetric);
 
-        case UA_TYPES_DOUBLE:
-        {
-            UA_Double data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_Double_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_DOUBLE]);
-        }
-        break;
+    UA_NodeId_clear(&node_id);
 
-        case UA_TYPES_STRING:
-        {
-            UA_String data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_String_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_STRING]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_String_clear(&data[i]);
-            }
-        }
-        break;
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
 
-        case UA_TYPES_DATETIME:
-        {
-            UA_DateTime data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_DateTime_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_DATETIME]);
-        }
-        break;
+    send_data_response(&symmetric, 0, 0);
+}
 
-        case UA_TYPES_GUID:
-        {
-            UA_Guid data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_Guid_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_GUID]);
-        }
-        break;
+/* 
+ *  Reads 'Inverse Name' Attribute from a node. 
+ */
+void handle_read_node_inverse_name(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_StatusCode retval;
+    UA_LocalizedText *node_inverse_name;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-        case UA_TYPES_BYTESTRING:
-        {
-            UA_ByteString data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_ByteString_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_BYTESTRING]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_ByteString_clear(&data[i]);
-            }
-        }
-        break;
+    if(entity_type)
+        retval = UA_Client_readInverseNameAttribute((UA_Client *)entity, node_id, node_inverse_name);
+    else
+        retval = UA_Server_readInverseName((UA_Server *)entity, node_id, node_inverse_name);
 
-        case UA_TYPES_XMLELEMENT:
-        {
-            UA_XmlElement data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_XmlElement_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_XMLELEMENT]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_XmlElement_clear(&data[i]);
-            }
-        }
-        break;
+    UA_NodeId_clear(&node_id);
 
-        case UA_TYPES_NODEID:
-        {
-            UA_NodeId data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_NodeId_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_NODEID]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_NodeId_clear(&data[i]);
-            }
-        }
-        break;
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_LocalizedText_clear(node_inverse_name);
+        send_opex_response(retval);
+        return;
+    }
 
-        case UA_TYPES_EXPANDEDNODEID:
-        {
-            UA_ExpandedNodeId data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_ExpandedNodeId_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_EXPANDEDNODEID]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_ExpandedNodeId_clear(&data[i]);
-            }
-        }
-        break;
+    send_data_response(node_inverse_name, 14, 0);
 
-        case UA_TYPES_STATUSCODE:
-        {
-            UA_StatusCode data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_StatusCode_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_STATUSCODE]);
-        }
-        break;
+    UA_LocalizedText_clear(node_inverse_name);
+}
 
-        case UA_TYPES_QUALIFIEDNAME:
-        {
-            UA_QualifiedName data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_QualifiedName_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_QualifiedName_clear(&data[i]);
-            }
-        }
-        break;
+/* 
+ *  Reads 'contains_no_loops' Attribute from a node. 
+ */
+void handle_read_node_contains_no_loops(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_Boolean contains_no_loops;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-        case UA_TYPES_LOCALIZEDTEXT:
-        {
-            UA_LocalizedText data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_LocalizedText_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_LocalizedText_clear(&data[i]);
-            }
-        }
-        break;
+    if(entity_type)
+        retval = UA_Client_readContainsNoLoopsAttribute((UA_Client *)entity, node_id, &contains_no_loops);
+    else
+        retval = UA_Server_readContainsNoLoop((UA_Server *)entity, node_id, &contains_no_loops);
 
-        //UA_TYPES_EXTENSIONOBJECT:
+    UA_NodeId_clear(&node_id);
 
-        //UA_TYPES_DATAVALUE
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
 
-        //UA_TYPES_VARIANT
+    send_data_response(&contains_no_loops, 0, 0);
+}
 
-        //UA_TYPES_DIAGNOSTICINFO:
+/* 
+ *  Reads 'data_type' Attribute from a node. 
+ */
+void handle_read_node_data_type(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_NodeId *node_data_type;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-        case UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE:
-        {
-            UA_SemanticChangeStructureDataType data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_SemanticChangeStructureDataType_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_SemanticChangeStructureDataType_clear(&data[i]);
-            }
-        }
-        break;
+    if(entity_type)
+        retval = UA_Client_readDataTypeAttribute((UA_Client *)entity, node_id, node_data_type);
+    else
+        retval = UA_Server_readDataType((UA_Server *)entity, node_id, node_data_type);
 
-        case UA_TYPES_TIMESTRING:
-        {
-            UA_TimeString data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_TimeString_init(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_TIMESTRING]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_TimeString_clear(&data[i]);
-            }
-        }
-        break;
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_NodeId_clear(node_data_type);
+        send_opex_response(retval);
+        return;
+    }
 
-        //UA_TYPES_VIEWATTRIBUTES
+    send_data_response(node_data_type, 12, 0);
 
-        case UA_TYPES_UADPNETWORKMESSAGECONTENTMASK:
-        {
-            UA_UadpNetworkMessageContentMask data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_UadpNetworkMessageContentMask_clear(&data[i]);
-            }
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_UADPNETWORKMESSAGECONTENTMASK]);
-        }
-        break;
+    UA_NodeId_clear(node_data_type);
+}
 
-        case UA_TYPES_XVTYPE:
-        {
-            UA_XVType data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_XVType_init(&data[i]);
-            }          
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_XVTYPE]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_XVType_clear(&data[i]);
-            }          
-        }
-        break;
+/* 
+ *  Reads 'value_rank' Attribute from a node. 
+ */
+void handle_read_node_value_rank(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_UInt32 *node_value_rank;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-        case UA_TYPES_ELEMENTOPERAND:
-        {
-            UA_ElementOperand data[array_raw_size];
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_ElementOperand_init(&data[i]);
-            }          
-            UA_Variant_setArrayCopy(&value, data, array_raw_size, &UA_TYPES[UA_TYPES_ELEMENTOPERAND]);
-            for(size_t i = 0; i < array_raw_size; i++)
-            {
-                UA_ElementOperand_clear(&data[i]);
-            }
-        }
-        break;
+    if(entity_type)
+        retval = UA_Client_readValueRankAttribute((UA_Client *)entity, node_id, node_value_rank);
+    else
+        retval = UA_Server_readValueRank((UA_Server *)entity, node_id, node_value_rank);
 
-        default:
-            errx(EXIT_FAILURE, ":handle_write_node_value invalid data_type = %ld", data_type);
-        break;
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_UInt32_clear(node_value_rank);
+        send_opex_response(retval);
+        return;
     }
-    
 
+    send_data_response(node_value_rank, 2, 0);
 
-    value.arrayDimensions = (UA_UInt32 *)UA_Array_new(array_dimension_size, &UA_TYPES[UA_TYPES_UINT32]);
-    value.arrayDimensionsSize = array_dimension_size;
+    UA_UInt32_clear(node_value_rank);
+}
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != array_dimension_size)
-        errx(EXIT_FAILURE, ":handle_write_node_array_dimension arity mismatch, list_size = %d, array_d = %ld", term_size, array_dimension_size);
+/* 
+ *  Reads 'array_dimensions' Attribute from a node. 
+ */
+void handle_read_node_array_dimensions(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    size_t array_dimensions_size;
+    UA_UInt32 *array_dimensions;
+    UA_Variant variant_array_dimensions;
+    UA_Variant_init(&variant_array_dimensions);
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+    
 
-    for (unsigned long i = 0; i < array_dimension_size; i++)
-    {
-        unsigned long dimension;
-        if (ei_decode_ulong(req, req_index, &dimension) < 0) {
-            send_error_response("einval");
-            return;
+    if(entity_type)
+        retval = UA_Client_readArrayDimensionsAttribute((UA_Client *)entity, node_id, &array_dimensions_size, &array_dimensions);
+    else
+        retval = UA_Server_readArrayDimensions((UA_Server *)entity, node_id, &variant_array_dimensions);
+
+    UA_NodeId_clear(&node_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        if (entity_type)
+        {
+            free(array_dimensions);
         }
-    
-         value.arrayDimensions[i] = (UA_UInt32) dimension;
+        UA_Variant_clear(&variant_array_dimensions);
+        send_opex_response(retval);
+        return;
     }
 
-    
     if(entity_type)
     {
-        retval = UA_Client_writeValueAttribute((UA_Client *)entity, node_id, &value);
+        send_data_response(array_dimensions, 28, (int) array_dimensions_size);    
+        free(array_dimensions);
     }
     else
     {
-        server_is_writing = true;
-        retval = UA_Server_writeValue((UA_Server *)entity, node_id, value);
+        send_data_response(variant_array_dimensions.data, 28, (int) variant_array_dimensions.arrayLength);
     }
-    
-    UA_Variant_clear(&value);
+
+    UA_Variant_clear(&variant_array_dimensions);
+}
+
+/* 
+ *  Reads 'access_level' Attribute from a node. 
+ */
+void handle_read_node_access_level(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_Byte *node_access_level;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    if(entity_type)
+        retval = UA_Client_readAccessLevelAttribute((UA_Client *)entity, node_id, node_access_level);
+    else
+        retval = UA_Server_readAccessLevel((UA_Server *)entity, node_id, node_access_level);
+
     UA_NodeId_clear(&node_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
+        UA_Byte_clear(node_access_level);
         send_opex_response(retval);
         return;
     }
 
-    send_ok_response();
-}
+    send_data_response(node_access_level, 24, 0);
 
+    UA_Byte_clear(node_access_level);
+}
 
 /* 
- *  Reads 'Node ID' Attribute from a node. 
+ *  Reads 'minimum_sampling_interval' Attribute from a node. 
  */
-void handle_read_node_node_id(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_minimum_sampling_interval(void *entity, bool entity_type, const char *req, int *req_index)
 {
     UA_StatusCode retval;
-    UA_NodeId *node_id_out;
+    UA_Double *node_minimum_sampling_interval;
     UA_NodeId node_id = assemble_node_id(req, req_index);
 
     if(entity_type)
-        retval = UA_Client_readNodeIdAttribute((UA_Client *)entity, node_id, node_id_out);
+        retval = UA_Client_readMinimumSamplingIntervalAttribute((UA_Client *)entity, node_id, node_minimum_sampling_interval);
     else
-        retval = UA_Server_readNodeId((UA_Server *)entity, node_id, node_id_out);
+        retval = UA_Server_readMinimumSamplingInterval((UA_Server *)entity, node_id, node_minimum_sampling_interval);
 
     UA_NodeId_clear(&node_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_NodeId_clear(node_id_out);
+        UA_Double_clear(node_minimum_sampling_interval);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(node_id_out, 12, 0);
+    send_data_response(node_minimum_sampling_interval, 4, 0);
 
-    UA_NodeId_clear(node_id_out);
+    UA_Double_clear(node_minimum_sampling_interval);
 }
 
 /* 
- *  Reads 'Node Class' Attribute from a node. 
+ *  Reads 'historizing' Attribute from a node. 
  */
-void handle_read_node_node_class(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_historizing(void *entity, bool entity_type, const char *req, int *req_index)
 {
     UA_StatusCode retval;
-    UA_NodeClass *node_class;
+    UA_Boolean *node_historizing;
     UA_NodeId node_id = assemble_node_id(req, req_index);
 
     if(entity_type)
-        retval = UA_Client_readNodeClassAttribute((UA_Client *)entity, node_id, node_class);
+        retval = UA_Client_readHistorizingAttribute((UA_Client *)entity, node_id, node_historizing);
     else
-        retval = UA_Server_readNodeClass((UA_Server *)entity, node_id, node_class);
+        retval = UA_Server_readHistorizing((UA_Server *)entity, node_id, node_historizing);
 
     UA_NodeId_clear(&node_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_NodeClass_clear(node_class);
+        UA_Boolean_clear(node_historizing);
         send_opex_response(retval);
         return;
     }
 
-    switch(*node_class)
-    {
-        case UA_NODECLASS_UNSPECIFIED:
-            send_data_response("Unspecified", 3, 0);
-        break;
-
-        case UA_NODECLASS_OBJECT:
-            send_data_response("Object", 3, 0);
-        break;
-
-        case UA_NODECLASS_VARIABLE:
-            send_data_response("Variable", 3, 0);
-        break;
-
-        case UA_NODECLASS_METHOD:
-            send_data_response("Method", 3, 0);
-        break;
+    send_data_response(node_historizing, 0, 0);
 
-        case UA_NODECLASS_OBJECTTYPE:
-            send_data_response("ObjectType", 3, 0);
-        break;
+    UA_Boolean_clear(node_historizing);
+}
 
-        case UA_NODECLASS_VARIABLETYPE:
-            send_data_response("VariableType", 3, 0);
-        break;
+/* 
+ *  Reads 'executable' Attribute from a node. 
+ */
+void handle_read_node_executable(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval;
+    UA_Boolean *node_executable;
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-        case UA_NODECLASS_REFERENCETYPE:
-            send_data_response("ReferenceType", 3, 0);
-        break;
+    if(entity_type)
+        retval = UA_Client_readExecutableAttribute((UA_Client *)entity, node_id, node_executable);
+    else
+        retval = UA_Server_readExecutable((UA_Server *)entity, node_id, node_executable);
 
-        case UA_NODECLASS_DATATYPE:
-            send_data_response("DataType", 3, 0);
-        break;
+    UA_NodeId_clear(&node_id);
 
-        case UA_NODECLASS_VIEW:
-            send_data_response("View", 3, 0);
-        break;
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_Boolean_clear(node_executable);
+        send_opex_response(retval);
+        return;
     }
 
-    UA_NodeClass_clear(node_class);
+    send_data_response(node_executable, 0, 0);
+
+    UA_Boolean_clear(node_executable);
 }
 
 /* 
- *  Reads 'Browse Name' Attribute from a node. 
+ *  Reads 'event_notifier' Attribute from a node. 
  */
-void handle_read_node_browse_name(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_event_notifier(void *entity, bool entity_type, const char *req, int *req_index)
 {
     UA_StatusCode retval;
-    UA_QualifiedName *node_browse_name;
+    UA_Byte event_notifier;
     UA_NodeId node_id = assemble_node_id(req, req_index);
 
     if(entity_type)
-        retval = UA_Client_readBrowseNameAttribute((UA_Client *)entity, node_id, node_browse_name);
+        retval = UA_Client_readEventNotifierAttribute((UA_Client *)entity, node_id, &event_notifier);
     else
-        retval = UA_Server_readBrowseName((UA_Server *)entity, node_id, node_browse_name);
+        retval = UA_Server_readEventNotifier((UA_Server *)entity, node_id, &event_notifier);
 
     UA_NodeId_clear(&node_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_QualifiedName_clear(node_browse_name);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(node_browse_name, 13, 0);
-
-    UA_QualifiedName_clear(node_browse_name);
+    send_data_response(&event_notifier, 24, 0);
 }
 
 /* 
- *  Reads 'Display Name' Attribute from a node. 
+ *  Read 'value' of a node in the server.
  */
-void handle_read_node_display_name(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_value(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
-    int term_type;
+    UA_Variant value;
+    UA_Variant_init(&value);
     UA_StatusCode retval;
-    UA_LocalizedText *node_display_name;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
 
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_read_node_value requires a 2-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id_ref(req, req_index);
+
+    unsigned long data_index;
+    if (ei_decode_ulong(req, req_index, &data_index) < 0) {
+        send_error_response("einval");
+        return;
+    }
+   
     if(entity_type)
-        retval = UA_Client_readDisplayNameAttribute((UA_Client *)entity, node_id, node_display_name);
+        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, &value);
     else
-        retval = UA_Server_readDisplayName((UA_Server *)entity, node_id, node_display_name);
-
-    UA_NodeId_clear(&node_id);
+        retval = UA_Server_readValue((UA_Server *)entity, node_id, &value);
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_LocalizedText_clear(node_display_name);
+        UA_Variant_clear(&value);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(node_display_name, 14, 0);
-
-    UA_LocalizedText_clear(node_display_name);
+    send_data_response(&value, 29, 0);
+    
+    UA_Variant_clear(&value);
 }
 
 /* 
- *  Reads 'Description' Attribute from a node. 
+ *  Read 'value' of a node, numeric arrays are sent as a single binary (see encode_packed_array) and any other
+ *  value as in `read_node_value`.
  */
-void handle_read_node_description(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_value_packed(void *entity, bool entity_type, const char *req, int *req_index)
 {
+    UA_Variant value;
+    UA_Variant_init(&value);
     UA_StatusCode retval;
-    UA_LocalizedText *node_description;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    UA_NodeId node_id = assemble_node_id_ref(req, req_index);
 
     if(entity_type)
-        retval = UA_Client_readDescriptionAttribute((UA_Client *)entity, node_id, node_description);
+        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, &value);
     else
-        retval = UA_Server_readDescription((UA_Server *)entity, node_id, node_description);
-
-    UA_NodeId_clear(&node_id);
+        retval = UA_Server_readValue((UA_Server *)entity, node_id, &value);
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_LocalizedText_clear(node_description);
+        UA_Variant_clear(&value);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(node_description, 14, 0);
+    send_data_response(&value, variant_is_packable(&value) ? 34 : 29, 0);
 
-    UA_LocalizedText_clear(node_description);
+    UA_Variant_clear(&value);
 }
 
 /* 
- *  Reads 'Write Mask' Attribute from a node. 
+ *  Read a slice of the 'value' of a node ({node_id, index_range, packed}), index_range is an OPC UA NumericRange
+ *  such as "100:199" or "0:3,2". Only the slice is transferred, as a packed binary when `packed` is set and the
+ *  array is numeric.
  */
-void handle_read_node_write_mask(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_value_range(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    UA_StatusCode retval;
-    UA_UInt32 *node_write_mask;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    int term_size;
+    int packed;
+    UA_ReadValueId item;
+    UA_DataValue result;
 
-    if(entity_type)
-        retval = UA_Client_readWriteMaskAttribute((UA_Client *)entity, node_id, node_write_mask);
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_read_node_value_range requires a 3-tuple, term_size = %d", term_size);
+
+    UA_ReadValueId_init(&item);
+    item.nodeId = assemble_node_id(req, req_index);
+    item.attributeId = UA_ATTRIBUTEID_VALUE;
+
+    if(assemble_string(req, req_index, &item.indexRange) != UA_STATUSCODE_GOOD ||
+        ei_decode_boolean(req, req_index, &packed) < 0) {
+        UA_ReadValueId_clear(&item);
+        send_error_response("einval");
+        return;
+    }
+
+    if(entity_type) {
+        UA_ReadRequest request;
+        UA_ReadRequest_init(&request);
+        request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+        request.nodesToRead = &item;
+        request.nodesToReadSize = 1;
+
+        UA_ReadResponse response = UA_Client_Service_read((UA_Client *)entity, request);
+
+        UA_DataValue_init(&result);
+        if(response.responseHeader.serviceResult != UA_STATUSCODE_GOOD) {
+            result.hasStatus = true;
+            result.status = response.responseHeader.serviceResult;
+        }
+        else if(response.resultsSize != 1) {
+            result.hasStatus = true;
+            result.status = UA_STATUSCODE_BADUNEXPECTEDERROR;
+        }
+        else
+            UA_DataValue_copy(&response.results[0], &result);
+
+        UA_ReadResponse_clear(&response);
+    }
     else
-        retval = UA_Server_readWriteMask((UA_Server *)entity, node_id, node_write_mask);
+        result = UA_Server_read((UA_Server *)entity, &item, UA_TIMESTAMPSTORETURN_NEITHER);
 
-    UA_NodeId_clear(&node_id);
+    UA_ReadValueId_clear(&item);
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_UInt32_clear(node_write_mask);
+    if(result.hasStatus && result.status != UA_STATUSCODE_GOOD) {
+        UA_StatusCode retval = result.status;
+        UA_DataValue_clear(&result);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(node_write_mask, 2, 0);
+    send_data_response(&result.value, packed && variant_is_packable(&result.value) ? 34 : 29, 0);
 
-    UA_UInt32_clear(node_write_mask);
+    UA_DataValue_clear(&result);
 }
 
 /* 
- *  Reads 'is_abstract' Attribute from a node. 
+ *  Read 'value' of a node in the server.
  */
-void handle_read_node_is_abstract(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_value_by_index(void *entity, bool entity_type, const char *req, int *req_index)
 {
+    int term_size;
+    UA_Variant value;
+    UA_Variant_init(&value);
     UA_StatusCode retval;
-    UA_Boolean *node_is_abstract;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
 
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_read_node_value requires a 2-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id_ref(req, req_index);
+
+    unsigned long data_index;
+    if (ei_decode_ulong(req, req_index, &data_index) < 0) {
+        send_error_response("einval");
+        return;
+    }
+   
     if(entity_type)
-        retval = UA_Client_readIsAbstractAttribute((UA_Client *)entity, node_id, node_is_abstract);
+        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, &value);
     else
-        retval = UA_Server_readIsAbstract((UA_Server *)entity, node_id, node_is_abstract);
-
-    UA_NodeId_clear(&node_id);
+        retval = UA_Server_readValue((UA_Server *)entity, node_id, &value);
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_Boolean_clear(node_is_abstract);
+        UA_Variant_clear(&value);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(node_is_abstract, 0, 0);
+    if(UA_Variant_isEmpty(&value)) {
+        UA_Variant_clear(&value);
+        send_error_response("nil");
+        return;
+    }
 
-    UA_Boolean_clear(node_is_abstract);
+    if(UA_Variant_isScalar(&value))
+    {
+        data_index = 0;
+    }
+
+    if(!UA_Variant_isScalar(&value) && value.arrayLength <= data_index)
+    {
+        UA_Variant_clear(&value);
+        send_opex_response(UA_STATUSCODE_BADTYPEMISMATCH);
+        return;   
+    }
+
+    if(value.type == &UA_TYPES[UA_TYPES_BOOLEAN])
+        send_data_response(((UA_Boolean *)value.data + data_index), 0, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_SBYTE])
+        send_data_response(((UA_SByte *)value.data + data_index), 1, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_BYTE])
+        send_data_response(((UA_Byte *)value.data + data_index), 2, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_INT16])
+        send_data_response(((UA_Int16 *)value.data + data_index), 1, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_UINT16])
+        send_data_response(((UA_UInt16 *)value.data + data_index), 2, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_INT32])
+        send_data_response(((UA_Int32 *)value.data + data_index), 1, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_UINT32])
+        send_data_response(((UA_UInt32 *)value.data + data_index), 2, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_INT64])
+        send_data_response(((UA_Int64 *)value.data + data_index), 15, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_UINT64])
+        send_data_response(((UA_UInt64 *)value.data + data_index), 16, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_FLOAT])
+        send_data_response(((UA_Float *)value.data + data_index), 17, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_DOUBLE])
+        send_data_response(((UA_Double *)value.data + data_index), 4, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_STRING])
+        send_data_response((*((UA_String *)value.data + data_index)).data, 5, (*((UA_String *)value.data + data_index)).length);
+    else if(value.type == &UA_TYPES[UA_TYPES_DATETIME])
+        send_data_response(((UA_DateTime *)value.data + data_index), 15, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_GUID])
+        send_data_response(((UA_Guid *)value.data + data_index), 18, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_BYTESTRING])
+        send_data_response((*((UA_ByteString *)value.data + data_index)).data, 5, (*((UA_ByteString *)value.data + data_index)).length);
+    else if(value.type == &UA_TYPES[UA_TYPES_XMLELEMENT])
+        send_data_response((*((UA_XmlElement *)value.data + data_index)).data, 5, (*((UA_XmlElement *)value.data + data_index)).length);
+    else if(value.type == &UA_TYPES[UA_TYPES_NODEID])
+        send_data_response(((UA_NodeId *)value.data + data_index), 12, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_EXPANDEDNODEID])
+        send_data_response(((UA_ExpandedNodeId *)value.data + data_index), 19, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_STATUSCODE])
+        send_data_response(((UA_StatusCode *)value.data + data_index), 20, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_QUALIFIEDNAME])
+        send_data_response(((UA_QualifiedName *)value.data + data_index), 13, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_LOCALIZEDTEXT])
+        send_data_response(((UA_LocalizedText *)value.data + data_index), 14, 0);
+
+    // TODO: UA_TYPES_EXTENSIONOBJECT
+    
+    // TODO: UA_TYPES_DATAVALUE
+
+    // TODO: UA_TYPES_VARIANT
+
+    // TODO: UA_TYPES_DIAGNOSTICINFO
+
+    else if(value.type == &UA_TYPES[UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE])
+        send_data_response(((UA_SemanticChangeStructureDataType *)value.data + data_index), 21, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_TIMESTRING])
+        send_data_response((*(UA_TimeString *)value.data).data, 5, (*(UA_TimeString *)value.data).length);
+
+    // TODO: UA_TYPES_VIEWATTRIBUTES
+
+    // TODO: UA_TYPES_UADPNETWORKMESSAGECONTENTMASK
+    else if(value.type == &UA_TYPES[UA_TYPES_UADPNETWORKMESSAGECONTENTMASK])
+        send_data_response(((UA_UadpDataSetMessageContentMask *)value.data + data_index), 2, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_XVTYPE])
+        send_data_response(((UA_XVType *)value.data + data_index), 22, 0);
+    else if(value.type == &UA_TYPES[UA_TYPES_ELEMENTOPERAND])
+        send_data_response(((UA_ElementOperand *)value.data + data_index), 2, 0);
+    else 
+        send_error_response("eagain");
+
+    UA_Variant_clear(&value);
 }
 
 /* 
- *  Reads 'symmetric' Attribute from a node. 
+ *  Read 'value' of a node in the server, this function may be faster than `read_node_value`, 
+ *  however `read_node_value` is safer.
  */
-void handle_read_node_symmetric(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_value_by_data_type(void *entity, bool entity_type, const char *req, int *req_index)
 {
+    int term_size;
+    int term_type;
+    UA_Variant *value;
     UA_StatusCode retval;
-    UA_Boolean symmetric;
+    
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_read_node_value_by_data_type requires a 2-tuple, term_size = %d", term_size);
+
     UA_NodeId node_id = assemble_node_id(req, req_index);
 
+    unsigned long data_type;
+    if (ei_decode_ulong(req, req_index, &data_type) < 0) {
+        send_error_response("einval");
+        return;
+    }
+   
     if(entity_type)
-        retval = UA_Client_readSymmetricAttribute((UA_Client *)entity, node_id, &symmetric);
+        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, value);
     else
-        retval = UA_Server_readSymmetric((UA_Server *)entity, node_id, &symmetric);
+        retval = UA_Server_readValue((UA_Server *)entity, node_id, value); 
 
     UA_NodeId_clear(&node_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
+        UA_Variant_clear(value);
+        UA_Variant_delete(value);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(&symmetric, 0, 0);
-}
+    if(UA_Variant_isEmpty(value) && value->type == &UA_TYPES[data_type]) {
+        UA_Variant_clear(value);
+        UA_Variant_delete(value);
+        send_error_response("nil");
+        return;
+    }
+
+    switch (data_type)
+    {
+        case UA_TYPES_BOOLEAN:
+            send_data_response(value->data, 0, 0);
+        break;
+
+        case UA_TYPES_SBYTE:
+            send_data_response(value->data, 1, 0);
+        break;
+
+        case UA_TYPES_BYTE:
+            send_data_response(value->data, 2, 0);
+        break;
+
+        case UA_TYPES_INT16:
+            send_data_response(value->data, 1, 0);
+        break;
+        
+        case UA_TYPES_UINT16:
+            send_data_response(value->data, 2, 0);
+        break;
+
+        case UA_TYPES_INT32:
+            send_data_response(value->data, 1, 0);
+        break;
+
+        case UA_TYPES_UINT32:
+            send_data_response(value->data, 2, 0);
+        break;
+
+        case UA_TYPES_INT64:
+            send_data_response(value->data, 15, 0);
+        break;
+
+        case UA_TYPES_UINT64:
+            send_data_response(value->data, 16, 0);
+        break;
+
+        case UA_TYPES_FLOAT:
+            send_data_response(value->data, 17, 0);
+        break;
+
+        case UA_TYPES_DOUBLE:
+            send_data_response(value->data, 4, 0);
+        break;
+
+        case UA_TYPES_STRING:
+            send_data_response((*(UA_String *)value->data).data, 5, (*(UA_String *)value->data).length);
+        break;
+
+        case UA_TYPES_DATETIME:
+            send_data_response(value->data, 15, 0);
+        break;
+
+        case UA_TYPES_GUID:
+            send_data_response(value->data, 18, 0);
+        break;
+
+        case UA_TYPES_BYTESTRING:
+            send_data_response((*(UA_ByteString *)value->data).data, 5, (*(UA_ByteString *)value->data).length);
+        break;
+
+        case UA_TYPES_XMLELEMENT:
+            send_data_response((*(UA_XmlElement *)value->data).data, 5, (*(UA_XmlElement *)value->data).length);
+        break;
+
+        case UA_TYPES_NODEID:
+            send_data_response(value->data, 12, 0);
+        break;
+
+        case UA_TYPES_EXPANDEDNODEID:
+            send_data_response(value->data, 19, 0);
+        break;
+
+        case UA_TYPES_STATUSCODE:
+            send_data_response(value->data, 20, 0);
+        break;
+
+        case UA_TYPES_QUALIFIEDNAME:
+            send_data_response(value->data, 13, 0);
+        break;
+
+        case UA_TYPES_LOCALIZEDTEXT:
+            send_data_response(value->data, 14, 0);
+        break;
+
+        // TODO: UA_TYPES_EXTENSIONOBJECT
+    
+        // TODO: UA_TYPES_DATAVALUE
+
+        // TODO: UA_TYPES_VARIANT
+
+        // TODO: UA_TYPES_DIAGNOSTICINFO
+
+        case UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE:
+            send_data_response(value->data, 21, 0);
+        break;
+
+        case UA_TYPES_TIMESTRING:
+            send_data_response((*(UA_TimeString *)value->data).data, 5, (*(UA_TimeString *)value->data).length);
+        break;
+
+        // TODO: UA_TYPES_VIEWATTRIBUTES
+
+        case UA_TYPES_UADPNETWORKMESSAGECONTENTMASK:
+            send_data_response(value->data, 2, 0);
+        break;
+
+        case UA_TYPES_XVTYPE:
+            send_data_response(value->data, 22, 0);
+        break;
+
+        case UA_TYPES_ELEMENTOPERAND:
+            send_data_response(value->data, 2, 0);
+        break;
+    
+        default:
+            send_error_response("eagain");
+        break;
+    }
 
+    UA_Variant_clear(value);
+}
 /* 
- *  Reads 'Inverse Name' Attribute from a node. 
+ *  Read several attributes in one round trip, expects a list of {node_id, attribute_id}.
+ *  The client issues a single Read service call, the server reads its information model directly.
  */
-void handle_read_node_inverse_name(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_read_node_values(void *entity, bool entity_type, const char *req, int *req_index)
 {
+    int list_size;
     int term_size;
-    int term_type;
-    UA_StatusCode retval;
-    UA_LocalizedText *node_inverse_name;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    if(entity_type)
-        retval = UA_Client_readInverseNameAttribute((UA_Client *)entity, node_id, node_inverse_name);
-    else
-        retval = UA_Server_readInverseName((UA_Server *)entity, node_id, node_inverse_name);
+    UA_ReadRequest request;
+    UA_ReadResponse response;
 
-    UA_NodeId_clear(&node_id);
+    if(ei_decode_list_header(req, req_index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":handle_read_node_values requires a list");
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_LocalizedText_clear(node_inverse_name);
-        send_opex_response(retval);
+    if(list_size == 0) {
+        send_data_response(NULL, 30, 0);
         return;
     }
 
-    send_data_response(node_inverse_name, 14, 0);
+    UA_ReadRequest_init(&request);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.nodesToRead = (UA_ReadValueId *) UA_Array_new(list_size, &UA_TYPES[UA_TYPES_READVALUEID]);
+    request.nodesToReadSize = list_size;
+    set_request_abort_array(request.nodesToRead, list_size, &UA_TYPES[UA_TYPES_READVALUEID]);
 
-    UA_LocalizedText_clear(node_inverse_name);
-}
+    for(size_t i = 0; i < list_size; i++) {
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 2)
+            errx(EXIT_FAILURE, ":handle_read_node_values requires a 2-tuple, term_size = %d", term_size);
 
-/* 
- *  Reads 'contains_no_loops' Attribute from a node. 
- */
-void handle_read_node_contains_no_loops(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    UA_StatusCode retval;
-    UA_Boolean contains_no_loops;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+        request.nodesToRead[i].nodeId = assemble_node_id(req, req_index);
+
+        unsigned long attribute_id;
+        if (ei_decode_ulong(req, req_index, &attribute_id) < 0) {
+            UA_ReadRequest_clear(&request);
+            send_error_response("einval");
+            return;
+        }
+
+        request.nodesToRead[i].attributeId = (UA_UInt32) attribute_id;
+    }
 
     if(entity_type)
-        retval = UA_Client_readContainsNoLoopsAttribute((UA_Client *)entity, node_id, &contains_no_loops);
-    else
-        retval = UA_Server_readContainsNoLoop((UA_Server *)entity, node_id, &contains_no_loops);
+        response = UA_Client_Service_read((UA_Client *)entity, request);
+    else {
+        UA_ReadResponse_init(&response);
+        response.results = (UA_DataValue *) UA_Array_new(list_size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+        response.resultsSize = list_size;
+
+        for(size_t i = 0; i < list_size; i++)
+            response.results[i] = UA_Server_read((UA_Server *)entity, &request.nodesToRead[i], UA_TIMESTAMPSTORETURN_NEITHER);
+    }
 
-    UA_NodeId_clear(&node_id);
+    UA_ReadRequest_clear(&request);
 
-    if(retval != UA_STATUSCODE_GOOD) {
+    if(response.responseHeader.serviceResult != UA_STATUSCODE_GOOD) {
+        UA_StatusCode retval = response.responseHeader.serviceResult;
+        UA_ReadResponse_clear(&response);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(&contains_no_loops, 0, 0);
+    send_data_response(response.results, 30, response.resultsSize);
+
+    UA_ReadResponse_clear(&response);
 }
 
-/* 
- *  Reads 'data_type' Attribute from a node. 
+/*
+ *  Replaces the element `index` of `array` with the scalar in `element` (same type).
+ *  On success the element data is moved into the array and `element` is left empty.
  */
-void handle_read_node_data_type(void *entity, bool entity_type, const char *req, int *req_index)
+static UA_StatusCode patch_array_element(UA_Variant *array, UA_Variant *element, size_t index)
 {
-    UA_StatusCode retval;
-    UA_NodeId *node_data_type;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    if(entity_type)
-        retval = UA_Client_readDataTypeAttribute((UA_Client *)entity, node_id, node_data_type);
-    else
-        retval = UA_Server_readDataType((UA_Server *)entity, node_id, node_data_type);
+    if(array->type != element->type || array->arrayLength <= index)
+        return UA_STATUSCODE_BADTYPEMISMATCH;
 
-    UA_NodeId_clear(&node_id);
+    const UA_DataType *type = element->type;
+    void *target = (void *)((uintptr_t)array->data + index * type->memSize);
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_NodeId_clear(node_data_type);
-        send_opex_response(retval);
-        return;
-    }
+    UA_clear(target, type);
+    memcpy(target, element->data, type->memSize);
 
-    send_data_response(node_data_type, 12, 0);
+    // The members now belong to the array, only release the scalar container.
+    UA_free(element->data);
+    UA_Variant_init(element);
 
-    UA_NodeId_clear(node_data_type);
+    return UA_STATUSCODE_GOOD;
 }
 
 /* 
- *  Reads 'value_rank' Attribute from a node. 
+ *  Change 'value' of several nodes in one round trip, expects a list of {node_id, data_type, index, value}
+ *  where index is nil for plain writes. Only the entries with an index are read back (in a single
+ *  Read call) to patch the array element before the batched write.
  */
-void handle_read_node_value_rank(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_write_node_values(void *entity, bool entity_type, const char *req, int *req_index)
 {
+    int list_size;
+    int term_size;
     UA_StatusCode retval;
-    UA_UInt32 *node_value_rank;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    if(entity_type)
-        retval = UA_Client_readValueRankAttribute((UA_Client *)entity, node_id, node_value_rank);
-    else
-        retval = UA_Server_readValueRank((UA_Server *)entity, node_id, node_value_rank);
 
-    UA_NodeId_clear(&node_id);
+    if(ei_decode_list_header(req, req_index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":handle_write_node_values requires a list");
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_UInt32_clear(node_value_rank);
-        send_opex_response(retval);
+    if(list_size == 0) {
+        send_data_response(NULL, 31, 0);
         return;
     }
 
-    send_data_response(node_value_rank, 2, 0);
+    UA_WriteValue *entries = (UA_WriteValue *) UA_Array_new(list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+    set_request_abort_array(entries, list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+    UA_StatusCode *results = request_arena_alloc(list_size * sizeof(UA_StatusCode));
+    long *indexes = request_arena_alloc(list_size * sizeof(long));
+    size_t *owners = request_arena_alloc(list_size * sizeof(size_t));
+    size_t indexed_size = 0;
 
-    UA_UInt32_clear(node_value_rank);
-}
+    for(size_t i = 0; i < list_size; i++) {
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 4)
+            errx(EXIT_FAILURE, ":handle_write_node_values requires a 4-tuple, term_size = %d", term_size);
 
-/* 
- *  Reads 'array_dimensions' Attribute from a node. 
- */
-void handle_read_node_array_dimensions(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    UA_StatusCode retval;
-    size_t array_dimensions_size;
-    UA_UInt32 *array_dimensions;
-    UA_Variant variant_array_dimensions;
-    UA_Variant_init(&variant_array_dimensions);
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-    
+        entries[i].nodeId = assemble_node_id(req, req_index);
+        entries[i].attributeId = UA_ATTRIBUTEID_VALUE;
+        results[i] = UA_STATUSCODE_GOOD;
+        owners[i] = i;
 
-    if(entity_type)
-        retval = UA_Client_readArrayDimensionsAttribute((UA_Client *)entity, node_id, &array_dimensions_size, &array_dimensions);
-    else
-        retval = UA_Server_readArrayDimensions((UA_Server *)entity, node_id, &variant_array_dimensions);
+        unsigned long data_type;
+        if (ei_decode_ulong(req, req_index, &data_type) < 0) {
+            UA_Array_delete(entries, list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+            send_error_response("einval");
+            return;
+        }
 
-    UA_NodeId_clear(&node_id);
+        unsigned long data_index;
+        char atom[MAXATOMLEN];
+        if (ei_decode_ulong(req, req_index, &data_index) == 0) {
+            indexes[i] = data_index;
+            indexed_size++;
+        }
+        else if (ei_decode_atom(req, req_index, atom) == 0 && !strcmp(atom, "nil"))
+            indexes[i] = -1;
+        else {
+            UA_Array_delete(entries, list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+            send_error_response("einval");
+            return;
+        }
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        if (entity_type)
-        {
-            free(array_dimensions);
+        if(assemble_variant_scalar(req, req_index, data_type, &entries[i].value.value) != UA_STATUSCODE_GOOD) {
+            UA_Array_delete(entries, list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+            send_error_response("einval");
+            return;
         }
-        UA_Variant_clear(&variant_array_dimensions);
-        send_opex_response(retval);
-        return;
-    }
 
-    if(entity_type)
-    {
-        send_data_response(array_dimensions, 28, (int) array_dimensions_size);    
-        free(array_dimensions);
-    }
-    else
-    {
-        send_data_response(variant_array_dimensions.data, 28, (int) variant_array_dimensions.arrayLength);
+        entries[i].value.hasValue = true;
     }
 
-    UA_Variant_clear(&variant_array_dimensions);
-}
+    // Read-modify-write for the array elements.
+    if(indexed_size) {
+        UA_ReadRequest read_request;
+        UA_ReadResponse read_response;
+        size_t *read_map = request_arena_alloc(indexed_size * sizeof(size_t));
 
-/* 
- *  Reads 'access_level' Attribute from a node. 
- */
-void handle_read_node_access_level(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    UA_StatusCode retval;
-    UA_Byte *node_access_level;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+        UA_ReadRequest_init(&read_request);
+        read_request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+        read_request.nodesToRead = (UA_ReadValueId *) UA_Array_new(indexed_size, &UA_TYPES[UA_TYPES_READVALUEID]);
+        read_request.nodesToReadSize = indexed_size;
 
-    if(entity_type)
-        retval = UA_Client_readAccessLevelAttribute((UA_Client *)entity, node_id, node_access_level);
-    else
-        retval = UA_Server_readAccessLevel((UA_Server *)entity, node_id, node_access_level);
+        for(size_t i = 0, j = 0; i < list_size; i++) {
+            if(indexes[i] < 0)
+                continue;
 
-    UA_NodeId_clear(&node_id);
+            UA_NodeId_copy(&entries[i].nodeId, &read_request.nodesToRead[j].nodeId);
+            read_request.nodesToRead[j].attributeId = UA_ATTRIBUTEID_VALUE;
+            read_map[j++] = i;
+        }
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_Byte_clear(node_access_level);
-        send_opex_response(retval);
-        return;
+        if(entity_type)
+            read_response = UA_Client_Service_read((UA_Client *)entity, read_request);
+        else {
+            UA_ReadResponse_init(&read_response);
+            read_response.results = (UA_DataValue *) UA_Array_new(indexed_size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+            read_response.resultsSize = indexed_size;
+
+            for(size_t j = 0; j < indexed_size; j++)
+                read_response.results[j] = UA_Server_read((UA_Server *)entity, &read_request.nodesToRead[j], UA_TIMESTAMPSTORETURN_NEITHER);
+        }
+
+        UA_ReadRequest_clear(&read_request);
+
+        retval = read_response.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD && read_response.resultsSize != indexed_size)
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_ReadResponse_clear(&read_response);
+            UA_Array_delete(entries, list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+            send_opex_response(retval);
+            return;
+        }
+
+        for(size_t j = 0; j < indexed_size; j++) {
+            size_t i = read_map[j];
+            UA_DataValue *current = &read_response.results[j];
+
+            if(current->hasStatus && current->status != UA_STATUSCODE_GOOD) {
+                results[i] = current->status;
+                continue;
+            }
+
+            // Scalars (or empty values) are overwritten like in write_node_value.
+            if(UA_Variant_isEmpty(&current->value) || UA_Variant_isScalar(&current->value))
+                continue;
+
+            // Elements of an array already patched by a previous entry are folded into that write.
+            for(size_t k = 0; k < j; k++) {
+                size_t previous = read_map[k];
+                if(results[previous] == UA_STATUSCODE_GOOD && owners[previous] == previous &&
+                    !UA_Variant_isScalar(&entries[previous].value.value) &&
+                    UA_NodeId_equal(&entries[previous].nodeId, &entries[i].nodeId)) {
+                    owners[i] = previous;
+                    break;
+                }
+            }
+
+            if(owners[i] != i) {
+                results[i] = patch_array_element(&entries[owners[i]].value.value, &entries[i].value.value, indexes[i]);
+                continue;
+            }
+
+            results[i] = patch_array_element(&current->value, &entries[i].value.value, indexes[i]);
+            if(results[i] == UA_STATUSCODE_GOOD) {
+                entries[i].value.value = current->value;
+                UA_Variant_init(&current->value);
+            }
+        }
+
+        UA_ReadResponse_clear(&read_response);
     }
 
-    send_data_response(node_access_level, 24, 0);
+    // Only the entries that survived the read step are sent.
+    UA_WriteRequest request;
+    UA_WriteRequest_init(&request);
+    size_t *write_map = request_arena_alloc(list_size * sizeof(size_t));
+    size_t write_size = 0;
 
-    UA_Byte_clear(node_access_level);
-}
+    for(size_t i = 0; i < list_size; i++)
+        if(results[i] == UA_STATUSCODE_GOOD && owners[i] == i)
+            write_map[write_size++] = i;
 
-/* 
- *  Reads 'minimum_sampling_interval' Attribute from a node. 
- */
-void handle_read_node_minimum_sampling_interval(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    UA_StatusCode retval;
-    UA_Double *node_minimum_sampling_interval;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    if(write_size) {
+        request.nodesToWrite = (UA_WriteValue *) UA_Array_new(write_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+        request.nodesToWriteSize = write_size;
 
-    if(entity_type)
-        retval = UA_Client_readMinimumSamplingIntervalAttribute((UA_Client *)entity, node_id, node_minimum_sampling_interval);
-    else
-        retval = UA_Server_readMinimumSamplingInterval((UA_Server *)entity, node_id, node_minimum_sampling_interval);
+        for(size_t j = 0; j < write_size; j++) {
+            request.nodesToWrite[j] = entries[write_map[j]];
+            UA_WriteValue_init(&entries[write_map[j]]);
+        }
 
-    UA_NodeId_clear(&node_id);
+        if(entity_type) {
+            UA_WriteResponse response = UA_Client_Service_write((UA_Client *)entity, request);
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_Double_clear(node_minimum_sampling_interval);
-        send_opex_response(retval);
-        return;
+            retval = response.responseHeader.serviceResult;
+            if(retval == UA_STATUSCODE_GOOD && response.resultsSize != write_size)
+                retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+            for(size_t j = 0; retval == UA_STATUSCODE_GOOD && j < write_size; j++)
+                results[write_map[j]] = response.results[j];
+
+            UA_WriteResponse_clear(&response);
+
+            if(retval != UA_STATUSCODE_GOOD) {
+                UA_WriteRequest_clear(&request);
+                UA_Array_delete(entries, list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+                send_opex_response(retval);
+                return;
+            }
+        }
+        else {
+            for(size_t j = 0; j < write_size; j++)
+                results[write_map[j]] = server_local_write((UA_Server *)entity, &request.nodesToWrite[j]);
+        }
     }
 
-    send_data_response(node_minimum_sampling_interval, 4, 0);
+    for(size_t i = 0; i < list_size; i++)
+        if(owners[i] != i && results[i] == UA_STATUSCODE_GOOD)
+            results[i] = results[owners[i]];
 
-    UA_Double_clear(node_minimum_sampling_interval);
+    UA_WriteRequest_clear(&request);
+    UA_Array_delete(entries, list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+
+    send_data_response(results, 31, list_size);
 }
 
 /* 
- *  Reads 'historizing' Attribute from a node. 
+ *   Registers a list of node ids and returns their handles, in the request order. The client registers them with
+ *   the server (RegisterNodes service) and keeps the aliases it returns.
  */
-void handle_read_node_historizing(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_register_nodes(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    UA_StatusCode retval;
-    UA_Boolean *node_historizing;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    if(entity_type)
-        retval = UA_Client_readHistorizingAttribute((UA_Client *)entity, node_id, node_historizing);
-    else
-        retval = UA_Server_readHistorizing((UA_Server *)entity, node_id, node_historizing);
+    int list_size;
 
-    UA_NodeId_clear(&node_id);
+    if(ei_decode_list_header(req, req_index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":handle_register_nodes requires a list");
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_Boolean_clear(node_historizing);
-        send_opex_response(retval);
+    if(list_size == 0) {
+        send_data_response(NULL, 37, 0);
         return;
     }
 
-    send_data_response(node_historizing, 0, 0);
+    UA_NodeId *node_ids = request_arena_alloc(list_size * sizeof(UA_NodeId));
+    UA_UInt32 *handles = request_arena_alloc(list_size * sizeof(UA_UInt32));
 
-    UA_Boolean_clear(node_historizing);
-}
+    for(int i = 0; i < list_size; i++)
+        node_ids[i] = assemble_node_id_ref(req, req_index);
 
-/* 
- *  Reads 'executable' Attribute from a node. 
- */
-void handle_read_node_executable(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    UA_StatusCode retval;
-    UA_Boolean *node_executable;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    if(!entity_type) {
+        for(int i = 0; i < list_size; i++)
+            handles[i] = register_node(&node_ids[i], NULL);
 
-    if(entity_type)
-        retval = UA_Client_readExecutableAttribute((UA_Client *)entity, node_id, node_executable);
-    else
-        retval = UA_Server_readExecutable((UA_Server *)entity, node_id, node_executable);
+        send_data_response(handles, 37, list_size);
+        return;
+    }
 
-    UA_NodeId_clear(&node_id);
+    UA_RegisterNodesRequest request;
+    UA_RegisterNodesRequest_init(&request);
+    request.nodesToRegister = node_ids;
+    request.nodesToRegisterSize = list_size;
+
+    UA_RegisterNodesResponse response = UA_Client_Service_registerNodes((UA_Client *)entity, request);
+
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.registeredNodeIdsSize != (size_t) list_size)
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_Boolean_clear(node_executable);
+        UA_RegisterNodesResponse_clear(&response);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(node_executable, 0, 0);
+    for(int i = 0; i < list_size; i++)
+        handles[i] = register_node(&node_ids[i], &response.registeredNodeIds[i]);
 
-    UA_Boolean_clear(node_executable);
+    UA_RegisterNodesResponse_clear(&response);
+    send_data_response(handles, 37, list_size);
 }
 
 /* 
- *  Reads 'event_notifier' Attribute from a node. 
+ *   Releases a list of handles, none of them is released if one is unknown. The client also unregisters them with
+ *   the server, the handles are released even if that fails.
  */
-void handle_read_node_event_notifier(void *entity, bool entity_type, const char *req, int *req_index)
+void handle_unregister_nodes(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    UA_StatusCode retval;
-    UA_Byte event_notifier;
-    UA_NodeId node_id = assemble_node_id(req, req_index);
-
-    if(entity_type)
-        retval = UA_Client_readEventNotifierAttribute((UA_Client *)entity, node_id, &event_notifier);
-    else
-        retval = UA_Server_readEventNotifier((UA_Server *)entity, node_id, &event_notifier);
+    int list_size;
 
-    UA_NodeId_clear(&node_id);
+    if(ei_decode_list_header(req, req_index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":handle_unregister_nodes requires a list");
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+    if(list_size == 0) {
+        send_ok_response();
         return;
     }
 
-    send_data_response(&event_notifier, 24, 0);
-}
+    UA_UInt32 *handles = request_arena_alloc(list_size * sizeof(UA_UInt32));
 
-/* 
- *  Read 'value' of a node in the server.
- */
-void handle_read_node_value(void *entity, bool entity_type, const char *req, int *req_index)
-{
-    int term_size;
-    UA_Variant *value = UA_Variant_new();
-    UA_Variant_init(value);
-    UA_StatusCode retval;
+    for(int i = 0; i < list_size; i++) {
+        unsigned long handle;
+        if(ei_decode_ulong(req, req_index, &handle) < 0 || handle > UA_UINT32_MAX ||
+            registered_node((UA_UInt32) handle) == NULL) {
+            send_error_response("einval");
+            return;
+        }
+
+        // Duplicates would be released twice.
+        for(int j = 0; j < i; j++) {
+            if(handles[j] == handle) {
+                send_error_response("einval");
+                return;
+            }
+        }
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_read_node_value requires a 2-tuple, term_size = %d", term_size);
+        handles[i] = (UA_UInt32) handle;
+    }
 
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    UA_NodeId *node_ids = (UA_NodeId *) UA_Array_new(list_size, &UA_TYPES[UA_TYPES_NODEID]);
+    for(int i = 0; i < list_size; i++)
+        unregister_node(handles[i], &node_ids[i]);
 
-    unsigned long data_index;
-    if (ei_decode_ulong(req, req_index, &data_index) < 0) {
-        send_error_response("einval");
-        return;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(entity_type) {
+        UA_UnregisterNodesRequest request;
+        UA_UnregisterNodesRequest_init(&request);
+        request.nodesToUnregister = node_ids;
+        request.nodesToUnregisterSize = list_size;
+
+        UA_UnregisterNodesResponse response = UA_Client_Service_unregisterNodes((UA_Client *)entity, request);
+        retval = response.responseHeader.serviceResult;
+        UA_UnregisterNodesResponse_clear(&response);
     }
-   
-    if(entity_type)
-        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, value);
-    else
-        retval = UA_Server_readValue((UA_Server *)entity, node_id, value);
 
-    UA_NodeId_clear(&node_id);
+    UA_Array_delete(node_ids, list_size, &UA_TYPES[UA_TYPES_NODEID]);
 
     if(retval != UA_STATUSCODE_GOOD) {
-        UA_Variant_clear(value);
-        UA_Variant_delete(value);
         send_opex_response(retval);
         return;
     }
 
-    send_data_response(value, 29, 0);
-    
-    UA_Variant_clear(value);
-    UA_Variant_delete(value);
+    send_ok_response();
 }
 
-/* 
- *  Read 'value' of a node in the server.
+/**********/
+/* Browse */
+/**********/
+
+/*  Recursive browse
+ *
+ *  browse_tree walks the forward references of a type (and its subtypes) breadth-first from a root node. A level is
+ *  browsed BROWSE_TREE_BATCH nodes at a time: a Client sends them in one Browse request and follows the continuation
+ *  points with BrowseNext, then reads the requested attributes of the new nodes in one Read request. Every node is
+ *  listed once, when it is first found. The entries are sent as {:ok, {:chunk, entries}} messages of up to
+ *  BROWSE_TREE_CHUNK nodes (or half the port packet size), the last message is {:ok, node_count}.
  */
-void handle_read_node_value_by_index(void *entity, bool entity_type, const char *req, int *req_index)
+#define BROWSE_TREE_BATCH 256
+#define BROWSE_TREE_CHUNK 1000
+
+struct browse_tree_node {
+    size_t parent; // Index in the browsed level
+    UA_ReferenceDescription reference;
+};
+
+struct browse_tree {
+    void *entity;
+    bool entity_type;
+    UA_BrowseDescription description; // Template, nodeId is set for every browsed node
+    UA_UInt32 *attribute_ids;
+    size_t attribute_ids_size;
+    struct node_id_set visited;
+    struct browse_tree_node *found; // Nodes found in the current batch
+    size_t found_size;
+    size_t found_capacity;
+    bool root_level; // Browse errors of the root are returned
+    ei_x_buff chunk;
+    size_t chunk_size;
+    uint32_t node_count;
+};
+
+/* Moves the references of a browse result to the nodes found in the batch, the result keeps the rest. */
+static void browse_tree_add_result(struct browse_tree *tree, size_t parent, UA_BrowseResult *result)
 {
-    int term_size;
-    UA_Variant *value = UA_Variant_new();
-    UA_Variant_init(value);
-    UA_StatusCode retval;
+    for(size_t i = 0; i < result->referencesSize; i++) {
+        UA_ReferenceDescription *reference = &result->references[i];
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_read_node_value requires a 2-tuple, term_size = %d", term_size);
+        if(reference->nodeId.serverIndex != 0 || !node_id_set_insert(&tree->visited, &reference->nodeId.nodeId))
+            continue;
 
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+        if(tree->found_size == tree->found_capacity) {
+            tree->found_capacity = tree->found_capacity ? 2 * tree->found_capacity : BROWSE_TREE_BATCH;
+            tree->found = realloc(tree->found, tree->found_capacity * sizeof(struct browse_tree_node));
+            if(!tree->found)
+                errx(EXIT_FAILURE, "Could not allocate the browse_tree nodes");
+        }
 
-    unsigned long data_index;
-    if (ei_decode_ulong(req, req_index, &data_index) < 0) {
-        send_error_response("einval");
-        return;
+        tree->found[tree->found_size].parent = parent;
+        tree->found[tree->found_size].reference = *reference;
+        UA_ReferenceDescription_init(reference);
+        tree->found_size++;
     }
-   
-    if(entity_type)
-        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, value);
-    else
-        retval = UA_Server_readValue((UA_Server *)entity, node_id, value);
+}
 
-    UA_NodeId_clear(&node_id);
+static UA_StatusCode browse_tree_server_batch(struct browse_tree *tree, const UA_NodeId *level, size_t first,
+                                              size_t count)
+{
+    for(size_t i = first; i < first + count; i++) {
+        tree->description.nodeId = level[i];
+        UA_BrowseResult result = UA_Server_browse((UA_Server *)tree->entity, 0, &tree->description);
+
+        if(tree->root_level && result.statusCode != UA_STATUSCODE_GOOD) {
+            UA_StatusCode retval = result.statusCode;
+            UA_BrowseResult_clear(&result);
+            return retval;
+        }
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_Variant_clear(value);
-        UA_Variant_delete(value);
-        send_opex_response(retval);
-        return;
-    }
+        for(;;) {
+            if(result.statusCode == UA_STATUSCODE_GOOD)
+                browse_tree_add_result(tree, i, &result);
 
-    if(UA_Variant_isEmpty(value)) {
-        UA_Variant_clear(value);
-        UA_Variant_delete(value);
-        send_error_response("nil");
-        return;
-    }
+            UA_ByteString continuation_point = result.continuationPoint;
+            UA_ByteString_init(&result.continuationPoint);
+            UA_BrowseResult_clear(&result);
 
-    if(UA_Variant_isScalar(value))
-    {
-        data_index = 0;
+            if(continuation_point.length == 0)
+                break;
+
+            result = UA_Server_browseNext((UA_Server *)tree->entity, false, &continuation_point);
+            UA_ByteString_clear(&continuation_point);
+        }
     }
 
-    if(!UA_Variant_isScalar(value) && value->arrayLength <= data_index)
-    {
-        UA_Variant_clear(value);
-        UA_Variant_delete(value);
-        send_opex_response(UA_STATUSCODE_BADTYPEMISMATCH);
-        return;   
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode browse_tree_client_batch(struct browse_tree *tree, const UA_NodeId *level, size_t first,
+                                              size_t count)
+{
+    UA_BrowseDescription descriptions[BROWSE_TREE_BATCH];
+    UA_ByteString continuation_points[BROWSE_TREE_BATCH];
+    size_t parents[BROWSE_TREE_BATCH];
+
+    // The descriptions borrow the node ids of the level, they are not cleared.
+    for(size_t i = 0; i < count; i++) {
+        descriptions[i] = tree->description;
+        descriptions[i].nodeId = level[first + i];
     }
 
-    if(value->type == &UA_TYPES[UA_TYPES_BOOLEAN])
-        send_data_response(((UA_Boolean *)value->data + data_index), 0, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_SBYTE])
-        send_data_response(((UA_SByte *)value->data + data_index), 1, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_BYTE])
-        send_data_response(((UA_Byte *)value->data + data_index), 2, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_INT16])
-        send_data_response(((UA_Int16 *)value->data + data_index), 1, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_UINT16])
-        send_data_response(((UA_UInt16 *)value->data + data_index), 2, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_INT32])
-        send_data_response(((UA_Int32 *)value->data + data_index), 1, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_UINT32])
-        send_data_response(((UA_UInt32 *)value->data + data_index), 2, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_INT64])
-        send_data_response(((UA_Int64 *)value->data + data_index), 15, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_UINT64])
-        send_data_response(((UA_UInt64 *)value->data + data_index), 16, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_FLOAT])
-        send_data_response(((UA_Float *)value->data + data_index), 17, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_DOUBLE])
-        send_data_response(((UA_Double *)value->data + data_index), 4, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_STRING])
-        send_data_response((*((UA_String *)value->data + data_index)).data, 5, (*((UA_String *)value->data + data_index)).length);
-    else if(value->type == &UA_TYPES[UA_TYPES_DATETIME])
-        send_data_response(((UA_DateTime *)value->data + data_index), 15, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_GUID])
-        send_data_response(((UA_Guid *)value->data + data_index), 18, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_BYTESTRING])
-        send_data_response((*((UA_ByteString *)value->data + data_index)).data, 5, (*((UA_ByteString *)value->data + data_index)).length);
-    else if(value->type == &UA_TYPES[UA_TYPES_XMLELEMENT])
-        send_data_response((*((UA_XmlElement *)value->data + data_index)).data, 5, (*((UA_XmlElement *)value->data + data_index)).length);
-    else if(value->type == &UA_TYPES[UA_TYPES_NODEID])
-        send_data_response(((UA_NodeId *)value->data + data_index), 12, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_EXPANDEDNODEID])
-        send_data_response(((UA_ExpandedNodeId *)value->data + data_index), 19, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_STATUSCODE])
-        send_data_response(((UA_StatusCode *)value->data + data_index), 20, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_QUALIFIEDNAME])
-        send_data_response(((UA_QualifiedName *)value->data + data_index), 13, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_LOCALIZEDTEXT])
-        send_data_response(((UA_LocalizedText *)value->data + data_index), 14, 0);
+    UA_BrowseRequest request;
+    UA_BrowseRequest_init(&request);
+    request.nodesToBrowse = descriptions;
+    request.nodesToBrowseSize = count;
 
-    // TODO: UA_TYPES_EXTENSIONOBJECT
-    
-    // TODO: UA_TYPES_DATAVALUE
+    UA_BrowseResponse response = UA_Client_Service_browse((UA_Client *)tree->entity, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != count)
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
 
-    // TODO: UA_TYPES_VARIANT
+    if(retval == UA_STATUSCODE_GOOD && tree->root_level)
+        retval = response.results[0].statusCode;
 
-    // TODO: UA_TYPES_DIAGNOSTICINFO
+    size_t results_size = retval == UA_STATUSCODE_GOOD ? count : 0;
+    UA_BrowseResult *results = response.results;
+    for(size_t i = 0; i < results_size; i++)
+        parents[i] = first + i;
 
-    else if(value->type == &UA_TYPES[UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE])
-        send_data_response(((UA_SemanticChangeStructureDataType *)value->data + data_index), 21, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_TIMESTRING])
-        send_data_response((*(UA_TimeString *)value->data).data, 5, (*(UA_TimeString *)value->data).length);
+    UA_BrowseNextResponse next_response;
+    UA_BrowseNextResponse_init(&next_response);
 
-    // TODO: UA_TYPES_VIEWATTRIBUTES
+    while(retval == UA_STATUSCODE_GOOD) {
+        size_t continuation_points_size = 0;
 
-    // TODO: UA_TYPES_UADPNETWORKMESSAGECONTENTMASK
-    else if(value->type == &UA_TYPES[UA_TYPES_UADPNETWORKMESSAGECONTENTMASK])
-        send_data_response(((UA_UadpDataSetMessageContentMask *)value->data + data_index), 2, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_XVTYPE])
-        send_data_response(((UA_XVType *)value->data + data_index), 22, 0);
-    else if(value->type == &UA_TYPES[UA_TYPES_ELEMENTOPERAND])
-        send_data_response(((UA_ElementOperand *)value->data + data_index), 2, 0);
-    else 
-        send_error_response("eagain");
+        for(size_t i = 0; i < results_size; i++) {
+            if(results[i].statusCode == UA_STATUSCODE_GOOD)
+                browse_tree_add_result(tree, parents[i], &results[i]);
 
-    UA_Variant_clear(value);
-    UA_Variant_delete(value);
+            if(results[i].continuationPoint.length > 0) {
+                parents[continuation_points_size] = parents[i];
+                continuation_points[continuation_points_size++] = results[i].continuationPoint;
+                UA_ByteString_init(&results[i].continuationPoint);
+            }
+        }
+
+        UA_BrowseNextResponse_clear(&next_response);
+        if(continuation_points_size == 0)
+            break;
+
+        UA_BrowseNextRequest next_request;
+        UA_BrowseNextRequest_init(&next_request);
+        next_request.continuationPoints = continuation_points;
+        next_request.continuationPointsSize = continuation_points_size;
+
+        next_response = UA_Client_Service_browseNext((UA_Client *)tree->entity, next_request);
+        for(size_t i = 0; i < continuation_points_size; i++)
+            UA_ByteString_clear(&continuation_points[i]);
+
+        retval = next_response.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD && next_response.resultsSize != continuation_points_size)
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+        results = next_response.results;
+        results_size = continuation_points_size;
+    }
+
+    UA_BrowseNextResponse_clear(&next_response);
+    UA_BrowseResponse_clear(&response);
+    return retval;
 }
 
-/* 
- *  Read 'value' of a node in the server, this function may be faster than `read_node_value`, 
- *  however `read_node_value` is safer.
- */
-void handle_read_node_value_by_data_type(void *entity, bool entity_type, const char *req, int *req_index)
+/* Reads the attributes of the nodes found in the batch, values[node * attribute_ids_size + attribute]. */
+static UA_StatusCode browse_tree_read_attributes(struct browse_tree *tree, UA_DataValue **values)
 {
-    int term_size;
-    int term_type;
-    UA_Variant *value;
-    UA_StatusCode retval;
-    
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_read_node_value_by_data_type requires a 2-tuple, term_size = %d", term_size);
+    size_t values_size = tree->found_size * tree->attribute_ids_size;
+    *values = NULL;
+
+    if(values_size == 0)
+        return UA_STATUSCODE_GOOD;
+
+    UA_ReadValueId *items = calloc(values_size, sizeof(UA_ReadValueId));
+    if(!items)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    // The items borrow the node ids of the found references, they are only freed.
+    for(size_t i = 0; i < tree->found_size; i++) {
+        for(size_t j = 0; j < tree->attribute_ids_size; j++) {
+            UA_ReadValueId *item = &items[i * tree->attribute_ids_size + j];
+            item->nodeId = tree->found[i].reference.nodeId.nodeId;
+            item->attributeId = tree->attribute_ids[j];
+        }
+    }
 
-    UA_NodeId node_id = assemble_node_id(req, req_index);
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(tree->entity_type) {
+        UA_ReadRequest request;
+        UA_ReadRequest_init(&request);
+        request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+        request.nodesToRead = items;
+        request.nodesToReadSize = values_size;
+
+        UA_ReadResponse response = UA_Client_Service_read((UA_Client *)tree->entity, request);
+        retval = response.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD && response.resultsSize != values_size)
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+
+        if(retval == UA_STATUSCODE_GOOD) {
+            *values = response.results;
+            response.results = NULL;
+            response.resultsSize = 0;
+        }
 
-    unsigned long data_type;
-    if (ei_decode_ulong(req, req_index, &data_type) < 0) {
-        send_error_response("einval");
-        return;
+        UA_ReadResponse_clear(&response);
     }
-   
-    if(entity_type)
-        retval = UA_Client_readValueAttribute((UA_Client *)entity, node_id, value);
-    else
-        retval = UA_Server_readValue((UA_Server *)entity, node_id, value); 
-
-    UA_NodeId_clear(&node_id);
+    else {
+        *values = (UA_DataValue *) UA_Array_new(values_size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+        if(!*values)
+            retval = UA_STATUSCODE_BADOUTOFMEMORY;
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_Variant_clear(value);
-        UA_Variant_delete(value);
-        send_opex_response(retval);
-        return;
+        for(size_t i = 0; retval == UA_STATUSCODE_GOOD && i < values_size; i++)
+            (*values)[i] = UA_Server_read((UA_Server *)tree->entity, &items[i], UA_TIMESTAMPSTORETURN_NEITHER);
     }
 
-    if(UA_Variant_isEmpty(value) && value->type == &UA_TYPES[data_type]) {
-        UA_Variant_clear(value);
-        UA_Variant_delete(value);
-        send_error_response("nil");
+    free(items);
+    return retval;
+}
+
+static void browse_tree_flush(struct browse_tree *tree)
+{
+    if(tree->chunk_size == 0)
         return;
+
+    send_data_response(&tree->chunk, 39, tree->chunk_size);
+    tree->chunk.index = 0;
+    tree->chunk_size = 0;
+}
+
+//{node_id, parent_node_id, reference_type_id, browse_name, display_name, node_class, type_definition, depth, attributes}
+static void browse_tree_encode_batch(struct browse_tree *tree, const UA_NodeId *level, size_t depth, UA_DataValue *values)
+{
+    for(size_t i = 0; i < tree->found_size; i++) {
+        UA_ReferenceDescription *reference = &tree->found[i].reference;
+
+        ei_x_encode_tuple_header(&tree->chunk, 9);
+        encode_node_id(&tree->chunk, &reference->nodeId.nodeId);
+        encode_node_id(&tree->chunk, (void *) &level[tree->found[i].parent]);
+        encode_node_id(&tree->chunk, &reference->referenceTypeId);
+        encode_qualified_name(&tree->chunk, &reference->browseName);
+        encode_localized_text(&tree->chunk, &reference->displayName);
+        ei_x_encode_ulong(&tree->chunk, reference->nodeClass);
+        encode_node_id(&tree->chunk, &reference->typeDefinition.nodeId);
+        ei_x_encode_ulong(&tree->chunk, depth);
+        encode_data_value_results(&tree->chunk, values ? values + i * tree->attribute_ids_size : NULL,
+                                  values ? tree->attribute_ids_size : 0);
+
+        tree->node_count++;
+        if(++tree->chunk_size == BROWSE_TREE_CHUNK || tree->chunk.index >= erlcmd_max_payload_size() / 2)
+            browse_tree_flush(tree);
     }
+}
 
-    switch (data_type)
-    {
-        case UA_TYPES_BOOLEAN:
-            send_data_response(value->data, 0, 0);
-        break;
+/*
+ *  Browses a level in batches, the nodes found are appended to `next` (when it isn't NULL).
+ */
+static UA_StatusCode browse_tree_level(struct browse_tree *tree, const UA_NodeId *level, size_t level_size,
+                                       size_t depth, UA_NodeId **next, size_t *next_size)
+{
+    size_t next_capacity = 0;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
 
-        case UA_TYPES_SBYTE:
-            send_data_response(value->data, 1, 0);
-        break;
+    for(size_t first = 0; first < level_size && retval == UA_STATUSCODE_GOOD; first += BROWSE_TREE_BATCH) {
+        size_t count = level_size - first < BROWSE_TREE_BATCH ? level_size - first : BROWSE_TREE_BATCH;
 
-        case UA_TYPES_BYTE:
-            send_data_response(value->data, 2, 0);
-        break;
+        if(tree->entity_type)
+            retval = browse_tree_client_batch(tree, level, first, count);
+        else
+            retval = browse_tree_server_batch(tree, level, first, count);
 
-        case UA_TYPES_INT16:
-            send_data_response(value->data, 1, 0);
-        break;
-        
-        case UA_TYPES_UINT16:
-            send_data_response(value->data, 2, 0);
-        break;
+        UA_DataValue *values = NULL;
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = browse_tree_read_attributes(tree, &values);
 
-        case UA_TYPES_INT32:
-            send_data_response(value->data, 1, 0);
-        break;
+        if(retval == UA_STATUSCODE_GOOD)
+            browse_tree_encode_batch(tree, level, depth, values);
 
-        case UA_TYPES_UINT32:
-            send_data_response(value->data, 2, 0);
-        break;
+        for(size_t i = 0; i < tree->found_size; i++) {
+            UA_ReferenceDescription *reference = &tree->found[i].reference;
 
-        case UA_TYPES_INT64:
-            send_data_response(value->data, 15, 0);
-        break;
+            if(retval == UA_STATUSCODE_GOOD && next != NULL) {
+                if(*next_size == next_capacity) {
+                    next_capacity = next_capacity ? 2 * next_capacity : BROWSE_TREE_BATCH;
+                    *next = realloc(*next, next_capacity * sizeof(UA_NodeId));
+                    if(!*next)
+                        errx(EXIT_FAILURE, "Could not allocate the browse_tree level");
+                }
 
-        case UA_TYPES_UINT64:
-            send_data_response(value->data, 16, 0);
-        break;
+                (*next)[(*next_size)++] = reference->nodeId.nodeId;
+                UA_NodeId_init(&reference->nodeId.nodeId);
+            }
 
-        case UA_TYPES_FLOAT:
-            send_data_response(value->data, 17, 0);
-        break;
+            UA_ReferenceDescription_clear(reference);
+        }
 
-        case UA_TYPES_DOUBLE:
-            send_data_response(value->data, 4, 0);
-        break;
+        UA_Array_delete(values, tree->found_size * tree->attribute_ids_size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+        tree->found_size = 0;
+    }
 
-        case UA_TYPES_STRING:
-            send_data_response((*(UA_String *)value->data).data, 5, (*(UA_String *)value->data).length);
-        break;
+    return retval;
+}
 
-        case UA_TYPES_DATETIME:
-            send_data_response(value->data, 15, 0);
-        break;
+/* 
+ *   Browses the subtree of a node ({root, max_depth, reference_type_id, node_class_mask, [attribute_id]}), see
+ *   browse_tree above. A max_depth of 0 browses the whole subtree, a node_class_mask of 0 follows every node class.
+ */
+void handle_browse_tree(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int list_size;
+    unsigned long max_depth;
+    unsigned long node_class_mask;
 
-        case UA_TYPES_GUID:
-            send_data_response(value->data, 18, 0);
-        break;
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 5)
+        errx(EXIT_FAILURE, ":handle_browse_tree requires a 5-tuple, term_size = %d", term_size);
 
-        case UA_TYPES_BYTESTRING:
-            send_data_response((*(UA_ByteString *)value->data).data, 5, (*(UA_ByteString *)value->data).length);
-        break;
+    UA_NodeId root = assemble_node_id(req, req_index);
 
-        case UA_TYPES_XMLELEMENT:
-            send_data_response((*(UA_XmlElement *)value->data).data, 5, (*(UA_XmlElement *)value->data).length);
-        break;
+    if(ei_decode_ulong(req, req_index, &max_depth) < 0) {
+        UA_NodeId_clear(&root);
+        send_error_response("einval");
+        return;
+    }
 
-        case UA_TYPES_NODEID:
-            send_data_response(value->data, 12, 0);
-        break;
+    UA_NodeId reference_type = assemble_node_id(req, req_index);
 
-        case UA_TYPES_EXPANDEDNODEID:
-            send_data_response(value->data, 19, 0);
-        break;
+    if(ei_decode_ulong(req, req_index, &node_class_mask) < 0 || node_class_mask > UA_UINT32_MAX ||
+        ei_decode_list_header(req, req_index, &list_size) < 0) {
+        UA_NodeId_clear(&root);
+        UA_NodeId_clear(&reference_type);
+        send_error_response("einval");
+        return;
+    }
 
-        case UA_TYPES_STATUSCODE:
-            send_data_response(value->data, 20, 0);
-        break;
+    struct browse_tree tree = {.entity = entity, .entity_type = entity_type, .attribute_ids_size = list_size};
+    tree.attribute_ids = request_arena_alloc((list_size + 1) * sizeof(UA_UInt32));
 
-        case UA_TYPES_QUALIFIEDNAME:
-            send_data_response(value->data, 13, 0);
-        break;
+    for(int i = 0; i < list_size; i++) {
+        unsigned long attribute_id;
+        if(ei_decode_ulong(req, req_index, &attribute_id) < 0 || attribute_id > UA_UINT32_MAX) {
+            UA_NodeId_clear(&root);
+            UA_NodeId_clear(&reference_type);
+            send_error_response("einval");
+            return;
+        }
 
-        case UA_TYPES_LOCALIZEDTEXT:
-            send_data_response(value->data, 14, 0);
-        break;
+        tree.attribute_ids[i] = (UA_UInt32) attribute_id;
+    }
 
-        // TODO: UA_TYPES_EXTENSIONOBJECT
-    
-        // TODO: UA_TYPES_DATAVALUE
+    UA_BrowseDescription_init(&tree.description);
+    tree.description.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+    tree.description.referenceTypeId = reference_type;
+    tree.description.includeSubtypes = true;
+    tree.description.nodeClassMask = (UA_UInt32) node_class_mask;
+    tree.description.resultMask = UA_BROWSERESULTMASK_ALL;
 
-        // TODO: UA_TYPES_VARIANT
+    ei_x_new(&tree.chunk);
+    node_id_set_insert(&tree.visited, &root);
 
-        // TODO: UA_TYPES_DIAGNOSTICINFO
+    UA_NodeId *level = (UA_NodeId *) malloc(sizeof(UA_NodeId));
+    if(!level)
+        errx(EXIT_FAILURE, "Could not allocate the browse_tree level");
 
-        case UA_TYPES_SEMANTICCHANGESTRUCTUREDATATYPE:
-            send_data_response(value->data, 21, 0);
-        break;
+    level[0] = root;
+    size_t level_size = 1;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
 
-        case UA_TYPES_TIMESTRING:
-            send_data_response((*(UA_TimeString *)value->data).data, 5, (*(UA_TimeString *)value->data).length);
-        break;
+    for(size_t depth = 1; level_size > 0 && retval == UA_STATUSCODE_GOOD; depth++) {
+        UA_NodeId *next = NULL;
+        size_t next_size = 0;
+        bool last_level = max_depth != 0 && depth == max_depth;
 
-        // TODO: UA_TYPES_VIEWATTRIBUTES
+        tree.root_level = depth == 1;
+        retval = browse_tree_level(&tree, level, level_size, depth, last_level ? NULL : &next, &next_size);
 
-        case UA_TYPES_UADPNETWORKMESSAGECONTENTMASK:
-            send_data_response(value->data, 2, 0);
-        break;
+        UA_Array_delete(level, level_size, &UA_TYPES[UA_TYPES_NODEID]);
+        level = next;
+        level_size = next_size;
+    }
 
-        case UA_TYPES_XVTYPE:
-            send_data_response(value->data, 22, 0);
-        break;
+    UA_Array_delete(level, level_size, &UA_TYPES[UA_TYPES_NODEID]);
+    node_id_set_clear(&tree.visited);
+    UA_NodeId_clear(&reference_type);
+    free(tree.found);
 
-        case UA_TYPES_ELEMENTOPERAND:
-            send_data_response(value->data, 2, 0);
-        break;
-    
-        default:
-            send_error_response("eagain");
-        break;
+    if(retval == UA_STATUSCODE_GOOD) {
+        browse_tree_flush(&tree);
+        send_data_response(&tree.node_count, 27, 0);
     }
+    else
+        send_opex_response(retval);
 
-    UA_Variant_clear(value);
-}
\ No newline at end of file
+    ei_x_free(&tree.chunk);
+}
@@ -24,7 +24,6 @@
 #include "erlcmd.h"
 
 //#define DEBUG
-#define ERLCMD_BUF_SIZE 32768
 
 #ifdef DEBUG
 FILE *log_location;
@@ -47,29 +46,81 @@ FILE *log_location;
 
 #define ONE_YEAR_MILLIS (1000ULL * 60 * 60 * 24 * 365)
 uint64_t current_time();
+uint64_t current_time_us();
 #endif // UTIL_H
 
-static char *caller_function;
+static const char *caller_function;
 
-static char *caller_metadata_ptr;
+static const char *caller_metadata_ptr;
 static size_t caller_metadata_size = 0;
 
+// Node id sets
+struct node_id_set {
+    UA_NodeId *node_ids; // Null node ids are empty slots
+    size_t size;
+    size_t capacity; // Power of two
+};
+
+bool node_id_set_insert(struct node_id_set *set, const UA_NodeId *node_id);
+void node_id_set_clear(struct node_id_set *set);
+
+// Registered nodes (node handles)
+uint32_t register_node(const UA_NodeId *node_id, const UA_NodeId *alias);
+const UA_NodeId *registered_node(uint32_t handle);
+void unregister_node(uint32_t handle, UA_NodeId *node_id);
+void unregister_session_nodes(uint32_t session);
+UA_StatusCode reregister_session_nodes(UA_Client *client, void (*renamed)(const UA_NodeId *alias,
+                                                                         const UA_NodeId *new_alias));
+
 //Client and Server common functions
 UA_NodeId assemble_node_id(const char *req, int *req_index);
+UA_NodeId assemble_node_id_ref(const char *req, int *req_index);
 UA_ExpandedNodeId assemble_expanded_node_id(const char *req, int *req_index);
 UA_QualifiedName assemble_qualified_name(const char *req, int *req_index);
+UA_StatusCode assemble_string(const char *req, int *req_index, UA_String *string);
+UA_StatusCode assemble_variant_scalar(const char *req, int *req_index, unsigned long data_type, UA_Variant *value);
+UA_StatusCode assemble_variant_array(const char *req, int *req_index, unsigned long data_type, UA_Variant *value);
+bool data_type_is_packable(unsigned long data_type);
 
 // Elixir Message assemblers
-void encode_client_config(char *resp, int *resp_index, void *data);
-void encode_server_on_the_network_struct(char *resp, int *resp_index, void *data, int data_len);
-void encode_application_description_struct(char *resp, int *resp_index, void *data, int data_len);
-void encode_endpoint_description_struct(char *resp, int *resp_index, void *data, int data_len);
-void encode_array_dimensions_struct(char *resp, int *resp_index, void *data, int data_len);
-void encode_server_config(char *resp, int *resp_index, void *data);
+void encode_client_config(ei_x_buff *resp, void *data);
+void encode_server_on_the_network_struct(ei_x_buff *resp, void *data, int data_len);
+void encode_application_description_struct(ei_x_buff *resp, void *data, int data_len);
+void encode_endpoint_description_struct(ei_x_buff *resp, void *data, int data_len);
+void encode_array_dimensions_struct(ei_x_buff *resp, void *data, int data_len);
+void encode_server_config(ei_x_buff *resp, void *data);
+void encode_qualified_name(ei_x_buff *resp, void *data);
+void encode_localized_text(ei_x_buff *resp, void *data);
+void encode_ua_guid(ei_x_buff *resp, void *data);
+void encode_variant_struct(ei_x_buff *resp, void *data);
+bool variant_is_packable(const UA_Variant *value);
+
+// Summary of a load_address_space chunk, failure indexes are positions in the chunk
+struct address_space_summary {
+    size_t namespaces_size;
+    const char **namespace_names;
+    UA_UInt16 *namespace_indexes;
+    size_t failures_size;
+    UA_UInt32 *failure_indexes;
+    UA_StatusCode *failure_codes;
+};
+
+void set_response_session(uint32_t session);
 void send_subscription_timeout_response(void *data, int data_type, int data_len);
 void send_subscription_deleted_response(void *data, int data_type, int data_len);
 void send_monitored_item_response(void *subscription_id, void *monitored_id, void *data, int data_type);
 void send_monitored_item_delete_response(void *subscription_id, void *monitored_id);
+void send_reconnected_response(uint32_t attempts, uint32_t subscriptions, uint32_t monitored_items, uint32_t failed);
+void set_notification_batch_size(int max_size);
+bool notification_batch_enabled();
+void add_notification_to_batch(void *subscription_id, void *monitored_id, void *data, int data_type);
+void flush_notification_batch();
+void set_write_batch(bool enabled, uint64_t interval);
+void flush_write_batch(bool force);
+bool set_notification_queue(size_t high_water);
+void flush_notification_queue();
+UA_StatusCode server_local_write(UA_Server *server, const UA_WriteValue *value);
+UA_StatusCode server_local_write_value(UA_Server *server, const UA_NodeId node_id, const UA_Variant value);
 void send_data_response(void *data, int data_type, int data_len);
 void send_error_response(const char *reason);
 void send_ok_response();
@@ -77,10 +128,50 @@ void send_opex_response(uint32_t reason);
 
 //Elixir message decoders
 void handle_caller_metadata(const char *req, int *req_index, const char* cmd);
-void free_caller_metadata();
+void *request_arena_alloc(size_t size);
+void reset_request_context();
+void set_request_abort_array(void *array, size_t size, const UA_DataType *type);
+
+// Caller of a request answered after its dispatch (asynchronous client requests)
+struct caller_context {
+    const char *function;
+    const char *metadata;
+    size_t metadata_size;
+};
+
+void save_caller_context(struct caller_context *context);
+void swap_caller_context(struct caller_context *context);
+void clear_caller_context(struct caller_context *context);
+
+// Elixir -> C request dispatch
+struct request_handler {
+    const char *name;
+    void (*handler)(void *entity, bool entity_type, const char *req, int *req_index);
+};
+
+void init_request_handlers(const struct request_handler *handlers);
+const struct request_handler *decode_request_handler(const char *req, int *req_index);
+void call_request_handler(const struct request_handler *rh, void *entity, bool entity_type, const char *req, int *req_index);
+
+// Port statistics, programs report their own gauges next to the common ones
+struct stats_gauge {
+    const char *name;
+    uint64_t value;
+};
+
+void send_stats_response(const struct stats_gauge *gauges, size_t gauges_size);
+void send_stats(const struct stats_gauge *gauges, size_t gauges_size);
+bool stats_push_due();
+int stats_push_timeout();
 
 //Client and Server common handlers
 void handle_test(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_list_commands(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_get_build_features(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_set_notification_batch_size(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_set_stats_interval(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_enable_shm_ring(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_set_notification_queue(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_add_variable_node(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_add_variable_type_node(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_add_object_node(void *entity, bool entity_type, const char *req, int *req_index);
@@ -89,6 +180,10 @@ void handle_add_view_node(void *entity, bool entity_type, const char *req, int *
 void handle_add_reference_type_node(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_add_data_type_node(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_add_reference(void *entity, bool entity_type, const char *req, int *req_index);
+void send_write_response(UA_Server *server,
+               const UA_NodeId *sessionId, void *sessionContext,
+               const UA_NodeId *nodeId, void *nodeContext,
+               const UA_NumericRange *range, const UA_DataValue *data);
 void handle_delete_reference(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_delete_node(void *entity, bool entity_type, const char *req, int *req_index);
 
@@ -108,6 +203,9 @@ void handle_write_node_executable(void *entity, bool entity_type, const char *re
 void handle_write_node_event_notifier(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_write_node_value(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_write_node_blank_array(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_write_node_array(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_write_node_value_range(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_write_node_values(void *entity, bool entity_type, const char *req, int *req_index);
 
 void handle_read_node_node_id(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_read_node_node_class(void *entity, bool entity_type, const char *req, int *req_index);
@@ -128,5 +226,11 @@ void handle_read_node_historizing(void *entity, bool entity_type, const char *re
 void handle_read_node_executable(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_read_node_event_notifier(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_read_node_value(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_read_node_value_packed(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_read_node_value_range(void *entity, bool entity_type, const char *req, int *req_index);
 void handle_read_node_value_by_index(void *entity, bool entity_type, const char *req, int *req_index);
-void handle_read_node_value_by_data_type(void *entity, bool entity_type, const char *req, int *req_index);
\ No newline at end of file
+void handle_read_node_value_by_data_type(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_read_node_values(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_register_nodes(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_unregister_nodes(void *entity, bool entity_type, const char *req, int *req_index);
+void handle_browse_tree(void *entity, bool entity_type, const char *req, int *req_index);
@@ -19,21 +19,51 @@
 #include "erlcmd.h"
 #include "common.h"
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#ifndef __WIN32__
+#include <fcntl.h>
+#endif
+
 #ifdef __WIN32__
 // Assume that all windows platforms are little endian
 #define TO_BIGENDIAN16(X) _byteswap_ushort(X)
 #define FROM_BIGENDIAN16(X) _byteswap_ushort(X)
+#define TO_BIGENDIAN32(X) _byteswap_ulong(X)
+#define FROM_BIGENDIAN32(X) _byteswap_ulong(X)
 #else
 // Other platforms have htons and ntohs without pulling in another library
 #define TO_BIGENDIAN16(X) htons(X)
 #define FROM_BIGENDIAN16(X) ntohs(X)
+#define TO_BIGENDIAN32(X) htonl(X)
+#define FROM_BIGENDIAN32(X) ntohl(X)
 #endif
 
+// Size of the length prefix, matches the {:packet, N} option of the Elixir port.
+static size_t packet_size = sizeof(uint16_t);
+static struct erlcmd_stats stats;
+
+// Non-blocking stdout (erlcmd_set_nonblocking), bytes the pipe didn't take yet, in order.
+static bool nonblocking = false;
+static char *pending = NULL;
+static size_t pending_offset = 0; // Already written
+static size_t pending_size = 0;
+static size_t pending_capacity = 0;
+
+static void stats_count(uint64_t *messages, uint64_t *bytes, uint64_t *max_size, size_t len)
+{
+    __atomic_add_fetch(messages, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(bytes, len, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(max_size, __ATOMIC_RELAXED);
+    while (len > max && !__atomic_compare_exchange_n(max_size, &max, len, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
 #ifdef __WIN32__
 /*
  * stdin on Windows
@@ -108,7 +138,7 @@ static void start_async_read(struct erlcmd *handler)
 {
     ReadFile(handler->h,
                handler->buffer + handler->index,
-               sizeof(handler->buffer) - handler->index,
+               handler->buffer_size - handler->index,
                NULL,
                &handler->overlapped);
 }
@@ -128,6 +158,11 @@ void erlcmd_init(struct erlcmd *handler,
 {
     memset(handler, 0, sizeof(*handler));
 
+    handler->buffer_size = ERLCMD_BUF_SIZE;
+    handler->buffer = malloc(handler->buffer_size);
+    if (!handler->buffer)
+        errx(EXIT_FAILURE, "Can't allocate the erlcmd buffer");
+
     handler->request_handler = request_handler;
     handler->cookie = cookie;
 
@@ -188,32 +223,206 @@ void erlcmd_init(struct erlcmd *handler,
 }
 
 /**
- * @brief Synchronously send a response back to Erlang
+ * @brief Select the length prefix used in both directions
  *
- * @param response what to send back
+ * @param size 2 (default) or 4, must match the {:packet, N} option of the port
  */
-void erlcmd_send(char *response, size_t len)
+void erlcmd_set_packet_size(size_t size)
 {
-    uint16_t be_len = TO_BIGENDIAN16(len - sizeof(uint16_t));
-    memcpy(response, &be_len, sizeof(be_len));
+    if (size != sizeof(uint16_t) && size != sizeof(uint32_t))
+        errx(EXIT_FAILURE, "Unsupported packet size: %d", (int) size);
 
-#ifdef __WIN32__
-    BOOL rc = WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), response, len, NULL, NULL);
-    if (!rc)
-        errx(EXIT_FAILURE, "WriteFile to stdout failed (Erlang exit?)");
-#else
+    packet_size = size;
+}
+
+/**
+ * @return the size of the length prefix, responses must reserve it at the beginning
+ */
+size_t erlcmd_packet_size()
+{
+    return packet_size;
+}
+
+/**
+ * @brief Size of a complete message, length prefix included
+ *
+ * @param msg a buffer that starts with the length prefix
+ */
+size_t erlcmd_message_size(const char *msg)
+{
+    if (packet_size == sizeof(uint16_t)) {
+        uint16_t be_len;
+        memcpy(&be_len, msg, sizeof(uint16_t));
+        return FROM_BIGENDIAN16(be_len) + packet_size;
+    } else {
+        uint32_t be_len;
+        memcpy(&be_len, msg, sizeof(uint32_t));
+        return FROM_BIGENDIAN32(be_len) + packet_size;
+    }
+}
+
+/**
+ * @return the largest payload that fits in the length prefix
+ */
+size_t erlcmd_max_payload_size()
+{
+    return packet_size == sizeof(uint16_t) ? UINT16_MAX : ERLCMD_MAX_BUF_SIZE - sizeof(uint32_t);
+}
+
+#ifndef __WIN32__
+/**
+ * @brief Writes as much of `data` as stdout takes, all of it unless stdout is non-blocking
+ *
+ * @return bytes written
+ */
+static size_t write_stdout(const char *data, size_t len)
+{
+    uint64_t started = current_time_us();
     size_t wrote = 0;
-    do {        
-        ssize_t amount_written = write(STDOUT_FILENO, response + wrote, len - wrote);
+
+    while (wrote < len) {
+        ssize_t amount_written = write(STDOUT_FILENO, data + wrote, len - wrote);
         if (amount_written < 0) {
             if (errno == EINTR)
                 continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
 
             err(EXIT_FAILURE, "write");
         }
         wrote += amount_written;
-    } while (wrote < len);
+    }
+
+    __atomic_add_fetch(&stats.write_time, current_time_us() - started, __ATOMIC_RELAXED);
+    return wrote;
+}
+
+static void pending_append(const char *data, size_t len)
+{
+    if (pending_offset > 0 && pending_size + len > pending_capacity) {
+        memmove(pending, pending + pending_offset, pending_size - pending_offset);
+        pending_size -= pending_offset;
+        pending_offset = 0;
+    }
+
+    if (pending_size + len > pending_capacity) {
+        size_t capacity = pending_capacity ? pending_capacity : ERLCMD_BUF_SIZE;
+        while (capacity < pending_size + len)
+            capacity *= 2;
+
+        pending = realloc(pending, capacity);
+        if (!pending)
+            errx(EXIT_FAILURE, "Could not allocate %d bytes of pending output", (int) capacity);
+        pending_capacity = capacity;
+    }
+
+    memcpy(pending + pending_size, data, len);
+    pending_size += len;
+}
+#endif
+
+/**
+ * @brief Send a response back to Erlang, synchronously unless stdout is non-blocking: then the bytes the pipe
+ *        doesn't take are kept in order and written by erlcmd_flush()
+ *
+ * @param response what to send back, starting with erlcmd_packet_size() bytes for the length
+ */
+void erlcmd_send(char *response, size_t len)
+{
+    if (packet_size == sizeof(uint16_t)) {
+        uint16_t be_len = TO_BIGENDIAN16(len - sizeof(uint16_t));
+        memcpy(response, &be_len, sizeof(be_len));
+    } else {
+        uint32_t be_len = TO_BIGENDIAN32(len - sizeof(uint32_t));
+        memcpy(response, &be_len, sizeof(be_len));
+    }
+
+#ifdef __WIN32__
+    uint64_t started = current_time_us();
+    BOOL rc = WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), response, len, NULL, NULL);
+    if (!rc)
+        errx(EXIT_FAILURE, "WriteFile to stdout failed (Erlang exit?)");
+    __atomic_add_fetch(&stats.write_time, current_time_us() - started, __ATOMIC_RELAXED);
+#else
+    size_t wrote = erlcmd_flush() == 0 ? write_stdout(response, len) : 0;
+    if (wrote < len)
+        pending_append(response + wrote, len - wrote);
 #endif
+
+    stats_count(&stats.messages_written, &stats.bytes_written, &stats.max_written_size, len);
+}
+
+/**
+ * @brief Writes the pending output that stdout takes without blocking
+ *
+ * @return bytes still pending
+ */
+size_t erlcmd_flush()
+{
+#ifndef __WIN32__
+    if (pending_size > pending_offset) {
+        pending_offset += write_stdout(pending + pending_offset, pending_size - pending_offset);
+
+        if (pending_offset == pending_size) {
+            pending_offset = 0;
+            pending_size = 0;
+        }
+    }
+#endif
+    return pending_size - pending_offset;
+}
+
+size_t erlcmd_pending_size()
+{
+    return pending_size - pending_offset;
+}
+
+/**
+ * @brief Makes stdout non-blocking (see erlcmd_send), or blocking again once the pending output is written
+ *
+ * @return false if not supported
+ */
+bool erlcmd_set_nonblocking(bool enabled)
+{
+#ifdef __WIN32__
+    return !enabled;
+#else
+    int flags = fcntl(STDOUT_FILENO, F_GETFL);
+    if (flags < 0 || fcntl(STDOUT_FILENO, F_SETFL, enabled ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) < 0)
+        return false;
+
+    nonblocking = enabled;
+    if (!enabled)
+        erlcmd_flush();
+    return true;
+#endif
+}
+
+bool erlcmd_nonblocking()
+{
+    return nonblocking;
+}
+
+/**
+ * @brief Grow the receive buffer so that a message of `needed` bytes fits.
+ *        The buffer is kept for the following messages.
+ */
+static void erlcmd_grow_buffer(struct erlcmd *handler, size_t needed)
+{
+    if (needed > ERLCMD_MAX_BUF_SIZE)
+        errx(EXIT_FAILURE, "Message too long: %d bytes. Max is %d bytes",
+             (int) needed, (int) ERLCMD_MAX_BUF_SIZE);
+
+    size_t new_size = handler->buffer_size;
+    while (new_size < needed)
+        new_size *= 2;
+
+    char *new_buffer = realloc(handler->buffer, new_size);
+    if (!new_buffer)
+        errx(EXIT_FAILURE, "Can't grow the erlcmd buffer to %d bytes", (int) new_size);
+
+    handler->buffer = new_buffer;
+    handler->buffer_size = new_size;
 }
 
 /**
@@ -223,23 +432,22 @@ void erlcmd_send(char *response, size_t len)
 static size_t erlcmd_try_dispatch(struct erlcmd *handler)
 {
     /* Check for length field */
-    if (handler->index < sizeof(uint16_t))
+    if (handler->index < packet_size)
         return 0;
 
-    uint16_t be_len;
-    memcpy(&be_len, handler->buffer, sizeof(uint16_t));
-    size_t msglen = FROM_BIGENDIAN16(be_len);
-    if (msglen + sizeof(uint16_t) > sizeof(handler->buffer))
-        errx(EXIT_FAILURE, "Message too long: %d bytes. Max is %d bytes",
-             (int) (msglen + sizeof(uint16_t)), (int) sizeof(handler->buffer));
+    size_t msglen = erlcmd_message_size(handler->buffer);
+
+    if (msglen > handler->buffer_size)
+        erlcmd_grow_buffer(handler, msglen);
 
     /* Check whether we've received the entire message */
-    if (msglen + sizeof(uint16_t) > handler->index)
+    if (msglen > handler->index)
         return 0;
 
+    stats_count(&stats.messages_read, &stats.bytes_read, &stats.max_read_size, msglen);
     handler->request_handler(handler->buffer, handler->cookie);
 
-    return msglen + sizeof(uint16_t);
+    return msglen;
 }
 
 /**
@@ -269,7 +477,7 @@ int erlcmd_process(struct erlcmd *handler)
 
     ResetEvent(handler->overlapped.hEvent);
 #else
-    ssize_t amount_read = read(STDIN_FILENO, handler->buffer + handler->index, sizeof(handler->buffer) - handler->index);
+    ssize_t amount_read = read(STDIN_FILENO, handler->buffer + handler->index, handler->buffer_size - handler->index);
     if (amount_read < 0) {
         /* EINTR is ok to get, since we were interrupted by a signal. */
         if (errno == EINTR)
@@ -315,3 +523,17 @@ HANDLE erlcmd_wfmo_event(struct erlcmd *handler)
 }
 
 #endif
+
+/**
+ * @brief Copy the port traffic counters
+ */
+void erlcmd_get_stats(struct erlcmd_stats *copy)
+{
+    copy->messages_read = __atomic_load_n(&stats.messages_read, __ATOMIC_RELAXED);
+    copy->bytes_read = __atomic_load_n(&stats.bytes_read, __ATOMIC_RELAXED);
+    copy->max_read_size = __atomic_load_n(&stats.max_read_size, __ATOMIC_RELAXED);
+    copy->messages_written = __atomic_load_n(&stats.messages_written, __ATOMIC_RELAXED);
+    copy->bytes_written = __atomic_load_n(&stats.bytes_written, __ATOMIC_RELAXED);
+    copy->max_written_size = __atomic_load_n(&stats.max_written_size, __ATOMIC_RELAXED);
+    copy->write_time = __atomic_load_n(&stats.write_time, __ATOMIC_RELAXED);
+}
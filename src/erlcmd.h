@@ -18,6 +18,8 @@
 #define ERLCMD_H
 
 #include <ei.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __WIN32__
 #include <windows.h>
@@ -26,10 +28,12 @@
 /*
  * Erlang request/response processing
  */
-#define ERLCMD_BUF_SIZE 32768 // Large size is to support large UART writes
+#define ERLCMD_BUF_SIZE 32768 // Initial size, grows for larger messages
+#define ERLCMD_MAX_BUF_SIZE (256 * 1024 * 1024)
 struct erlcmd
 {
-    char buffer[ERLCMD_BUF_SIZE];
+    char *buffer;
+    size_t buffer_size;
     size_t index;
 
     void (*request_handler)(const char *emsg, void *cookie);
@@ -46,11 +50,34 @@ struct erlcmd
 #endif
 };
 
+/*
+ * Port traffic counters, updated atomically on every message
+ */
+struct erlcmd_stats
+{
+    uint64_t messages_read;
+    uint64_t bytes_read;
+    uint64_t max_read_size;
+    uint64_t messages_written;
+    uint64_t bytes_written;
+    uint64_t max_written_size;
+    uint64_t write_time; // us spent in write(), a slow reader shows up here
+};
+
 void erlcmd_init(struct erlcmd *handler,
 		 void (*request_handler)(const char *req, void *cookie),
 		 void *cookie);
+void erlcmd_set_packet_size(size_t packet_size);
+size_t erlcmd_packet_size();
+size_t erlcmd_message_size(const char *msg);
+size_t erlcmd_max_payload_size();
 void erlcmd_send(char *response, size_t len);
+size_t erlcmd_flush();
+size_t erlcmd_pending_size();
+bool erlcmd_set_nonblocking(bool enabled);
+bool erlcmd_nonblocking();
 int erlcmd_process(struct erlcmd *handler);
+void erlcmd_get_stats(struct erlcmd_stats *stats);
 
 #ifdef __WIN32__
 HANDLE erlcmd_wfmo_event(struct erlcmd *handler);
@@ -10,30 +10,836 @@
 #include "erlcmd.h"
 #include "common.h"
 
+/*  Sessions
+ *
+ *  One port can hold several independent UA_Client instances, each one addressed by a session handle. Session 0 is
+ *  created at startup and serves the requests without a handle, the others are created with new_client_session and
+ *  receive the requests of the form {{handle, command}, caller, args}. Everything they send back (responses and
+ *  subscription events) is wrapped as {:session, handle, message}.
+ *
+ *  `session` and `client` always point to the session of the request or iteration being processed, so the handlers
+ *  and the open62541 callbacks don't need to know about other sessions.
+ */
+
+/*  Last-value cache
+ *
+ *  Monitored items created with the "cache" option keep the latest notification of their node here, so
+ *  read_cached_value can answer without a round trip. Entries are keyed by NodeId and shared by the monitored items
+ *  of the same node, each item holds a reference (its monContext) that is released by deleteMonitoredItemCallback.
+ */
+#define VALUE_CACHE_MIN_BUCKETS 64
+
+struct cached_value {
+    UA_NodeId node_id;
+    UA_DataValue value;
+    UA_UInt32 subscription_id; // Subscription of the latest notification
+    uint64_t received; // current_time() of the latest notification
+    bool stale; // No notification yet, or its subscription timed out
+    size_t references;
+    struct cached_value *next;
+};
+
+struct value_cache {
+    struct cached_value **buckets;
+    size_t buckets_size;
+    size_t size;
+};
+
+static struct cached_value **cache_bucket(struct value_cache *cache, const UA_NodeId *node_id)
+{
+    return &cache->buckets[UA_NodeId_hash(node_id) & (cache->buckets_size - 1)];
+}
+
+static struct cached_value *cache_lookup(struct value_cache *cache, const UA_NodeId *node_id)
+{
+    if(cache->size == 0)
+        return NULL;
+
+    for(struct cached_value *entry = *cache_bucket(cache, node_id); entry; entry = entry->next) {
+        if(UA_NodeId_equal(&entry->node_id, node_id))
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void cache_resize(struct value_cache *cache, size_t buckets_size)
+{
+    struct cached_value **old_buckets = cache->buckets;
+    size_t old_buckets_size = cache->buckets_size;
+
+    cache->buckets = calloc(buckets_size, sizeof(struct cached_value *));
+    if(!cache->buckets)
+        errx(EXIT_FAILURE, "Could not allocate the value cache");
+    cache->buckets_size = buckets_size;
+
+    for(size_t i = 0; i < old_buckets_size; i++) {
+        struct cached_value *entry = old_buckets[i];
+        while(entry) {
+            struct cached_value *next = entry->next;
+            struct cached_value **bucket = cache_bucket(cache, &entry->node_id);
+            entry->next = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+
+    free(old_buckets);
+}
+
+/* Returns the entry of node_id with one more reference, it is created (stale) when missing. */
+static struct cached_value *cache_acquire(struct value_cache *cache, const UA_NodeId *node_id)
+{
+    struct cached_value *entry = cache_lookup(cache, node_id);
+    if(entry) {
+        entry->references++;
+        return entry;
+    }
+
+    if(cache->size >= cache->buckets_size)
+        cache_resize(cache, cache->buckets_size ? cache->buckets_size * 2 : VALUE_CACHE_MIN_BUCKETS);
+
+    entry = calloc(1, sizeof(struct cached_value));
+    if(!entry)
+        errx(EXIT_FAILURE, "Could not allocate a cached value");
+
+    UA_NodeId_copy(node_id, &entry->node_id);
+    UA_DataValue_init(&entry->value);
+    entry->stale = true;
+    entry->references = 1;
+
+    struct cached_value **bucket = cache_bucket(cache, node_id);
+    entry->next = *bucket;
+    *bucket = entry;
+    cache->size++;
+    return entry;
+}
+
+static void cache_release(struct value_cache *cache, struct cached_value *released)
+{
+    if(--released->references > 0)
+        return;
+
+    for(struct cached_value **entry = cache_bucket(cache, &released->node_id); *entry; entry = &(*entry)->next) {
+        if(*entry == released) {
+            *entry = released->next;
+            break;
+        }
+    }
+
+    UA_NodeId_clear(&released->node_id);
+    UA_DataValue_clear(&released->value);
+    free(released);
+    cache->size--;
+}
+
+static void cache_update(struct cached_value *entry, UA_UInt32 subscription_id, const UA_DataValue *value)
+{
+    UA_DataValue_clear(&entry->value);
+    UA_DataValue_copy(value, &entry->value);
+    entry->subscription_id = subscription_id;
+    entry->received = current_time();
+    entry->stale = false;
+}
+
+static void cache_invalidate_subscription(struct value_cache *cache, UA_UInt32 subscription_id)
+{
+    for(size_t i = 0; i < cache->buckets_size; i++) {
+        for(struct cached_value *entry = cache->buckets[i]; entry; entry = entry->next) {
+            if(entry->subscription_id == subscription_id)
+                entry->stale = true;
+        }
+    }
+}
+
+static void cache_clear(struct value_cache *cache)
+{
+    for(size_t i = 0; i < cache->buckets_size; i++) {
+        struct cached_value *entry = cache->buckets[i];
+        while(entry) {
+            struct cached_value *next = entry->next;
+            UA_NodeId_clear(&entry->node_id);
+            UA_DataValue_clear(&entry->value);
+            free(entry);
+            entry = next;
+        }
+    }
+
+    free(cache->buckets);
+    cache->buckets = NULL;
+    cache->buckets_size = 0;
+    cache->size = 0;
+}
+
+/*  Subscription definitions
+ *
+ *  Every subscription and monitored item created by Elixir is kept with the request that created it, so a lost
+ *  connection can be restored without Elixir (see Reconnect). Elixir keeps the ids of the first creation, the
+ *  server ids of a recreated subscription or item may differ. An item entry is the monContext of its open62541
+ *  monitored item.
+ */
+struct monitored_item_entry {
+    UA_UInt32 subscription_id; // Ids known by Elixir
+    UA_UInt32 monitored_id;
+    UA_UInt32 server_monitored_id;
+    UA_MonitoredItemCreateRequest request; // Owned copy, the filter included
+    struct cached_value *cached;
+};
+
+struct subscription_entry {
+    UA_UInt32 subscription_id; // Id known by Elixir
+    UA_UInt32 server_subscription_id;
+    UA_Double requested_publishing_interval;
+    UA_Double publishing_interval; // Revised by the server
+    bool lost; // Deleted by open62541 along with the connection, waits to be recreated
+    struct monitored_item_entry **items;
+    size_t items_size;
+    size_t items_capacity;
+};
+
+struct reconnect {
+    char *url; // Of the last connect, NULL when Elixir didn't connect the session
+    char *username;
+    char *password;
+    uint64_t min_interval; // ms, 0 disables reconnecting
+    uint64_t max_interval;
+    double jitter;
+    uint64_t next_attempt; // current_time() of the next attempt, 0 while the connection isn't lost
+    uint32_t attempts;
+    uint64_t random; // xorshift64 state
+};
+
+struct client_session {
+    UA_UInt32 handle;
+    UA_Client *client;
+    struct subscription_entry *subscriptions;
+    size_t subscriptions_size;
+    size_t subscriptions_capacity;
+    size_t pending_async_requests;
+    struct value_cache cache;
+    struct reconnect reconnect;
+    bool restoring; // Subscriptions are being recreated, their delete callbacks are ignored
+};
+
+static struct client_session **sessions = NULL;
+static size_t sessions_size = 0;
+static size_t sessions_capacity = 0;
+static UA_UInt32 next_session_handle = 1;
+
+static struct client_session *session = NULL;
 UA_Client *client;
 
+static struct client_session *add_session(UA_UInt32 handle)
+{
+    if(sessions_size == sessions_capacity) {
+        sessions_capacity = sessions_capacity ? sessions_capacity * 2 : 8;
+        sessions = realloc(sessions, sessions_capacity * sizeof(struct client_session *));
+        if(!sessions)
+            errx(EXIT_FAILURE, "Could not allocate the sessions table");
+    }
+
+    struct client_session *new_session = calloc(1, sizeof(struct client_session));
+    if(!new_session)
+        errx(EXIT_FAILURE, "Could not allocate a client session");
+
+    new_session->handle = handle;
+    new_session->client = UA_Client_new();
+    // Seeds the reconnect jitter, different in every port
+    new_session->reconnect.random = (current_time_us() ^ ((uint64_t) getpid() << 32) ^ handle) | 1;
+    sessions[sessions_size++] = new_session;
+    return new_session;
+}
+
+static struct client_session *find_session(UA_UInt32 handle)
+{
+    for(size_t i = 0; i < sessions_size; i++) {
+        if(sessions[i]->handle == handle)
+            return sessions[i];
+    }
+
+    return NULL;
+}
+
+static void select_session(struct client_session *selected)
+{
+    session = selected;
+    client = selected->client;
+    set_response_session(selected->handle);
+}
+
+static void reconnect_disarm(struct client_session *s);
+static void forget_lost_subscriptions();
+static void free_subscriptions(struct client_session *s);
+
+static void delete_session(struct client_session *deleted)
+{
+    struct client_session *previous = session;
+
+    // Pending asynchronous requests and subscriptions are notified to the deleted session.
+    select_session(deleted);
+    reconnect_disarm(deleted);
+    forget_lost_subscriptions();
+    UA_Client_delete(deleted->client);
+    select_session(previous == deleted ? sessions[0] : previous);
+
+    for(size_t i = 0; i < sessions_size; i++) {
+        if(sessions[i] == deleted) {
+            sessions[i] = sessions[--sessions_size];
+            break;
+        }
+    }
+
+    unregister_session_nodes(deleted->handle);
+    free_subscriptions(deleted);
+    cache_clear(&deleted->cache);
+    free(deleted);
+}
+
+/*  The open62541 client only makes progress (publish responses, keep-alives, secure channel renewal) inside
+ *  UA_Client_run_iterate, while main() sleeps in poll() on stdin. Active subscriptions are tracked so the poll
+ *  timeout can be bounded by the shortest publishing interval instead of waiting for the next Elixir command.
+ *  While asynchronous requests are in flight the client is iterated every CLIENT_MIN_ITERATE_TIMEOUT.
+ */
+#define CLIENT_IDLE_ITERATE_TIMEOUT 1000 // ms, connected without subscriptions
+#define CLIENT_MIN_ITERATE_TIMEOUT 1 // ms, never busy-spin
+
+static struct subscription_entry *find_subscription(UA_UInt32 subscription_id)
+{
+    for(size_t i = 0; i < session->subscriptions_size; i++) {
+        if(session->subscriptions[i].subscription_id == subscription_id)
+            return &session->subscriptions[i];
+    }
+
+    return NULL;
+}
+
+static struct subscription_entry *find_server_subscription(UA_UInt32 server_subscription_id)
+{
+    for(size_t i = 0; i < session->subscriptions_size; i++) {
+        if(!session->subscriptions[i].lost && session->subscriptions[i].server_subscription_id == server_subscription_id)
+            return &session->subscriptions[i];
+    }
+
+    return NULL;
+}
+
+static struct monitored_item_entry *find_monitored_item(const struct subscription_entry *entry, UA_UInt32 monitored_id)
+{
+    for(size_t i = 0; i < entry->items_size; i++) {
+        if(entry->items[i]->monitored_id == monitored_id)
+            return entry->items[i];
+    }
+
+    return NULL;
+}
+
+static struct subscription_entry *track_subscription(UA_UInt32 server_subscription_id,
+                                                     UA_Double requested_publishing_interval,
+                                                     UA_Double publishing_interval)
+{
+    if(session->subscriptions_size == session->subscriptions_capacity) {
+        session->subscriptions_capacity = session->subscriptions_capacity ? session->subscriptions_capacity * 2 : 8;
+        session->subscriptions = realloc(session->subscriptions,
+                                         session->subscriptions_capacity * sizeof(struct subscription_entry));
+        if(!session->subscriptions)
+            errx(EXIT_FAILURE, "Could not allocate the subscriptions table");
+    }
+
+    // The server id, unless a recreated subscription still uses it towards Elixir.
+    UA_UInt32 subscription_id = server_subscription_id;
+    while(find_subscription(subscription_id) || subscription_id == 0)
+        subscription_id++;
+
+    struct subscription_entry *entry = &session->subscriptions[session->subscriptions_size++];
+    memset(entry, 0, sizeof(struct subscription_entry));
+    entry->subscription_id = subscription_id;
+    entry->server_subscription_id = server_subscription_id;
+    entry->requested_publishing_interval = requested_publishing_interval;
+    entry->publishing_interval = publishing_interval;
+    return entry;
+}
+
+static void free_monitored_item(struct monitored_item_entry *item)
+{
+    if(item->cached)
+        cache_release(&session->cache, item->cached);
+
+    UA_MonitoredItemCreateRequest_clear(&item->request);
+    free(item);
+}
+
+static void untrack_subscription(struct subscription_entry *entry)
+{
+    for(size_t i = 0; i < entry->items_size; i++)
+        free_monitored_item(entry->items[i]);
+    free(entry->items);
+
+    *entry = session->subscriptions[--session->subscriptions_size];
+}
+
+static void track_monitored_item(struct subscription_entry *entry, struct monitored_item_entry *item)
+{
+    if(entry->items_size == entry->items_capacity) {
+        entry->items_capacity = entry->items_capacity ? entry->items_capacity * 2 : 8;
+        entry->items = realloc(entry->items, entry->items_capacity * sizeof(struct monitored_item_entry *));
+        if(!entry->items)
+            errx(EXIT_FAILURE, "Could not allocate the monitored items table");
+    }
+
+    item->subscription_id = entry->subscription_id;
+    item->monitored_id = item->server_monitored_id;
+    while(find_monitored_item(entry, item->monitored_id) || item->monitored_id == 0)
+        item->monitored_id++;
+
+    entry->items[entry->items_size++] = item;
+}
+
+/* Returns false if the item isn't in the table (its creation failed). */
+static bool untrack_monitored_item(struct monitored_item_entry *item)
+{
+    struct subscription_entry *entry = find_subscription(item->subscription_id);
+    if(!entry)
+        return false;
+
+    for(size_t i = 0; i < entry->items_size; i++) {
+        if(entry->items[i] == item) {
+            entry->items[i] = entry->items[--entry->items_size];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Removes a subscription that won't be recreated, Elixir gets the delete events open62541 would have sent. */
+static void forget_subscription(struct subscription_entry *entry)
+{
+    UA_UInt32 subscription_id = entry->subscription_id;
+
+    while(entry->items_size > 0) {
+        struct monitored_item_entry *item = entry->items[--entry->items_size];
+        UA_UInt32 monitored_id = item->monitored_id;
+
+        free_monitored_item(item);
+        send_monitored_item_delete_response(&subscription_id, &monitored_id);
+    }
+
+    untrack_subscription(entry);
+    send_subscription_deleted_response(&subscription_id, 27, 0);
+}
+
+static void forget_lost_subscriptions()
+{
+    for(size_t i = 0; i < session->subscriptions_size;) {
+        if(session->subscriptions[i].lost)
+            forget_subscription(&session->subscriptions[i]);
+        else
+            i++;
+    }
+}
+
+/* Without events, the session (and its cache) is being deleted. */
+static void free_subscriptions(struct client_session *s)
+{
+    for(size_t i = 0; i < s->subscriptions_size; i++) {
+        for(size_t j = 0; j < s->subscriptions[i].items_size; j++) {
+            UA_MonitoredItemCreateRequest_clear(&s->subscriptions[i].items[j]->request);
+            free(s->subscriptions[i].items[j]);
+        }
+        free(s->subscriptions[i].items);
+    }
+
+    free(s->subscriptions);
+    s->subscriptions = NULL;
+    s->subscriptions_size = 0;
+    s->subscriptions_capacity = 0;
+}
+
+/*  Reconnect
+ *
+ *  With set_reconnect, a session that loses its connection connects again to the url (and user) of its last
+ *  connect. The first attempt waits min_interval ms, the interval doubles after every failed attempt up to
+ *  max_interval and is shortened at random by up to `jitter` of it, so the ports of a plant don't reconnect in
+ *  lockstep after a network glitch.
+ *
+ *  open62541 (1.0) closes the session and deletes its client subscriptions when the connection is lost, so the
+ *  session can't be reactivated nor its server subscriptions transferred: they are recreated from their
+ *  definitions with a CreateSubscription and batched CreateMonitoredItems requests, keeping the ids known by
+ *  Elixir, and a single {:reconnected, %{...}} event is sent. A manual connect of a lost session also restores
+ *  them, what can't be recreated is reported as deleted.
+ *
+ *  The attempts run in the port loop with the blocking UA_Client_connect (1.0 has no asynchronous connect with a
+ *  user), the other sessions and the Elixir requests wait meanwhile: an attempt is given RECONNECT_CONNECT_TIMEOUT
+ *  instead of the timeout of the client config, so an unreachable server stalls the port that long per attempt.
+ *
+ *  The aliases of registered nodes only hold for the session that returned them: the node handles of the session
+ *  are registered again first, and the monitored items created with an old alias are recreated with the new one.
+ */
+#define RECONNECT_ITEMS_BATCH 1000 // Monitored items per CreateMonitoredItems request
+#define RECONNECT_CONNECT_TIMEOUT 500 // ms, longest connect of an attempt (the config timeout when it is shorter)
+#define RECONNECT_MAX_DOUBLINGS 20
+
+static bool reconnect_armed(const struct client_session *s)
+{
+    return s->reconnect.url != NULL && s->reconnect.min_interval > 0;
+}
+
+/* Subscriptions deleted now go with the connection, they are kept to be recreated. */
+static bool connection_lost()
+{
+    return reconnect_armed(session) && UA_Client_getState(client) < UA_CLIENTSTATE_SESSION;
+}
+
+static void reconnect_arm(const char *url, const char *username, const char *password)
+{
+    reconnect_disarm(session);
+
+    session->reconnect.url = strdup(url);
+    session->reconnect.username = username ? strdup(username) : NULL;
+    session->reconnect.password = password ? strdup(password) : NULL;
+    if(!session->reconnect.url || (username && !session->reconnect.username) ||
+        (password && !session->reconnect.password))
+        errx(EXIT_FAILURE, "Could not allocate the reconnect url");
+}
+
+static void reconnect_disarm(struct client_session *s)
+{
+    free(s->reconnect.url);
+    free(s->reconnect.username);
+    free(s->reconnect.password);
+    s->reconnect.url = NULL;
+    s->reconnect.username = NULL;
+    s->reconnect.password = NULL;
+}
+
+static uint64_t reconnect_delay(struct reconnect *r)
+{
+    uint32_t doublings = r->attempts < RECONNECT_MAX_DOUBLINGS ? r->attempts : RECONNECT_MAX_DOUBLINGS;
+    uint64_t delay = r->min_interval << doublings;
+    if(delay > r->max_interval)
+        delay = r->max_interval;
+
+    r->random ^= r->random << 13;
+    r->random ^= r->random >> 7;
+    r->random ^= r->random << 17;
+    double unit = (r->random >> 11) * (1.0 / 9007199254740992.0); // [0, 1)
+
+    return delay - (uint64_t) (delay * r->jitter * unit);
+}
+
+static void dataChangeNotificationCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext,
+                                           UA_UInt32 monitored_id, void *monContext, UA_DataValue *data);
+static void deleteMonitoredItemCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext,
+                                        UA_UInt32 monitored_id, void *monContext);
+static void deleteSubscriptionCallback(UA_Client *client, UA_UInt32 subscription_id, void *subscriptionContext);
+
+/* Recreates items [first, first + count) of a recreated subscription, failed ones are left without server id. */
+static void restore_monitored_items(struct subscription_entry *entry, size_t first, size_t count,
+                                    uint32_t *restored, uint32_t *failed)
+{
+    UA_MonitoredItemCreateRequest *items = malloc(count * sizeof(UA_MonitoredItemCreateRequest));
+    void **contexts = malloc(count * sizeof(void *));
+    UA_Client_DataChangeNotificationCallback *callbacks =
+        malloc(count * sizeof(UA_Client_DataChangeNotificationCallback));
+    UA_Client_DeleteMonitoredItemCallback *delete_callbacks =
+        malloc(count * sizeof(UA_Client_DeleteMonitoredItemCallback));
+    if(!items || !contexts || !callbacks || !delete_callbacks)
+        errx(EXIT_FAILURE, "Could not allocate %d monitored items to recreate", (int) count);
+
+    for(size_t i = 0; i < count; i++) {
+        items[i] = entry->items[first + i]->request; // Shallow, the entries keep them
+        contexts[i] = entry->items[first + i];
+        callbacks[i] = dataChangeNotificationCallback;
+        delete_callbacks[i] = deleteMonitoredItemCallback;
+    }
+
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = entry->server_subscription_id;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+    request.itemsToCreate = items;
+    request.itemsToCreateSize = count;
+
+    UA_CreateMonitoredItemsResponse response =
+        UA_Client_MonitoredItems_createDataChanges(client, request, contexts, callbacks, delete_callbacks);
+
+    for(size_t i = 0; i < count; i++) {
+        struct monitored_item_entry *item = entry->items[first + i];
+
+        if(response.responseHeader.serviceResult == UA_STATUSCODE_GOOD && i < response.resultsSize &&
+            response.results[i].statusCode == UA_STATUSCODE_GOOD) {
+            item->server_monitored_id = response.results[i].monitoredItemId;
+            (*restored)++;
+        }
+        else {
+            item->server_monitored_id = 0;
+            (*failed)++;
+        }
+    }
+
+    UA_CreateMonitoredItemsResponse_clear(&response);
+    free(items);
+    free(contexts);
+    free(callbacks);
+    free(delete_callbacks);
+}
+
+/* A registered node got a new alias, the items monitoring it (and their cached values) follow. */
+static void rename_monitored_node(const UA_NodeId *alias, const UA_NodeId *new_alias)
+{
+    for(size_t i = 0; i < session->subscriptions_size; i++) {
+        struct subscription_entry *entry = &session->subscriptions[i];
+
+        for(size_t j = 0; j < entry->items_size; j++) {
+            struct monitored_item_entry *item = entry->items[j];
+            if(!UA_NodeId_equal(&item->request.itemToMonitor.nodeId, alias))
+                continue;
+
+            UA_NodeId_clear(&item->request.itemToMonitor.nodeId);
+            UA_NodeId_copy(new_alias, &item->request.itemToMonitor.nodeId);
+
+            if(item->cached) {
+                cache_release(&session->cache, item->cached);
+                item->cached = cache_acquire(&session->cache, new_alias);
+            }
+        }
+    }
+}
+
+static void restore_subscriptions(uint32_t attempts)
+{
+    uint32_t subscriptions = 0;
+    uint32_t monitored_items = 0;
+    uint32_t failed = 0;
+
+    // Nothing is added to or removed from the tables meanwhile, the entries stay in place.
+    session->restoring = true;
+    for(size_t i = 0; i < session->subscriptions_size; i++) {
+        struct subscription_entry *entry = &session->subscriptions[i];
+        if(!entry->lost)
+            continue;
+
+        UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+        request.requestedPublishingInterval = entry->requested_publishing_interval;
+        UA_CreateSubscriptionResponse response =
+            UA_Client_Subscriptions_create(client, request, NULL, NULL, deleteSubscriptionCallback);
+
+        if(response.responseHeader.serviceResult != UA_STATUSCODE_GOOD) {
+            failed += 1 + entry->items_size;
+            continue;
+        }
+
+        entry->server_subscription_id = response.subscriptionId;
+        entry->publishing_interval = response.revisedPublishingInterval;
+        entry->lost = false;
+        subscriptions++;
+
+        for(size_t first = 0; first < entry->items_size; first += RECONNECT_ITEMS_BATCH) {
+            size_t count = entry->items_size - first;
+            if(count > RECONNECT_ITEMS_BATCH)
+                count = RECONNECT_ITEMS_BATCH;
+
+            restore_monitored_items(entry, first, count, &monitored_items, &failed);
+        }
+    }
+    session->restoring = false;
+
+    // Lost again meanwhile, open62541 dropped what was recreated: everything waits for the next attempt.
+    if(UA_Client_getState(client) < UA_CLIENTSTATE_SESSION) {
+        for(size_t i = 0; i < session->subscriptions_size; i++) {
+            session->subscriptions[i].lost = true;
+            cache_invalidate_subscription(&session->cache, session->subscriptions[i].subscription_id);
+        }
+
+        session->reconnect.next_attempt = current_time() + reconnect_delay(&session->reconnect);
+        return;
+    }
+
+    // What couldn't be recreated is gone for good.
+    for(size_t i = 0; i < session->subscriptions_size; i++) {
+        struct subscription_entry *entry = &session->subscriptions[i];
+        UA_UInt32 subscription_id = entry->subscription_id;
+
+        for(size_t j = 0; !entry->lost && j < entry->items_size;) {
+            struct monitored_item_entry *item = entry->items[j];
+            if(item->server_monitored_id != 0) {
+                j++;
+                continue;
+            }
+
+            UA_UInt32 monitored_id = item->monitored_id;
+            entry->items[j] = entry->items[--entry->items_size];
+            free_monitored_item(item);
+            send_monitored_item_delete_response(&subscription_id, &monitored_id);
+        }
+    }
+    forget_lost_subscriptions();
+
+    send_reconnected_response(attempts, subscriptions, monitored_items, failed);
+}
+
+/* Called after every iteration of the session, notices a lost connection and connects again when it is due. */
+static void reconnect_if_due()
+{
+    struct reconnect *r = &session->reconnect;
+    bool connected = UA_Client_getState(client) >= UA_CLIENTSTATE_SESSION;
+
+    if(r->next_attempt == 0) {
+        if(connected || !reconnect_armed(session))
+            return;
+
+        // Lost, even the first attempt waits so that every port doesn't reconnect at once.
+        r->attempts = 0;
+        r->next_attempt = current_time() + reconnect_delay(r);
+        return;
+    }
+
+    if(!connected) {
+        if(!reconnect_armed(session) || current_time() < r->next_attempt)
+            return;
+
+        // A session that is only half closed still counts as connected for UA_Client_connect.
+        if(UA_Client_getState(client) != UA_CLIENTSTATE_DISCONNECTED)
+            UA_Client_disconnect(client);
+
+        UA_ClientConfig *config = UA_Client_getConfig(client);
+        UA_UInt32 timeout = config->timeout;
+        if(timeout > RECONNECT_CONNECT_TIMEOUT)
+            config->timeout = RECONNECT_CONNECT_TIMEOUT;
+
+        r->attempts++;
+        UA_StatusCode retval = r->username ? UA_Client_connect_username(client, r->url, r->username, r->password)
+                                           : UA_Client_connect(client, r->url);
+        config->timeout = timeout;
+        if(retval != UA_STATUSCODE_GOOD) {
+            r->next_attempt = current_time() + reconnect_delay(r);
+            return;
+        }
+    }
+
+    r->next_attempt = 0;
+    reregister_session_nodes(client, rename_monitored_node);
+    restore_subscriptions(r->attempts);
+}
+
+/* After a connect by Elixir, the node handles are registered with the new session and the subscriptions of a lost
+ * connection come back at once. */
+static void reconnect_connected()
+{
+    reregister_session_nodes(client, rename_monitored_node);
+
+    for(size_t i = 0; i < session->subscriptions_size; i++) {
+        if(session->subscriptions[i].lost) {
+            session->reconnect.next_attempt = 0;
+            restore_subscriptions(session->reconnect.attempts);
+            return;
+        }
+    }
+
+    session->reconnect.next_attempt = 0;
+}
+
+/* Milliseconds poll() may sleep before the session must iterate again, -1 while it is not connected. */
+static int session_iterate_timeout(const struct client_session *s)
+{
+    if(UA_Client_getState(s->client) < UA_CLIENTSTATE_CONNECTED) {
+        if(s->reconnect.next_attempt == 0 || !reconnect_armed(s))
+            return -1;
+
+        uint64_t now = current_time();
+        return now >= s->reconnect.next_attempt ? 0 : (int) (s->reconnect.next_attempt - now);
+    }
+
+    if(s->pending_async_requests > 0)
+        return CLIENT_MIN_ITERATE_TIMEOUT;
+
+    UA_Double timeout = CLIENT_IDLE_ITERATE_TIMEOUT;
+    for(size_t i = 0; i < s->subscriptions_size; i++) {
+        if(!s->subscriptions[i].lost && s->subscriptions[i].publishing_interval < timeout)
+            timeout = s->subscriptions[i].publishing_interval;
+    }
+
+    if(timeout < CLIENT_MIN_ITERATE_TIMEOUT)
+        timeout = CLIENT_MIN_ITERATE_TIMEOUT;
+
+    return (int) timeout;
+}
+
+/* Shortest timeout of all the sessions, -1 while none of them is connected. */
+static int client_iterate_timeout()
+{
+    int timeout = -1;
+    for(size_t i = 0; i < sessions_size; i++) {
+        int session_timeout = session_iterate_timeout(sessions[i]);
+        if(session_timeout >= 0 && (timeout < 0 || session_timeout < timeout))
+            timeout = session_timeout;
+    }
+
+    return timeout;
+}
+
 /************************************/
 /* Default Client backend callbacks */
 /************************************/
 
-static void subscriptionInactivityCallback (UA_Client *client, UA_UInt32 subscription_id, void *subContext) 
+/* The callbacks get the server ids, Elixir gets the ones of the subscription definitions. */
+static void subscriptionInactivityCallback (UA_Client *client, UA_UInt32 server_subscription_id, void *subContext) 
 {
+    struct subscription_entry *entry = find_server_subscription(server_subscription_id);
+    if(!entry)
+        return;
+
+    UA_UInt32 subscription_id = entry->subscription_id;
+    cache_invalidate_subscription(&session->cache, subscription_id);
     send_subscription_timeout_response(&subscription_id, 27, 0);
 }
 
-static void deleteSubscriptionCallback(UA_Client *client, UA_UInt32 subscription_id, void *subscriptionContext) 
+static void deleteSubscriptionCallback(UA_Client *client, UA_UInt32 server_subscription_id, void *subscriptionContext) 
 {
+    struct subscription_entry *entry = session->restoring ? NULL : find_server_subscription(server_subscription_id);
+    if(!entry)
+        return;
+
+    UA_UInt32 subscription_id = entry->subscription_id;
+
+    // Kept with its items (their callbacks came first) until reconnect_if_due recreates it.
+    if(connection_lost()) {
+        entry->lost = true;
+        cache_invalidate_subscription(&session->cache, subscription_id);
+        return;
+    }
+
+    untrack_subscription(entry);
     send_subscription_deleted_response(&subscription_id, 27, 0);
 }
 
-static void dataChangeNotificationCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext, UA_UInt32 monitored_id, void *monContext, UA_DataValue *data) 
+static void dataChangeNotificationCallback(UA_Client *client, UA_UInt32 server_subscription_id, void *subContext,
+                                           UA_UInt32 server_monitored_id, void *monContext, UA_DataValue *data) 
 {
+    struct monitored_item_entry *item = monContext;
+
+    if(item->cached)
+        cache_update(item->cached, item->subscription_id, data);
+
     UA_Variant variant = data->value;
-    send_monitored_item_response(&subscription_id, &monitored_id, &variant, 29);
+
+    if(notification_batch_enabled())
+        add_notification_to_batch(&item->subscription_id, &item->monitored_id, &variant, 29);
+    else
+        send_monitored_item_response(&item->subscription_id, &item->monitored_id, &variant, 29);
 }
 
-static void deleteMonitoredItemCallback(UA_Client *client, UA_UInt32 subscription_id, void *subContext, UA_UInt32 monitored_id, void *monContext)
+static void deleteMonitoredItemCallback(UA_Client *client, UA_UInt32 server_subscription_id, void *subContext,
+                                        UA_UInt32 server_monitored_id, void *monContext)
 {
+    struct monitored_item_entry *item = monContext;
+
+    if(session->restoring || connection_lost() || !untrack_monitored_item(item))
+        return;
+
+    UA_UInt32 subscription_id = item->subscription_id;
+    UA_UInt32 monitored_id = item->monitored_id;
+    free_monitored_item(item);
     send_monitored_item_delete_response(&subscription_id, &monitored_id);
 }
 /***************************************/
@@ -156,6 +962,8 @@ static void handle_get_client_state(void *entity, bool entity_type, const char *
 */
 static void handle_reset_client(void *entity, bool entity_type, const char *req, int *req_index)
 {
+    reconnect_disarm(session);
+    forget_lost_subscriptions();
     UA_Client_reset(client);
     send_ok_response();
 }
@@ -187,8 +995,10 @@ static void handle_connect_client_by_url(void *entity, bool entity_type, const c
         send_opex_response(retval);
         return;
     }
-    
+
+    reconnect_arm(url, NULL, NULL);
     send_ok_response();
+    reconnect_connected();
 }
 
 /* Connect to the server by passing a url, username and password.
@@ -236,8 +1046,10 @@ static void handle_connect_client_by_username(void *entity, bool entity_type, co
         send_opex_response(retval);
         return;
     }
-    
+
+    reconnect_arm(url, username, password);
     send_ok_response();
+    reconnect_connected();
 }
 
 /* Connect to the server without creating a session.
@@ -257,6 +1069,10 @@ static void handle_connect_client_no_session(void *entity, bool entity_type, con
         errx(EXIT_FAILURE, "Invalid url");
     url[binary_len] = '\0';
     
+    // Without a session there are no subscriptions to restore.
+    reconnect_disarm(session);
+    forget_lost_subscriptions();
+
     UA_StatusCode retval = UA_Client_connect_noSession(client, url);
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -271,7 +1087,10 @@ static void handle_connect_client_no_session(void *entity, bool entity_type, con
  * @return Indicates whether the operation succeeded or returns an error code */
 static void handle_disconnect_client(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    
+    // Asked for, the subscriptions are deleted rather than kept for a reconnect.
+    reconnect_disarm(session);
+    forget_lost_subscriptions();
+
     UA_StatusCode retval = UA_Client_disconnect(client);
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -281,6 +1100,40 @@ static void handle_disconnect_client(void *entity, bool entity_type, const char
     send_ok_response();
 }
 
+/* 
+ *  Configures the reconnection of the selected session (see Reconnect), expects {min_interval, max_interval, jitter}.
+ *  A min_interval of 0 disables it, the subscriptions of an already lost connection are then reported as deleted.
+ */
+static void handle_set_reconnect(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    unsigned long min_interval;
+    unsigned long max_interval;
+    double jitter;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 || term_size != 3)
+        errx(EXIT_FAILURE, ":set_reconnect requires a 3-tuple, term_size = %d", term_size);
+
+    if (ei_decode_ulong(req, req_index, &min_interval) < 0 ||
+        ei_decode_ulong(req, req_index, &max_interval) < 0 ||
+        ei_decode_double(req, req_index, &jitter) < 0 ||
+        max_interval < min_interval || jitter < 0.0 || jitter > 1.0) {
+        send_error_response("einval");
+        return;
+    }
+
+    session->reconnect.min_interval = min_interval;
+    session->reconnect.max_interval = max_interval;
+    session->reconnect.jitter = jitter;
+
+    if(!reconnect_armed(session)) {
+        forget_lost_subscriptions();
+        session->reconnect.next_attempt = 0;
+    }
+
+    send_ok_response();
+}
+
 /**************/
 /* Encryption */
 /**************/
@@ -878,7 +1731,10 @@ void handle_add_subscription(void *entity, bool entity_type, const char *req, in
         return;
     }
 
-    send_data_response(&(response.subscriptionId), 27, 0);
+    struct subscription_entry *entry = track_subscription(response.subscriptionId, (UA_Double) publishing_interval,
+                                                          response.revisedPublishingInterval);
+
+    send_data_response(&(entry->subscription_id), 27, 0);
 }
 
 void handle_delete_subscription(void *entity, bool entity_type, const char *req, int *req_index)
@@ -889,7 +1745,20 @@ void handle_delete_subscription(void *entity, bool entity_type, const char *req,
         return;
     }
 
-    UA_StatusCode retval = UA_Client_Subscriptions_deleteSingle(client, (UA_UInt32) subscription_id);
+    struct subscription_entry *entry = find_subscription((UA_UInt32) subscription_id);
+    if(!entry) {
+        send_opex_response(UA_STATUSCODE_BADSUBSCRIPTIONIDINVALID);
+        return;
+    }
+
+    // Waiting to be recreated, there is nothing to delete on the server.
+    if(entry->lost) {
+        forget_subscription(entry);
+        send_ok_response();
+        return;
+    }
+
+    UA_StatusCode retval = UA_Client_Subscriptions_deleteSingle(client, entry->server_subscription_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -909,15 +1778,102 @@ void handle_delete_subscription(void *entity, bool entity_type, const char *req,
  *  And a Subscription can contain many MonitoredItems.
  */
 
+/* 
+ *  Decodes the optional monitoring parameters map, known keys are:
+ *  "deadband_type" (0 none, 1 absolute, 2 percent), "deadband_value", "trigger" (0 status, 1 status/value,
+ *  2 status/value/timestamp), "queue_size", "discard_oldest" and "cache" (keep the latest value for
+ *  read_cached_value).
+ *  A DataChangeFilter is only attached when a deadband or a trigger is given.
+ */
+static int decode_monitoring_options(const char *req, int *req_index, UA_MonitoringParameters *parameters,
+                                     UA_DataChangeFilter *filter, bool *cache)
+{
+    int map_size;
+    int term_size;
+    int term_type;
+    bool use_filter = false;
+
+    UA_DataChangeFilter_init(filter);
+    filter->trigger = UA_DATACHANGETRIGGER_STATUSVALUE;
+    filter->deadbandType = UA_DEADBANDTYPE_NONE;
+
+    if(ei_decode_map_header(req, req_index, &map_size) < 0)
+        return -1;
+
+    for(int i_key = 0; i_key < map_size; i_key++)
+    {
+        if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+            return -1;
+
+        char key[term_size + 1];
+        long binary_len;
+        if (ei_decode_binary(req, req_index, key, &binary_len) < 0)
+            return -1;
+        key[binary_len] = '\0';
+
+        unsigned long value;
+        if(!strcmp(key, "deadband_type"))
+        {
+            if (ei_decode_ulong(req, req_index, &value) < 0 || value > UA_DEADBANDTYPE_PERCENT)
+                return -1;
+            filter->deadbandType = (UA_UInt32) value;
+            use_filter = true;
+        }
+        else if(!strcmp(key, "deadband_value"))
+        {
+            if (ei_decode_double(req, req_index, &filter->deadbandValue) < 0)
+                return -1;
+        }
+        else if(!strcmp(key, "trigger"))
+        {
+            if (ei_decode_ulong(req, req_index, &value) < 0 || value > UA_DATACHANGETRIGGER_STATUSVALUETIMESTAMP)
+                return -1;
+            filter->trigger = (UA_DataChangeTrigger) value;
+            use_filter = true;
+        }
+        else if(!strcmp(key, "queue_size"))
+        {
+            if (ei_decode_ulong(req, req_index, &value) < 0)
+                return -1;
+            parameters->queueSize = (UA_UInt32) value;
+        }
+        else if(!strcmp(key, "discard_oldest"))
+        {
+            int discard_oldest;
+            if (ei_decode_boolean(req, req_index, &discard_oldest) < 0)
+                return -1;
+            parameters->discardOldest = discard_oldest;
+        }
+        else if(!strcmp(key, "cache"))
+        {
+            int cache_value;
+            if (ei_decode_boolean(req, req_index, &cache_value) < 0)
+                return -1;
+            *cache = cache_value;
+        }
+        else
+            return -1;
+    }
+
+    if(use_filter) {
+        parameters->filter.encoding = UA_EXTENSIONOBJECT_DECODED_NODELETE;
+        parameters->filter.content.decoded.type = &UA_TYPES[UA_TYPES_DATACHANGEFILTER];
+        parameters->filter.content.decoded.data = filter;
+    }
+
+    return 0;
+}
+
 void handle_add_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
     int term_type;
     UA_MonitoredItemCreateResult monitored_item_response;
 
+    // {node_id, subscription_id, sampling_interval, options}, options is optional.
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 3)
-        errx(EXIT_FAILURE, ":handle_add_monitored_item requires a 3-tuple, term_size = %d", term_size);
+        (term_size != 3 && term_size != 4))
+        errx(EXIT_FAILURE, ":handle_add_monitored_item requires a 3-tuple or a 4-tuple, term_size = %d", term_size);
 
     UA_NodeId monitored_node = assemble_node_id(req, req_index);
 
@@ -937,18 +1893,51 @@ void handle_add_monitored_item(void *entity, bool entity_type, const char *req,
 
     monitored_item_request.requestedParameters.samplingInterval = (UA_Double) sampling_interval;
 
-    monitored_item_response = UA_Client_MonitoredItems_createDataChange(client, subscription_id,
+    // Filtered by the server, it lives on the stack until the request is sent.
+    UA_DataChangeFilter filter;
+    bool cache = false;
+    if (term_size == 4 &&
+        decode_monitoring_options(req, req_index, &monitored_item_request.requestedParameters, &filter, &cache) < 0) {
+        UA_NodeId_clear(&monitored_node);
+        send_error_response("einval");
+        return;
+    }
+
+    struct subscription_entry *entry = find_subscription((UA_UInt32) subscription_id);
+    if(!entry || entry->lost) {
+        UA_NodeId_clear(&monitored_node);
+        send_opex_response(entry ? UA_STATUSCODE_BADCONNECTIONCLOSED : UA_STATUSCODE_BADSUBSCRIPTIONIDINVALID);
+        return;
+    }
+
+    struct monitored_item_entry *item = calloc(1, sizeof(struct monitored_item_entry));
+    if(!item)
+        errx(EXIT_FAILURE, "Could not allocate a monitored item");
+    item->cached = cache ? cache_acquire(&session->cache, &monitored_node) : NULL;
+
+    monitored_item_response = UA_Client_MonitoredItems_createDataChange(client, entry->server_subscription_id,
                                                                         UA_TIMESTAMPSTORETURN_BOTH, monitored_item_request,
-                                                                        NULL, dataChangeNotificationCallback, deleteMonitoredItemCallback);
+                                                                        item, dataChangeNotificationCallback, deleteMonitoredItemCallback);
 
-    UA_NodeId_clear(&monitored_node);
+    // The subscription table may have changed during the request.
+    entry = find_subscription((UA_UInt32) subscription_id);
 
-    if(monitored_item_response.statusCode != UA_STATUSCODE_GOOD) {
-        send_opex_response(monitored_item_response.statusCode);
+    if(monitored_item_response.statusCode != UA_STATUSCODE_GOOD || !entry || entry->lost) {
+        UA_NodeId_clear(&monitored_node);
+        free_monitored_item(item);
+        send_opex_response(monitored_item_response.statusCode != UA_STATUSCODE_GOOD ? monitored_item_response.statusCode
+                                                                                     : UA_STATUSCODE_BADCONNECTIONCLOSED);
         return;
     }
 
-    send_data_response(&(monitored_item_response.monitoredItemId), 27, 0);
+    // Kept to recreate the item after a reconnect.
+    item->server_monitored_id = monitored_item_response.monitoredItemId;
+    UA_MonitoredItemCreateRequest_copy(&monitored_item_request, &item->request);
+    track_monitored_item(entry, item);
+
+    UA_NodeId_clear(&monitored_node);
+
+    send_data_response(&(item->monitored_id), 27, 0);
 }
 
 void handle_delete_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
@@ -973,7 +1962,23 @@ void handle_delete_monitored_item(void *entity, bool entity_type, const char *re
         return;
     }
 
-    retval = UA_Client_MonitoredItems_deleteSingle(client, (UA_UInt32) subscription_id, (UA_UInt32) monitored_item_id);
+    struct subscription_entry *entry = find_subscription((UA_UInt32) subscription_id);
+    struct monitored_item_entry *item = entry ? find_monitored_item(entry, (UA_UInt32) monitored_item_id) : NULL;
+    if(!item) {
+        send_opex_response(UA_STATUSCODE_BADMONITOREDITEMIDINVALID);
+        return;
+    }
+
+    if(entry->lost) {
+        UA_UInt32 monitored_id = item->monitored_id;
+        untrack_monitored_item(item);
+        free_monitored_item(item);
+        send_monitored_item_delete_response(&entry->subscription_id, &monitored_id);
+        send_ok_response();
+        return;
+    }
+
+    retval = UA_Client_MonitoredItems_deleteSingle(client, entry->server_subscription_id, item->server_monitored_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -983,25 +1988,442 @@ void handle_delete_monitored_item(void *entity, bool entity_type, const char *re
     send_ok_response();
 }
 
+/* 
+ *  Reads the 'value' attribute of a node from the last-value cache, expects {node_id, max_age}.
+ *  The entry is used when it has been notified less than max_age ms ago (nil for any age) and its subscription is
+ *  active, otherwise the value is read from the server.
+ */
+static void handle_read_cached_value(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    char atom[MAXATOMLEN];
+    unsigned long max_age = 0;
+    bool any_age = false;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_read_cached_value requires a 2-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    if(ei_decode_atom(req, req_index, atom) == 0 && !strcmp(atom, "nil"))
+        any_age = true;
+    else if(ei_decode_ulong(req, req_index, &max_age) < 0) {
+        UA_NodeId_clear(&node_id);
+        send_error_response("einval");
+        return;
+    }
+
+    struct cached_value *entry = cache_lookup(&session->cache, &node_id);
+    if(entry && !entry->stale && (any_age || current_time() - entry->received <= max_age)) {
+        UA_NodeId_clear(&node_id);
+        send_data_response(&entry->value, 35, 1);
+        return;
+    }
+
+    UA_ReadValueId item;
+    UA_ReadValueId_init(&item);
+    item.nodeId = node_id;
+    item.attributeId = UA_ATTRIBUTEID_VALUE;
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.nodesToRead = &item;
+    request.nodesToReadSize = 1;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+
+    UA_ReadResponse response = UA_Client_Service_read(client, request);
+    UA_StatusCode retval = response.responseHeader.serviceResult;
+    if(retval == UA_STATUSCODE_GOOD && response.resultsSize != 1)
+        retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+    else if(retval == UA_STATUSCODE_GOOD && response.results[0].hasStatus)
+        retval = response.results[0].status;
+
+    if(retval != UA_STATUSCODE_GOOD)
+        send_opex_response(retval);
+    else {
+        // Entries that are only old are refreshed, stale ones wait for their subscription.
+        if(entry && !entry->stale)
+            cache_update(entry, entry->subscription_id, &response.results[0]);
+        send_data_response(&response.results[0], 35, 0);
+    }
+
+    UA_ReadResponse_clear(&response);
+    UA_NodeId_clear(&node_id);
+}
+
+/***********/
+/* History */
+/***********/
+
+/* 
+ *  Reads the raw history of a node ({node_id, start_time, end_time, max_values}, 0 for no bound/limit), following
+ *  the continuation points of the server. Requires open62541 built with UA_ENABLE_HISTORIZING.
+ */
+static void handle_history_read_raw(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    long long start_time;
+    long long end_time;
+    unsigned long max_values;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_history_read_raw requires a 4-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    if(ei_decode_longlong(req, req_index, &start_time) < 0 ||
+        ei_decode_longlong(req, req_index, &end_time) < 0 ||
+        ei_decode_ulong(req, req_index, &max_values) < 0 || max_values > UA_UINT32_MAX) {
+        UA_NodeId_clear(&node_id);
+        send_error_response("einval");
+        return;
+    }
+
+#ifdef UA_ENABLE_HISTORIZING
+    UA_ReadRawModifiedDetails details;
+    UA_ReadRawModifiedDetails_init(&details);
+    details.startTime = start_time;
+    details.endTime = end_time;
+    details.numValuesPerNode = (UA_UInt32) max_values;
+
+    UA_HistoryReadValueId item;
+    UA_HistoryReadValueId_init(&item);
+    item.nodeId = node_id;
+
+    UA_HistoryReadRequest request;
+    UA_HistoryReadRequest_init(&request);
+    request.historyReadDetails.encoding = UA_EXTENSIONOBJECT_DECODED;
+    request.historyReadDetails.content.decoded.type = &UA_TYPES[UA_TYPES_READRAWMODIFIEDDETAILS];
+    request.historyReadDetails.content.decoded.data = &details;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_BOTH;
+    request.nodesToRead = &item;
+    request.nodesToReadSize = 1;
+
+    UA_DataValue *values = NULL;
+    size_t values_size = 0;
+    UA_StatusCode retval;
+
+    for(;;) {
+        UA_HistoryReadResponse response = UA_Client_Service_historyRead(client, request);
+        retval = response.responseHeader.serviceResult;
+        if(retval == UA_STATUSCODE_GOOD && response.resultsSize != 1)
+            retval = UA_STATUSCODE_BADUNEXPECTEDERROR;
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = response.results[0].statusCode;
+        if(retval == UA_STATUSCODE_GOODNODATA)
+            retval = UA_STATUSCODE_GOOD;
+
+        UA_HistoryData *history_data = NULL;
+        if(retval == UA_STATUSCODE_GOOD && response.results[0].historyData.encoding >= UA_EXTENSIONOBJECT_DECODED &&
+            response.results[0].historyData.content.decoded.type == &UA_TYPES[UA_TYPES_HISTORYDATA])
+            history_data = response.results[0].historyData.content.decoded.data;
+
+        // The values are moved out of the response
+        if(history_data && history_data->dataValuesSize > 0) {
+            size_t size = (values_size + history_data->dataValuesSize) * sizeof(UA_DataValue);
+            UA_DataValue *resized = (UA_DataValue *) UA_realloc(values, size);
+            if(!resized)
+                retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            else {
+                values = resized;
+                memcpy(values + values_size, history_data->dataValues, history_data->dataValuesSize * sizeof(UA_DataValue));
+                values_size += history_data->dataValuesSize;
+                UA_free(history_data->dataValues);
+                history_data->dataValues = NULL;
+                history_data->dataValuesSize = 0;
+            }
+        }
+
+        UA_ByteString_clear(&item.continuationPoint);
+        if(retval == UA_STATUSCODE_GOOD) {
+            item.continuationPoint = response.results[0].continuationPoint;
+            UA_ByteString_init(&response.results[0].continuationPoint);
+        }
+        UA_HistoryReadResponse_clear(&response);
+
+        if(item.continuationPoint.length == 0)
+            break;
+
+        if(max_values != 0 && values_size >= max_values) {
+            // Enough values, the server can forget the rest.
+            request.releaseContinuationPoints = true;
+            response = UA_Client_Service_historyRead(client, request);
+            UA_HistoryReadResponse_clear(&response);
+            UA_ByteString_clear(&item.continuationPoint);
+            break;
+        }
+
+        if(max_values != 0)
+            details.numValuesPerNode = (UA_UInt32) (max_values - values_size);
+    }
+
+    if(retval != UA_STATUSCODE_GOOD)
+        send_opex_response(retval);
+    else
+        send_data_response(values, 38, values_size);
+
+    UA_Array_delete(values, values_size, &UA_TYPES[UA_TYPES_DATAVALUE]);
+#else
+    send_opex_response(UA_STATUSCODE_BADNOTSUPPORTED);
+#endif
+
+    UA_NodeId_clear(&node_id);
+}
+
+/************/
+/* Sessions */
+/************/
+
+/* 
+ *  Creates a new client session in this port, returns its handle.
+ */
+static void handle_new_client_session(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    struct client_session *new_session = add_session(next_session_handle++);
+    send_data_response(&new_session->handle, 27, 0);
+}
+
+/* 
+ *  Disconnects and deletes a client session, session 0 can't be deleted.
+ */
+static void handle_delete_client_session(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long handle;
+    if (ei_decode_ulong(req, req_index, &handle) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    struct client_session *deleted = find_session((UA_UInt32) handle);
+    if(handle == 0 || !deleted) {
+        send_error_response("einval");
+        return;
+    }
+
+    delete_session(deleted);
+    send_ok_response();
+}
+
+/****************************/
+/* Asynchronous (pipelined) */
+/****************************/
+
+/*  The *_async handlers only send the request and return, so the port keeps reading commands while it is in
+ *  flight. The caller is saved with the request and its response is sent when UA_Client_run_iterate receives it,
+ *  in any order. open62541 calls every callback exactly once, also on timeout or disconnection.
+ */
+static struct caller_context *new_async_request()
+{
+    struct caller_context *caller = malloc(sizeof(struct caller_context));
+    if(!caller)
+        errx(EXIT_FAILURE, "Could not allocate an asynchronous request");
+
+    save_caller_context(caller);
+    session->pending_async_requests++;
+    return caller;
+}
+
+static void delete_async_request(struct caller_context *caller)
+{
+    clear_caller_context(caller);
+    free(caller);
+    session->pending_async_requests--;
+}
+
+static void async_read_callback(UA_Client *client, void *userdata, UA_UInt32 request_id, UA_ReadResponse *response)
+{
+    struct caller_context *caller = userdata;
+
+    swap_caller_context(caller);
+    if(response->responseHeader.serviceResult != UA_STATUSCODE_GOOD)
+        send_opex_response(response->responseHeader.serviceResult);
+    else
+        send_data_response(response->results, 30, response->resultsSize);
+    swap_caller_context(caller);
+
+    delete_async_request(caller);
+}
+
+static void async_write_callback(UA_Client *client, void *userdata, UA_UInt32 request_id, UA_WriteResponse *response)
+{
+    struct caller_context *caller = userdata;
+
+    swap_caller_context(caller);
+    if(response->responseHeader.serviceResult != UA_STATUSCODE_GOOD)
+        send_opex_response(response->responseHeader.serviceResult);
+    else
+        send_data_response(response->results, 31, response->resultsSize);
+    swap_caller_context(caller);
+
+    delete_async_request(caller);
+}
+
+/* 
+ *  Asynchronous read_node_values, expects a list of {node_id, attribute_id}.
+ */
+static void handle_read_node_values_async(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int list_size;
+    int term_size;
+    UA_ReadRequest request;
+    UA_UInt32 request_id;
+
+    if(ei_decode_list_header(req, req_index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":handle_read_node_values_async requires a list");
+
+    if(list_size == 0) {
+        send_data_response(NULL, 30, 0);
+        return;
+    }
+
+    UA_ReadRequest_init(&request);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.nodesToRead = (UA_ReadValueId *) UA_Array_new(list_size, &UA_TYPES[UA_TYPES_READVALUEID]);
+    request.nodesToReadSize = list_size;
+    set_request_abort_array(request.nodesToRead, list_size, &UA_TYPES[UA_TYPES_READVALUEID]);
+
+    for(size_t i = 0; i < list_size; i++) {
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 2)
+            errx(EXIT_FAILURE, ":handle_read_node_values_async requires a 2-tuple, term_size = %d", term_size);
+
+        request.nodesToRead[i].nodeId = assemble_node_id(req, req_index);
+
+        unsigned long attribute_id;
+        if (ei_decode_ulong(req, req_index, &attribute_id) < 0) {
+            UA_ReadRequest_clear(&request);
+            send_error_response("einval");
+            return;
+        }
+
+        request.nodesToRead[i].attributeId = (UA_UInt32) attribute_id;
+    }
+
+    struct caller_context *caller = new_async_request();
+    UA_StatusCode retval = UA_Client_sendAsyncReadRequest((UA_Client *)entity, &request, async_read_callback, caller, &request_id);
+    UA_ReadRequest_clear(&request);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        delete_async_request(caller);
+        send_opex_response(retval);
+    }
+}
+
+/* 
+ *  Asynchronous write_node_values, expects a list of {node_id, data_type, nil, value}. Array elements can't be
+ *  patched without reading the array first, so the index must be nil.
+ */
+static void handle_write_node_values_async(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int list_size;
+    int term_size;
+    char atom[MAXATOMLEN];
+    UA_WriteRequest request;
+    UA_UInt32 request_id;
+
+    if(ei_decode_list_header(req, req_index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":handle_write_node_values_async requires a list");
+
+    if(list_size == 0) {
+        send_data_response(NULL, 31, 0);
+        return;
+    }
+
+    UA_WriteRequest_init(&request);
+    request.nodesToWrite = (UA_WriteValue *) UA_Array_new(list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+    request.nodesToWriteSize = list_size;
+    set_request_abort_array(request.nodesToWrite, list_size, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+
+    for(size_t i = 0; i < list_size; i++) {
+        if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+            term_size != 4)
+            errx(EXIT_FAILURE, ":handle_write_node_values_async requires a 4-tuple, term_size = %d", term_size);
+
+        request.nodesToWrite[i].nodeId = assemble_node_id(req, req_index);
+        request.nodesToWrite[i].attributeId = UA_ATTRIBUTEID_VALUE;
+        request.nodesToWrite[i].value.hasValue = true;
+
+        unsigned long data_type;
+        if (ei_decode_ulong(req, req_index, &data_type) < 0 ||
+            ei_decode_atom(req, req_index, atom) < 0 || strcmp(atom, "nil") ||
+            assemble_variant_scalar(req, req_index, data_type, &request.nodesToWrite[i].value.value) != UA_STATUSCODE_GOOD) {
+            UA_WriteRequest_clear(&request);
+            send_error_response("einval");
+            return;
+        }
+    }
+
+    struct caller_context *caller = new_async_request();
+    UA_StatusCode retval = UA_Client_sendAsyncWriteRequest((UA_Client *)entity, &request, async_write_callback, caller, &request_id);
+    UA_WriteRequest_clear(&request);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        delete_async_request(caller);
+        send_opex_response(retval);
+    }
+}
+
+/***************************/
+/* Port statistics         */
+/***************************/
+
+#define CLIENT_STATS_GAUGES 3
+
+static size_t client_stats_gauges(struct stats_gauge *gauges)
+{
+    uint64_t pending_async_requests = 0;
+    uint64_t cached_values = 0;
+    for(size_t i = 0; i < sessions_size; i++) {
+        pending_async_requests += sessions[i]->pending_async_requests;
+        cached_values += sessions[i]->cache.size;
+    }
+
+    gauges[0] = (struct stats_gauge) {"sessions", sessions_size};
+    gauges[1] = (struct stats_gauge) {"pending_async_requests", pending_async_requests};
+    gauges[2] = (struct stats_gauge) {"cached_values", cached_values};
+    return CLIENT_STATS_GAUGES;
+}
+
+/* 
+ *   Returns the per-command latencies, port counters and gauges, see encode_port_stats.
+ */
+static void handle_get_stats(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    struct stats_gauge gauges[CLIENT_STATS_GAUGES];
+    send_stats_response(gauges, client_stats_gauges(gauges));
+}
+
 /*******************************/
 /* Elixir -> C Message Handler */
 /*******************************/
 
-struct request_handler {
-    const char *name;
-    void (*handler)(void *entity, bool entity_type, const char *req, int *req_index);
-};
-
 /*  Elixir request handler table
- *  FIXME: Order roughly based on most frequent calls to least (WIP).
+ *  The position of a handler is its opcode, Elixir fetches the mapping with list_commands.
  */
 static struct request_handler request_handlers[] = {
     {"test", handle_test},
+    {"list_commands", handle_list_commands},
+    {"get_stats", handle_get_stats},
+    {"get_build_features", handle_get_build_features},
+    {"set_stats_interval", handle_set_stats_interval},
+    {"enable_shm_ring", handle_enable_shm_ring},
+    {"set_notification_queue", handle_set_notification_queue},
     // Reading and Writing Node Attributes ??
     // TODO: Add UA_Server_writeArrayDimensions, inverse name (read) 
     {"write_node_value", handle_write_node_value},
+    {"write_node_values", handle_write_node_values},
+    {"write_node_values_async", handle_write_node_values_async},
     {"read_node_value", handle_read_node_value},
     {"read_node_value_by_index", handle_read_node_value_by_index},
+    {"read_node_value_packed", handle_read_node_value_packed},
+    {"read_node_value_range", handle_read_node_value_range},
+    {"read_node_values", handle_read_node_values},
+    {"register_nodes", handle_register_nodes},
+    {"unregister_nodes", handle_unregister_nodes},
+    {"browse_tree", handle_browse_tree},
+    {"read_node_values_async", handle_read_node_values_async},
     {"read_node_value_by_data_type", handle_read_node_value_by_data_type},
     {"write_node_node_id", handle_write_node_node_id},
     {"write_node_node_class", handle_write_node_node_class},
@@ -1025,6 +2447,8 @@ static struct request_handler request_handlers[] = {
     {"write_node_executable", handle_write_node_executable},
     {"write_node_user_executable", handle_write_node_user_executable},
     {"write_node_blank_array", handle_write_node_blank_array},
+    {"write_node_array", handle_write_node_array},
+    {"write_node_value_range", handle_write_node_value_range},
     {"read_node_node_id", handle_read_node_node_id},
     {"read_node_node_class", handle_read_node_node_class},
     {"read_node_browse_name", handle_read_node_browse_name},
@@ -1051,6 +2475,8 @@ static struct request_handler request_handlers[] = {
     {"set_client_config", handle_set_client_config},     
     {"get_client_config", handle_get_client_config},     
     {"reset_client", handle_reset_client},
+    {"new_client_session", handle_new_client_session},
+    {"delete_client_session", handle_delete_client_session},
     // encryption functions
     {"set_config_with_security_policies", handle_set_config_with_security_policies},
     // connections functions
@@ -1058,6 +2484,7 @@ static struct request_handler request_handlers[] = {
     {"connect_client_by_username", handle_connect_client_by_username},     
     {"connect_client_no_session", handle_connect_client_no_session},     
     {"disconnect_client", handle_disconnect_client}, 
+    {"set_reconnect", handle_set_reconnect},
     // discovery functions
     {"find_servers_on_network", handle_find_servers_on_network},
     {"find_servers", handle_find_servers}, 
@@ -1065,8 +2492,12 @@ static struct request_handler request_handlers[] = {
     // Subscriptions and Monitored Items functions.
     {"add_subscription", handle_add_subscription},
     {"delete_subscription", handle_delete_subscription},
+    {"set_notification_batch_size", handle_set_notification_batch_size},
     {"add_monitored_item", handle_add_monitored_item},
     {"delete_monitored_item", handle_delete_monitored_item},
+    {"read_cached_value", handle_read_cached_value},
+    // History
+    {"history_read_raw", handle_history_read_raw},
     // Node Addition and Deletion
     {"add_variable_node", handle_add_variable_node},
     {"add_variable_type_node", handle_add_variable_type_node},
@@ -1092,7 +2523,7 @@ static void handle_elixir_request(const char *req, void *cookie)
 
     // Commands are of the form {Command, Arguments}:
     // { atom(), term() }
-    int req_index = sizeof(uint16_t);
+    int req_index = erlcmd_packet_size();
     if (ei_decode_version(req, &req_index, NULL) < 0)
         errx(EXIT_FAILURE, "Message version issue?");
 
@@ -1101,39 +2532,66 @@ static void handle_elixir_request(const char *req, void *cookie)
             arity != 3)
         errx(EXIT_FAILURE, "expecting {cmd, caller_info, args} tuple");
 
-    char cmd[MAXATOMLEN];
-    if (ei_decode_atom(req, &req_index, cmd) < 0)
-        errx(EXIT_FAILURE, "expecting command atom");
-    
-    //execute all handler
-    for (struct request_handler *rh = request_handlers; rh->name != NULL; rh++) {
-        if (strcmp(cmd, rh->name) == 0) {
-            handle_caller_metadata(req, &req_index, cmd);
-            rh->handler(client, 1, req, &req_index);
-            free_caller_metadata();
-            return;
-        }
+    // Session requests are of the form {{handle, Command}, caller_info, args}
+    unsigned long handle = 0;
+    int term_type;
+    int term_size;
+    if(ei_get_type(req, &req_index, &term_type, &term_size) < 0)
+        errx(EXIT_FAILURE, "expecting command");
+
+    if(term_type == ERL_SMALL_TUPLE_EXT) {
+        if(ei_decode_tuple_header(req, &req_index, &arity) < 0 || arity != 2 ||
+            ei_decode_ulong(req, &req_index, &handle) < 0)
+            errx(EXIT_FAILURE, "expecting {handle, cmd} tuple");
     }
-    // no listed function
-    errx(EXIT_FAILURE, "unknown command: %s", cmd);
+
+    const struct request_handler *rh = decode_request_handler(req, &req_index);
+
+    handle_caller_metadata(req, &req_index, rh->name);
+
+    struct client_session *target = find_session((UA_UInt32) handle);
+    if(target) {
+        select_session(target);
+        call_request_handler(rh, client, 1, req, &req_index);
+    }
+    else
+        send_error_response("einval");
+
+    select_session(sessions[0]);
+    reset_request_context();
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    client = UA_Client_new();
+    // `--packet 4` selects a 4-byte length prefix ({:packet, 4} in Elixir).
+    if (argc > 2 && strcmp(argv[1], "--packet") == 0)
+        erlcmd_set_packet_size(strtoul(argv[2], NULL, 10));
+
+    select_session(add_session(0));
 
     struct erlcmd *handler = malloc(sizeof(struct erlcmd));
+    init_request_handlers(request_handlers);
     erlcmd_init(handler, handle_elixir_request, NULL);
 
     for (;;) {
-        struct pollfd fdset;
+        struct pollfd fdset[2];
 
-        fdset.fd = STDIN_FILENO;
-        fdset.events = POLLIN;
-        fdset.revents = 0;
+        fdset[0].fd = STDIN_FILENO;
+        fdset[0].events = POLLIN;
+        fdset[0].revents = 0;
 
-        int timeout = -1; // Wait forever unless told by otherwise
-        int rc = poll(&fdset, 1, timeout);
+        // Output Elixir didn't take yet (see set_notification_queue), wake up when the pipe drains.
+        fdset[1].fd = STDOUT_FILENO;
+        fdset[1].events = POLLOUT;
+        fdset[1].revents = 0;
+
+        // Wake up in time for the next publish response or keep-alive of any session (or statistics push), or
+        // wait forever when none of them is connected.
+        int timeout = client_iterate_timeout();
+        int stats_timeout = stats_push_timeout();
+        if(stats_timeout >= 0 && (timeout < 0 || stats_timeout < timeout))
+            timeout = stats_timeout;
+        int rc = poll(fdset, erlcmd_pending_size() > 0 ? 2 : 1, timeout);
 
         if (rc < 0) {
             // Retry if EINTR
@@ -1143,18 +2601,43 @@ int main()
             err(EXIT_FAILURE, "poll");
         }
 
-        if (fdset.revents & (POLLIN | POLLHUP)) {
+        if (fdset[0].revents & (POLLIN | POLLHUP)) {
             if (erlcmd_process(handler))
                 break;
         }
 
-        if(UA_Client_getState(client) >= UA_CLIENTSTATE_CONNECTED)
-        {
-            UA_Client_run_iterate(client, 0);
+        for(size_t i = 0; i < sessions_size; i++) {
+            if(UA_Client_getState(sessions[i]->client) >= UA_CLIENTSTATE_CONNECTED) {
+                select_session(sessions[i]);
+                UA_Client_run_iterate(client, 0);
+            }
+        }
+        // Lost connections are noticed right after the iteration that lost them.
+        for(size_t i = 0; i < sessions_size; i++) {
+            select_session(sessions[i]);
+            reconnect_if_due();
+        }
+        select_session(sessions[0]);
+
+        // Notifications collected by this pass (or by the requests above) go out as one message.
+        flush_notification_batch();
+        flush_notification_queue();
+
+        if(stats_push_due()) {
+            struct stats_gauge gauges[CLIENT_STATS_GAUGES];
+            send_stats(gauges, client_stats_gauges(gauges));
         }
     }
     
-    /* Disconnects the client internally */
-    UA_Client_delete(client); 
+    /* Disconnects the clients internally */
+    for(size_t i = 0; i < sessions_size; i++) {
+        select_session(sessions[i]);
+        reconnect_disarm(sessions[i]);
+        UA_Client_delete(client);
+        free_subscriptions(sessions[i]);
+        cache_clear(&sessions[i]->cache);
+        free(sessions[i]);
+    }
+    free(sessions);
     free(handler);
 }
\ No newline at end of file
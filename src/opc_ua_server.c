@@ -7,6 +7,11 @@
 #include <unistd.h>
 #include <poll.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "erlcmd.h"
 #include "common.h"
 
@@ -21,6 +26,7 @@ User_list users_list = {.list_size = 0};
 pthread_t server_tid;
 pthread_attr_t server_attr;
 UA_Boolean running = true;
+bool server_thread_active = false;
 
 UA_Server *server;
 UA_Client *discoveryClient;
@@ -46,13 +52,31 @@ allowDeleteReference(UA_Server *server, UA_AccessControl *ac,
                      const UA_NodeId *sessionId, void *sessionContext,
                      const UA_DeleteReferencesItem *item) {return UA_FALSE;}
 
-void* server_runner(void* arg)
+/*  Local MonitoredItems
+ *
+ *  Every local MonitoredItem has a context. Changes are sent as {:subscription, {:data, 0, monId, data}} (or in a
+ *  :data_batch when batching is enabled), subscription 0 meaning the server itself. With coalescing only the
+ *  latest value of each item is kept and sent once per server iteration.
+ */
+struct local_monitored_item {
+    UA_UInt32 monitored_item_id;
+    bool coalesce;
+    bool pending;
+    UA_Variant latest_value;
+    struct local_monitored_item *next;
+};
+
+static struct local_monitored_item *local_monitored_items = NULL;
+static size_t pending_monitored_items = 0;
+
+static void send_local_notification(UA_UInt32 monitored_item_id, UA_Variant *value)
 {
-	UA_StatusCode retval = UA_Server_run(server, &running);
-    if(retval != UA_STATUSCODE_GOOD) {
-        errx(EXIT_FAILURE, "Unexpected Server error %s", UA_StatusCode_name(retval));
-    }
-    return NULL;
+    UA_UInt32 subscription_id = 0;
+
+    if(notification_batch_enabled())
+        add_notification_to_batch(&subscription_id, &monitored_item_id, value, 29);
+    else
+        send_monitored_item_response(&subscription_id, &monitored_item_id, value, 29);
 }
 
 static void
@@ -60,6 +84,195 @@ dataChangeNotificationCallback(UA_Server *server, UA_UInt32 monitoredItemId,
                                void *monitoredItemContext, const UA_NodeId *nodeId,
                                void *nodeContext, UA_UInt32 attributeId,
                                const UA_DataValue *value) {
+    struct local_monitored_item *item = monitoredItemContext;
+    UA_Variant variant = value->value;
+
+    if(!item->coalesce) {
+        send_local_notification(monitoredItemId, &variant);
+        return;
+    }
+
+    // Latest value wins.
+    if(item->pending)
+        UA_Variant_clear(&item->latest_value);
+    else
+        pending_monitored_items++;
+
+    if(UA_Variant_copy(&variant, &item->latest_value) != UA_STATUSCODE_GOOD) {
+        pending_monitored_items--;
+        item->pending = false;
+        return;
+    }
+
+    item->pending = true;
+}
+
+static void flush_local_notifications()
+{
+    for(struct local_monitored_item *item = local_monitored_items;
+        item != NULL && pending_monitored_items > 0; item = item->next) {
+        if(!item->pending)
+            continue;
+
+        send_local_notification(item->monitored_item_id, &item->latest_value);
+        UA_Variant_clear(&item->latest_value);
+        item->pending = false;
+        pending_monitored_items--;
+    }
+
+    flush_notification_batch();
+}
+
+static void delete_local_monitored_item(UA_UInt32 monitored_item_id)
+{
+    for(struct local_monitored_item **item = &local_monitored_items; *item != NULL; item = &(*item)->next) {
+        if((*item)->monitored_item_id != monitored_item_id)
+            continue;
+
+        struct local_monitored_item *deleted = *item;
+        *item = deleted->next;
+
+        if(deleted->pending) {
+            UA_Variant_clear(&deleted->latest_value);
+            pending_monitored_items--;
+        }
+        free(deleted);
+        return;
+    }
+}
+
+/*  Server command queue
+ *
+ *  UA_Server is not thread safe. Once the server is started, the stdin thread only copies the raw Elixir
+ *  requests into a single-producer/single-consumer ring and the server thread decodes and executes them between
+ *  iterations, so every server API call (and every response written to stdout) happens on one thread.
+ *  A short repeated callback bounds how long UA_Server_run_iterate may wait on the network before the queue is
+ *  drained again, and everything queued at that point runs back-to-back.
+ *  When the ring is full the stdin thread sleeps on command_queue_not_full (and stops reading Elixir requests) until
+ *  the server thread pops a command, the ring itself stays lock-free while it has room.
+ */
+#define SERVER_COMMAND_QUEUE_SIZE 1024 // Must be a power of 2
+#define SERVER_COMMAND_QUEUE_INTERVAL 5 // ms, minimum repeated callback interval of open62541
+
+static char *command_queue[SERVER_COMMAND_QUEUE_SIZE];
+static size_t command_queue_head = 0; // Only written by the server thread
+static size_t command_queue_tail = 0; // Only written by the stdin thread
+static pthread_mutex_t command_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t command_queue_not_full = PTHREAD_COND_INITIALIZER;
+static bool command_queue_waiting = false; // The stdin thread waits for room, written under command_queue_lock
+
+static void dispatch_elixir_request(const char *req);
+
+static void command_queue_push(const char *req)
+{
+    size_t msg_size = erlcmd_message_size(req);
+    char *msg = malloc(msg_size);
+    if(!msg)
+        errx(EXIT_FAILURE, "Can't allocate a queued command of %d bytes", (int) msg_size);
+    memcpy(msg, req, msg_size);
+
+    size_t tail = __atomic_load_n(&command_queue_tail, __ATOMIC_RELAXED);
+
+    // Backpressure, wait for the server thread when the ring is full. The flag and head are seq_cst so either the
+    // server thread sees the flag after popping or this thread sees the new head before waiting.
+    if(tail - __atomic_load_n(&command_queue_head, __ATOMIC_ACQUIRE) == SERVER_COMMAND_QUEUE_SIZE) {
+        pthread_mutex_lock(&command_queue_lock);
+        __atomic_store_n(&command_queue_waiting, true, __ATOMIC_SEQ_CST);
+        while(tail - __atomic_load_n(&command_queue_head, __ATOMIC_SEQ_CST) == SERVER_COMMAND_QUEUE_SIZE)
+            pthread_cond_wait(&command_queue_not_full, &command_queue_lock);
+        __atomic_store_n(&command_queue_waiting, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&command_queue_lock);
+    }
+
+    command_queue[tail & (SERVER_COMMAND_QUEUE_SIZE - 1)] = msg;
+    __atomic_store_n(&command_queue_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static char *command_queue_pop()
+{
+    size_t head = __atomic_load_n(&command_queue_head, __ATOMIC_RELAXED);
+
+    if(head == __atomic_load_n(&command_queue_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    char *msg = command_queue[head & (SERVER_COMMAND_QUEUE_SIZE - 1)];
+    __atomic_store_n(&command_queue_head, head + 1, __ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&command_queue_waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&command_queue_lock);
+        pthread_cond_signal(&command_queue_not_full);
+        pthread_mutex_unlock(&command_queue_lock);
+    }
+
+    return msg;
+}
+
+static void drain_command_queue()
+{
+    char *msg;
+    while((msg = command_queue_pop()) != NULL) {
+        dispatch_elixir_request(msg);
+        free(msg);
+    }
+}
+
+#define SERVER_STATS_GAUGES 2
+
+static size_t server_stats_gauges(struct stats_gauge *gauges)
+{
+    size_t head = __atomic_load_n(&command_queue_head, __ATOMIC_ACQUIRE);
+    size_t tail = __atomic_load_n(&command_queue_tail, __ATOMIC_ACQUIRE);
+
+    gauges[0] = (struct stats_gauge) {"command_queue", tail - head};
+    gauges[1] = (struct stats_gauge) {"server_running", server_thread_active};
+    return SERVER_STATS_GAUGES;
+}
+
+/* Statistics are pushed by the thread that owns stdout, the server thread while it runs. */
+static void push_stats_if_due()
+{
+    if(stats_push_due()) {
+        struct stats_gauge gauges[SERVER_STATS_GAUGES];
+        send_stats(gauges, server_stats_gauges(gauges));
+    }
+}
+
+static void command_queue_callback(UA_Server *server, void *data)
+{
+    drain_command_queue();
+    flush_write_batch(false);
+    flush_notification_queue();
+    push_stats_if_due();
+}
+
+void* server_runner(void* arg)
+{
+    UA_UInt64 callback_id;
+    UA_StatusCode retval = UA_Server_addRepeatedCallback(server, command_queue_callback, NULL,
+                                                         SERVER_COMMAND_QUEUE_INTERVAL, &callback_id);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_run_startup(server);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        errx(EXIT_FAILURE, "Unexpected Server error %s", UA_StatusCode_name(retval));
+    }
+
+    while(__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        drain_command_queue();
+        UA_Server_run_iterate(server, true);
+        flush_local_notifications();
+        flush_write_batch(false);
+        flush_notification_queue();
+        push_stats_if_due();
+    }
+
+    UA_Server_removeRepeatedCallback(server, callback_id);
+
+    retval = UA_Server_run_shutdown(server);
+    if(retval != UA_STATUSCODE_GOOD) {
+        errx(EXIT_FAILURE, "Unexpected Server error %s", UA_StatusCode_name(retval));
+    }
+    return NULL;
 }
 
 void set_users_list_size(int size)
@@ -210,6 +423,31 @@ static void handle_set_port(void *entity, bool entity_type, const char *req, int
     send_ok_response();
 }
 
+/* 
+*   Sets the number of worker threads of the server, it must be set before starting it. open62541 only has them when
+*   built with UA_MULTITHREADING >= 200 (OPEN62541_PROFILE=multithreading).
+*/
+static void handle_set_worker_threads(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long n_threads;
+    if (ei_decode_ulong(req, req_index, &n_threads) < 0 || n_threads > UA_UINT16_MAX) {
+        send_error_response("einval");
+        return;
+    }
+
+#if UA_MULTITHREADING >= 200
+    if(server_thread_active) {
+        send_opex_response(UA_STATUSCODE_BADINVALIDSTATE);
+        return;
+    }
+
+    UA_Server_getConfig(server)->nThreads = (UA_UInt16) n_threads;
+    send_ok_response();
+#else
+    send_opex_response(UA_STATUSCODE_BADNOTSUPPORTED);
+#endif
+}
+
 /* 
 *   Sets the server port. 
 *   TODO: free usernames/password allocated array.
@@ -290,14 +528,22 @@ static void handle_add_all_endpoints(void *entity, bool entity_type, const char
 
 static void handle_start_server(void *entity, bool entity_type, const char *req, int *req_index)
 {
+    // Already running, this request came through the command queue.
+    if(server_thread_active) {
+        send_ok_response();
+        return;
+    }
+
     running = true;
+    server_thread_active = true;
     pthread_create(&server_tid, NULL, server_runner, NULL);
     send_ok_response();
 }
 
+/* Runs on the server thread, the stdin thread joins it right after queuing this request. */
 static void handle_stop_server(void *entity, bool entity_type, const char *req, int *req_index)
 {
-    running = false;
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
     send_ok_response();
 }
 
@@ -725,245 +971,2253 @@ void handle_add_reference(void *entity, bool entity_type, const char *req, int *
     send_ok_response();
 }
 
-/*************/
-/* Discovery */
-/*************/
-
-/* 
- *  Sets the configuration for the a Server representing a local discovery server as a central instance.
- *  Any other server can register with this server using "discovery_register" function
- *  NOTE: before calling this function, this server should have the default configuration.
- *  LDS Servers only supports the Discovery Services. Cannot be used in combination with any other capability.
+/*  Bulk address space load
+ *
+ *  A chunk is a list of {:namespace, name}, {:reference, {source_id, reference_type_id, target_id, is_forward}}
+ *  and {node_type, {requested_new_node_id, parent_node_id, reference_type_node_id, browse_name[, type_definition]},
+ *  [{attribute_id, value}]} entries. Attributes are set at creation time instead of being written afterwards and
+ *  a failed entry does not stop the load, its position and status code are returned in the summary.
  */
-void handle_set_lds_config(void *entity, bool entity_type, const char *req, int *req_index)
+static void assemble_localized_text(const char *req, int *req_index, UA_LocalizedText *text)
 {
     int term_size;
-    int term_type;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
         term_size != 2)
-        errx(EXIT_FAILURE, ":handle_set_lds_config requires a 2-tuple, term_size = %d", term_size);
+        errx(EXIT_FAILURE, "assemble_localized_text requires a 2-tuple, term_size = %d", term_size);
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-            errx(EXIT_FAILURE, "Invalid application_uri (type)");
+    UA_LocalizedText_clear(text);
 
-    UA_String application_uri;
-    application_uri.data = (char *)malloc(term_size + 1);
-    application_uri.length = term_size;
-    long binary_len;
-    if (ei_decode_binary(req, req_index, application_uri.data, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid application_uri");
-    application_uri.data[binary_len] = '\0';
+    if(assemble_string(req, req_index, &text->locale) != UA_STATUSCODE_GOOD ||
+        assemble_string(req, req_index, &text->text) != UA_STATUSCODE_GOOD)
+        errx(EXIT_FAILURE, "Invalid localized text");
+}
 
-    UA_ServerConfig *config = UA_Server_getConfig(server);
+static void assemble_array_dimensions(const char *req, int *req_index, size_t *array_dimensions_size, UA_UInt32 **array_dimensions)
+{
+    int term_size;
 
-    // This is an LDS server only. Set the application type to DISCOVERYSERVER.
-    config->applicationDescription.applicationType = UA_APPLICATIONTYPE_DISCOVERYSERVER;
-    
-    if(config->applicationDescription.applicationUri.data)
-        UA_String_clear(&config->applicationDescription.applicationUri);
-    
-    config->applicationDescription.applicationUri = application_uri;
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0)
+        errx(EXIT_FAILURE, "assemble_array_dimensions requires a tuple");
 
-    // corrupted size vs. prev_size
-    config->discovery.mdns.serverCapabilitiesSize = 1;
-    UA_String *caps = (UA_String *) UA_Array_new(1, &UA_TYPES[UA_TYPES_STRING]);
-    caps[0] = UA_String_fromChars("LDS");
-    config->discovery.mdns.serverCapabilities = caps;
+    UA_Array_delete(*array_dimensions, *array_dimensions_size, &UA_TYPES[UA_TYPES_UINT32]);
+    *array_dimensions = (UA_UInt32 *) UA_Array_new(term_size, &UA_TYPES[UA_TYPES_UINT32]);
+    *array_dimensions_size = term_size;
 
-    // Enable the mDNS announce and response functionality
-    config->discovery.mdnsEnable = true;
-    config->discovery.mdns.mdnsServerName = UA_String_fromChars("LDS");
+    for(int i = 0; i < term_size; i++) {
+        unsigned long dimension;
+        if (ei_decode_ulong(req, req_index, &dimension) < 0)
+            errx(EXIT_FAILURE, "Invalid array dimension");
 
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_ATOM_EXT)
-    {
-        long timeout;
-        if (ei_decode_ulong(req, req_index, &timeout) < 0) {
-            send_error_response("einval");
-            return;
-        }
-        config->discovery.cleanupTimeout = timeout;
-    }
-    else
-    {
-        char nil[4];
-        if (ei_decode_atom(req, req_index, nil) < 0)
-        errx(EXIT_FAILURE, "expecting command atom");
-        config->discovery.cleanupTimeout = 60*60;
+        (*array_dimensions)[i] = (UA_UInt32) dimension;
     }
-
-    send_ok_response();
 }
 
-/* 
- *  Registers a server in a discovery server.
- *  NOTE: before calling this function, this server should have the default 
- *  configuration and a port = 0.
+/*
+ *  Decodes a snapshot value {data_type, array_length, array_dimensions, data}: an array_length of -1 is a scalar,
+ *  data is the raw memory of pointer-free types or a list of binaries for string types.
  */
-void handle_discovery_register(void *entity, bool entity_type, const char *req, int *req_index)
+static UA_StatusCode assemble_snapshot_value(const char *req, int *req_index, unsigned long data_type, UA_Variant *value)
 {
     int term_size;
     int term_type;
-    long binary_len;
-    UA_StatusCode retval;
 
-    UA_ServerConfig *config = UA_Server_getConfig(server);
+    long array_length;
+    if (ei_decode_long(req, req_index, &array_length) < 0)
+        errx(EXIT_FAILURE, "Invalid array_length");
 
-    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 4)
-        errx(EXIT_FAILURE, ":handle_discovery_register requires a 4-tuple, term_size = %d", term_size);
+    size_t array_dimensions_size = 0;
+    UA_UInt32 *array_dimensions = NULL;
+    assemble_array_dimensions(req, req_index, &array_dimensions_size, &array_dimensions);
 
-    // application_uri
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-            errx(EXIT_FAILURE, "Invalid application_uri (type)");
+    if(data_type >= UA_TYPES_COUNT)
+        errx(EXIT_FAILURE, "Invalid snapshot data_type");
 
-    UA_String application_uri;
-    application_uri.data = (char *)malloc(term_size + 1);
-    application_uri.length = term_size;
-    if (ei_decode_binary(req, req_index, application_uri.data, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid application_uri");
-    application_uri.data[binary_len] = '\0';
+    const UA_DataType *type = &UA_TYPES[data_type];
+    size_t data_size = array_length < 0 ? 1 : (size_t) array_length;
+    void *data = array_length < 0 ? UA_new(type) : UA_Array_new(data_size, type);
 
-    if(config->applicationDescription.applicationUri.data)
-        UA_String_clear(&config->applicationDescription.applicationUri);
-    
-    config->applicationDescription.applicationUri = application_uri;
+    if(type->pointerFree) {
+        long binary_len;
+        if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT ||
+            term_size != data_size * type->memSize)
+            errx(EXIT_FAILURE, "Invalid snapshot value size");
+
+        if(data_size == 0)
+            ei_skip_term(req, req_index);
+        else if (ei_decode_binary(req, req_index, data, &binary_len) < 0)
+            errx(EXIT_FAILURE, "Invalid snapshot value");
+    }
+    else if(data_type == UA_TYPES_STRING || data_type == UA_TYPES_BYTESTRING || data_type == UA_TYPES_XMLELEMENT) {
+        if(ei_decode_list_header(req, req_index, &term_size) < 0 || term_size != data_size)
+            errx(EXIT_FAILURE, "Invalid snapshot value size");
 
-    // server_name
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-            errx(EXIT_FAILURE, "Invalid server_name (type)");
+        for(size_t i = 0; i < data_size; i++)
+            if(assemble_string(req, req_index, (UA_String *) data + i) != UA_STATUSCODE_GOOD)
+                errx(EXIT_FAILURE, "Invalid snapshot value");
 
-    UA_String server_name;
-    server_name.data = (char *)malloc(term_size + 1);
-    server_name.length = term_size;
-    if (ei_decode_binary(req, req_index, server_name.data, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid server_name");
-    server_name.data[binary_len] = '\0';
+        if(data_size && ei_decode_list_header(req, req_index, &term_size) < 0)
+            errx(EXIT_FAILURE, "Invalid snapshot value");
+    }
+    else
+        errx(EXIT_FAILURE, "Unsupported snapshot data_type");
 
-    if(config->discovery.mdns.mdnsServerName.data)
-        UA_String_clear(&config->discovery.mdns.mdnsServerName);
-    
-    config->discovery.mdns.mdnsServerName = server_name;
+    if(array_length < 0)
+        UA_Variant_setScalar(value, data, type);
+    else
+        UA_Variant_setArray(value, data, data_size, type);
 
-    // endpoint
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
-            errx(EXIT_FAILURE, "Invalid endpoint (type)");
+    value->arrayDimensionsSize = array_dimensions_size;
+    value->arrayDimensions = array_dimensions;
 
-    //char *endpoint = (char *)malloc(term_size + 1);
-    char endpoint[term_size + 1];
-    if (ei_decode_binary(req, req_index, endpoint, &binary_len) < 0) 
-        errx(EXIT_FAILURE, "Invalid endpoint");
-    endpoint[binary_len] = '\0';
+    return UA_STATUSCODE_GOOD;
+}
 
-    // timeout
-    long timeout;
-    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_ATOM_EXT)
-    {
-        if (ei_decode_ulong(req, req_index, &timeout) < 0) {
-            send_error_response("einval");
-            return;
+/*
+ *  {data_type, value} for a scalar, {data_type, array_raw_size, array_dimensions} for a blank array and
+ *  {data_type, array_length, array_dimensions, data} for a value restored from a snapshot.
+ */
+static UA_StatusCode assemble_node_value(const char *req, int *req_index, UA_Variant *value)
+{
+    int term_size;
+    UA_StatusCode retval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size < 2 || term_size > 4)
+        errx(EXIT_FAILURE, "assemble_node_value requires a 2, 3 or 4-tuple, term_size = %d", term_size);
+
+    unsigned long data_type;
+    if (ei_decode_ulong(req, req_index, &data_type) < 0)
+        errx(EXIT_FAILURE, "Invalid data_type");
+
+    UA_Variant_clear(value);
+
+    if(term_size == 2) {
+        int value_index = *req_index;
+        retval = assemble_variant_scalar(req, req_index, data_type, value);
+
+        // Keep decoding the rest of the chunk in sync.
+        if(retval != UA_STATUSCODE_GOOD) {
+            *req_index = value_index;
+            if(ei_skip_term(req, req_index) < 0)
+                errx(EXIT_FAILURE, "Invalid value");
         }
-    }
-    else
-    {
-        char nil[4];
-        if (ei_decode_atom(req, req_index, nil) < 0)
-            errx(EXIT_FAILURE, "expecting command atom");
-        timeout = 10 * 60 * 1000;
+
+        return retval;
     }
 
-    if(discoveryClient != NULL)
-        UA_Client_delete(discoveryClient);
+    if(term_size == 4)
+        return assemble_snapshot_value(req, req_index, data_type, value);
 
-    discoveryClient = UA_Client_new();
-    UA_ClientConfig_setDefault(UA_Client_getConfig(discoveryClient));
+    unsigned long array_raw_size;
+    if (ei_decode_ulong(req, req_index, &array_raw_size) < 0)
+        errx(EXIT_FAILURE, "Invalid array_raw_size");
 
-    // Delay first register for 500ms
-    retval = UA_Server_addPeriodicServerRegisterCallback(server, discoveryClient, endpoint, timeout, 500, NULL);
-    
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_Client_disconnect(discoveryClient);
-        UA_Client_delete(discoveryClient);
-        send_opex_response(retval);
-        return;
+    size_t array_dimensions_size = 0;
+    UA_UInt32 *array_dimensions = NULL;
+    assemble_array_dimensions(req, req_index, &array_dimensions_size, &array_dimensions);
+
+    if(data_type >= UA_TYPES_COUNT) {
+        UA_Array_delete(array_dimensions, array_dimensions_size, &UA_TYPES[UA_TYPES_UINT32]);
+        return UA_STATUSCODE_BADDATATYPEIDUNKNOWN;
     }
 
-    send_ok_response();
+    UA_Variant_setArray(value, UA_Array_new(array_raw_size, &UA_TYPES[data_type]), array_raw_size, &UA_TYPES[data_type]);
+    value->arrayDimensionsSize = array_dimensions_size;
+    value->arrayDimensions = array_dimensions;
+
+    return UA_STATUSCODE_GOOD;
 }
 
-/* 
- *  Unregister the server from the discovery server.
- */
-void handle_discovery_unregister(void *entity, bool entity_type, const char *req, int *req_index)
+static UA_StatusCode skip_node_attribute(const char *req, int *req_index)
 {
-    UA_StatusCode retval = UA_Server_unregister_discovery(server, discoveryClient);
+    if(ei_skip_term(req, req_index) < 0)
+        errx(EXIT_FAILURE, "Invalid attribute value");
 
-    UA_Client_disconnect(discoveryClient);
-    //UA_Client_delete(discoveryClient);
+    return UA_STATUSCODE_BADATTRIBUTEIDINVALID;
+}
 
-    if(retval != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval);
+/*
+ *  Decodes an {attribute_id, value} pair into the *Attributes struct of the node class. Attributes that the node
+ *  class does not have return UA_STATUSCODE_BADATTRIBUTEIDINVALID.
+ */
+static UA_StatusCode assemble_node_attribute(const char *req, int *req_index, UA_NodeClass node_class, void *attributes)
+{
+    int term_size;
+    int boolean;
+    unsigned long ulong;
+    long slong;
+    double real;
+
+    // Every *Attributes type begins with the UA_NodeAttributes fields.
+    UA_NodeAttributes *node_attributes = attributes;
+    UA_Variant *value = NULL;
+    UA_NodeId *data_type = NULL;
+    UA_Int32 *value_rank = NULL;
+    size_t *array_dimensions_size = NULL;
+    UA_UInt32 **array_dimensions = NULL;
+    UA_Byte *access_level = NULL;
+    UA_Double *minimum_sampling_interval = NULL;
+    UA_Boolean *historizing = NULL;
+    UA_Boolean *is_abstract = NULL;
+    UA_Boolean *symmetric = NULL;
+    UA_LocalizedText *inverse_name = NULL;
+    UA_Boolean *contains_no_loops = NULL;
+    UA_Byte *event_notifier = NULL;
+
+    switch(node_class)
+    {
+        case UA_NODECLASS_VARIABLE:
+        {
+            UA_VariableAttributes *vAttr = attributes;
+            value = &vAttr->value;
+            data_type = &vAttr->dataType;
+            value_rank = &vAttr->valueRank;
+            array_dimensions_size = &vAttr->arrayDimensionsSize;
+            array_dimensions = &vAttr->arrayDimensions;
+            access_level = &vAttr->accessLevel;
+            minimum_sampling_interval = &vAttr->minimumSamplingInterval;
+            historizing = &vAttr->historizing;
+        }
+        break;
+
+        case UA_NODECLASS_VARIABLETYPE:
+        {
+            UA_VariableTypeAttributes *vtAttr = attributes;
+            value = &vtAttr->value;
+            data_type = &vtAttr->dataType;
+            value_rank = &vtAttr->valueRank;
+            array_dimensions_size = &vtAttr->arrayDimensionsSize;
+            array_dimensions = &vtAttr->arrayDimensions;
+            is_abstract = &vtAttr->isAbstract;
+        }
+        break;
+
+        case UA_NODECLASS_OBJECT:
+            event_notifier = &((UA_ObjectAttributes *)attributes)->eventNotifier;
+        break;
+
+        case UA_NODECLASS_OBJECTTYPE:
+            is_abstract = &((UA_ObjectTypeAttributes *)attributes)->isAbstract;
+        break;
+
+        case UA_NODECLASS_VIEW:
+            contains_no_loops = &((UA_ViewAttributes *)attributes)->containsNoLoops;
+            event_notifier = &((UA_ViewAttributes *)attributes)->eventNotifier;
+        break;
+
+        case UA_NODECLASS_REFERENCETYPE:
+            is_abstract = &((UA_ReferenceTypeAttributes *)attributes)->isAbstract;
+            symmetric = &((UA_ReferenceTypeAttributes *)attributes)->symmetric;
+            inverse_name = &((UA_ReferenceTypeAttributes *)attributes)->inverseName;
+        break;
+
+        case UA_NODECLASS_DATATYPE:
+            is_abstract = &((UA_DataTypeAttributes *)attributes)->isAbstract;
+        break;
+
+        default:
+        break;
+    }
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, "assemble_node_attribute requires a 2-tuple, term_size = %d", term_size);
+
+    unsigned long attribute_id;
+    if (ei_decode_ulong(req, req_index, &attribute_id) < 0)
+        errx(EXIT_FAILURE, "Invalid attribute_id");
+
+    switch(attribute_id)
+    {
+        case UA_ATTRIBUTEID_DISPLAYNAME:
+            assemble_localized_text(req, req_index, &node_attributes->displayName);
+        break;
+
+        case UA_ATTRIBUTEID_DESCRIPTION:
+            assemble_localized_text(req, req_index, &node_attributes->description);
+        break;
+
+        case UA_ATTRIBUTEID_WRITEMASK:
+            if (ei_decode_ulong(req, req_index, &ulong) < 0)
+                errx(EXIT_FAILURE, "Invalid write_mask");
+            node_attributes->writeMask = (UA_UInt32) ulong;
+        break;
+
+        case UA_ATTRIBUTEID_ISABSTRACT:
+            if(!is_abstract)
+                return skip_node_attribute(req, req_index);
+            if (ei_decode_boolean(req, req_index, &boolean) < 0)
+                errx(EXIT_FAILURE, "Invalid is_abstract");
+            *is_abstract = (UA_Boolean) boolean;
+        break;
+
+        case UA_ATTRIBUTEID_SYMMETRIC:
+            if(!symmetric)
+                return skip_node_attribute(req, req_index);
+            if (ei_decode_boolean(req, req_index, &boolean) < 0)
+                errx(EXIT_FAILURE, "Invalid symmetric");
+            *symmetric = (UA_Boolean) boolean;
+        break;
+
+        case UA_ATTRIBUTEID_INVERSENAME:
+            if(!inverse_name)
+                return skip_node_attribute(req, req_index);
+            assemble_localized_text(req, req_index, inverse_name);
+        break;
+
+        case UA_ATTRIBUTEID_CONTAINSNOLOOPS:
+            if(!contains_no_loops)
+                return skip_node_attribute(req, req_index);
+            if (ei_decode_boolean(req, req_index, &boolean) < 0)
+                errx(EXIT_FAILURE, "Invalid contains_no_loops");
+            *contains_no_loops = (UA_Boolean) boolean;
+        break;
+
+        case UA_ATTRIBUTEID_EVENTNOTIFIER:
+            if(!event_notifier)
+                return skip_node_attribute(req, req_index);
+            if (ei_decode_ulong(req, req_index, &ulong) < 0)
+                errx(EXIT_FAILURE, "Invalid event_notifier");
+            *event_notifier = (UA_Byte) ulong;
+        break;
+
+        case UA_ATTRIBUTEID_VALUE:
+            if(!value)
+                return skip_node_attribute(req, req_index);
+            return assemble_node_value(req, req_index, value);
+
+        case UA_ATTRIBUTEID_DATATYPE:
+            if(!data_type)
+                return skip_node_attribute(req, req_index);
+            UA_NodeId_clear(data_type);
+            *data_type = assemble_node_id(req, req_index);
+        break;
+
+        case UA_ATTRIBUTEID_VALUERANK:
+            if(!value_rank)
+                return skip_node_attribute(req, req_index);
+            if (ei_decode_long(req, req_index, &slong) < 0)
+                errx(EXIT_FAILURE, "Invalid value_rank");
+            *value_rank = (UA_Int32) slong;
+        break;
+
+        case UA_ATTRIBUTEID_ARRAYDIMENSIONS:
+            if(!array_dimensions)
+                return skip_node_attribute(req, req_index);
+            assemble_array_dimensions(req, req_index, array_dimensions_size, array_dimensions);
+        break;
+
+        case UA_ATTRIBUTEID_ACCESSLEVEL:
+            if(!access_level)
+                return skip_node_attribute(req, req_index);
+            if (ei_decode_ulong(req, req_index, &ulong) < 0)
+                errx(EXIT_FAILURE, "Invalid access_level");
+            *access_level = (UA_Byte) ulong;
+        break;
+
+        case UA_ATTRIBUTEID_MINIMUMSAMPLINGINTERVAL:
+            if(!minimum_sampling_interval)
+                return skip_node_attribute(req, req_index);
+            if (ei_decode_double(req, req_index, &real) < 0)
+                errx(EXIT_FAILURE, "Invalid minimum_sampling_interval");
+            *minimum_sampling_interval = real;
+        break;
+
+        case UA_ATTRIBUTEID_HISTORIZING:
+            if(!historizing)
+                return skip_node_attribute(req, req_index);
+            if (ei_decode_boolean(req, req_index, &boolean) < 0)
+                errx(EXIT_FAILURE, "Invalid historizing");
+            *historizing = (UA_Boolean) boolean;
+        break;
+
+        default:
+            return skip_node_attribute(req, req_index);
+    }
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode load_namespace(UA_Server *server, const char *req, int *req_index, struct address_space_summary *summary)
+{
+    int term_size;
+    int term_type;
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+        errx(EXIT_FAILURE, "Invalid namespace (size)");
+
+    char *namespace = request_arena_alloc(term_size + 1);
+    long binary_len;
+    if (ei_decode_binary(req, req_index, namespace, &binary_len) < 0)
+        errx(EXIT_FAILURE, "Invalid namespace");
+
+    namespace[binary_len] = '\0';
+
+    summary->namespace_names[summary->namespaces_size] = namespace;
+    summary->namespace_indexes[summary->namespaces_size++] = UA_Server_addNamespace(server, namespace);
+
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_StatusCode load_reference(UA_Server *server, const char *req, int *req_index)
+{
+    int term_size;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":load_address_space reference requires a 4-tuple, term_size = %d", term_size);
+
+    UA_NodeId source_id = assemble_node_id_ref(req, req_index);
+    UA_NodeId reference_type_id = assemble_node_id_ref(req, req_index);
+    UA_ExpandedNodeId target_id = assemble_expanded_node_id(req, req_index);
+
+    int is_forward;
+    if (ei_decode_boolean(req, req_index, &is_forward) < 0)
+        errx(EXIT_FAILURE, "Invalid is_forward");
+
+    UA_StatusCode retval = UA_Server_addReference(server, source_id, reference_type_id, target_id, (UA_Boolean)is_forward);
+
+    UA_ExpandedNodeId_clear(&target_id);
+
+    return retval;
+}
+
+static UA_StatusCode load_node(UA_Server *server, const char *req, int *req_index, const char *node_type)
+{
+    int term_size;
+    int list_size;
+    UA_NodeClass node_class;
+    const UA_DataType *attributes_type;
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+
+    union {
+        UA_VariableAttributes variable;
+        UA_VariableTypeAttributes variable_type;
+        UA_ObjectAttributes object;
+        UA_ObjectTypeAttributes object_type;
+        UA_ViewAttributes view;
+        UA_ReferenceTypeAttributes reference_type;
+        UA_DataTypeAttributes data_type;
+    } attributes;
+
+    if(!strcmp(node_type, "variable_node")) {
+        node_class = UA_NODECLASS_VARIABLE;
+        attributes.variable = UA_VariableAttributes_default;
+        attributes_type = &UA_TYPES[UA_TYPES_VARIABLEATTRIBUTES];
+    }
+    else if(!strcmp(node_type, "variable_type_node")) {
+        node_class = UA_NODECLASS_VARIABLETYPE;
+        attributes.variable_type = UA_VariableTypeAttributes_default;
+        attributes_type = &UA_TYPES[UA_TYPES_VARIABLETYPEATTRIBUTES];
+    }
+    else if(!strcmp(node_type, "object_node")) {
+        node_class = UA_NODECLASS_OBJECT;
+        attributes.object = UA_ObjectAttributes_default;
+        attributes_type = &UA_TYPES[UA_TYPES_OBJECTATTRIBUTES];
+    }
+    else if(!strcmp(node_type, "object_type_node")) {
+        node_class = UA_NODECLASS_OBJECTTYPE;
+        attributes.object_type = UA_ObjectTypeAttributes_default;
+        attributes_type = &UA_TYPES[UA_TYPES_OBJECTTYPEATTRIBUTES];
+    }
+    else if(!strcmp(node_type, "view_node")) {
+        node_class = UA_NODECLASS_VIEW;
+        attributes.view = UA_ViewAttributes_default;
+        attributes_type = &UA_TYPES[UA_TYPES_VIEWATTRIBUTES];
+    }
+    else if(!strcmp(node_type, "reference_type_node")) {
+        node_class = UA_NODECLASS_REFERENCETYPE;
+        attributes.reference_type = UA_ReferenceTypeAttributes_default;
+        attributes_type = &UA_TYPES[UA_TYPES_REFERENCETYPEATTRIBUTES];
+    }
+    else if(!strcmp(node_type, "data_type_node")) {
+        node_class = UA_NODECLASS_DATATYPE;
+        attributes.data_type = UA_DataTypeAttributes_default;
+        attributes_type = &UA_TYPES[UA_TYPES_DATATYPEATTRIBUTES];
+    }
+    else {
+        // Creation arguments and attributes
+        if(ei_skip_term(req, req_index) < 0 || ei_skip_term(req, req_index) < 0)
+            errx(EXIT_FAILURE, "Invalid node");
+
+        return UA_STATUSCODE_BADNODECLASSINVALID;
+    }
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        (term_size != 4 && term_size != 5))
+        errx(EXIT_FAILURE, ":load_address_space node requires a 4-tuple or a 5-tuple, term_size = %d", term_size);
+
+    UA_NodeId requested_new_node_id = assemble_node_id_ref(req, req_index);
+    UA_NodeId parent_node_id = assemble_node_id_ref(req, req_index);
+    UA_NodeId reference_type_node_id = assemble_node_id_ref(req, req_index);
+    UA_QualifiedName browse_name = assemble_qualified_name(req, req_index);
+    UA_NodeId type_definition = term_size == 5 ? assemble_node_id_ref(req, req_index) : UA_NODEID_NULL;
+
+    if(ei_decode_list_header(req, req_index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":load_address_space node attributes must be a list");
+
+    for(int i = 0; i < list_size; i++) {
+        UA_StatusCode attribute_retval = assemble_node_attribute(req, req_index, node_class, &attributes);
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = attribute_retval;
+    }
+
+    if(list_size && ei_decode_list_header(req, req_index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":load_address_space node attributes must be a proper list");
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        switch(node_class)
+        {
+            case UA_NODECLASS_VARIABLE:
+            {
+                UA_NodeId new_node_id;
+                retval = UA_Server_addVariableNode(server, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, attributes.variable, NULL, &new_node_id);
+                if(retval == UA_STATUSCODE_GOOD) {
+                    UA_ValueCallback callback;
+                    callback.onRead = NULL;
+                    callback.onWrite = send_write_response;
+                    UA_Server_setVariableNode_valueCallback(server, new_node_id, callback);
+                    UA_NodeId_clear(&new_node_id);
+                }
+            }
+            break;
+
+            case UA_NODECLASS_VARIABLETYPE:
+                retval = UA_Server_addVariableTypeNode(server, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, attributes.variable_type, NULL, NULL);
+            break;
+
+            case UA_NODECLASS_OBJECT:
+                retval = UA_Server_addObjectNode(server, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, type_definition, attributes.object, NULL, NULL);
+            break;
+
+            case UA_NODECLASS_OBJECTTYPE:
+                retval = UA_Server_addObjectTypeNode(server, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, attributes.object_type, NULL, NULL);
+            break;
+
+            case UA_NODECLASS_VIEW:
+                retval = UA_Server_addViewNode(server, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, attributes.view, NULL, NULL);
+            break;
+
+            case UA_NODECLASS_REFERENCETYPE:
+                retval = UA_Server_addReferenceTypeNode(server, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, attributes.reference_type, NULL, NULL);
+            break;
+
+            case UA_NODECLASS_DATATYPE:
+                retval = UA_Server_addDataTypeNode(server, requested_new_node_id, parent_node_id, reference_type_node_id, browse_name, attributes.data_type, NULL, NULL);
+            break;
+
+            default:
+                retval = UA_STATUSCODE_BADNODECLASSINVALID;
+            break;
+        }
+    }
+
+    UA_QualifiedName_clear(&browse_name);
+    UA_clear(&attributes, attributes_type);
+
+    return retval;
+}
+
+/*
+ *  Decodes and creates a list of address space entries, sends back the summary.
+ */
+static void load_address_space(UA_Server *server, const char *buf, int *index)
+{
+    int list_size;
+    int term_size;
+    char atom[MAXATOMLEN];
+    struct address_space_summary summary = {.namespaces_size = 0, .failures_size = 0};
+
+    if(ei_decode_list_header(buf, index, &list_size) < 0)
+        errx(EXIT_FAILURE, ":load_address_space requires a list");
+
+    if(list_size == 0) {
+        send_data_response(&summary, 33, 0);
+        return;
+    }
+
+    summary.namespace_names = request_arena_alloc(list_size * sizeof(const char *));
+    summary.namespace_indexes = request_arena_alloc(list_size * sizeof(UA_UInt16));
+    summary.failure_indexes = request_arena_alloc(list_size * sizeof(UA_UInt32));
+    summary.failure_codes = request_arena_alloc(list_size * sizeof(UA_StatusCode));
+
+    for(int i = 0; i < list_size; i++) {
+        UA_StatusCode retval;
+
+        if(ei_decode_tuple_header(buf, index, &term_size) < 0 ||
+            ei_decode_atom(buf, index, atom) < 0)
+            errx(EXIT_FAILURE, ":load_address_space invalid entry %d", i);
+
+        if(!strcmp(atom, "namespace") && term_size == 2)
+            retval = load_namespace(server, buf, index, &summary);
+        else if(!strcmp(atom, "reference") && term_size == 2)
+            retval = load_reference(server, buf, index);
+        else if(term_size == 3)
+            retval = load_node(server, buf, index, atom);
+        else
+            errx(EXIT_FAILURE, ":load_address_space invalid entry %d, term_size = %d", i, term_size);
+
+        if(retval != UA_STATUSCODE_GOOD) {
+            summary.failure_indexes[summary.failures_size] = i;
+            summary.failure_codes[summary.failures_size++] = retval;
+        }
+    }
+
+    send_data_response(&summary, 33, 0);
+}
+
+/* 
+ *  Adds a chunk of namespaces, nodes (with their attributes) and references in a single request.
+ *  Returns {[{namespace, ns_index}], [{entry_index, status_code}]}.
+ */
+void handle_load_address_space(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    load_address_space((UA_Server *)entity, req, req_index);
+}
+
+/*  Nodeset snapshots
+ *
+ *  save_nodeset writes the user namespaces (ns_index >= 1) as a list of load_address_space entries in the Erlang
+ *  external term format: the namespaces, every node in browse order (parents first) with its attributes and current
+ *  value, then the remaining references. load_nodeset maps the file and creates the nodes in a single pass. Values
+ *  are stored as raw memory, so a snapshot is restored on the host that saved it. Method nodes are not saved.
+ *
+ *  The terms follow a snapshot_file_header. load_nodeset checks it (and a checksum of the terms) before decoding
+ *  anything, the decoders trust their input: a truncated or corrupt file, or one from another host layout, is an
+ *  error rather than a port exit.
+ */
+#define SNAPSHOT_MAGIC "OPEXNSET"
+#define SNAPSHOT_FORMAT_VERSION 1
+
+struct snapshot_file_header {
+    char magic[8];
+    uint32_t format_version;
+    uint16_t byte_order; // 0x0102 as written by the host
+    uint8_t word_size; // sizeof(void *)
+    uint8_t reserved;
+    uint32_t types_count; // UA_TYPES_COUNT, raw values depend on the open62541 type layouts
+    uint32_t reserved2;
+    uint64_t payload_size; // Bytes of terms after the header
+    uint64_t checksum; // FNV-1a of the terms
+};
+
+static void snapshot_file_header_init(struct snapshot_file_header *file_header)
+{
+    memset(file_header, 0, sizeof(struct snapshot_file_header));
+    memcpy(file_header->magic, SNAPSHOT_MAGIC, sizeof(file_header->magic));
+    file_header->format_version = SNAPSHOT_FORMAT_VERSION;
+    file_header->byte_order = 0x0102;
+    file_header->word_size = sizeof(void *);
+    file_header->types_count = UA_TYPES_COUNT;
+}
+
+#define SNAPSHOT_CHECKSUM_INIT 0xcbf29ce484222325ULL
+
+static uint64_t snapshot_checksum(uint64_t checksum, const char *data, size_t size)
+{
+    for(size_t i = 0; i < size; i++) {
+        checksum ^= (unsigned char) data[i];
+        checksum *= 0x100000001b3ULL;
+    }
+
+    return checksum;
+}
+
+// {node_type, ns_index, identifier}, as assemble_node_id expects it.
+static void encode_snapshot_node_id(ei_x_buff *buff, const UA_NodeId *node_id)
+{
+    ei_x_encode_tuple_header(buff, 3);
+
+    switch(node_id->identifierType)
+    {
+        case UA_NODEIDTYPE_NUMERIC:
+            ei_x_encode_ulong(buff, 0);
+            ei_x_encode_ulong(buff, node_id->namespaceIndex);
+            ei_x_encode_ulong(buff, node_id->identifier.numeric);
+        break;
+
+        case UA_NODEIDTYPE_STRING:
+            ei_x_encode_ulong(buff, 1);
+            ei_x_encode_ulong(buff, node_id->namespaceIndex);
+            ei_x_encode_binary(buff, node_id->identifier.string.data, node_id->identifier.string.length);
+        break;
+
+        case UA_NODEIDTYPE_GUID:
+            ei_x_encode_ulong(buff, 2);
+            ei_x_encode_ulong(buff, node_id->namespaceIndex);
+            encode_ua_guid(buff, (void *) &node_id->identifier.guid);
+        break;
+
+        case UA_NODEIDTYPE_BYTESTRING:
+            ei_x_encode_ulong(buff, 3);
+            ei_x_encode_ulong(buff, node_id->namespaceIndex);
+            ei_x_encode_binary(buff, node_id->identifier.byteString.data, node_id->identifier.byteString.length);
+        break;
+    }
+}
+
+static bool snapshot_value_supported(const UA_Variant *value)
+{
+    const UA_DataType *type = value->type;
+
+    if(!type || type->typeIndex >= UA_TYPES_COUNT || type != &UA_TYPES[type->typeIndex])
+        return false;
+
+    return type->pointerFree || type->typeIndex == UA_TYPES_STRING ||
+        type->typeIndex == UA_TYPES_BYTESTRING || type->typeIndex == UA_TYPES_XMLELEMENT;
+}
+
+// {data_type, array_length, array_dimensions, data}, see assemble_snapshot_value.
+static void encode_snapshot_value(ei_x_buff *buff, const UA_Variant *value)
+{
+    const UA_DataType *type = value->type;
+    bool is_scalar = UA_Variant_isScalar(value);
+    size_t data_size = is_scalar ? 1 : value->arrayLength;
+
+    ei_x_encode_tuple_header(buff, 4);
+    ei_x_encode_ulong(buff, type->typeIndex);
+    ei_x_encode_long(buff, is_scalar ? -1 : (long) value->arrayLength);
+
+    ei_x_encode_tuple_header(buff, value->arrayDimensionsSize);
+    for(size_t i = 0; i < value->arrayDimensionsSize; i++)
+        ei_x_encode_ulong(buff, value->arrayDimensions[i]);
+
+    if(type->pointerFree) {
+        ei_x_encode_binary(buff, data_size ? value->data : "", data_size * type->memSize);
+        return;
+    }
+
+    if(data_size)
+        ei_x_encode_list_header(buff, data_size);
+
+    for(size_t i = 0; i < data_size; i++) {
+        UA_String *string = (UA_String *) value->data + i;
+        ei_x_encode_binary(buff, string->length ? (const char *) string->data : "", string->length);
+    }
+
+    ei_x_encode_empty_list(buff);
+}
+
+// {attribute_id, value}, as assemble_node_attribute expects it. Returns false if nothing was encoded.
+static bool encode_snapshot_attribute(ei_x_buff *buff, UA_UInt32 attribute_id, const UA_Variant *value)
+{
+    const UA_DataType *type;
+
+    switch(attribute_id)
+    {
+        case UA_ATTRIBUTEID_VALUE:
+            if(!snapshot_value_supported(value))
+                return false;
+
+            ei_x_encode_tuple_header(buff, 2);
+            ei_x_encode_ulong(buff, attribute_id);
+            encode_snapshot_value(buff, value);
+        return true;
+
+        case UA_ATTRIBUTEID_ARRAYDIMENSIONS:
+            if(value->type != &UA_TYPES[UA_TYPES_UINT32] || UA_Variant_isScalar(value) || value->arrayLength == 0)
+                return false;
+
+            ei_x_encode_tuple_header(buff, 2);
+            ei_x_encode_ulong(buff, attribute_id);
+            ei_x_encode_tuple_header(buff, value->arrayLength);
+            for(size_t i = 0; i < value->arrayLength; i++)
+                ei_x_encode_ulong(buff, ((UA_UInt32 *) value->data)[i]);
+        return true;
+
+        case UA_ATTRIBUTEID_DISPLAYNAME:
+        case UA_ATTRIBUTEID_DESCRIPTION:
+        case UA_ATTRIBUTEID_INVERSENAME:
+            type = &UA_TYPES[UA_TYPES_LOCALIZEDTEXT];
+        break;
+
+        case UA_ATTRIBUTEID_WRITEMASK:
+            type = &UA_TYPES[UA_TYPES_UINT32];
+        break;
+
+        case UA_ATTRIBUTEID_ISABSTRACT:
+        case UA_ATTRIBUTEID_SYMMETRIC:
+        case UA_ATTRIBUTEID_CONTAINSNOLOOPS:
+        case UA_ATTRIBUTEID_HISTORIZING:
+            type = &UA_TYPES[UA_TYPES_BOOLEAN];
+        break;
+
+        case UA_ATTRIBUTEID_EVENTNOTIFIER:
+        case UA_ATTRIBUTEID_ACCESSLEVEL:
+            type = &UA_TYPES[UA_TYPES_BYTE];
+        break;
+
+        case UA_ATTRIBUTEID_DATATYPE:
+            type = &UA_TYPES[UA_TYPES_NODEID];
+        break;
+
+        case UA_ATTRIBUTEID_VALUERANK:
+            type = &UA_TYPES[UA_TYPES_INT32];
+        break;
+
+        case UA_ATTRIBUTEID_MINIMUMSAMPLINGINTERVAL:
+            type = &UA_TYPES[UA_TYPES_DOUBLE];
+        break;
+
+        default:
+        return false;
+    }
+
+    if(!UA_Variant_hasScalarType(value, type))
+        return false;
+
+    ei_x_encode_tuple_header(buff, 2);
+    ei_x_encode_ulong(buff, attribute_id);
+
+    switch(type->typeIndex)
+    {
+        case UA_TYPES_LOCALIZEDTEXT:
+            encode_localized_text(buff, value->data);
+        break;
+
+        case UA_TYPES_UINT32:
+            ei_x_encode_ulong(buff, *(UA_UInt32 *) value->data);
+        break;
+
+        case UA_TYPES_BOOLEAN:
+            ei_x_encode_boolean(buff, *(UA_Boolean *) value->data);
+        break;
+
+        case UA_TYPES_BYTE:
+            ei_x_encode_ulong(buff, *(UA_Byte *) value->data);
+        break;
+
+        case UA_TYPES_NODEID:
+            encode_snapshot_node_id(buff, value->data);
+        break;
+
+        case UA_TYPES_INT32:
+            ei_x_encode_long(buff, *(UA_Int32 *) value->data);
+        break;
+
+        case UA_TYPES_DOUBLE:
+            ei_x_encode_double(buff, *(UA_Double *) value->data);
+        break;
+    }
+
+    return true;
+}
+
+static const UA_UInt32 snapshot_variable_attributes[] = {
+    UA_ATTRIBUTEID_DISPLAYNAME, UA_ATTRIBUTEID_DESCRIPTION, UA_ATTRIBUTEID_WRITEMASK, UA_ATTRIBUTEID_DATATYPE,
+    UA_ATTRIBUTEID_VALUERANK, UA_ATTRIBUTEID_ARRAYDIMENSIONS, UA_ATTRIBUTEID_VALUE, UA_ATTRIBUTEID_ACCESSLEVEL,
+    UA_ATTRIBUTEID_MINIMUMSAMPLINGINTERVAL, UA_ATTRIBUTEID_HISTORIZING
+};
+
+static const UA_UInt32 snapshot_variable_type_attributes[] = {
+    UA_ATTRIBUTEID_DISPLAYNAME, UA_ATTRIBUTEID_DESCRIPTION, UA_ATTRIBUTEID_WRITEMASK, UA_ATTRIBUTEID_DATATYPE,
+    UA_ATTRIBUTEID_VALUERANK, UA_ATTRIBUTEID_ARRAYDIMENSIONS, UA_ATTRIBUTEID_VALUE, UA_ATTRIBUTEID_ISABSTRACT
+};
+
+static const UA_UInt32 snapshot_object_attributes[] = {
+    UA_ATTRIBUTEID_DISPLAYNAME, UA_ATTRIBUTEID_DESCRIPTION, UA_ATTRIBUTEID_WRITEMASK, UA_ATTRIBUTEID_EVENTNOTIFIER
+};
+
+static const UA_UInt32 snapshot_type_attributes[] = {
+    UA_ATTRIBUTEID_DISPLAYNAME, UA_ATTRIBUTEID_DESCRIPTION, UA_ATTRIBUTEID_WRITEMASK, UA_ATTRIBUTEID_ISABSTRACT
+};
+
+static const UA_UInt32 snapshot_view_attributes[] = {
+    UA_ATTRIBUTEID_DISPLAYNAME, UA_ATTRIBUTEID_DESCRIPTION, UA_ATTRIBUTEID_WRITEMASK, UA_ATTRIBUTEID_CONTAINSNOLOOPS,
+    UA_ATTRIBUTEID_EVENTNOTIFIER
+};
+
+static const UA_UInt32 snapshot_reference_type_attributes[] = {
+    UA_ATTRIBUTEID_DISPLAYNAME, UA_ATTRIBUTEID_DESCRIPTION, UA_ATTRIBUTEID_WRITEMASK, UA_ATTRIBUTEID_ISABSTRACT,
+    UA_ATTRIBUTEID_SYMMETRIC, UA_ATTRIBUTEID_INVERSENAME
+};
+
+#define SNAPSHOT_ATTRIBUTES(attributes) attributes_size = sizeof(attributes) / sizeof(UA_UInt32); attribute_ids = attributes
+
+/*
+ *  {node_type, creation_args, attributes} of a node found by browsing its parent. `attributes` is a scratch buffer.
+ *  Returns false for node classes that are not saved.
+ */
+static bool encode_snapshot_node(UA_Server *server, ei_x_buff *buff, ei_x_buff *attributes, const UA_NodeId *parent_node_id,
+                                 const UA_ReferenceDescription *reference)
+{
+    const char *node_type;
+    const UA_UInt32 *attribute_ids;
+    size_t attributes_size;
+    bool has_type_definition = false;
+
+    switch(reference->nodeClass)
+    {
+        case UA_NODECLASS_VARIABLE:
+            node_type = "variable_node";
+            has_type_definition = true;
+            SNAPSHOT_ATTRIBUTES(snapshot_variable_attributes);
+        break;
+
+        case UA_NODECLASS_VARIABLETYPE:
+            node_type = "variable_type_node";
+            SNAPSHOT_ATTRIBUTES(snapshot_variable_type_attributes);
+        break;
+
+        case UA_NODECLASS_OBJECT:
+            node_type = "object_node";
+            has_type_definition = true;
+            SNAPSHOT_ATTRIBUTES(snapshot_object_attributes);
+        break;
+
+        case UA_NODECLASS_OBJECTTYPE:
+            node_type = "object_type_node";
+            SNAPSHOT_ATTRIBUTES(snapshot_type_attributes);
+        break;
+
+        case UA_NODECLASS_VIEW:
+            node_type = "view_node";
+            SNAPSHOT_ATTRIBUTES(snapshot_view_attributes);
+        break;
+
+        case UA_NODECLASS_REFERENCETYPE:
+            node_type = "reference_type_node";
+            SNAPSHOT_ATTRIBUTES(snapshot_reference_type_attributes);
+        break;
+
+        case UA_NODECLASS_DATATYPE:
+            node_type = "data_type_node";
+            SNAPSHOT_ATTRIBUTES(snapshot_type_attributes);
+        break;
+
+        default:
+        return false;
+    }
+
+    int encoded_attributes = 0;
+    attributes->index = 0;
+
+    for(size_t i = 0; i < attributes_size; i++) {
+        UA_ReadValueId item;
+        UA_ReadValueId_init(&item);
+        item.nodeId = reference->nodeId.nodeId;
+        item.attributeId = attribute_ids[i];
+
+        UA_DataValue attribute = UA_Server_read(server, &item, UA_TIMESTAMPSTORETURN_NEITHER);
+
+        if(attribute.hasValue && (!attribute.hasStatus || attribute.status == UA_STATUSCODE_GOOD) &&
+            encode_snapshot_attribute(attributes, attribute_ids[i], &attribute.value))
+            encoded_attributes++;
+
+        UA_DataValue_clear(&attribute);
+    }
+
+    ei_x_encode_tuple_header(buff, 3);
+    ei_x_encode_atom(buff, node_type);
+
+    ei_x_encode_tuple_header(buff, has_type_definition ? 5 : 4);
+    encode_snapshot_node_id(buff, &reference->nodeId.nodeId);
+    encode_snapshot_node_id(buff, parent_node_id);
+    encode_snapshot_node_id(buff, &reference->referenceTypeId);
+    encode_qualified_name(buff, (void *) &reference->browseName);
+    if(has_type_definition)
+        encode_snapshot_node_id(buff, &reference->typeDefinition.nodeId);
+
+    if(encoded_attributes)
+        ei_x_encode_list_header(buff, encoded_attributes);
+    ei_x_append_buf(buff, attributes->buff, attributes->index);
+    ei_x_encode_empty_list(buff);
+
+    return true;
+}
+
+static void encode_snapshot_reference(ei_x_buff *buff, const UA_NodeId *source_id, const UA_NodeId *reference_type_id,
+                                      const UA_NodeId *target_id)
+{
+    ei_x_encode_tuple_header(buff, 2);
+    ei_x_encode_atom(buff, "reference");
+    ei_x_encode_tuple_header(buff, 4);
+    encode_snapshot_node_id(buff, source_id);
+    encode_snapshot_node_id(buff, reference_type_id);
+    encode_snapshot_node_id(buff, target_id);
+    ei_x_encode_boolean(buff, 1);
+}
+
+static UA_BrowseResult browse_snapshot_references(UA_Server *server, const UA_NodeId *node_id, UA_UInt32 reference_type)
+{
+    UA_BrowseDescription description;
+    UA_BrowseDescription_init(&description);
+    description.nodeId = *node_id;
+    description.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+    description.referenceTypeId = UA_NODEID_NUMERIC(0, reference_type);
+    description.includeSubtypes = true;
+    description.resultMask = UA_BROWSERESULTMASK_ALL;
+
+    return UA_Server_browse(server, 0, &description);
+}
+
+static bool write_snapshot(const char *path, ei_x_buff *header, ei_x_buff *nodes, ei_x_buff *references)
+{
+    char tmp_path[strlen(path) + 5];
+    sprintf(tmp_path, "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if(!file)
+        return false;
+
+    struct snapshot_file_header file_header;
+    snapshot_file_header_init(&file_header);
+    file_header.payload_size = (uint64_t) header->index + nodes->index + references->index;
+    file_header.checksum = snapshot_checksum(SNAPSHOT_CHECKSUM_INIT, header->buff, header->index);
+    file_header.checksum = snapshot_checksum(file_header.checksum, nodes->buff, nodes->index);
+    file_header.checksum = snapshot_checksum(file_header.checksum, references->buff, references->index);
+
+    bool written = fwrite(&file_header, 1, sizeof(file_header), file) == sizeof(file_header) &&
+        fwrite(header->buff, 1, header->index, file) == header->index &&
+        fwrite(nodes->buff, 1, nodes->index, file) == nodes->index &&
+        fwrite(references->buff, 1, references->index, file) == references->index;
+
+    if(fclose(file) != 0 || !written || rename(tmp_path, path) != 0) {
+        int error = errno;
+        unlink(tmp_path);
+        errno = error;
+        return false;
+    }
+
+    return true;
+}
+
+static const char *posix_error_atom(int error)
+{
+    switch(error)
+    {
+        case ENOENT: return "enoent";
+        case EACCES: return "eacces";
+        case ENOSPC: return "enospc";
+        case EISDIR: return "eisdir";
+        case ENOTDIR: return "enotdir";
+        default: return "eio";
+    }
+}
+
+static void decode_snapshot_path(const char *req, int *req_index, char *path, int path_size)
+{
+    int term_size;
+    int term_type;
+    long binary_len;
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT || term_size >= path_size)
+        errx(EXIT_FAILURE, "Invalid path (size)");
+
+    if (ei_decode_binary(req, req_index, path, &binary_len) < 0)
+        errx(EXIT_FAILURE, "Invalid path");
+
+    path[binary_len] = '\0';
+}
+
+/* 
+ *  Saves the user namespaces (nodes, attributes, references and current values) to a snapshot file.
+ *  Returns the number of saved entries.
+ */
+void handle_save_nodeset(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_Server *server = (UA_Server *)entity;
+    char path[PATH_MAX];
+    ei_x_buff header;
+    ei_x_buff nodes;
+    ei_x_buff references;
+    ei_x_buff attributes;
+    UA_UInt32 entries_size = 0;
+    struct node_id_set visited = {.node_ids = NULL, .size = 0, .capacity = 0};
+    UA_NodeId *queue = NULL;
+    size_t queue_head = 0;
+    size_t queue_size = 0;
+    size_t queue_capacity = 0;
+
+    decode_snapshot_path(req, req_index, path, sizeof(path));
+
+    ei_x_new_with_version(&header);
+    ei_x_new(&nodes);
+    ei_x_new(&references);
+    ei_x_new(&attributes);
+
+    // Namespaces are restored in order to keep their indexes.
+    UA_Variant namespaces;
+    if(UA_Server_readValue(server, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_NAMESPACEARRAY), &namespaces) == UA_STATUSCODE_GOOD) {
+        if(namespaces.type == &UA_TYPES[UA_TYPES_STRING])
+            for(size_t i = 2; i < namespaces.arrayLength; i++) {
+                UA_String *namespace = (UA_String *) namespaces.data + i;
+                ei_x_encode_tuple_header(&nodes, 2);
+                ei_x_encode_atom(&nodes, "namespace");
+                ei_x_encode_binary(&nodes, namespace->data, namespace->length);
+                entries_size++;
+            }
+
+        UA_Variant_clear(&namespaces);
+    }
+
+    UA_NodeId root_folder = UA_NODEID_NUMERIC(0, UA_NS0ID_ROOTFOLDER);
+    node_id_set_insert(&visited, &root_folder);
+    queue_capacity = 1024;
+    queue = (UA_NodeId *) malloc(queue_capacity * sizeof(UA_NodeId));
+    UA_NodeId_copy(&root_folder, &queue[queue_size++]);
+
+    // Breadth-first through the hierarchical references, a node is saved when it is found the first time.
+    while(queue_head < queue_size) {
+        UA_NodeId *node_id = &queue[queue_head++];
+        bool user_node = node_id->namespaceIndex >= 1;
+
+        UA_BrowseResult children = browse_snapshot_references(server, node_id, UA_NS0ID_HIERARCHICALREFERENCES);
+
+        for(size_t i = 0; i < children.referencesSize; i++) {
+            UA_ReferenceDescription *child = &children.references[i];
+            UA_NodeId *child_id = &child->nodeId.nodeId;
+
+            if(child->nodeId.serverIndex != 0 || child->nodeClass == UA_NODECLASS_METHOD)
+                continue;
+
+            if(node_id_set_insert(&visited, child_id)) {
+                if(queue_size == queue_capacity) {
+                    queue_capacity *= 2;
+                    queue = (UA_NodeId *) realloc(queue, queue_capacity * sizeof(UA_NodeId));
+                    if(!queue)
+                        errx(EXIT_FAILURE, "Could not allocate the snapshot queue");
+                    node_id = &queue[queue_head - 1];
+                }
+
+                UA_NodeId_copy(child_id, &queue[queue_size++]);
+
+                if(child_id->namespaceIndex >= 1 && encode_snapshot_node(server, &nodes, &attributes, node_id, child)) {
+                    entries_size++;
+                    continue;
+                }
+            }
+
+            if(user_node || child_id->namespaceIndex >= 1) {
+                encode_snapshot_reference(&references, node_id, &child->referenceTypeId, child_id);
+                entries_size++;
+            }
+        }
+
+        UA_BrowseResult_clear(&children);
+
+        if(!user_node)
+            continue;
+
+        // HasTypeDefinition is set by the node creation.
+        UA_BrowseResult targets = browse_snapshot_references(server, node_id, UA_NS0ID_NONHIERARCHICALREFERENCES);
+        UA_NodeId has_type_definition = UA_NODEID_NUMERIC(0, UA_NS0ID_HASTYPEDEFINITION);
+
+        for(size_t i = 0; i < targets.referencesSize; i++) {
+            UA_ReferenceDescription *target = &targets.references[i];
+
+            if(target->nodeId.serverIndex != 0 || UA_NodeId_equal(&target->referenceTypeId, &has_type_definition))
+                continue;
+
+            encode_snapshot_reference(&references, node_id, &target->referenceTypeId, &target->nodeId.nodeId);
+            entries_size++;
+        }
+
+        UA_BrowseResult_clear(&targets);
+    }
+
+    if(entries_size)
+        ei_x_encode_list_header(&header, entries_size);
+    ei_x_encode_empty_list(&references);
+
+    bool written = write_snapshot(path, &header, &nodes, &references);
+    int error = errno;
+
+    for(size_t i = 0; i < queue_size; i++)
+        UA_NodeId_clear(&queue[i]);
+    free(queue);
+    node_id_set_clear(&visited);
+    ei_x_free(&header);
+    ei_x_free(&nodes);
+    ei_x_free(&references);
+    ei_x_free(&attributes);
+
+    if(!written) {
+        send_error_response(posix_error_atom(error));
+        return;
+    }
+
+    send_data_response(&entries_size, 2, 0);
+}
+
+/* 
+ *  Restores a snapshot written by save_nodeset, returns the same summary as load_address_space.
+ */
+void handle_load_nodeset(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    char path[PATH_MAX];
+    struct stat file_stat;
+    int version;
+    int index = 0;
+
+    decode_snapshot_path(req, req_index, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        send_error_response(posix_error_atom(errno));
+        return;
+    }
+
+    if(fstat(fd, &file_stat) < 0 || (size_t) file_stat.st_size < sizeof(struct snapshot_file_header)) {
+        close(fd);
+        send_error_response("einval");
+        return;
+    }
+
+    const char *snapshot = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(snapshot == MAP_FAILED) {
+        send_error_response(posix_error_atom(errno));
+        return;
+    }
+
+    struct snapshot_file_header expected;
+    struct snapshot_file_header file_header;
+    snapshot_file_header_init(&expected);
+    memcpy(&file_header, snapshot, sizeof(file_header));
+
+    const char *payload = snapshot + sizeof(file_header);
+    size_t payload_size = file_stat.st_size - sizeof(file_header);
+
+    if(memcmp(file_header.magic, expected.magic, sizeof(expected.magic)) != 0 ||
+        file_header.payload_size != payload_size ||
+        file_header.checksum != snapshot_checksum(SNAPSHOT_CHECKSUM_INIT, payload, payload_size) ||
+        ei_decode_version(payload, &index, &version) < 0)
+        send_error_response("einval");
+    else if(file_header.format_version != expected.format_version || file_header.byte_order != expected.byte_order ||
+        file_header.word_size != expected.word_size || file_header.types_count != expected.types_count)
+        send_opex_response(UA_STATUSCODE_BADDATAENCODINGUNSUPPORTED);
+    else
+        load_address_space((UA_Server *)entity, payload, &index);
+
+    munmap((void *) snapshot, file_stat.st_size);
+}
+
+/*************/
+/* Discovery */
+/*************/
+
+/* 
+ *  Sets the configuration for the a Server representing a local discovery server as a central instance.
+ *  Any other server can register with this server using "discovery_register" function
+ *  NOTE: before calling this function, this server should have the default configuration.
+ *  LDS Servers only supports the Discovery Services. Cannot be used in combination with any other capability.
+ */
+void handle_set_lds_config(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_set_lds_config requires a 2-tuple, term_size = %d", term_size);
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+            errx(EXIT_FAILURE, "Invalid application_uri (type)");
+
+    UA_String application_uri;
+    application_uri.data = (char *)malloc(term_size + 1);
+    application_uri.length = term_size;
+    long binary_len;
+    if (ei_decode_binary(req, req_index, application_uri.data, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid application_uri");
+    application_uri.data[binary_len] = '\0';
+
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+
+    // This is an LDS server only. Set the application type to DISCOVERYSERVER.
+    config->applicationDescription.applicationType = UA_APPLICATIONTYPE_DISCOVERYSERVER;
+    
+    if(config->applicationDescription.applicationUri.data)
+        UA_String_clear(&config->applicationDescription.applicationUri);
+    
+    config->applicationDescription.applicationUri = application_uri;
+
+    // corrupted size vs. prev_size
+    config->discovery.mdns.serverCapabilitiesSize = 1;
+    UA_String *caps = (UA_String *) UA_Array_new(1, &UA_TYPES[UA_TYPES_STRING]);
+    caps[0] = UA_String_fromChars("LDS");
+    config->discovery.mdns.serverCapabilities = caps;
+
+    // Enable the mDNS announce and response functionality
+    config->discovery.mdnsEnable = true;
+    config->discovery.mdns.mdnsServerName = UA_String_fromChars("LDS");
+
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_ATOM_EXT)
+    {
+        long timeout;
+        if (ei_decode_ulong(req, req_index, &timeout) < 0) {
+            send_error_response("einval");
+            return;
+        }
+        config->discovery.cleanupTimeout = timeout;
+    }
+    else
+    {
+        char nil[4];
+        if (ei_decode_atom(req, req_index, nil) < 0)
+        errx(EXIT_FAILURE, "expecting command atom");
+        config->discovery.cleanupTimeout = 60*60;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Registers a server in a discovery server.
+ *  NOTE: before calling this function, this server should have the default 
+ *  configuration and a port = 0.
+ */
+void handle_discovery_register(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    long binary_len;
+    UA_StatusCode retval;
+
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 4)
+        errx(EXIT_FAILURE, ":handle_discovery_register requires a 4-tuple, term_size = %d", term_size);
+
+    // application_uri
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+            errx(EXIT_FAILURE, "Invalid application_uri (type)");
+
+    UA_String application_uri;
+    application_uri.data = (char *)malloc(term_size + 1);
+    application_uri.length = term_size;
+    if (ei_decode_binary(req, req_index, application_uri.data, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid application_uri");
+    application_uri.data[binary_len] = '\0';
+
+    if(config->applicationDescription.applicationUri.data)
+        UA_String_clear(&config->applicationDescription.applicationUri);
+    
+    config->applicationDescription.applicationUri = application_uri;
+
+    // server_name
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+            errx(EXIT_FAILURE, "Invalid server_name (type)");
+
+    UA_String server_name;
+    server_name.data = (char *)malloc(term_size + 1);
+    server_name.length = term_size;
+    if (ei_decode_binary(req, req_index, server_name.data, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid server_name");
+    server_name.data[binary_len] = '\0';
+
+    if(config->discovery.mdns.mdnsServerName.data)
+        UA_String_clear(&config->discovery.mdns.mdnsServerName);
+    
+    config->discovery.mdns.mdnsServerName = server_name;
+
+    // endpoint
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT)
+            errx(EXIT_FAILURE, "Invalid endpoint (type)");
+
+    //char *endpoint = (char *)malloc(term_size + 1);
+    char endpoint[term_size + 1];
+    if (ei_decode_binary(req, req_index, endpoint, &binary_len) < 0) 
+        errx(EXIT_FAILURE, "Invalid endpoint");
+    endpoint[binary_len] = '\0';
+
+    // timeout
+    long timeout;
+    if (ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_ATOM_EXT)
+    {
+        if (ei_decode_ulong(req, req_index, &timeout) < 0) {
+            send_error_response("einval");
+            return;
+        }
+    }
+    else
+    {
+        char nil[4];
+        if (ei_decode_atom(req, req_index, nil) < 0)
+            errx(EXIT_FAILURE, "expecting command atom");
+        timeout = 10 * 60 * 1000;
+    }
+
+    if(discoveryClient != NULL)
+        UA_Client_delete(discoveryClient);
+
+    discoveryClient = UA_Client_new();
+    UA_ClientConfig_setDefault(UA_Client_getConfig(discoveryClient));
+
+    // Delay first register for 500ms
+    retval = UA_Server_addPeriodicServerRegisterCallback(server, discoveryClient, endpoint, timeout, 500, NULL);
+    
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_Client_disconnect(discoveryClient);
+        UA_Client_delete(discoveryClient);
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/* 
+ *  Unregister the server from the discovery server.
+ */
+void handle_discovery_unregister(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    UA_StatusCode retval = UA_Server_unregister_discovery(server, discoveryClient);
+
+    UA_Client_disconnect(discoveryClient);
+    //UA_Client_delete(discoveryClient);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    send_ok_response();
+}
+
+/************************/
+/* Local MonitoredItems */
+/************************/
+
+/* 
+ *  MonitoredItems are used with the Subscription mechanism of OPC UA to transported notifications for data changes and events. 
+ *  MonitoredItems can also be registered locally. Notifications are then forwarded to a user-defined callback 
+ *  instead of a remote client.
+ */
+void handle_add_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+    UA_MonitoredItemCreateResult retval;
+
+    // {node_id, sampling_interval, coalesce}, the coalesce flag is optional.
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        (term_size != 2 && term_size != 3))
+        errx(EXIT_FAILURE, ":handle_add_monitored_item requires a 2-tuple or a 3-tuple, term_size = %d", term_size);
+
+    UA_NodeId monitored_node = assemble_node_id(req, req_index);
+
+    double sampling_interval;
+    if (ei_decode_double(req, req_index, &sampling_interval) < 0) {
+        UA_NodeId_clear(&monitored_node);
+        send_error_response("einval");
+        return;
+    }
+
+    int coalesce = false;
+    if (term_size == 3 && ei_decode_boolean(req, req_index, &coalesce) < 0) {
+        UA_NodeId_clear(&monitored_node);
+        send_error_response("einval");
+        return;
+    }
+
+    struct local_monitored_item *item = calloc(1, sizeof(struct local_monitored_item));
+    if(!item)
+        errx(EXIT_FAILURE, "Could not allocate a local monitored item");
+    item->coalesce = coalesce;
+
+    UA_MonitoredItemCreateRequest monitor_request = UA_MonitoredItemCreateRequest_default(monitored_node);
+    monitor_request.requestedParameters.samplingInterval = (UA_Double) sampling_interval;
+    if(coalesce) {
+        monitor_request.requestedParameters.queueSize = 1;
+        monitor_request.requestedParameters.discardOldest = true;
+    }
+    
+    retval = UA_Server_createDataChangeMonitoredItem(server, UA_TIMESTAMPSTORETURN_SOURCE,
+                                            monitor_request, item, dataChangeNotificationCallback);
+    
+    UA_NodeId_clear(&monitored_node);
+
+    if(retval.statusCode != UA_STATUSCODE_GOOD) {
+        free(item);
+        send_opex_response(retval.statusCode);
+        return;
+    }
+
+    item->monitored_item_id = retval.monitoredItemId;
+    item->next = local_monitored_items;
+    local_monitored_items = item;
+
+    send_data_response(&(retval.monitoredItemId), 27, 0);
+}
+
+void handle_delete_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int term_type;
+
+    unsigned long monitored_item_id;
+    if (ei_decode_ulong(req, req_index, &monitored_item_id) < 0) {
+        send_error_response("einval");
+        return;
+    }
+    
+    UA_StatusCode retval = UA_Server_deleteMonitoredItem(server, (UA_UInt32) monitored_item_id);
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
+        return;
+    }
+
+    delete_local_monitored_item((UA_UInt32) monitored_item_id);
+
+    send_ok_response();
+}
+
+/****************/
+/* Write events */
+/****************/
+
+/* 
+ *  Enables batched write events ({enabled, interval}), see set_write_batch. With interval = 0 the batch is sent
+ *  at the end of every server iteration.
+ */
+void handle_set_write_batch(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int enabled;
+    unsigned long interval;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_set_write_batch requires a 2-tuple, term_size = %d", term_size);
+
+    if (ei_decode_boolean(req, req_index, &enabled) < 0 ||
+        ei_decode_ulong(req, req_index, &interval) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    set_write_batch(enabled, (uint64_t) interval);
+
+    send_ok_response();
+}
+
+/**
+ * @brief Copies the value callback of a variable node that stores its value (not a data source) from the nodestore
+ */
+static UA_StatusCode read_value_callback(UA_Server *server, const UA_NodeId *node_id, UA_ValueCallback *callback)
+{
+    UA_Nodestore *nodestore = &UA_Server_getConfig(server)->nodestore;
+    const UA_Node *node = nodestore->getNode(nodestore->context, node_id);
+    if(!node)
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    const UA_VariableNode *variable_node = (const UA_VariableNode *) node;
+    if(node->nodeClass != UA_NODECLASS_VARIABLE || variable_node->valueSource != UA_VALUESOURCE_DATA)
+        retval = UA_STATUSCODE_BADNODECLASSINVALID;
+    else
+        *callback = variable_node->value.data.callback;
+
+    nodestore->releaseNode(nodestore->context, node);
+    return retval;
+}
+
+/* 
+ *  Enables or disables ({node_id, enabled}) the forwarding of external writes of a variable node to Elixir.
+ *  Only onWrite is changed, the node keeps its onRead callback.
+ */
+void handle_set_write_forwarding(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    int enabled;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 2)
+        errx(EXIT_FAILURE, ":handle_set_write_forwarding requires a 2-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id_ref(req, req_index);
+
+    if (ei_decode_boolean(req, req_index, &enabled) < 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    UA_ValueCallback callback;
+    UA_StatusCode retval = read_value_callback((UA_Server *)entity, &node_id, &callback);
+
+    if(retval == UA_STATUSCODE_GOOD) {
+        callback.onWrite = enabled ? send_write_response : NULL;
+        retval = UA_Server_setVariableNode_valueCallback((UA_Server *)entity, node_id, callback);
+    }
+
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
         return;
     }
 
     send_ok_response();
 }
 
-/************************/
-/* Local MonitoredItems */
-/************************/
+/* 
+ *   Returns the per-command latencies, port counters and gauges, see encode_port_stats.
+ */
+static void handle_get_stats(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    struct stats_gauge gauges[SERVER_STATS_GAUGES];
+    send_stats_response(gauges, server_stats_gauges(gauges));
+}
+
+/***********/
+/* History */
+/***********/
+
+/*  In-memory history
+ *
+ *  configure_history keeps the last `capacity` samples of a variable node in a ring allocated once, when the node
+ *  is configured, and HistoryRead (raw, by time range) is served from it. Pointer-free scalar values (numbers,
+ *  booleans, DateTimes...) are stored in the sample itself, so recording them doesn't allocate; other values are
+ *  copied. A sample is only recorded `sampling` ms (source timestamp) after the previous one, 0 records every change.
+ *  Requires open62541 built with UA_ENABLE_HISTORIZING (OPEN62541_PROFILE=historizing).
+ */
+#define HISTORY_MAX_CAPACITY (16 * 1024 * 1024)
+
+#ifdef UA_ENABLE_HISTORIZING
+#define HISTORY_INLINE_SIZE 16
+
+struct history_sample {
+    UA_DateTime source_timestamp;
+    UA_DateTime server_timestamp;
+    const UA_DataType *type; // NULL for a sample without value
+    UA_StatusCode status;
+    bool is_inline;
+    union {
+        UA_Byte data[HISTORY_INLINE_SIZE];
+        UA_Variant *variant;
+    } value;
+};
+
+struct node_history {
+    UA_NodeId node_id;
+    struct history_sample *samples;
+    size_t capacity;
+    uint64_t written; // Samples recorded so far, the ring holds the last min(written, capacity)
+    UA_DateTime sampling;
+};
+
+/*  The histories are reached by the server thread (configure_history) and by the services that call the history
+ *  database hooks, worker threads with UA_MULTITHREADING >= 200: the table (which realloc may move and from which
+ *  entries are swap-removed) and the rings are only touched with histories_lock held.
+ */
+static pthread_mutex_t histories_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct node_history *histories = NULL;
+static size_t histories_size = 0;
+
+static struct node_history *find_history(const UA_NodeId *node_id)
+{
+    for(size_t i = 0; i < histories_size; i++)
+        if(UA_NodeId_equal(&histories[i].node_id, node_id))
+            return &histories[i];
+
+    return NULL;
+}
+
+static void clear_history_sample(struct history_sample *sample)
+{
+    if(sample->type != NULL && !sample->is_inline)
+        UA_Variant_delete(sample->value.variant);
+
+    sample->type = NULL;
+}
+
+static void clear_history_samples(struct node_history *history)
+{
+    for(size_t i = 0; i < history->capacity; i++)
+        clear_history_sample(&history->samples[i]);
+
+    free(history->samples);
+    history->samples = NULL;
+}
+
+static void delete_histories(UA_HistoryDatabase *hdb)
+{
+    pthread_mutex_lock(&histories_lock);
+    for(size_t i = 0; i < histories_size; i++) {
+        clear_history_samples(&histories[i]);
+        UA_NodeId_clear(&histories[i].node_id);
+    }
+
+    free(histories);
+    histories = NULL;
+    histories_size = 0;
+    pthread_mutex_unlock(&histories_lock);
+}
+
+/* Called by the server for every value written to a historizing node. */
+static void history_set_value(UA_Server *server, void *hdbContext, const UA_NodeId *sessionId, void *sessionContext,
+                              const UA_NodeId *nodeId, UA_Boolean historizing, const UA_DataValue *value)
+{
+    if(!historizing)
+        return;
+
+    pthread_mutex_lock(&histories_lock);
+
+    struct node_history *history = find_history(nodeId);
+    if(history == NULL) {
+        pthread_mutex_unlock(&histories_lock);
+        return;
+    }
+
+    UA_DateTime now = UA_DateTime_now();
+    UA_DateTime timestamp = value->hasSourceTimestamp ? value->sourceTimestamp : now;
+
+    if(history->written > 0 && history->sampling > 0) {
+        const struct history_sample *last = &history->samples[(history->written - 1) % history->capacity];
+        if(timestamp - last->source_timestamp < history->sampling) {
+            pthread_mutex_unlock(&histories_lock);
+            return;
+        }
+    }
+
+    struct history_sample *sample = &history->samples[history->written % history->capacity];
+    clear_history_sample(sample);
+
+    sample->source_timestamp = timestamp;
+    sample->server_timestamp = value->hasServerTimestamp ? value->serverTimestamp : now;
+    sample->status = value->hasStatus ? value->status : UA_STATUSCODE_GOOD;
+
+    const UA_Variant *variant = &value->value;
+    if(value->hasValue && variant->type != NULL) {
+        if(UA_Variant_isScalar(variant) && variant->type->pointerFree && variant->type->memSize <= HISTORY_INLINE_SIZE) {
+            memcpy(sample->value.data, variant->data, variant->type->memSize);
+            sample->is_inline = true;
+            sample->type = variant->type;
+        }
+        else {
+            sample->value.variant = UA_Variant_new();
+            sample->is_inline = false;
+
+            if(sample->value.variant && UA_Variant_copy(variant, sample->value.variant) == UA_STATUSCODE_GOOD)
+                sample->type = variant->type;
+            else {
+                UA_Variant_delete(sample->value.variant);
+                sample->status = UA_STATUSCODE_BADOUTOFMEMORY;
+            }
+        }
+    }
+
+    history->written++;
+    pthread_mutex_unlock(&histories_lock);
+}
+
+static UA_StatusCode copy_history_sample(const struct history_sample *sample, UA_TimestampsToReturn timestamps,
+                                         UA_DataValue *value)
+{
+    UA_DataValue_init(value);
+
+    if(timestamps == UA_TIMESTAMPSTORETURN_SOURCE || timestamps == UA_TIMESTAMPSTORETURN_BOTH) {
+        value->hasSourceTimestamp = true;
+        value->sourceTimestamp = sample->source_timestamp;
+    }
+
+    if(timestamps == UA_TIMESTAMPSTORETURN_SERVER || timestamps == UA_TIMESTAMPSTORETURN_BOTH) {
+        value->hasServerTimestamp = true;
+        value->serverTimestamp = sample->server_timestamp;
+    }
+
+    if(sample->status != UA_STATUSCODE_GOOD) {
+        value->hasStatus = true;
+        value->status = sample->status;
+    }
+
+    if(sample->type == NULL)
+        return UA_STATUSCODE_GOOD;
+
+    value->hasValue = true;
+    if(sample->is_inline)
+        return UA_Variant_setScalarCopy(&value->value, sample->value.data, sample->type);
+
+    return UA_Variant_copy(sample->value.variant, &value->value);
+}
+
+/*
+ *  Samples between startTime and endTime (both included, 0 for no bound) in chronological order. When more than
+ *  numValuesPerNode samples match, the continuation point is the position of the next one in the ring.
+ */
+static UA_StatusCode read_node_history_raw(const UA_ReadRawModifiedDetails *details, UA_TimestampsToReturn timestamps,
+                                           const UA_HistoryReadValueId *node_to_read, UA_ByteString *continuation_point,
+                                           UA_HistoryData *history_data)
+{
+    if(details->isReadModified)
+        return UA_STATUSCODE_BADHISTORYOPERATIONUNSUPPORTED;
+
+    if(timestamps == UA_TIMESTAMPSTORETURN_NEITHER)
+        return UA_STATUSCODE_BADTIMESTAMPSTORETURNINVALID;
+
+    struct node_history *history = find_history(&node_to_read->nodeId);
+    if(history == NULL)
+        return UA_STATUSCODE_BADHISTORYOPERATIONUNSUPPORTED;
+
+    UA_DateTime start = details->startTime;
+    UA_DateTime end = details->endTime;
+    bool reverse = end != 0 && start > end; // The interval is read newest first
+    if(reverse) {
+        start = details->endTime;
+        end = details->startTime;
+    }
+
+    // Samples [low, high) are kept, a continuation point holds the index to resume at (the upper bound when read
+    // newest first). Samples overwritten since the previous call are skipped.
+    uint64_t low = history->written > history->capacity ? history->written - history->capacity : 0;
+    uint64_t high = history->written;
+
+    if(node_to_read->continuationPoint.length > 0) {
+        if(node_to_read->continuationPoint.length != sizeof(uint64_t))
+            return UA_STATUSCODE_BADCONTINUATIONPOINTINVALID;
+
+        uint64_t resume;
+        memcpy(&resume, node_to_read->continuationPoint.data, sizeof(uint64_t));
+        if(reverse && resume < high)
+            high = resume > low ? resume : low;
+        else if(!reverse && resume > low)
+            low = resume < high ? resume : high;
+    }
+
+    size_t count = 0;
+    bool more = false;
+    uint64_t resume = 0;
+    for(uint64_t n = 0; n < high - low; n++) {
+        uint64_t i = reverse ? high - 1 - n : low + n;
+        UA_DateTime timestamp = history->samples[i % history->capacity].source_timestamp;
+        if(timestamp < start || (end != 0 && timestamp > end))
+            continue;
+
+        if(details->numValuesPerNode != 0 && count == details->numValuesPerNode) {
+            more = true;
+            resume = reverse ? i + 1 : i;
+            break;
+        }
+
+        count++;
+    }
+
+    if(count == 0)
+        return UA_STATUSCODE_GOODNODATA;
+
+    history_data->dataValues = (UA_DataValue *) UA_Array_new(count, &UA_TYPES[UA_TYPES_DATAVALUE]);
+    if(!history_data->dataValues)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    history_data->dataValuesSize = count;
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    size_t index = 0;
+    for(uint64_t n = 0; index < count && retval == UA_STATUSCODE_GOOD; n++) {
+        uint64_t i = reverse ? high - 1 - n : low + n;
+        const struct history_sample *sample = &history->samples[i % history->capacity];
+        if(sample->source_timestamp < start || (end != 0 && sample->source_timestamp > end))
+            continue;
+
+        retval = copy_history_sample(sample, timestamps, &history_data->dataValues[index++]);
+    }
+
+    if(retval == UA_STATUSCODE_GOOD && more) {
+        retval = UA_ByteString_allocBuffer(continuation_point, sizeof(uint64_t));
+        if(retval == UA_STATUSCODE_GOOD)
+            memcpy(continuation_point->data, &resume, sizeof(uint64_t));
+    }
+
+    return retval;
+}
+
+static void history_read_raw(UA_Server *server, void *hdbContext, const UA_NodeId *sessionId, void *sessionContext,
+                             const UA_RequestHeader *requestHeader, const UA_ReadRawModifiedDetails *historyReadDetails,
+                             UA_TimestampsToReturn timestampsToReturn, UA_Boolean releaseContinuationPoints,
+                             size_t nodesToReadSize, const UA_HistoryReadValueId *nodesToRead,
+                             UA_HistoryReadResponse *response, UA_HistoryData * const * const historyData)
+{
+    // Continuation points are positions in the ring, releasing them frees nothing.
+    if(releaseContinuationPoints)
+        return;
+
+    pthread_mutex_lock(&histories_lock);
+    for(size_t i = 0; i < nodesToReadSize; i++)
+        response->results[i].statusCode = read_node_history_raw(historyReadDetails, timestampsToReturn,
+            &nodesToRead[i], &response->results[i].continuationPoint, historyData[i]);
+    pthread_mutex_unlock(&histories_lock);
+}
+
+/* Server calls are made without histories_lock, they may call the history hooks. */
+static UA_StatusCode configure_history(UA_Server *server, UA_NodeId *node_id, size_t capacity, UA_Double sampling)
+{
+    struct node_history *history;
+
+    if(capacity == 0) {
+        pthread_mutex_lock(&histories_lock);
+        history = find_history(node_id);
+        if(history != NULL) {
+            clear_history_samples(history);
+            UA_NodeId_clear(&history->node_id);
+            *history = histories[--histories_size];
+        }
+        pthread_mutex_unlock(&histories_lock);
+
+        return UA_Server_writeHistorizing(server, *node_id, false);
+    }
+
+    UA_Byte access_level;
+    UA_StatusCode retval = UA_Server_readAccessLevel(server, *node_id, &access_level);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_writeAccessLevel(server, *node_id, access_level | UA_ACCESSLEVELMASK_HISTORYREAD);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_writeHistorizing(server, *node_id, true);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    struct history_sample *samples = calloc(capacity, sizeof(struct history_sample));
+    if(!samples)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    pthread_mutex_lock(&histories_lock);
+    history = find_history(node_id);
+
+    if(history == NULL) {
+        struct node_history *resized = realloc(histories, (histories_size + 1) * sizeof(struct node_history));
+        if(!resized) {
+            pthread_mutex_unlock(&histories_lock);
+            free(samples);
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+
+        histories = resized;
+        history = &histories[histories_size++];
+        UA_NodeId_copy(node_id, &history->node_id);
+    }
+    else
+        clear_history_samples(history);
+
+    history->samples = samples;
+    history->capacity = capacity;
+    history->written = 0;
+    history->sampling = (UA_DateTime) (sampling * UA_DATETIME_MSEC);
+    pthread_mutex_unlock(&histories_lock);
+
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    if(config->historyDatabase.setValue != history_set_value) {
+        memset(&config->historyDatabase, 0, sizeof(UA_HistoryDatabase));
+        config->historyDatabase.deleteMembers = delete_histories;
+        config->historyDatabase.setValue = history_set_value;
+        config->historyDatabase.readRaw = history_read_raw;
+    }
+    config->accessHistoryDataCapability = true;
+
+    return UA_STATUSCODE_GOOD;
+}
+#endif
 
 /* 
- *  MonitoredItems are used with the Subscription mechanism of OPC UA to transported notifications for data changes and events. 
- *  MonitoredItems can also be registered locally. Notifications are then forwarded to a user-defined callback 
- *  instead of a remote client.
+ *  Keeps the last `capacity` samples of a variable node for HistoryRead ({node_id, capacity, sampling}), it also
+ *  sets its Historizing attribute and the HistoryRead bit of its AccessLevel. Configuring a node again starts an
+ *  empty history, a 0 capacity drops it.
  */
-void handle_add_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+static void handle_configure_history(void *entity, bool entity_type, const char *req, int *req_index)
 {
     int term_size;
-    int term_type;
-    UA_MonitoredItemCreateResult retval;
+    unsigned long capacity;
+    double sampling;
 
     if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
-        term_size != 2)
-        errx(EXIT_FAILURE, ":handle_add_monitored_item requires a 2-tuple, term_size = %d", term_size);
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_configure_history requires a 3-tuple, term_size = %d", term_size);
 
-    UA_NodeId monitored_node = assemble_node_id(req, req_index);
+    UA_NodeId node_id = assemble_node_id(req, req_index);
 
-    double sampling_interval;
-    if (ei_decode_double(req, req_index, &sampling_interval) < 0) {
+    if(ei_decode_ulong(req, req_index, &capacity) < 0 ||
+        ei_decode_double(req, req_index, &sampling) < 0 ||
+        capacity > HISTORY_MAX_CAPACITY || sampling < 0) {
+        UA_NodeId_clear(&node_id);
         send_error_response("einval");
         return;
     }
 
-    UA_MonitoredItemCreateRequest monitor_request = UA_MonitoredItemCreateRequest_default(monitored_node);
-    monitor_request.requestedParameters.samplingInterval = (UA_Double) sampling_interval;
-    
-    retval = UA_Server_createDataChangeMonitoredItem(server, UA_TIMESTAMPSTORETURN_SOURCE,
-                                            monitor_request, NULL, dataChangeNotificationCallback);
-    
-    UA_NodeId_clear(&monitored_node);
+#ifdef UA_ENABLE_HISTORIZING
+    UA_StatusCode retval = configure_history((UA_Server *)entity, &node_id, capacity, sampling);
+    UA_NodeId_clear(&node_id);
 
-    if(retval.statusCode != UA_STATUSCODE_GOOD) {
-        send_opex_response(retval.statusCode);
+    if(retval != UA_STATUSCODE_GOOD) {
+        send_opex_response(retval);
         return;
     }
 
-    send_data_response(&(retval.monitoredItemId), 27, 0);
+    send_ok_response();
+#else
+    UA_NodeId_clear(&node_id);
+    send_opex_response(UA_STATUSCODE_BADNOTSUPPORTED);
+#endif
 }
 
-void handle_delete_monitored_item(void *entity, bool entity_type, const char *req, int *req_index)
+/*****************/
+/* Shadow values */
+/*****************/
+
+/*  Shadow values
+ *
+ *  A shadow variable is backed by a DataSource whose read returns a slot of a flat table allocated once by
+ *  set_shadow_table, so publishing a value doesn't go through UA_Server_write (nor its monitored items and onWrite
+ *  callbacks): monitored items sample the slot. update_shadow_values carries many {handle, value} pairs in one
+ *  binary of 16 byte records in the host byte order, <<handle::32, kind::32, value::64>> where kind is
+ *  SHADOW_VALUE_INTEGER or SHADOW_VALUE_FLOAT.
+ *
+ *  While the server runs the stdin thread writes the slots itself, before queuing the request that the server
+ *  thread only answers. Every slot is a seqlock: the writer makes the sequence odd while it stores the value,
+ *  readers retry when the sequence was odd or changed, so the server thread never blocks on the stdin thread.
+ */
+#define SHADOW_MAX_VALUES (16 * 1024 * 1024)
+#define SHADOW_RECORD_SIZE 16
+
+enum shadow_value_kind {
+    SHADOW_VALUE_NONE = 0, // Never updated
+    SHADOW_VALUE_INTEGER = 1,
+    SHADOW_VALUE_FLOAT = 2
+};
+
+struct shadow_value {
+    uint32_t sequence; // Odd while the slot is written
+    uint32_t kind;
+    uint64_t bits; // int64_t or double
+    UA_DateTime source_timestamp;
+};
+
+// Only resized while the server doesn't run (no concurrent reader nor writer).
+static struct shadow_value *shadow_values = NULL;
+static size_t shadow_values_size = 0;
+
+static void shadow_value_store(struct shadow_value *slot, uint32_t kind, uint64_t bits, UA_DateTime source_timestamp)
+{
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->kind, kind, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->bits, bits, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->source_timestamp, source_timestamp, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+static void shadow_value_load(const struct shadow_value *slot, uint32_t *kind, uint64_t *bits,
+                              UA_DateTime *source_timestamp)
+{
+    uint32_t sequence;
+
+    do {
+        sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        *kind = __atomic_load_n(&slot->kind, __ATOMIC_RELAXED);
+        *bits = __atomic_load_n(&slot->bits, __ATOMIC_RELAXED);
+        *source_timestamp = __atomic_load_n(&slot->source_timestamp, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while((sequence & 1) || sequence != __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED));
+}
+
+static bool shadow_data_type_supported(unsigned long data_type)
+{
+    return (data_type >= UA_TYPES_BOOLEAN && data_type <= UA_TYPES_DOUBLE) || data_type == UA_TYPES_DATETIME;
+}
+
+/* Converts a slot to the `data_type` of its variable, floats only fit Float and Double variables. */
+static UA_StatusCode shadow_value_to_variant(unsigned long data_type, uint32_t kind, uint64_t bits, UA_Variant *value)
+{
+    union {
+        UA_Boolean boolean;
+        UA_SByte sbyte;
+        UA_Byte byte;
+        UA_Int16 int16;
+        UA_UInt16 uint16;
+        UA_Int32 int32;
+        UA_UInt32 uint32;
+        UA_Int64 int64;
+        UA_UInt64 uint64;
+        UA_Float float_value;
+        UA_Double double_value;
+    } scalar;
+    int64_t integer;
+    double real;
+
+    memcpy(&integer, &bits, sizeof(integer));
+    memcpy(&real, &bits, sizeof(real));
+
+    if(kind == SHADOW_VALUE_FLOAT && data_type != UA_TYPES_FLOAT && data_type != UA_TYPES_DOUBLE)
+        return UA_STATUSCODE_BADTYPEMISMATCH;
+
+    switch(data_type) {
+        case UA_TYPES_BOOLEAN: scalar.boolean = integer != 0; break;
+        case UA_TYPES_SBYTE: scalar.sbyte = (UA_SByte) integer; break;
+        case UA_TYPES_BYTE: scalar.byte = (UA_Byte) integer; break;
+        case UA_TYPES_INT16: scalar.int16 = (UA_Int16) integer; break;
+        case UA_TYPES_UINT16: scalar.uint16 = (UA_UInt16) integer; break;
+        case UA_TYPES_INT32: scalar.int32 = (UA_Int32) integer; break;
+        case UA_TYPES_UINT32: scalar.uint32 = (UA_UInt32) integer; break;
+        case UA_TYPES_INT64: scalar.int64 = integer; break;
+        case UA_TYPES_UINT64: scalar.uint64 = (UA_UInt64) integer; break;
+        case UA_TYPES_FLOAT:
+            scalar.float_value = kind == SHADOW_VALUE_FLOAT ? (UA_Float) real : (UA_Float) integer;
+        break;
+        case UA_TYPES_DOUBLE:
+            scalar.double_value = kind == SHADOW_VALUE_FLOAT ? real : (UA_Double) integer;
+        break;
+        case UA_TYPES_DATETIME: scalar.int64 = integer; break;
+        default:
+            return UA_STATUSCODE_BADTYPEMISMATCH;
+    }
+
+    return UA_Variant_setScalarCopy(value, &scalar, &UA_TYPES[data_type]);
+}
+
+/* The node context of a shadow variable is its handle and data type, (handle << 8) | data_type. */
+static UA_StatusCode read_shadow_value(UA_Server *server, const UA_NodeId *sessionId, void *sessionContext,
+                                       const UA_NodeId *nodeId, void *nodeContext, UA_Boolean sourceTimeStamp,
+                                       const UA_NumericRange *range, UA_DataValue *value)
+{
+    uintptr_t context = (uintptr_t) nodeContext;
+    size_t handle = context >> 8;
+    unsigned long data_type = context & 0xff;
+
+    if(range)
+        return UA_STATUSCODE_BADINDEXRANGEINVALID;
+
+    if(handle >= shadow_values_size)
+        return UA_STATUSCODE_BADNOTFOUND;
+
+    uint32_t kind;
+    uint64_t bits;
+    UA_DateTime source_timestamp;
+    shadow_value_load(&shadow_values[handle], &kind, &bits, &source_timestamp);
+
+    if(kind == SHADOW_VALUE_NONE)
+        return UA_STATUSCODE_BADWAITINGFORINITIALDATA;
+
+    UA_StatusCode retval = shadow_value_to_variant(data_type, kind, bits, &value->value);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    value->hasValue = true;
+    if(sourceTimeStamp) {
+        value->sourceTimestamp = source_timestamp;
+        value->hasSourceTimestamp = true;
+    }
+
+    return UA_STATUSCODE_GOOD;
+}
+
+/* 
+ *  Decodes the binary of an update_shadow_values request, writing the slots when `apply` is set. Returns the number
+ *  of records with a handle out of the table, they are skipped.
+ */
+static size_t update_shadow_values(const char *req, int *req_index, bool apply)
 {
     int term_size;
     int term_type;
 
-    unsigned long monitored_item_id;
-    if (ei_decode_ulong(req, req_index, &monitored_item_id) < 0) {
+    if(ei_get_type(req, req_index, &term_type, &term_size) < 0 || term_type != ERL_BINARY_EXT ||
+        term_size % SHADOW_RECORD_SIZE != 0)
+        errx(EXIT_FAILURE, ":update_shadow_values requires a binary of %d byte records", SHADOW_RECORD_SIZE);
+
+    // Read in place, past the tag and the 4 byte length of the binary.
+    const char *records = req + *req_index + 5;
+    if(ei_skip_term(req, req_index) < 0)
+        errx(EXIT_FAILURE, "Invalid shadow values");
+
+    UA_DateTime now = UA_DateTime_now();
+    size_t unknown = 0;
+
+    for(size_t offset = 0; offset < (size_t) term_size; offset += SHADOW_RECORD_SIZE) {
+        uint32_t handle;
+        uint32_t kind;
+        uint64_t bits;
+
+        memcpy(&handle, records + offset, sizeof(handle));
+        memcpy(&kind, records + offset + 4, sizeof(kind));
+        memcpy(&bits, records + offset + 8, sizeof(bits));
+
+        if(handle >= shadow_values_size || (kind != SHADOW_VALUE_INTEGER && kind != SHADOW_VALUE_FLOAT)) {
+            unknown++;
+            continue;
+        }
+
+        if(apply)
+            shadow_value_store(&shadow_values[handle], kind, bits, now);
+    }
+
+    return unknown;
+}
+
+/* 
+ *  Allocates the shadow table with `size` slots, existing slots keep their values. It can't be resized while the
+ *  server runs.
+ */
+static void handle_set_shadow_table(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    unsigned long size;
+    if (ei_decode_ulong(req, req_index, &size) < 0 || size > SHADOW_MAX_VALUES) {
         send_error_response("einval");
         return;
     }
-    
-    UA_StatusCode retval = UA_Server_deleteMonitoredItem(server, (UA_UInt32) monitored_item_id);
+
+    if(server_thread_active) {
+        send_opex_response(UA_STATUSCODE_BADINVALIDSTATE);
+        return;
+    }
+
+    if(size == 0) {
+        free(shadow_values);
+        shadow_values = NULL;
+        shadow_values_size = 0;
+        send_ok_response();
+        return;
+    }
+
+    struct shadow_value *resized = realloc(shadow_values, size * sizeof(struct shadow_value));
+    if(!resized) {
+        send_opex_response(UA_STATUSCODE_BADOUTOFMEMORY);
+        return;
+    }
+
+    if(size > shadow_values_size)
+        memset(resized + shadow_values_size, 0, (size - shadow_values_size) * sizeof(struct shadow_value));
+
+    shadow_values = resized;
+    shadow_values_size = size;
+    send_ok_response();
+}
+
+/* 
+ *  Backs a variable node with the slot `handle` of the shadow table ({node_id, handle, data_type}), `data_type`
+ *  (UA_TYPES index) is a number, a Boolean or a DateTime and should be the DataType of the node. The node can't be
+ *  written anymore.
+ */
+static void handle_set_shadow_variable(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    int term_size;
+    unsigned long handle;
+    unsigned long data_type;
+
+    if(ei_decode_tuple_header(req, req_index, &term_size) < 0 ||
+        term_size != 3)
+        errx(EXIT_FAILURE, ":handle_set_shadow_variable requires a 3-tuple, term_size = %d", term_size);
+
+    UA_NodeId node_id = assemble_node_id(req, req_index);
+
+    if(ei_decode_ulong(req, req_index, &handle) < 0 ||
+        ei_decode_ulong(req, req_index, &data_type) < 0 ||
+        handle >= shadow_values_size || !shadow_data_type_supported(data_type)) {
+        UA_NodeId_clear(&node_id);
+        send_error_response("einval");
+        return;
+    }
+
+    UA_DataSource data_source;
+    data_source.read = read_shadow_value;
+    data_source.write = NULL;
+
+    UA_StatusCode retval = UA_Server_setNodeContext((UA_Server *)entity, node_id,
+                                                    (void *) (uintptr_t) ((handle << 8) | data_type));
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = UA_Server_setVariableNode_dataSource((UA_Server *)entity, node_id, data_source);
+
+    UA_NodeId_clear(&node_id);
 
     if(retval != UA_STATUSCODE_GOOD) {
         send_opex_response(retval);
@@ -973,25 +3227,47 @@ void handle_delete_monitored_item(void *entity, bool entity_type, const char *re
     send_ok_response();
 }
 
+/* 
+ *  Writes the {handle, value} records of the binary to the shadow table. Once the server runs the stdin thread has
+ *  written them (see handle_elixir_request), only the handles are checked here.
+ */
+static void handle_update_shadow_values(void *entity, bool entity_type, const char *req, int *req_index)
+{
+    if(update_shadow_values(req, req_index, !server_thread_active) > 0) {
+        send_error_response("einval");
+        return;
+    }
+
+    send_ok_response();
+}
+
 /*******************************/
 /* Elixir -> C Message Handler */
 /*******************************/
 
-struct request_handler {
-    const char *name;
-    void (*handler)(void *entity, bool entity_type, const char *req, int *req_index);
-};
-
 /*  Elixir request handler table
- *  FIXME: Order roughly based on most frequent calls to least (WIP).
+ *  The position of a handler is its opcode, Elixir fetches the mapping with list_commands.
  */
 static struct request_handler request_handlers[] = {
     {"test", handle_test},
+    {"list_commands", handle_list_commands},
+    {"get_stats", handle_get_stats},
+    {"get_build_features", handle_get_build_features},
+    {"set_stats_interval", handle_set_stats_interval},
+    {"enable_shm_ring", handle_enable_shm_ring},
+    {"set_notification_queue", handle_set_notification_queue},
     // Reading and Writing Node Attributes ??
     // TODO: Add UA_Server_writeArrayDimensions, 
     {"write_node_value", handle_write_node_value},
+    {"write_node_values", handle_write_node_values},
     {"read_node_value", handle_read_node_value},
     {"read_node_value_by_index", handle_read_node_value_by_index},
+    {"read_node_value_packed", handle_read_node_value_packed},
+    {"read_node_value_range", handle_read_node_value_range},
+    {"read_node_values", handle_read_node_values},
+    {"register_nodes", handle_register_nodes},
+    {"unregister_nodes", handle_unregister_nodes},
+    {"browse_tree", handle_browse_tree},
     {"write_node_browse_name", handle_write_node_browse_name},
     {"write_node_display_name", handle_write_node_display_name},
     {"write_node_description", handle_write_node_description},
@@ -1006,6 +3282,8 @@ static struct request_handler request_handlers[] = {
     {"write_node_historizing", handle_write_node_historizing},
     {"write_node_executable", handle_write_node_executable},
     {"write_node_blank_array", handle_write_node_blank_array},
+    {"write_node_array", handle_write_node_array},
+    {"write_node_value_range", handle_write_node_value_range},
     {"read_node_node_id", handle_read_node_node_id},
     {"read_node_node_class", handle_read_node_node_class},
     {"read_node_browse_name", handle_read_node_browse_name},
@@ -1026,6 +3304,15 @@ static struct request_handler request_handlers[] = {
     // Local MonitoredItems
     {"add_monitored_item", handle_add_monitored_item},
     {"delete_monitored_item", handle_delete_monitored_item},
+    {"set_notification_batch_size", handle_set_notification_batch_size},
+    {"set_write_batch", handle_set_write_batch},
+    {"set_write_forwarding", handle_set_write_forwarding},
+    // History
+    {"configure_history", handle_configure_history},
+    // Shadow values
+    {"set_shadow_table", handle_set_shadow_table},
+    {"set_shadow_variable", handle_set_shadow_variable},
+    {"update_shadow_values", handle_update_shadow_values},
     // Node Addition and Deletion
     {"add_namespace", handle_add_namespace},
     {"add_variable_node", handle_add_variable_node},
@@ -1036,6 +3323,9 @@ static struct request_handler request_handlers[] = {
     {"add_reference_type_node", handle_add_reference_type_node},
     {"add_data_type_node", handle_add_data_type_node},
     {"add_reference", handle_add_reference},
+    {"load_address_space", handle_load_address_space},
+    {"save_nodeset", handle_save_nodeset},
+    {"load_nodeset", handle_load_nodeset},
     {"delete_reference", handle_delete_reference},
     {"delete_node", handle_delete_node},
     // configuration & lifecycle functions
@@ -1045,6 +3335,7 @@ static struct request_handler request_handlers[] = {
     {"set_network_tcp_layer", handle_set_network_tcp_layer},
     {"set_hostname", handle_set_hostname},
     {"set_port", handle_set_port},
+    {"set_worker_threads", handle_set_worker_threads},
     {"set_users", handle_set_users_and_passwords},
     {"add_all_endpoints", handle_add_all_endpoints},
     {"start_server", handle_start_server},
@@ -1065,17 +3356,14 @@ static struct request_handler request_handlers[] = {
 
 
 /**
- * @brief Decode and forward requests from Elixir to the appropriate handlers
+ * @brief Decode and execute a request from Elixir with the appropriate handler
  * @param req the undecoded request
- * @param cookie
  */
-static void handle_elixir_request(const char *req, void *cookie)
+static void dispatch_elixir_request(const char *req)
 {
-    (void) cookie;
-
     // Commands are of the form {Command, Arguments}:
     // {atom(), {pid(), ref()}, term()}
-    int req_index = sizeof(uint16_t);
+    int req_index = erlcmd_packet_size();
     if (ei_decode_version(req, &req_index, NULL) < 0)
         errx(EXIT_FAILURE, "Message version issue?");
 
@@ -1084,39 +3372,74 @@ static void handle_elixir_request(const char *req, void *cookie)
             arity != 3)
         errx(EXIT_FAILURE, "expecting {cmd, {pid, ref}, args} tuple");
 
-    char cmd[MAXATOMLEN];
-    if (ei_decode_atom(req, &req_index, cmd) < 0)
-        errx(EXIT_FAILURE, "expecting command atom");
-    
-    //execute all handler
-    for (struct request_handler *rh = request_handlers; rh->name != NULL; rh++) {
-        if (strcmp(cmd, rh->name) == 0) {
-            handle_caller_metadata(req, &req_index, cmd);
-            rh->handler(server, 0, req, &req_index);
-            free_caller_metadata();
-            return;
-        }
+    const struct request_handler *rh = decode_request_handler(req, &req_index);
+
+    handle_caller_metadata(req, &req_index, rh->name);
+    call_request_handler(rh, server, 0, req, &req_index);
+    reset_request_context();
+}
+
+/**
+ * @brief Forward requests from Elixir to the server thread once it is running, execute them directly otherwise
+ * @param req the undecoded request
+ * @param cookie
+ */
+static void handle_elixir_request(const char *req, void *cookie)
+{
+    (void) cookie;
+
+    if(!server_thread_active) {
+        dispatch_elixir_request(req);
+        return;
+    }
+
+    // Peek at the command, shadow values are written by this thread (the server thread answers the request).
+    int req_index = erlcmd_packet_size();
+    int arity;
+    const struct request_handler *rh = NULL;
+    if (ei_decode_version(req, &req_index, NULL) == 0 &&
+            ei_decode_tuple_header(req, &req_index, &arity) == 0)
+        rh = decode_request_handler(req, &req_index);
+
+    if (rh && rh->handler == handle_update_shadow_values && ei_skip_term(req, &req_index) == 0)
+        update_shadow_values(req, &req_index, true);
+
+    command_queue_push(req);
+
+    // The server thread exits after stop_server so requests run here again.
+    if (rh && rh->handler == handle_stop_server) {
+        pthread_join(server_tid, NULL);
+        server_thread_active = false;
     }
-    // no listed function
-    errx(EXIT_FAILURE, "unknown command: %s", cmd);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    // `--packet 4` selects a 4-byte length prefix ({:packet, 4} in Elixir).
+    if (argc > 2 && strcmp(argv[1], "--packet") == 0)
+        erlcmd_set_packet_size(strtoul(argv[2], NULL, 10));
+
     server = UA_Server_new();
 
     struct erlcmd *handler = malloc(sizeof(struct erlcmd));
+    init_request_handlers(request_handlers);
     erlcmd_init(handler, handle_elixir_request, NULL);
 
     for (;;) {
-        struct pollfd fdset;
+        struct pollfd fdset[2];
+
+        fdset[0].fd = STDIN_FILENO;
+        fdset[0].events = POLLIN;
+        fdset[0].revents = 0;
 
-        fdset.fd = STDIN_FILENO;
-        fdset.events = POLLIN;
-        fdset.revents = 0;
+        // Output Elixir didn't take yet (see set_notification_queue), the server thread writes it while it runs.
+        fdset[1].fd = STDOUT_FILENO;
+        fdset[1].events = POLLOUT;
+        fdset[1].revents = 0;
 
-        int timeout = -1; // Wait forever unless told by otherwise
-        int rc = poll(&fdset, 1, timeout);
+        // Wait forever unless statistics are pushed, the server thread pushes them while it runs.
+        int timeout = server_thread_active ? -1 : stats_push_timeout();
+        int rc = poll(fdset, !server_thread_active && erlcmd_pending_size() > 0 ? 2 : 1, timeout);
 
         if (rc < 0) {
             // Retry if EINTR
@@ -1126,18 +3449,31 @@ int main()
             err(EXIT_FAILURE, "poll");
         }
 
-        if (fdset.revents & (POLLIN | POLLHUP)) {
+        if (fdset[0].revents & (POLLIN | POLLHUP)) {
             if (erlcmd_process(handler))
                 break;
         }
+
+        if(!server_thread_active) {
+            flush_notification_queue();
+            push_stats_if_due();
+        }
     }
     
     /* Disconnects the client internally */
     free(handler);
-    running = false;
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+    // Release threads memory
+    if(server_thread_active)
+        pthread_join(server_tid, NULL);
+
+    // Requests that arrived after the last iteration are dropped.
+    char *msg;
+    while((msg = command_queue_pop()) != NULL)
+        free(msg);
+
     delete_users_list();
     delete_discovery_params();
-    // Release threads memory
-    pthread_join(server_tid, NULL);
     UA_Server_delete(server); 
+    free(shadow_values);
 }
\ No newline at end of file
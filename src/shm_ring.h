@@ -0,0 +1,32 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+
+/*
+ * Shared memory ring between a port (single producer) and OpcUA.ShmRing (single consumer, the port owner).
+ *
+ * Records are a uint32_t length followed by an encoded term (version byte included), padded to 8 bytes. A record
+ * never wraps, SHM_RING_WRAP tells the consumer to continue at the start of the data. For every record the port
+ * sends a one byte doorbell message ('s') through the pipe, so records and pipe messages keep their order.
+ */
+#define SHM_RING_MAGIC 0x6f706578 // "opex"
+#define SHM_RING_WRAP UINT32_MAX
+#define SHM_RING_ALIGN 8
+#define SHM_RING_RECORD_SIZE(len) ((sizeof(uint32_t) + (len) + SHM_RING_ALIGN - 1) & ~((uint64_t) SHM_RING_ALIGN - 1))
+#define SHM_RING_DOORBELL 's'
+
+struct shm_ring_header {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t capacity; // Data bytes, a multiple of SHM_RING_ALIGN
+    char pad0[48]; // head and tail on their own cache lines
+    uint64_t head; // Bytes written, only the producer writes it
+    char pad1[56];
+    uint64_t tail; // Bytes consumed, only the consumer writes it
+    char pad2[56];
+};
+
+#define SHM_RING_DATA(header) ((char *) (header) + sizeof(struct shm_ring_header))
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ *  Consumer side of the shared memory ring (see shm_ring.h), loaded by OpcUA.ShmRing in the port owner process.
+ *
+ *  open/1 maps the ring created by a port (enable_shm_ring) and unlinks its name, read/1 decodes the oldest record
+ *  straight from the ring memory and releases it. Only the owner of a ring reads it, so the tail has a single writer.
+ */
+#include <erl_nif.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shm_ring.h"
+
+struct shm_ring {
+    struct shm_ring_header *header;
+    size_t size;
+};
+
+static ErlNifResourceType *shm_ring_type = NULL;
+static ERL_NIF_TERM atom_ok;
+static ERL_NIF_TERM atom_error;
+static ERL_NIF_TERM atom_empty;
+
+static void shm_ring_destructor(ErlNifEnv *env, void *obj)
+{
+    struct shm_ring *ring = obj;
+
+    if(ring->header != NULL)
+        munmap(ring->header, ring->size);
+}
+
+static ERL_NIF_TERM error_tuple(ErlNifEnv *env, const char *reason)
+{
+    return enif_make_tuple2(env, atom_error, enif_make_atom(env, reason));
+}
+
+/* open(name) :: {:ok, ring} | {:error, reason} */
+static ERL_NIF_TERM shm_ring_open(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    char name[64];
+
+    if(enif_get_string(env, argv[0], name, sizeof(name), ERL_NIF_LATIN1) <= 0)
+        return enif_make_badarg(env);
+
+    int fd = shm_open(name, O_RDWR, 0600);
+    if(fd < 0)
+        return error_tuple(env, "enoent");
+
+    // Nothing else needs the name once it is mapped
+    shm_unlink(name);
+
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && (size_t) st.st_size > sizeof(struct shm_ring_header))
+        mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(mapping == MAP_FAILED)
+        return error_tuple(env, "enomem");
+
+    struct shm_ring_header *header = mapping;
+    if(header->magic != SHM_RING_MAGIC || header->capacity + sizeof(struct shm_ring_header) > (size_t) st.st_size) {
+        munmap(mapping, st.st_size);
+        return error_tuple(env, "einval");
+    }
+
+    struct shm_ring *ring = enif_alloc_resource(shm_ring_type, sizeof(struct shm_ring));
+    ring->header = header;
+    ring->size = st.st_size;
+
+    ERL_NIF_TERM term = enif_make_resource(env, ring);
+    enif_release_resource(ring);
+
+    return enif_make_tuple2(env, atom_ok, term);
+}
+
+/* read(ring) :: {:ok, term} | :empty | {:error, :einval} */
+static ERL_NIF_TERM shm_ring_read(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    struct shm_ring *ring;
+
+    if(!enif_get_resource(env, argv[0], shm_ring_type, (void **) &ring))
+        return enif_make_badarg(env);
+
+    struct shm_ring_header *header = ring->header;
+    uint64_t capacity = header->capacity;
+    uint64_t tail = header->tail;
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    char *data = SHM_RING_DATA(header);
+    uint32_t len;
+
+    if(head == tail)
+        return atom_empty;
+
+    memcpy(&len, data + tail % capacity, sizeof(len));
+    if(len == SHM_RING_WRAP) {
+        tail += capacity - tail % capacity;
+        if(head == tail)
+            return atom_empty;
+
+        memcpy(&len, data, sizeof(len));
+    }
+
+    uint64_t record = SHM_RING_RECORD_SIZE(len);
+    if(record > head - tail)
+        return error_tuple(env, "einval");
+
+    ERL_NIF_TERM term;
+    const unsigned char *payload = (const unsigned char *) data + tail % capacity + sizeof(uint32_t);
+    size_t decoded = enif_binary_to_term(env, payload, len, &term, 0);
+
+    __atomic_store_n(&header->tail, tail + record, __ATOMIC_RELEASE);
+
+    if(decoded == 0)
+        return error_tuple(env, "einval");
+
+    return enif_make_tuple2(env, atom_ok, term);
+}
+
+static ERL_NIF_TERM shm_ring_loaded(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    return enif_make_atom(env, "true");
+}
+
+static int load(ErlNifEnv *env, void **priv_data, ERL_NIF_TERM load_info)
+{
+    shm_ring_type = enif_open_resource_type(env, NULL, "shm_ring", shm_ring_destructor, ERL_NIF_RT_CREATE, NULL);
+    if(shm_ring_type == NULL)
+        return -1;
+
+    atom_ok = enif_make_atom(env, "ok");
+    atom_error = enif_make_atom(env, "error");
+    atom_empty = enif_make_atom(env, "empty");
+    return 0;
+}
+
+static ErlNifFunc nif_funcs[] = {
+    {"open", 1, shm_ring_open, 0},
+    {"read", 1, shm_ring_read, 0},
+    {"loaded?", 0, shm_ring_loaded, 0}
+};
+
+ERL_NIF_INIT(Elixir.OpcUA.ShmRing, nif_funcs, load, NULL, NULL, NULL)
@@ -233,4 +233,50 @@ defmodule ClientArraysTest do
     resp = Client.read_node_value(state.c_pid, node_id)
     assert resp == {:ok, [node_id, node_id, node_id, node_id]}
   end
+
+  test "write several array elements in one request", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    unknown_node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "Unknown")
+
+    resp =
+      Client.write_node_values(state.c_pid, [
+        {node_id, 11, "alde103_1", 0},
+        {node_id, 11, "alde103_3", 2},
+        {node_id, 11, "alde103_error", 4},
+        {unknown_node_id, 11, "alde103"}
+      ])
+
+    assert resp == {:ok, [:ok, :ok, {:error, "BadTypeMismatch"}, {:error, "BadNodeIdUnknown"}]}
+
+    resp = Client.read_node_value(state.c_pid, node_id)
+    assert resp == {:ok, ["alde103_1", "", "alde103_3", ""]}
+  end
+
+  test "write/read array node slices by index range", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    :ok = Server.write_node_blank_array(state.s_pid, node_id, 10, [4])
+
+    resp = Client.write_node_value_range(state.c_pid, node_id, "1:2", 10, [103.0, 103103.0])
+    assert resp == :ok
+
+    resp = Client.read_node_value(state.c_pid, node_id)
+    assert resp == {:ok, [0.0, 103.0, 103103.0, 0.0]}
+
+    resp = Client.read_node_value_range(state.c_pid, node_id, "2:3")
+    assert resp == {:ok, [103103.0, 0.0]}
+
+    resp = Client.read_node_value_range(state.c_pid, node_id, "1")
+    assert resp == {:ok, [103.0]}
+
+    {:ok, packed_array} = Client.read_node_value_range(state.c_pid, node_id, "1:2", packed: true)
+    assert OpcUA.PackedArray.to_list(packed_array) == [103.0, 103103.0]
+
+    # Packed slices can be written back.
+    resp = Client.write_node_value_range(state.c_pid, node_id, "2:3", 10, packed_array.data)
+    assert resp == :ok
+    assert {:ok, [0.0, 103.0, 103.0, 103103.0]} == Server.read_node_value(state.s_pid, node_id)
+
+    assert {:error, _reason} = Client.read_node_value_range(state.c_pid, node_id, "4:5")
+    assert {:error, _reason} = Client.write_node_value_range(state.c_pid, node_id, "0:1", 10, [1.0])
+  end
 end
@@ -65,4 +65,28 @@ defmodule ClientConnectionTest do
     assert :ok == Client.connect_by_username(c_pid, url: url, user: user, password: password)
     assert {:ok, "Session"} == Client.get_state(c_pid)
   end
+
+  test "Client sessions sharing a port", %{c_pid: c_pid} do
+    {:ok, session_1} = Client.start_link(session_of: c_pid)
+    {:ok, session_2} = Client.start_link(session_of: c_pid)
+    :ok = Client.set_config(session_1)
+    :ok = Client.set_config(session_2)
+
+    assert :ok == Client.connect_by_url(session_1, url: "opc.tcp://localhost:4001/")
+    assert :ok == Client.connect_by_username(session_2, url: "opc.tcp://localhost:4002/", user: "alde103", password: "secret")
+
+    assert {:ok, "Disconnected"} == Client.get_state(c_pid)
+    assert {:ok, "Session"} == Client.get_state(session_1)
+    assert {:ok, "Session"} == Client.get_state(session_2)
+
+    assert :ok == Client.disconnect(session_1)
+    assert {:ok, "Disconnected"} == Client.get_state(session_1)
+    assert {:ok, "Session"} == Client.get_state(session_2)
+
+    # Closing a session doesn't affect the others.
+    :ok = Client.stop(session_2)
+    assert {:ok, "Disconnected"} == Client.get_state(session_1)
+
+    assert {:error, :einval} == Client.command(session_1, {:session, :new})
+  end
 end
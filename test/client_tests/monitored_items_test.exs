@@ -75,7 +75,7 @@ defmodule ClientMonitoredItemsTest do
     :ok = Client.set_config(c_pid)
     :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4005/")
 
-    %{c_pid: c_pid, ns_index: ns_index}
+    %{c_pid: c_pid, s_pid: pid, ns_index: ns_index}
   end
 
   test "Add & delete a Subscription & Monitored Item", state do
@@ -133,4 +133,131 @@ defmodule ClientMonitoredItemsTest do
     #refute receive
     refute_received({:data, 1, 2, 104104.0})
   end
+
+  test "Notifications arrive without further client requests", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    assert {:ok, 1} == Client.add_subscription(state.c_pid)
+    assert {:ok, 1} == Client.add_monitored_item(state.c_pid, monitored_item: node_id, subscription_id: 1)
+
+    # Only the server is touched from here on, the client port must keep publishing on its own.
+    assert :ok == Server.write_node_value(state.s_pid, node_id, 10, 205.0)
+    assert_receive({:data, 1, 1, 205.0}, 3000)
+
+    assert :ok == Server.write_node_value(state.s_pid, node_id, 10, 206.0)
+    assert_receive({:data, 1, 1, 206.0}, 3000)
+  end
+
+  test "Batched notifications", state do
+    node_id_1 = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    node_id_2 = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Volts")
+
+    assert :ok == Client.set_notification_batch_size(state.c_pid, 100)
+
+    assert {:ok, 1} == Client.add_subscription(state.c_pid)
+    assert {:ok, 1} == Client.add_monitored_item(state.c_pid, monitored_item: node_id_1, subscription_id: 1)
+    assert {:ok, 2} == Client.add_monitored_item(state.c_pid, monitored_item: node_id_2, subscription_id: 1)
+
+    assert :ok == Server.write_node_value(state.s_pid, node_id_1, 10, 301.0)
+    assert :ok == Server.write_node_value(state.s_pid, node_id_2, 10, 302.0)
+
+    items = receive_batches([], 2)
+    assert {1, 1, 301.0} in items
+    assert {1, 2, 302.0} in items
+
+    refute_received({:data, 1, _, _})
+  end
+
+  test "Read cached values of monitored nodes", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    uncached_node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Volts")
+
+    assert :ok == Server.write_node_value(state.s_pid, node_id, 10, 205.0)
+    assert :ok == Server.write_node_value(state.s_pid, uncached_node_id, 10, 12.0)
+
+    assert {:ok, 1} == Client.add_subscription(state.c_pid)
+    assert {:ok, 1} == Client.add_monitored_item(state.c_pid, monitored_item: node_id, subscription_id: 1, cache: true)
+    assert_receive({:data, 1, 1, 205.0}, 3000)
+
+    assert {:ok, %{value: 205.0, cached: true, source_timestamp: ts}} = Client.read_cached_value(state.c_pid, node_id)
+    assert is_integer(ts)
+
+    # Stale entries and nodes without cache are read from the server.
+    Process.sleep(20)
+    assert {:ok, %{value: 205.0, cached: false}} = Client.read_cached_value(state.c_pid, node_id, 10)
+    assert {:ok, %{value: 12.0, cached: false}} = Client.read_cached_value(state.c_pid, uncached_node_id)
+
+    assert :ok == Server.write_node_value(state.s_pid, node_id, 10, 206.0)
+    assert_receive({:data, 1, 1, 206.0}, 3000)
+    assert {:ok, %{value: 206.0, cached: true}} = Client.read_cached_value(state.c_pid, node_id, 1000)
+
+    assert :ok == Client.delete_monitored_item(state.c_pid, subscription_id: 1, monitored_item_id: 1)
+    assert {:ok, %{value: 206.0, cached: false}} = Client.read_cached_value(state.c_pid, node_id)
+  end
+
+  test "Monitored item with an absolute deadband", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    assert {:error, :einval} ==
+             Client.add_monitored_item(state.c_pid, monitored_item: node_id, subscription_id: 1, deadband: {:relative, 1.0})
+
+    assert {:ok, 1} == Client.add_subscription(state.c_pid, 100.0)
+
+    assert {:ok, 1} ==
+             Client.add_monitored_item(state.c_pid,
+               monitored_item: node_id,
+               subscription_id: 1,
+               sampling_time: 50.0,
+               deadband: {:absolute, 10.0},
+               trigger: :status_value,
+               queue_size: 1,
+               discard_oldest: true
+             )
+
+    assert :ok == Server.write_node_value(state.s_pid, node_id, 10, 100.0)
+    assert_receive({:data, 1, 1, 100.0}, 3000)
+
+    # Within the deadband, filtered by the server.
+    assert :ok == Server.write_node_value(state.s_pid, node_id, 10, 100.5)
+    Process.sleep(300)
+    assert :ok == Server.write_node_value(state.s_pid, node_id, 10, 120.0)
+    assert_receive({:data, 1, 1, 120.0}, 3000)
+
+    refute_received({:data, 1, 1, 100.5})
+  end
+
+  test "Subscriptions are recreated after a lost connection", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    assert {:error, :einval} == Client.set_reconnect(state.c_pid, min_interval: 100, max_interval: 50)
+    assert :ok == Client.set_reconnect(state.c_pid, min_interval: 50, max_interval: 200)
+
+    assert {:ok, [registered]} = Client.register_nodes(state.c_pid, [node_id])
+
+    assert {:ok, 1} == Client.add_subscription(state.c_pid)
+    assert {:ok, 1} == Client.add_monitored_item(state.c_pid, monitored_item: node_id, subscription_id: 1)
+    assert {:ok, 2} == Client.add_monitored_item(state.c_pid, monitored_item: registered, subscription_id: 1)
+
+    assert :ok == Server.stop_server(state.s_pid)
+    Process.sleep(500)
+    assert :ok == Server.start(state.s_pid)
+
+    assert_receive({:reconnected, %{subscriptions: 1, monitored_items: 2, failed: 0}}, 10_000)
+    refute_received({:delete, 1})
+
+    # Same ids as before the connection was lost, the handle was registered with the new session.
+    assert :ok == Server.write_node_value(state.s_pid, node_id, 10, 405.0)
+    assert_receive({:data, 1, 1, 405.0}, 3000)
+    assert_receive({:data, 1, 2, 405.0}, 3000)
+    assert {:ok, 405.0} == Client.read_node_value(state.c_pid, registered)
+  end
+
+  defp receive_batches(items, 0), do: items
+
+  defp receive_batches(items, pending) do
+    assert_receive({:data_batch, batch}, 3000)
+    assert is_list(batch)
+    found = Enum.count(batch, fn {_, _, value} -> value in [301.0, 302.0] end)
+    receive_batches(items ++ batch, max(pending - found, 0))
+  end
 end
@@ -106,7 +106,7 @@ defmodule ClientWriteAttrTest do
     :ok = Client.set_config(c_pid)
     :ok = Client.connect_by_url(c_pid, url: "opc.tcp://localhost:4007/")
 
-    %{c_pid: c_pid, ns_index: ns_index}
+    %{c_pid: c_pid, s_pid: s_pid, ns_index: ns_index}
   end
 
   test "Write and Read Attributes", %{c_pid: c_pid, ns_index: ns_index} do
@@ -406,4 +406,170 @@ defmodule ClientWriteAttrTest do
     c_response = Client.read_node_value_by_data_type(c_pid, node_id, 29)
     assert c_response == {:ok, {103.0999984741211, 103.0}}
   end
+
+  test "Read several attributes in one request", %{c_pid: c_pid, ns_index: ns_index} do
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    var_node_id = NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 10001)
+    unknown_node_id = NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 404)
+
+    assert :ok == Client.write_node_value(c_pid, node_id, 1, 21)
+
+    c_response =
+      Client.read_node_values(c_pid, [
+        {node_id, :value},
+        {node_id, :browse_name},
+        {var_node_id, :access_level},
+        {unknown_node_id, :value}
+      ])
+
+    assert c_response ==
+             {:ok,
+              [
+                {:ok, 21},
+                {:ok, QualifiedName.new(ns_index: ns_index, name: "Temperature")},
+                {:ok, 3},
+                {:error, "BadNodeIdUnknown"}
+              ]}
+
+    assert Client.read_node_values(c_pid, []) == {:ok, []}
+  end
+
+  test "Pipelined asynchronous reads and writes", %{c_pid: c_pid, ns_index: ns_index} do
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    unknown_node_id = NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 404)
+
+    c_response = Client.write_node_values_async(c_pid, [{node_id, 1, 21}, {unknown_node_id, 1, 21}])
+    assert c_response == {:ok, [:ok, {:error, "BadNodeIdUnknown"}]}
+
+    assert Client.write_node_values_async(c_pid, [{node_id, 1, 21, 0}]) == {:error, :einval}
+
+    results =
+      1..10
+      |> Enum.map(fn _ -> Task.async(fn -> Client.read_node_values_async(c_pid, [{node_id, :value}]) end) end)
+      |> Enum.map(&Task.await/1)
+
+    assert results == List.duplicate({:ok, [{:ok, 21}]}, 10)
+
+    assert Client.read_node_values_async(c_pid, [{unknown_node_id, :value}]) ==
+             {:ok, [{:error, "BadNodeIdUnknown"}]}
+
+    assert Client.read_node_values_async(c_pid, []) == {:ok, []}
+  end
+
+  test "Read and write registered nodes", %{c_pid: c_pid, ns_index: ns_index} do
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    assert {:ok, [%NodeId{handle: handle} = registered]} = Client.register_nodes(c_pid, [node_id])
+    assert is_integer(handle)
+
+    assert :ok == Client.write_node_value(c_pid, registered, 1, 22)
+    assert {:ok, 22} == Client.read_node_value(c_pid, registered)
+    assert {:ok, 22} == Client.read_node_value(c_pid, node_id)
+    assert {:ok, [{:ok, 22}]} == Client.read_node_values(c_pid, [{registered, :value}])
+
+    assert {:error, :einval} == Client.unregister_nodes(c_pid, [node_id])
+    assert {:ok, [node_id]} == Client.unregister_nodes(c_pid, [registered])
+    assert {:error, :einval} == Client.unregister_nodes(c_pid, [registered])
+
+    # Released handles are rejected.
+    assert {:error, :einval} == Client.read_node_value(c_pid, registered)
+    assert {:error, :einval} == Client.write_node_value(c_pid, registered, 1, 23)
+    assert {:error, :einval} == Client.read_node_values(c_pid, [{node_id, :value}, {registered, :value}])
+    assert {:ok, 22} == Client.read_node_value(c_pid, node_id)
+
+    # The released slot is reused with another handle, the old one still names no node.
+    other_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Sensor")
+    assert {:ok, [%NodeId{handle: other_handle} = other]} = Client.register_nodes(c_pid, [other_id])
+    assert other_handle != handle
+    assert {:error, :einval} == Client.read_node_value(c_pid, registered)
+    assert {:ok, _browse_name} = Client.read_node_browse_name(c_pid, other)
+    assert Client.read_node_browse_name(c_pid, other) == Client.read_node_browse_name(c_pid, other_id)
+    assert {:ok, [other_id]} == Client.unregister_nodes(c_pid, [other])
+
+    assert {:ok, []} == Client.register_nodes(c_pid, [])
+  end
+
+  @tag feature: :historizing
+  test "Read the in-memory history of a node", %{c_pid: c_pid, s_pid: s_pid, ns_index: ns_index} do
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    assert :ok == Server.configure_history(s_pid, node_id, 5)
+    assert {:ok, true} == Client.read_node_historizing(c_pid, node_id)
+
+    for value <- 1..7, do: :ok = Client.write_node_value(c_pid, node_id, 1, value)
+
+    # Only the last 5 values are kept.
+    assert {:ok, values} = Client.history_read_raw(c_pid, node_id)
+    assert [3, 4, 5, 6, 7] == Enum.map(values, & &1.value)
+    assert Enum.all?(values, &(is_integer(&1.source_timestamp) and &1.status == nil))
+
+    # Continuation points are followed, up to max_values.
+    assert {:ok, [%{value: 3}, %{value: 4}]} = Client.history_read_raw(c_pid, node_id, max_values: 2)
+
+    [_, _, %{source_timestamp: start_time}, _, %{source_timestamp: end_time}] = values
+
+    assert {:ok, [%{value: 5}, %{value: 6}, %{value: 7}]} =
+             Client.history_read_raw(c_pid, node_id, start_time: start_time, end_time: end_time)
+
+    # A start time after the end time reads the interval newest first.
+    assert {:ok, [%{value: 7}, %{value: 6}, %{value: 5}]} =
+             Client.history_read_raw(c_pid, node_id, start_time: end_time, end_time: start_time)
+
+    assert {:ok, [%{value: 7}, %{value: 6}]} =
+             Client.history_read_raw(c_pid, node_id, start_time: end_time, end_time: start_time, max_values: 2)
+
+    assert :ok == Server.configure_history(s_pid, node_id, 0)
+    assert {:error, "BadHistoryOperationUnsupported"} == Client.history_read_raw(c_pid, node_id)
+
+    assert {:error, :einval} == Server.configure_history(s_pid, node_id, 5, sampling: -1.0)
+    assert {:error, :einval} == Client.history_read_raw(c_pid, node_id, max_values: -1)
+  end
+
+  @tag without: :historizing
+  test "History needs the historizing profile", %{c_pid: c_pid, s_pid: s_pid, ns_index: ns_index} do
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    assert {:error, "BadNotSupported"} == Server.configure_history(s_pid, node_id, 5)
+    assert {:error, "BadNotSupported"} == Client.history_read_raw(c_pid, node_id)
+  end
+
+  test "Browse a subtree in one call", %{c_pid: c_pid, ns_index: ns_index} do
+    objects_folder = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+    object_node_id = NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 10002)
+    var_node_id = NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 10001)
+    sensor_node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Sensor")
+    temperature_node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    assert {:ok, nodes} = Client.browse_tree(c_pid, objects_folder, attributes: [:node_class, 13])
+
+    # Every node is reported once, parents before their children.
+    node_ids = Enum.map(nodes, & &1.node_id)
+    assert node_ids == Enum.uniq(node_ids)
+
+    assert %{parent_node_id: ^objects_folder, depth: 1, node_class: 1} =
+             object = Enum.find(nodes, &(&1.node_id == object_node_id))
+
+    assert %{parent_node_id: ^object_node_id, depth: 2, node_class: 2} =
+             var = Enum.find(nodes, &(&1.node_id == var_node_id))
+
+    assert Enum.find_index(nodes, &(&1 == object)) < Enum.find_index(nodes, &(&1 == var))
+    assert %{node_class: {:ok, 2}, 13 => {:ok, _value}} = var.attributes
+
+    assert %{parent_node_id: ^sensor_node_id} = Enum.find(nodes, &(&1.node_id == temperature_node_id))
+
+    # Only the first level.
+    assert {:ok, level} = Client.browse_tree(c_pid, objects_folder, max_depth: 1)
+    assert Enum.all?(level, &(&1.depth == 1 and &1.attributes == %{}))
+    refute Enum.any?(level, &(&1.node_id == var_node_id))
+
+    # Objects only.
+    assert {:ok, objects} = Client.browse_tree(c_pid, objects_folder, node_class_mask: 1)
+    assert Enum.any?(objects, &(&1.node_id == sensor_node_id))
+    refute Enum.any?(objects, &(&1.node_id == temperature_node_id))
+
+    unknown = NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 99999)
+    assert {:error, "BadNodeIdUnknown"} == Client.browse_tree(c_pid, unknown)
+    assert {:error, :einval} == Client.browse_tree(c_pid, objects_folder, max_depth: -1)
+    assert {:error, :einval} == Client.browse_tree(c_pid, objects_folder, attributes: [:unknown])
+  end
 end
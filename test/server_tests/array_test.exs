@@ -172,4 +172,120 @@ defmodule ServerArrayTest do
     resp = Server.write_node_blank_array(state.pid, node_id, 30, [2, 2])
     assert resp == :ok
   end
+
+  test "read large array value node with 4-byte framing" do
+    {:ok, pid} = OpcUA.Server.start_link(packet: 4)
+    Server.set_default_config(pid)
+    {:ok, ns_index} = OpcUA.Server.add_namespace(pid, "Room")
+
+    node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Large_Array")
+    parent_node_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+    reference_type_node_id = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47)
+    browse_name = QualifiedName.new(ns_index: ns_index, name: "Large Array")
+    type_definition = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+
+    :ok = Server.add_variable_node(pid,
+      requested_new_node_id: node_id,
+      parent_node_id: parent_node_id,
+      reference_type_node_id: reference_type_node_id,
+      browse_name: browse_name,
+      type_definition: type_definition
+    )
+
+    # 20000 doubles are well above the 64 KiB limit of the default framing.
+    :ok = Server.write_node_value_rank(pid, node_id, 1)
+    :ok = Server.write_node_array_dimensions(pid, node_id, [20000])
+    :ok = Server.write_node_blank_array(pid, node_id, 10, [20000])
+
+    {:ok, values} = Server.read_node_value(pid, node_id)
+    assert length(values) == 20000
+    assert Enum.all?(values, &(&1 == 0.0))
+  end
+
+  test "read large array value node through the shared memory ring" do
+    {:ok, pid} = OpcUA.Server.start_link()
+    Server.set_default_config(pid)
+
+    if OpcUA.ShmRing.loaded?() do
+      {:ok, ns_index} = OpcUA.Server.add_namespace(pid, "Room")
+
+      node_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "Large_Array")
+
+      :ok = Server.add_variable_node(pid,
+        requested_new_node_id: node_id,
+        parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+        reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+        browse_name: QualifiedName.new(ns_index: ns_index, name: "Large Array"),
+        type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+      )
+
+      assert {:error, :einval} == Server.enable_shm_ring(pid, 1024)
+      assert :ok == Server.enable_shm_ring(pid, 1024 * 1024, threshold: 1024)
+      assert {:error, "BadInvalidState"} == Server.enable_shm_ring(pid, 1024 * 1024)
+
+      # 2-byte framing, the 20000 doubles only fit through the ring; the ring wraps a few times.
+      :ok = Server.write_node_value_rank(pid, node_id, 1)
+      :ok = Server.write_node_array_dimensions(pid, node_id, [20000])
+      :ok = Server.write_node_blank_array(pid, node_id, 10, [20000])
+
+      for _ <- 1..10 do
+        {:ok, values} = Server.read_node_value(pid, node_id)
+        assert length(values) == 20000
+      end
+
+      assert :ok == Server.enable_shm_ring(pid, 0)
+      assert {:ok, 1} == Server.read_node_value_rank(pid, node_id)
+    else
+      assert {:error, :nif_not_loaded} == Server.enable_shm_ring(pid, 1024 * 1024)
+    end
+  end
+
+  test "read packed numeric array value node", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    :ok = Server.write_node_value_rank(state.pid, node_id, 2)
+    :ok = Server.write_node_array_dimensions(state.pid, node_id, [2, 3])
+    :ok = Server.write_node_blank_array(state.pid, node_id, 9, [2, 3])
+    :ok = Server.write_node_value(state.pid, node_id, 9, 1.5, 4)
+
+    {:ok, %OpcUA.PackedArray{data_type: 9, dimensions: {2, 3}} = packed_array} =
+      Server.read_node_value_packed(state.pid, node_id)
+
+    assert byte_size(packed_array.data) == 6 * 4
+    assert OpcUA.PackedArray.size(packed_array) == 6
+    assert OpcUA.PackedArray.at(packed_array, 4) == 1.5
+    assert OpcUA.PackedArray.at(packed_array, 6) == nil
+    assert OpcUA.PackedArray.to_list(packed_array) == [0.0, 0.0, 0.0, 0.0, 1.5, 0.0]
+
+    # Non numeric values are not packed.
+    :ok = Server.write_node_blank_array(state.pid, node_id, 11, [2, 3])
+    assert {:ok, ["", "", "", "", "", ""]} == Server.read_node_value_packed(state.pid, node_id)
+  end
+
+  test "write whole array value node", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    :ok = Server.write_node_value_rank(state.pid, node_id, 2)
+    :ok = Server.write_node_array_dimensions(state.pid, node_id, [2, 3])
+
+    assert :ok == Server.write_node_array(state.pid, node_id, 10, [1.0, 2.0, 3.0, 4.0, 5.0, 6.0], [2, 3])
+    assert {:ok, [1.0, 2.0, 3.0, 4.0, 5.0, 6.0]} == Server.read_node_value(state.pid, node_id)
+
+    # Packed binaries round trip.
+    {:ok, packed_array} = Server.read_node_value_packed(state.pid, node_id)
+    :ok = Server.write_node_value(state.pid, node_id, 10, 0.0, 0)
+    assert :ok == Server.write_node_array(state.pid, node_id, packed_array)
+    assert {:ok, 1.0} == Server.read_node_value_by_index(state.pid, node_id, 0)
+
+    data = for v <- 6..1, into: <<>>, do: <<v::signed-native-32>>
+    assert :ok == Server.write_node_array(state.pid, node_id, 5, data, [2, 3])
+    assert {:ok, [6, 5, 4, 3, 2, 1]} == Server.read_node_value(state.pid, node_id)
+
+    # Small integers lists are encoded as strings by the BEAM.
+    assert :ok == Server.write_node_array(state.pid, node_id, 2, [1, 2, 3, 4, 5, 6], [2, 3])
+    assert {:ok, [1, 2, 3, 4, 5, 6]} == Server.read_node_value(state.pid, node_id)
+
+    assert {:error, "BadTypeMismatch"} == Server.write_node_array(state.pid, node_id, 2, [1, 2, 3], [2, 3])
+    assert {:error, "BadTypeMismatch"} == Server.write_node_array(state.pid, node_id, 11, "packed", [])
+  end
 end
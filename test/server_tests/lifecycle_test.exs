@@ -58,6 +58,24 @@ defmodule ServerLifecycleTest do
     assert response == :ok
   end
 
+  @tag feature: :multithreading
+  test "Set worker threads", state do
+    assert :ok == Server.set_default_config(state.pid)
+
+    assert :ok == Server.set_worker_threads(state.pid, 4)
+    assert {:ok, %{"n_threads" => 4}} = Server.get_config(state.pid)
+
+    assert :ok == Server.start(state.pid)
+    assert {:error, "BadInvalidState"} == Server.set_worker_threads(state.pid, 2)
+    assert :ok == Server.stop_server(state.pid)
+  end
+
+  @tag without: :multithreading
+  test "Worker threads need the multithreading profile", state do
+    assert :ok == Server.set_default_config(state.pid)
+    assert {:error, "BadNotSupported"} == Server.set_worker_threads(state.pid, 4)
+  end
+
   test "Set users", state do
     response = Server.set_default_config(state.pid)
     assert response == :ok
@@ -79,4 +97,62 @@ defmodule ServerLifecycleTest do
     response = Server.stop_server(state.pid)
     assert response == :ok
   end
+
+  test "Use and restart a running server", state do
+    :ok = Server.set_default_config(state.pid)
+    :ok = Server.set_port(state.pid, 4023)
+    :ok = Server.start(state.pid)
+
+    # Requests are executed by the server thread while it is running.
+    for n <- 1..100 do
+      assert {:ok, _ns_index} = Server.add_namespace(state.pid, "Room#{n}")
+    end
+
+    assert {:ok, %{"hostname" => "localhost"}} = Server.get_config(state.pid)
+
+    assert :ok == Server.stop_server(state.pid)
+
+    # And by the port thread again once it has stopped.
+    assert {:ok, %{"hostname" => "localhost"}} = Server.get_config(state.pid)
+
+    assert :ok == Server.start(state.pid)
+    assert :ok == Server.stop_server(state.pid)
+  end
+
+  test "Commands are sent as opcodes after the handshake", state do
+    # The handshake reply is the first message sent by the port.
+    assert :ok == Server.set_default_config(state.pid)
+
+    %{opcodes: opcodes} = :sys.get_state(state.pid)
+    assert is_integer(opcodes[:set_default_server_config])
+    assert is_integer(opcodes[:get_server_config])
+
+    assert {:ok, %{"hostname" => "localhost"}} = Server.get_config(state.pid)
+  end
+
+  test "Port statistics", state do
+    assert :ok == Server.set_default_config(state.pid)
+    assert {:ok, _config} = Server.get_config(state.pid)
+
+    assert {:ok, %{handlers: handlers, port: port, gauges: gauges}} = Server.get_stats(state.pid)
+
+    assert %{calls: 1, total_time: total_time, max_time: max_time, histogram: histogram} =
+             handlers[:set_default_server_config]
+
+    assert max_time <= total_time
+    assert length(histogram) == 24
+    assert Enum.sum(histogram) == 1
+    refute Map.has_key?(handlers, :start_server)
+
+    assert port.messages_read >= 3
+    assert port.messages_written >= 3
+    assert port.max_read_size > 0
+    assert %{command_queue: 0, server_running: 0, write_batch: 0} = gauges
+
+    assert :ok == Server.set_stats_interval(state.pid, 10)
+    assert :ok == Server.start(state.pid)
+    assert {:ok, %{gauges: %{server_running: 1}}} = Server.get_stats(state.pid)
+    assert :ok == Server.set_stats_interval(state.pid, 0)
+    assert :ok == Server.stop_server(state.pid)
+  end
 end
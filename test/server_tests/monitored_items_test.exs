@@ -54,4 +54,59 @@ defmodule ServerMonitoredItemsTest do
     assert {:error, "BadMonitoredItemIdInvalid"} == Server.delete_monitored_item(state.pid, 10)
     assert :ok == Server.delete_monitored_item(state.pid, 1)
   end
+
+  test "Receive changes of local monitored items", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    :ok = Server.set_port(state.pid, 4025)
+    :ok = Server.write_node_access_level(state.pid, node_id, 3)
+    assert {:ok, 1} == Server.add_monitored_item(state.pid, monitored_item: node_id, sampling_time: 50.0)
+    :ok = Server.start(state.pid)
+
+    assert :ok == Server.write_node_value(state.pid, node_id, 10, 21.5)
+    assert_receive({:data, 1, 21.5}, 2000)
+
+    :ok = Server.stop_server(state.pid)
+  end
+
+  test "Coalesce and batch changes of local monitored items", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    :ok = Server.set_port(state.pid, 4026)
+    :ok = Server.write_node_access_level(state.pid, node_id, 3)
+    :ok = Server.set_notification_batch_size(state.pid, 10)
+    assert {:ok, 1} == Server.add_monitored_item(state.pid, monitored_item: node_id, sampling_time: 200.0, coalesce: true)
+    :ok = Server.start(state.pid)
+
+    for value <- [1.0, 2.0, 3.0] do
+      assert :ok == Server.write_node_value(state.pid, node_id, 10, value)
+    end
+
+    assert_receive({:data_batch, [{1, 3.0}]}, 2000)
+    refute_received({:data, 1, _value})
+
+    :ok = Server.stop_server(state.pid)
+  end
+
+  test "Publish shadow values", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+    :ok = Server.set_port(state.pid, 4027)
+
+    assert {:error, :einval} == Server.set_shadow_variable(state.pid, node_id, 3, 10)
+    assert :ok == Server.set_shadow_table(state.pid, 16)
+    assert :ok == Server.set_shadow_variable(state.pid, node_id, 3, 10)
+    assert {:ok, 1} == Server.add_monitored_item(state.pid, monitored_item: node_id, sampling_time: 50.0)
+    :ok = Server.start(state.pid)
+
+    assert {:error, "BadInvalidState"} == Server.set_shadow_table(state.pid, 32)
+    assert {:error, :einval} == Server.update_shadow_values(state.pid, [{3, "hot"}])
+
+    assert :ok == Server.update_shadow_values(state.pid, [{3, 21.5}, {4, 1}])
+    assert_receive({:data, 1, 21.5}, 2000)
+    assert {:ok, 21.5} == Server.read_node_value(state.pid, node_id)
+
+    # Handles out of the table are skipped, the others are still updated.
+    assert {:error, :einval} == Server.update_shadow_values(state.pid, [{3, 22}, {16, 1.0}])
+    assert_receive({:data, 1, 22.0}, 2000)
+
+    :ok = Server.stop_server(state.pid)
+  end
 end
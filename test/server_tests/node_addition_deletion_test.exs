@@ -59,4 +59,176 @@ defmodule ServerNodeAdditionDeletionTest do
 
     assert resp == :ok
   end
+
+  test "Add and delete a reference to a registered node", state do
+    {:ok, ns_index} = OpcUA.Server.add_namespace(state.pid, "Room")
+    objects_folder = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85)
+    organizes = NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35)
+    source_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_Room")
+    target_id = NodeId.new(ns_index: ns_index, identifier_type: "string", identifier: "R1_TS1_Sensor")
+
+    for {node_id, name} <- [{source_id, "Room"}, {target_id, "Temperature sensor"}] do
+      :ok =
+        Server.add_object_node(state.pid,
+          requested_new_node_id: node_id,
+          parent_node_id: objects_folder,
+          reference_type_node_id: organizes,
+          browse_name: QualifiedName.new(ns_index: ns_index, name: name),
+          type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+        )
+    end
+
+    assert {:ok, [registered_target]} = Server.register_nodes(state.pid, [target_id])
+
+    assert :ok ==
+             Server.add_reference(state.pid,
+               source_id: source_id,
+               reference_type_id: organizes,
+               target_id: registered_target,
+               is_forward: true
+             )
+
+    assert {:ok, nodes} = Server.browse_tree(state.pid, source_id, max_depth: 1)
+    assert Enum.any?(nodes, &(&1.node_id == target_id))
+
+    assert :ok ==
+             Server.delete_reference(state.pid,
+               source_id: source_id,
+               reference_type_id: organizes,
+               target_id: registered_target,
+               is_forward: true,
+               delete_bidirectional: true
+             )
+
+    assert {:ok, []} == Server.browse_tree(state.pid, source_id, max_depth: 1)
+
+    # A released handle is rejected, it doesn't become the null node id (a random new id).
+    assert {:ok, [_target_id]} = Server.unregister_nodes(state.pid, [registered_target])
+
+    assert {:error, :einval} ==
+             Server.add_object_node(state.pid,
+               requested_new_node_id: registered_target,
+               parent_node_id: objects_folder,
+               reference_type_node_id: organizes,
+               browse_name: QualifiedName.new(ns_index: ns_index, name: "Stale"),
+               type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+             )
+  end
+
+  test "Load an address space in bulk", state do
+    object_node_id = NodeId.new(ns_index: 2, identifier_type: "string", identifier: "R1_TS1_Sensor")
+
+    object =
+      OpcUA.ObjectNode.new(
+        [
+          requested_new_node_id: object_node_id,
+          parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+          reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+          browse_name: QualifiedName.new(ns_index: 2, name: "Temperature sensor"),
+          type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+        ],
+        display_name: {"en-US", "Temperature sensor"}
+      )
+
+    # Enough nodes to be sent in several port messages.
+    variables =
+      for i <- 1..2000 do
+        {:variable_node,
+         OpcUA.VariableNode.new(
+           [
+             requested_new_node_id: NodeId.new(ns_index: 2, identifier_type: "integer", identifier: i),
+             parent_node_id: object_node_id,
+             reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+             browse_name: QualifiedName.new(ns_index: 2, name: "Temperature #{i}"),
+             type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+           ],
+           access_level: 3,
+           value: {10, i * 1.0}
+         )}
+      end
+
+    address_space = [namespace: "Room", object_node: object] ++ variables ++ [object_node: object]
+
+    assert {:ok, %{namespaces: %{"Room" => 2}, failures: [{2002, "BadNodeIdExists"}]}} ==
+             Server.load_address_space(state.pid, address_space)
+
+    assert {:ok, {"en-US", "Temperature sensor"}} == Server.read_node_display_name(state.pid, object_node_id)
+
+    node_id = NodeId.new(ns_index: 2, identifier_type: "integer", identifier: 2000)
+    assert {:ok, 2000.0} == Server.read_node_value(state.pid, node_id)
+    assert {:ok, 3} == Server.read_node_access_level(state.pid, node_id)
+  end
+
+  test "Save and restore a nodeset snapshot", state do
+    object_node_id = NodeId.new(ns_index: 2, identifier_type: "string", identifier: "R1_TS1_Sensor")
+
+    object =
+      OpcUA.ObjectNode.new(
+        [
+          requested_new_node_id: object_node_id,
+          parent_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 85),
+          reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 35),
+          browse_name: QualifiedName.new(ns_index: 2, name: "Temperature sensor"),
+          type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 58)
+        ],
+        display_name: {"en-US", "Temperature sensor"}
+      )
+
+    variables =
+      for {identifier, value} <- [{1, {10, 21.5}}, {2, {11, "Celsius"}}] do
+        {:variable_node,
+         OpcUA.VariableNode.new(
+           [
+             requested_new_node_id: NodeId.new(ns_index: 2, identifier_type: "integer", identifier: identifier),
+             parent_node_id: object_node_id,
+             reference_type_node_id: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 47),
+             browse_name: QualifiedName.new(ns_index: 2, name: "Temperature #{identifier}"),
+             type_definition: NodeId.new(ns_index: 0, identifier_type: "integer", identifier: 63)
+           ],
+           access_level: 3,
+           value: value
+         )}
+      end
+
+    assert {:ok, %{failures: []}} =
+             Server.load_address_space(state.pid, [namespace: "Room", object_node: object] ++ variables)
+
+    path = Path.join(System.tmp_dir!(), "opex62541_nodeset_#{System.unique_integer([:positive])}.etf")
+    on_exit(fn -> File.rm(path) end)
+
+    assert {:ok, entries} = Server.save_nodeset(state.pid, path)
+    assert entries >= 4
+
+    {:ok, pid} = OpcUA.Server.start_link()
+    Server.set_default_config(pid)
+
+    assert {:ok, %{namespaces: %{"Room" => 2}, failures: []}} == Server.load_nodeset(pid, path)
+
+    assert {:ok, {"en-US", "Temperature sensor"}} == Server.read_node_display_name(pid, object_node_id)
+
+    node_id = NodeId.new(ns_index: 2, identifier_type: "integer", identifier: 1)
+    assert {:ok, 21.5} == Server.read_node_value(pid, node_id)
+    assert {:ok, 3} == Server.read_node_access_level(pid, node_id)
+
+    node_id = NodeId.new(ns_index: 2, identifier_type: "integer", identifier: 2)
+    assert {:ok, "Celsius"} == Server.read_node_value(pid, node_id)
+
+    assert {:error, :enoent} == Server.load_nodeset(pid, path <> ".missing")
+
+    # Damaged snapshots are rejected before anything is decoded.
+    snapshot = File.read!(path)
+    damaged_path = path <> ".damaged"
+    on_exit(fn -> File.rm(damaged_path) end)
+
+    File.write!(damaged_path, binary_part(snapshot, 0, byte_size(snapshot) - 1))
+    assert {:error, :einval} == Server.load_nodeset(pid, damaged_path)
+
+    <<file_header::binary-size(40), payload::binary>> = snapshot
+    <<first, rest::binary>> = payload
+    File.write!(damaged_path, <<file_header::binary, Bitwise.bxor(first, 0xFF), rest::binary>>)
+    assert {:error, :einval} == Server.load_nodeset(pid, damaged_path)
+
+    File.write!(damaged_path, "garbage")
+    assert {:error, :einval} == Server.load_nodeset(pid, damaged_path)
+  end
 end
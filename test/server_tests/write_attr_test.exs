@@ -183,4 +183,24 @@ defmodule ServerWriteAttrTest do
     resp = Server.write_node_value(state.pid, node_id, 30, 21321)
     assert resp == :ok
   end
+
+  test "read several attributes in one request", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    resp = Server.write_node_value(state.pid, node_id, 11, "alde103")
+    assert resp == :ok
+
+    resp = Server.read_node_values(state.pid, [{node_id, :value}, {node_id, :browse_name}])
+    assert resp == {:ok, [{:ok, "alde103"}, {:ok, QualifiedName.new(ns_index: state.ns_index, name: "Temperature")}]}
+  end
+
+  test "write several values in one request", state do
+    node_id = NodeId.new(ns_index: state.ns_index, identifier_type: "string", identifier: "R1_TS1_Temperature")
+
+    resp = Server.write_node_values(state.pid, [{node_id, 9, 103.0}, {node_id, 11, "alde103"}])
+    assert resp == {:ok, [:ok, :ok]}
+
+    resp = Server.read_node_value(state.pid, node_id)
+    assert resp == {:ok, "alde103"}
+  end
 end
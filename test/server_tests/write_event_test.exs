@@ -51,6 +51,23 @@ defmodule ServerWriteEventTest do
       :ok = Server.write_node_write_mask(s_pid, requested_new_node_id, 0x3FFFFF)
       :ok = Server.write_node_access_level(s_pid, requested_new_node_id, 3)
 
+      # Second Variable Node
+      requested_new_node_id =
+        NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 10003)
+
+      browse_name = QualifiedName.new(ns_index: 1, name: "Var2")
+
+      :ok = Server.add_variable_node(s_pid,
+        requested_new_node_id: requested_new_node_id,
+        parent_node_id: parent_node_id,
+        reference_type_node_id: reference_type_node_id,
+        browse_name: browse_name,
+        type_definition: type_definition
+      )
+
+      :ok = Server.write_node_write_mask(s_pid, requested_new_node_id, 0x3FFFFF)
+      :ok = Server.write_node_access_level(s_pid, requested_new_node_id, 3)
+
       :ok = Server.start(s_pid)
 
       %{s_pid: s_pid, parent_pid: parent_pid}
@@ -67,6 +84,12 @@ defmodule ServerWriteEventTest do
       state
     end
 
+    @impl true
+    def handle_write_batch(write_events, %{parent_pid: parent_pid} = state) do
+      send(parent_pid, {:write_batch, write_events})
+      state
+    end
+
     def handle_call(:get_server_pid, _from , state), do: {:reply, state.s_pid, state}
   end
 
@@ -113,4 +136,94 @@ defmodule ServerWriteEventTest do
     # Server values write must not activate a write event.
     refute_receive({_node_id, 90.0}, 1000)
   end
+
+  test "Batched write events and write forwarding opt-out", %{c_pid: c_pid, my_pid: my_pid} do
+    node_id =  NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 10001)
+
+    s_pid = MyServer.get_server_pid(my_pid)
+    assert :ok == Server.set_write_batch(s_pid, interval: 100)
+
+    assert :ok == Client.write_node_value(c_pid, node_id, 9, 1.0)
+    assert :ok == Server.write_node_value(s_pid, node_id, 9, 2.0)
+    assert :ok == Client.write_node_value(c_pid, node_id, 9, 3.0)
+    assert_receive({:write_batch, [{^node_id, 1.0}, {^node_id, 3.0}]}, 1000)
+
+    assert :ok == Server.set_write_forwarding(s_pid, node_id, false)
+    assert :ok == Client.write_node_value(c_pid, node_id, 9, 4.0)
+    assert {:ok, 4.0} == Client.read_node_value(c_pid, node_id)
+    refute_receive({:write_batch, _write_events}, 500)
+
+    assert :ok == Server.set_write_forwarding(s_pid, node_id, true)
+    assert :ok == Server.set_write_batch(s_pid, enabled: false)
+    assert :ok == Client.write_node_value(c_pid, node_id, 9, 5.0)
+    assert_receive({^node_id, 5.0}, 1000)
+  end
+
+  test "Write events through the notification queue", %{c_pid: c_pid, my_pid: my_pid} do
+    node_id_1 =  NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 10001)
+    node_id_2 =  NodeId.new(ns_index: 1, identifier_type: "integer", identifier: 10003)
+
+    s_pid = MyServer.get_server_pid(my_pid)
+
+    # Every byte the pipe doesn't take right away is above the mark.
+    case Server.set_notification_queue(s_pid, 1) do
+      :ok ->
+        # A single Write request: the server emits all its write events in one go, 16 KB each, far
+        # faster than the port owner reads the pipe.
+        padding = String.duplicate("x", 16 * 1024)
+
+        values =
+          for value <- 1..200 do
+            node_id = if rem(value, 2) == 0, do: node_id_1, else: node_id_2
+            {node_id, 11, "#{value}:" <> padding}
+          end
+
+        assert {:ok, results} = Client.write_node_values(c_pid, values)
+        assert Enum.all?(results, &(&1 == :ok))
+
+        latest_1 = "200:" <> padding
+        latest_2 = "199:" <> padding
+        received =
+          %{node_id_1 => [], node_id_2 => []}
+          |> receive_write_events({node_id_1, latest_1}, {node_id_2, latest_2})
+
+        # Intermediate values are compacted, the latest one of each node arrives last.
+        assert length(received[node_id_1]) + length(received[node_id_2]) < 200
+        assert List.last(received[node_id_1]) == latest_1
+        assert List.last(received[node_id_2]) == latest_2
+        refute_receive({^node_id_1, _value}, 500)
+        refute_receive({^node_id_2, _value}, 500)
+
+        assert {:ok, %{port: %{notifications_dropped: dropped, output_pending: 0}, gauges: gauges}} =
+                 Server.get_stats(s_pid)
+
+        assert dropped > 0
+        assert %{notification_queue: 0} = gauges
+
+        assert :ok == Server.set_notification_queue(s_pid, 0)
+        assert :ok == Client.write_node_value(c_pid, node_id_1, 9, 21.0)
+        assert_receive({^node_id_1, 21.0}, 1000)
+
+      {:error, "BadNotSupported"} ->
+        # Windows
+        :ok
+    end
+  end
+
+  # Collects the write events of both nodes, in arrival order, until the latest value of each one arrived.
+  defp receive_write_events(received, {node_id_1, latest_1} = last_1, {node_id_2, latest_2} = last_2) do
+    if List.last(received[node_id_1]) == latest_1 and List.last(received[node_id_2]) == latest_2 do
+      received
+    else
+      receive do
+        {^node_id_1, value} ->
+          receive_write_events(Map.update!(received, node_id_1, &(&1 ++ [value])), last_1, last_2)
+
+        {^node_id_2, value} ->
+          receive_write_events(Map.update!(received, node_id_2, &(&1 ++ [value])), last_1, last_2)
+      after
+        5000 -> flunk("Missing the latest write events")
+      end
+    end
+  end
 end
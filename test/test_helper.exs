@@ -1 +1,12 @@
-ExUnit.start()
+# Tests tagged `feature: f` only run with ports built with the open62541 feature `f` (see
+# `OpcUA.Server.get_build_features/1`), the ones tagged `without: f` only with ports built without it.
+{:ok, pid} = OpcUA.Server.start_link()
+{:ok, features} = OpcUA.Server.get_build_features(pid)
+GenServer.stop(pid)
+
+excluded =
+  for feature <- [:multithreading, :historizing] do
+    if feature in features, do: {:without, feature}, else: {:feature, feature}
+  end
+
+ExUnit.start(exclude: excluded)